@@ -266,6 +266,7 @@ static void aun_udp_recv(void *arg, struct udp_pcb *pcb, struct pbuf *p,
    if (p->tot_len <= sizeof frame) {
       u16_t n = pbuf_copy_partial(p, frame, p->tot_len, 0);
       aun_udp_input(&aun, ip_addr_get_ip4_u32(addr), port, frame, n);
+      Pi1MHz_Poll_Wake(POLL_EVENT_AUN);
    }
    pbuf_free(p);
 }
@@ -298,7 +299,7 @@ void aun_emulator_init(uint8_t instance, uint8_t address)
    IRQ_NUM = instance;
    /* The AUN engine itself comes up on the Beeb's INIT command (the
     * network stack may not be ready yet at RST); the poll hook is
-    * registered once here - Pi1MHz_Register_Poll dedupes. */
+    * registered once here - Pi1MHz_Register_Poll_Event dedupes. */
    aun_pending     = false;
    aun_irq_enabled = false;
    aun_irq_state   = 0;
@@ -306,7 +307,11 @@ void aun_emulator_init(uint8_t instance, uint8_t address)
       services emulator initialises earlier in the table, so the port is
       up; disabling AUN leaves 30-44 unclaimed and ignored. */
    (void)services_register(AUN_CMD_FIRST, AUN_CMD_LAST, aun_emulator_command);
-   Pi1MHz_Register_Poll(aun_emulator_poll);
+   /* Woken by a latched command or an inbound frame.  The engine's own
+      timers (the 10 ms reject retransmit, 8 ms deferrals, 1 s timeouts) are
+      in milliseconds and raise nothing, so it also runs once a millisecond
+      regardless - against ~290,000 passes a second before. */
+   Pi1MHz_Register_Poll_Event(aun_emulator_poll, POLL_NORMAL, 1000u, POLL_EVENT_AUN);
 }
 
 /* Plain-text status block for the web UI (webserver.c /aun). */
@@ -374,6 +379,7 @@ void aun_emulator_command(uint32_t cp, uint32_t addr, uint8_t data)
    aun_pending_cp   = cp;
    aun_pending_addr = addr;
    aun_pending      = true;
+   Pi1MHz_Poll_Wake_FIQ(POLL_EVENT_AUN);
 }
 
 static void aun_execute(uint32_t cp, uint32_t addr)
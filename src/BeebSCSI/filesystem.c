@@ -63,7 +63,12 @@
 #include "debug.h"
 #include "scsi.h"
 #include "fatfs/ff.h"
+#include "fatfs/diskio.h"
 #include "filesystem.h"
+#include "packedlun.h"
+#include "sectorcache.h"
+#include "sparselun.h"
+#include "writecache.h"
 #include "../config.h"			/* Beeb_write_protect */
 #include "../rpi/rpi.h"
 #include "../rpi/fileparser.h"
@@ -122,12 +127,16 @@ static struct filesystemStateStruct
    FATFS fsObject;                     // FAT FS file system object
    FIL fileObject[MAX_LUNS];           // FAT FS file objects
    DWORD clmt[MAX_LUNS][SZ_TBL];
+   FIL overlayObject[MAX_LUNS];        // scsiN.cow of an overlay LUN, which takes its writes
+   DWORD overlayClmt[MAX_LUNS][SZ_TBL];
 
    bool fsMountState;                  // File system mount state (true = mounted, false = dismounted)
 
    uint8_t lunDirectory;               // Current LUN directory ID
    uint8_t lunDirectoryVFS;            // Current LUN directory ID for VFS
    bool fsLunStatus[MAX_LUNS];         // LUN image availability flags for the currently selected LUN directory (true = started, false = stopped)
+   bool fsLunPrepared[MAX_LUNS];       // LUN image opened ahead of the Beeb by filesystemPrefetchNextLun(), but stopped
+   bool fsLunOverlay[MAX_LUNS];        // LUN has a scsiN.cow open in overlayObject
 	struct HDGeometry fsLunGeometry[MAX_LUNS];   // Keep the geometry details for each LUN
    parserkeyvalue keyvalues[MAX_LUNS][NUM_KEYS];   // keys from .cfg file for each LUN
 } filesystemState;
@@ -141,10 +150,44 @@ NOINIT_SECTION static uint8_t sectorBuffer[SECTOR_BUFFER_SIZE];   // Buffer for
 static uint8_t sectorsInBuffer = 0;
 static uint8_t currentBufferSector = 0;
 static uint32_t sectorsRemaining = 0;
+static uint32_t readSector = 0;          // first sector of the next read from the image
+static uint32_t writeSector = 0;         // first sector of the next write to the image, for the sector cache
 
 NOINIT_SECTION static FIL fileObjectFAT;
 
+// A flat FORMAT grows the new image this much a poll pass
+#define FORMAT_CHUNK_BYTES (1024 * 1024)
+
+// The flat FORMAT in progress: the new image, and the size it is growing to
+static struct
+{
+   bool running;
+   uint8_t lunNumber;
+   FSIZE_t size;
+} formatJob;
+NOINIT_SECTION static FIL fileObjectFormat;
+
+// The next LUN filesystemPrefetchNextLun() looks at; MAX_LUNS when done
+static uint8_t prefetchLun = MAX_LUNS;
+
+// scsiN.map: a LUN image's cluster link map, kept for the next time the LUN
+// is started (see filesystemLinkLunImage())
+struct lunMapHeader
+{
+   char magic[8];                      // "BSCSIMAP"
+   uint32_t sectorsPerCluster;         // of the volume the map was made on
+   uint32_t firstCluster;              // of the image
+   uint32_t imageBytes;
+   uint32_t entries;                   // of the link map that follows (its [0])
+};
+
 static bool filesystemCheckLunDirectory(uint8_t lunDirectory, uint8_t lunNumber);
+static void filesystemRestartPrefetch(void);
+static void filesystemLinkLunImage(uint8_t lunNumber);
+static bool filesystemImageRead(uint8_t lunNumber, uint32_t offset, uint8_t *buffer, uint32_t length);
+static bool filesystemImageWrite(uint8_t lunNumber, uint32_t offset, const uint8_t *data, uint32_t length);
+static bool filesystemBaseRead(uint8_t lunNumber, uint32_t firstSector, uint8_t *buffer, uint32_t sectors);
+static bool filesystemPackedRead(uint8_t lunNumber, uint32_t offset, uint8_t *buffer, uint32_t length);
 
 static void filesystemPrintfserror(FRESULT fsResult)
 {
@@ -289,6 +332,7 @@ void filesystemReset(void)
 
    if (debugFlag_filesystem) debugString_P(PSTR("File system: filesystemMount(): Successful\r\n"));
    filesystemState.fsMountState = true;
+   filesystemRestartPrefetch();
 
    // Note: ADFS does not send a SCSI STARTSTOP command on reboot... it assumes that LUN 0 is already started.
    // This is theoretically incorrect... the host should not assume anything about the state of a SCSI LUN.
@@ -311,7 +355,11 @@ bool filesystemDismount(void)
       return false;
    }
 
-   // Set all LUNs to stopped
+   // A FORMAT cannot carry on without the card
+   filesystemFormatLunAbandon();
+
+   // Set all LUNs to stopped (and close the ones opened ahead of the Beeb)
+   prefetchLun = MAX_LUNS;
    for( uint8_t i=0 ; i < MAX_LUNS; i++ )
    {
       filesystemSetLunStatus(i, false);
@@ -386,39 +434,63 @@ static void fsHostLunNames(uint8_t lunNumber, char *dir, size_t dirSize,
    }
 }
 
-// True if `path` is a file of a started (or host-locked) LUN, or a directory
-// containing one. Deliberately conservative: it matches the whole "scsi<n>."
-// stem, so the descriptor and config alongside the image are covered too -
-// they are read when the LUN starts, so replacing them under a running LUN is
-// the same class of problem.
-bool filesystemHostPathBusy(const char *path)
+// Does `path` name one of lunNumber's files, or a directory at or above the
+// one holding them? Deliberately conservative: it matches the whole
+// "scsi<n>." stem, so the descriptor and config alongside the image are
+// covered too - they are read when the LUN starts, so replacing them under a
+// running LUN is the same class of problem.
+static bool fsHostPathNamesLun(const char *path, uint8_t lunNumber)
 {
-   if (path == NULL || path[0] == '\0') return false;
-
+   char dir[24];
+   char stem[40];
    size_t pathLen = strlen(path);
    while (pathLen > 1u && path[pathLen - 1u] == '/') pathLen--;   // ignore a trailing /
 
-   for (uint8_t lunNumber = 0; lunNumber < MAX_LUNS; lunNumber++) {
-      if (!filesystemState.fsLunStatus[lunNumber] && !filesystemLunHostLocked(lunNumber))
-         continue;
+   fsHostLunNames(lunNumber, dir, sizeof(dir), stem, sizeof(stem));
+   size_t stemLen = strlen(stem);
+   size_t dirLen = strlen(dir);
+   return (pathLen >= stemLen && fsHostNameEqual(path, stem, stemLen)) ||
+          (pathLen <= dirLen && fsHostNameEqual(path, dir, pathLen) &&
+           (dir[pathLen] == '\0' || dir[pathLen] == '/'));
+}
 
-      char dir[24];
-      char stem[40];
-      fsHostLunNames(lunNumber, dir, sizeof(dir), stem, sizeof(stem));
+// Started, host-locked or formatting: the Beeb (or a host write) has it.
+static bool fsHostLunInUse(uint8_t lunNumber)
+{
+   return filesystemState.fsLunStatus[lunNumber] || filesystemLunHostLocked(lunNumber)
+          || (formatJob.running && formatJob.lunNumber == lunNumber);
+}
 
-      // path names one of this LUN's own files
-      size_t stemLen = strlen(stem);
-      if (pathLen >= stemLen && fsHostNameEqual(path, stem, stemLen)) return true;
+// True if `path` is a file of a started (or host-locked, or formatting) LUN,
+// or a directory containing one. Only looks: a LUN filesystemPrefetchNextLun()
+// opened that the Beeb has not started yet is not busy, but is still open -
+// a host write calls filesystemReleasePreparedLun() first.
+bool filesystemHostPathBusy(const char *path)
+{
+   if (path == NULL || path[0] == '\0') return false;
 
-      // path is a directory at or above the one holding them
-      size_t dirLen = strlen(dir);
-      if (pathLen <= dirLen && fsHostNameEqual(path, dir, pathLen) &&
-          (dir[pathLen] == '\0' || dir[pathLen] == '/')) return true;
+   for (uint8_t lunNumber = 0; lunNumber < MAX_LUNS; lunNumber++) {
+      if (fsHostLunInUse(lunNumber) && fsHostPathNamesLun(path, lunNumber))
+         return true;
    }
 
    return false;
 }
 
+// A host transfer is about to write, rename or delete `path`: a LUN only
+// opened ahead of the Beeb whose files it names gives way. It is closed, and
+// opened again from whatever the host leaves when the Beeb wants it.
+void filesystemReleasePreparedLun(const char *path)
+{
+   if (path == NULL || path[0] == '\0') return;
+
+   for (uint8_t lunNumber = 0; lunNumber < MAX_LUNS; lunNumber++) {
+      if (filesystemState.fsLunPrepared[lunNumber] && !fsHostLunInUse(lunNumber)
+          && fsHostPathNamesLun(path, lunNumber))
+         filesystemSetLunStatus(lunNumber, false);
+   }
+}
+
 // Which LUN's image does `path` name, if any? Unlike filesystemHostPathBusy()
 // this ignores LUN status - the caller is about to write the file and wants to
 // lock it whether or not the LUN happens to be started.
@@ -457,6 +529,10 @@ void filesystemHostLockLun(int8_t lunNumber, bool lock)
 
    if (lock) hostLockMask |= (uint16_t)(1u << (uint8_t)lunNumber);
    else      hostLockMask &= (uint16_t)~(1u << (uint8_t)lunNumber);
+
+   // The image is about to change under a LUN opened ahead of the Beeb
+   if (lock && filesystemState.fsLunPrepared[lunNumber])
+      filesystemSetLunStatus((uint8_t)lunNumber, false);
 }
 
 bool filesystemLunHostLocked(uint8_t lunNumber)
@@ -488,6 +564,13 @@ bool filesystemHostLunRevoked(uint8_t lunNumber)
 // Function to set the status of a LUN image
 bool filesystemSetLunStatus(uint8_t lunNumber, bool lunStatus)
 {
+   // A LUN opened ahead of the Beeb is open as a started one is, and is
+   // stopped the same way
+   if (!lunStatus && filesystemState.fsLunPrepared[lunNumber]) {
+      filesystemState.fsLunPrepared[lunNumber] = false;
+      filesystemState.fsLunStatus[lunNumber] = true;
+   }
+
    // Is the requested status the same as the current status?
    if (filesystemState.fsLunStatus[lunNumber] == lunStatus) {
       if (debugFlag_filesystem) {
@@ -524,6 +607,9 @@ bool filesystemSetLunStatus(uint8_t lunNumber, bool lunStatus)
          return false;
       }
 
+      // The image may have changed on the card while the LUN was stopped
+      sectorCacheInvalidateLun(lunNumber);
+
       // Exit with success
       filesystemState.fsLunStatus[lunNumber] = true;
 
@@ -535,14 +621,60 @@ bool filesystemSetLunStatus(uint8_t lunNumber, bool lunStatus)
       return true;
    }
 
-   // Transitioning from started to stopped
+   // Transitioning from started to stopped: anything written back goes to the card first
+   if (!writeCacheSync(lunNumber) && debugFlag_filesystem)
+      debugString_P(PSTR("File system: filesystemSetLunStatus(): ERROR: Cannot write to LUN image!\r\n"));
    f_close(&filesystemState.fileObject[lunNumber]);
+   if (filesystemState.fsLunOverlay[lunNumber]) {
+      f_close(&filesystemState.overlayObject[lunNumber]);
+      filesystemState.fsLunOverlay[lunNumber] = false;
+   }
    parse_releasekeyvalues(filesystemState.keyvalues[lunNumber], NUM_KEYS);
    filesystemState.fsLunStatus[lunNumber] = false;
+   sectorCacheInvalidateLun(lunNumber);
+   if (sparseLunIsSparse(lunNumber)) {
+      if (debugFlag_filesystem) {
+         struct sparseLunStats stats;
+
+         sparseLunGetStats(lunNumber, &stats);
+         debugStringInt32_P(PSTR("File system: sparse LUN blocks "), stats.blocks, false);
+         debugStringInt32_P(PSTR(" allocated "), stats.allocated, true);
+      }
+      sparseLunClose(lunNumber);
+   }
+   if (packedLunIsPacked(lunNumber)) {
+      if (debugFlag_filesystem) {
+         struct packedLunStats stats;
+
+         packedLunGetStats(lunNumber, &stats);
+         debugStringInt32_P(PSTR("File system: packed LUN chunks "), stats.chunks, false);
+         debugStringInt32_P(PSTR(" read "), stats.reads, false);
+         debugStringInt32_P(PSTR(" hits "), stats.hits, true);
+      }
+      packedLunClose(lunNumber);
+   }
 
    if (debugFlag_filesystem) {
       debugStringInt16_P(PSTR("File system: filesystemSetLunStatus(): LUN number "), (uint16_t)lunNumber, false);
       debugString_P(PSTR(" is stopped\r\n"));
+      if (sectorCacheEnabled()) {
+         struct sectorCacheStats stats;
+
+         sectorCacheGetStats(lunNumber, &stats);
+         debugStringInt32_P(PSTR("File system: sector cache hits "), stats.hits, false);
+         debugStringInt32_P(PSTR(" misses "), stats.misses, false);
+         debugStringInt32_P(PSTR(" read ahead "), stats.readAhead, false);
+         debugStringInt32_P(PSTR(" used "), stats.readAheadUsed, true);
+      }
+      if (writeCacheEnabled(lunNumber)) {
+         struct writeCacheStats stats;
+
+         writeCacheGetStats(lunNumber, &stats);
+         debugStringInt32_P(PSTR("File system: write-back sectors "), stats.sectors, false);
+         debugStringInt32_P(PSTR(" dirty "), stats.dirty, false);
+         debugStringInt32_P(PSTR(" writes "), stats.flushes, false);
+         debugStringInt32_P(PSTR(" syncs "), stats.syncs, true);
+      }
    }
 
    // Exit with success
@@ -576,6 +708,55 @@ bool filesystemTestLunStatus(uint8_t lunNumber)
    return true;
 }
 
+// Opening LUNs ahead of the Beeb -------------------------------------------
+//
+// Starting a LUN opens its image, builds its link map and reads its .dsc and
+// .cfg, which ADFS would otherwise wait for on its first READ after a boot or
+// *MOUNT.  filesystemPrefetchNextLun() does that work while the bus is idle,
+// a LUN at a time, but leaves the LUN stopped: to the Beeb and the jukebox
+// nothing has changed, and filesystemCheckLunImage() only has to start it.
+// A host transfer wanting the image closes it again (filesystemReleasePreparedLun()).
+// scsi_prefetch=0 in Pi1MHz.cfg turns it off.
+
+static void filesystemRestartPrefetch(void)
+{
+   const char *v = config_get("scsi_prefetch");
+
+   prefetchLun = (v == NULL || config_get_bool("scsi_prefetch")) ? 0 : MAX_LUNS;
+}
+
+// Open the next LUN image there is ahead of the Beeb.  False once there are
+// none left to look at.
+bool filesystemPrefetchNextLun(void)
+{
+   FILINFO fileInfo;
+
+   if (!filesystemState.fsMountState) return false;
+
+   while (prefetchLun < MAX_LUNS) {
+      uint8_t lunNumber = prefetchLun++;
+
+      if (filesystemState.fsLunStatus[lunNumber] || filesystemState.fsLunPrepared[lunNumber]
+          || filesystemLunHostLocked(lunNumber) || (formatJob.running && formatJob.lunNumber == lunNumber))
+         continue;
+
+      if (lunNumber < 8)
+         snprintf(fileName, sizeof(fileName), "/BeebSCSI%d/scsi%d.dat", filesystemState.lunDirectory, lunNumber);
+      else
+         snprintf(fileName, sizeof(fileName), "/BeebVFS%d/scsi%d.dat", filesystemState.lunDirectoryVFS, lunNumber & 7);
+      if (f_stat(fileName, &fileInfo) != FR_OK) continue;
+
+      if (debugFlag_filesystem) debugStringInt16_P(PSTR("File system: filesystemPrefetchNextLun(): Opening LUN "), lunNumber, true);
+      if (filesystemCheckLunImage(lunNumber)) {
+         sectorCacheInvalidateLun(lunNumber);
+         filesystemState.fsLunStatus[lunNumber] = false;
+         filesystemState.fsLunPrepared[lunNumber] = true;
+      }
+      return true;
+   }
+   return false;
+}
+
 // Function to read the user code for the specified LUN image
 void filesystemReadLunUserCode(uint8_t lunNumber, uint8_t userCode[5])
 {
@@ -651,12 +832,248 @@ static bool filesystemCheckLunDirectory(uint8_t lunDirectory, uint8_t lunNumber)
    return true;
 }
 
+// The size of the disc a LUN image holds so far, in bytes: the size of the
+// file, or of the disc in the header of a sparse or packed image
+static uint32_t filesystemLunImageBytes(uint8_t lunNumber)
+{
+   if (sparseLunIsSparse(lunNumber))
+      return sparseLunSectors(lunNumber) * 256;
+   if (packedLunIsPacked(lunNumber))
+      return packedLunSectors(lunNumber) * 256;
+   return (uint32_t)f_size(&filesystemState.fileObject[lunNumber]);
+}
+
+// Assemble the name of a LUN's overlay, scsiN.cow alongside its scsiN.dat
+static void filesystemOverlayName(uint8_t lunNumber)
+{
+   if (lunNumber < 8)
+      snprintf(fileName, sizeof(fileName), "/BeebSCSI%d/scsi%d.cow", filesystemState.lunDirectory, lunNumber);
+   else
+      snprintf(fileName, sizeof(fileName), "/BeebVFS%d/scsi%d.cow", filesystemState.lunDirectoryVFS, lunNumber & 7);
+}
+
+// Open a LUN's overlay, if it has one, once its geometry is known.  An empty
+// scsiN.cow is given its header here - unless the Beeb is write-protected,
+// when it would never take a write anyway and the LUN is left as it is.
+static bool filesystemCheckLunOverlay(uint8_t lunNumber)
+{
+   FIL *fp = &filesystemState.overlayObject[lunNumber];
+   uint32_t sectors = filesystemGetLunTotalSectors(lunNumber);
+   uint32_t imageSectors = (filesystemLunImageBytes(lunNumber) + 255) / 256;
+   FRESULT fsResult;
+
+   filesystemOverlayName(lunNumber);
+   fsResult = f_open(fp, fileName, FA_READ | FA_WRITE);
+   if (fsResult == FR_NO_FILE)
+      return true;
+   if (fsResult != FR_OK) {
+      if (debugFlag_filesystem) {
+         debugString_P(PSTR("File system: filesystemCheckLunOverlay(): ERROR: f_open on overlay returned "));
+         filesystemPrintfserror(fsResult);
+      }
+      return false;
+   }
+   if (sparseLunIsSparse(lunNumber)) {
+      if (debugFlag_filesystem) debugString_P(PSTR("File system: filesystemCheckLunOverlay(): ERROR: A sparse LUN image cannot have an overlay\r\n"));
+      f_close(fp);
+      return false;
+   }
+   if (f_size(fp) == 0 && config_beeb_write_protected()) {
+      f_close(fp);
+      return true;
+   }
+
+#if FF_USE_FASTSEEK
+   filesystemState.overlayClmt[lunNumber][0] = SZ_TBL;
+   fp->cltbl = filesystemState.overlayClmt[lunNumber];
+   if (f_lseek(fp, CREATE_LINKMAP) != FR_OK)
+      fp->cltbl = 0;
+#endif
+
+   // The overlay covers the whole disc, or all of the image if that is bigger
+   if (imageSectors > sectors)
+      sectors = imageSectors;
+   filesystemState.fsLunOverlay[lunNumber] = true;
+   if (!sparseLunOpenOverlay(lunNumber, (uint32_t)f_size(fp), sectors)) {
+      if (debugFlag_filesystem) debugString_P(PSTR("File system: filesystemCheckLunOverlay(): ERROR: Overlay is damaged or does not match its LUN image\r\n"));
+      filesystemState.fsLunOverlay[lunNumber] = false;
+      f_close(fp);
+      return false;
+   }
+
+   if (debugFlag_filesystem) debugString_P(PSTR("File system: filesystemCheckLunOverlay(): Writes go to the overlay\r\n"));
+   return true;
+}
+
+#if FF_USE_FASTSEEK
+// Assemble the name of a LUN's saved link map, scsiN.map alongside its scsiN.dat
+static void filesystemLunMapName(uint8_t lunNumber, char *name, size_t size)
+{
+   if (lunNumber < 8)
+      snprintf(name, size, "/BeebSCSI%d/scsi%d.map", filesystemState.lunDirectory, lunNumber);
+   else
+      snprintf(name, size, "/BeebVFS%d/scsi%d.map", filesystemState.lunDirectoryVFS, lunNumber & 7);
+}
+
+// Read a cluster's FAT entry - what FatFs's get_fat() does, which is not
+// exported.  FAT12 entries straddle sectors; its volumes are small enough
+// for the map always to be built.
+static bool filesystemFatEntry(DWORD cluster, DWORD *entry)
+{
+   FATFS *fs = &filesystemState.fsObject;
+   static BYTE fatSector[FF_MAX_SS];
+   const BYTE *sectorData = fatSector;
+   LBA_t sector;
+   UINT offset;
+
+   if (cluster < 2 || cluster >= fs->n_fatent) return false;
+   if (fs->fs_type == FS_FAT16) {
+      sector = fs->fatbase + cluster / (FF_MAX_SS / 2);
+      offset = (cluster % (FF_MAX_SS / 2)) * 2;
+   } else if (fs->fs_type == FS_FAT32) {
+      sector = fs->fatbase + cluster / (FF_MAX_SS / 4);
+      offset = (cluster % (FF_MAX_SS / 4)) * 4;
+   } else {
+      return false;
+   }
+
+   // The sector in FatFs's window may have changed since it was written
+   if (sector == fs->winsect)
+      sectorData = fs->win;
+   else if (disk_read(fs->pdrv, fatSector, sector, 1) != RES_OK)
+      return false;
+
+   if (fs->fs_type == FS_FAT16)
+      *entry = (DWORD)sectorData[offset] | ((DWORD)sectorData[offset + 1] << 8);
+   else
+      *entry = ((DWORD)sectorData[offset] | ((DWORD)sectorData[offset + 1] << 8) |
+                ((DWORD)sectorData[offset + 2] << 16) | ((DWORD)sectorData[offset + 3] << 24)) & 0x0FFFFFFF;
+   return true;
+}
+
+// Does the link map in clmt[] still describe the image?  The file must start
+// with the first fragment and hold as many clusters as the fragments add up
+// to, the last cluster of each fragment must lead to the first of the next,
+// and the last must end the chain.  A change to the image that kept all of
+// those would go unnoticed - but it is a FAT read a fragment, against one
+// every 128 or 256 clusters of the image to build the map again.
+static bool filesystemLunMapFits(uint8_t lunNumber)
+{
+   const FIL *fp = &filesystemState.fileObject[lunNumber];
+   const DWORD *clmt = filesystemState.clmt[lunNumber];
+   DWORD clusterBytes = (DWORD)filesystemState.fsObject.csize * FF_MAX_SS;
+   DWORD clusters = 0, entry;
+   DWORD endOfChain = (filesystemState.fsObject.fs_type == FS_FAT16) ? 0xFFF8 : 0x0FFFFFF8;
+   uint32_t i;
+
+   if (clmt[1] == 0 || clmt[2] != fp->obj.sclust) return false;
+   for (i = 1; clmt[i] != 0; i += 2) {
+      if (i + 2 >= clmt[0] || !filesystemFatEntry(clmt[i + 1] + clmt[i] - 1, &entry)) return false;
+      if (clmt[i + 2] != 0 ? entry != clmt[i + 3] : entry < endOfChain) return false;
+      clusters += clmt[i];
+   }
+   return i + 1 == clmt[0] && clusters == (DWORD)((f_size(fp) + clusterBytes - 1) / clusterBytes);
+}
+
+// Read the link map saved in scsiN.map, if it was made for the image as it is
+static bool filesystemLoadLunMap(uint8_t lunNumber)
+{
+   const FIL *fp = &filesystemState.fileObject[lunNumber];
+   DWORD *clmt = filesystemState.clmt[lunNumber];
+   struct lunMapHeader header;
+   char name[24];
+   FIL fileObject;
+   UINT bytesRead;
+   bool loaded;
+
+   if (f_size(fp) == 0) return false;
+   filesystemLunMapName(lunNumber, name, sizeof(name));
+   if (f_open(&fileObject, name, FA_READ) != FR_OK) return false;
+
+   loaded = f_read(&fileObject, &header, sizeof(header), &bytesRead) == FR_OK && bytesRead == sizeof(header)
+            && memcmp(header.magic, "BSCSIMAP", sizeof(header.magic)) == 0
+            && header.sectorsPerCluster == filesystemState.fsObject.csize
+            && header.firstCluster == fp->obj.sclust && header.imageBytes == f_size(fp)
+            && header.entries >= 4 && header.entries <= SZ_TBL
+            && f_read(&fileObject, clmt, header.entries * sizeof(DWORD), &bytesRead) == FR_OK
+            && bytesRead == header.entries * sizeof(DWORD) && clmt[0] == header.entries;
+   f_close(&fileObject);
+
+   return loaded && filesystemLunMapFits(lunNumber);
+}
+
+// Keep a LUN image's link map in scsiN.map.  Not for VFS, whose directories
+// the Pi only reads, nor when the Beeb is write-protected; a map that cannot
+// be saved is built again next time.
+static void filesystemSaveLunMap(uint8_t lunNumber)
+{
+   const FIL *fp = &filesystemState.fileObject[lunNumber];
+   const DWORD *clmt = filesystemState.clmt[lunNumber];
+   struct lunMapHeader header;
+   char name[24];
+   FIL fileObject;
+   UINT bytesWritten;
+   bool saved;
+
+   if (lunNumber > 7 || config_beeb_write_protected() || f_size(fp) == 0) return;
+
+   memcpy(header.magic, "BSCSIMAP", sizeof(header.magic));
+   header.sectorsPerCluster = filesystemState.fsObject.csize;
+   header.firstCluster = fp->obj.sclust;
+   header.imageBytes = (uint32_t)f_size(fp);
+   header.entries = clmt[0];
+
+   filesystemLunMapName(lunNumber, name, sizeof(name));
+   if (f_open(&fileObject, name, FA_WRITE | FA_CREATE_ALWAYS) != FR_OK) return;
+   saved = f_write(&fileObject, &header, sizeof(header), &bytesWritten) == FR_OK && bytesWritten == sizeof(header)
+           && f_write(&fileObject, clmt, header.entries * sizeof(DWORD), &bytesWritten) == FR_OK
+           && bytesWritten == header.entries * sizeof(DWORD);
+   if (f_close(&fileObject) != FR_OK || !saved) {
+      if (debugFlag_filesystem) debugString_P(PSTR("File system: filesystemSaveLunMap(): ERROR: Could not write .map\r\n"));
+      f_unlink(name);
+   }
+}
+
+// Give a LUN image its cluster link map, so a seek in it need not follow the
+// FAT from the start of the file.  Building the map follows the whole chain,
+// which on a big or fragmented image is most of the time it takes to start
+// the LUN; so the map is kept in scsiN.map and used again while it fits.
+static void filesystemLinkLunImage(uint8_t lunNumber)
+{
+   FIL *fp = &filesystemState.fileObject[lunNumber];
+
+   fp->cltbl = filesystemState.clmt[lunNumber];
+   if (filesystemLoadLunMap(lunNumber)) {
+      if (debugFlag_filesystem) debugString_P(PSTR("File system: filesystemLinkLunImage(): Using the saved link map\r\n"));
+      return;
+   }
+
+   filesystemState.clmt[lunNumber][0] = SZ_TBL;
+   if (f_lseek(fp, CREATE_LINKMAP) != FR_OK) {
+      // if f_lseek fails then file is very fragmented.
+      // fall back to slow seek.
+      fp->cltbl = 0;
+      if (debugFlag_filesystem) debugString_P(PSTR("File system: filesystemLinkLunImage(): LUN very fragmented falling back to slow seek\r\n"));
+      return;
+   }
+   filesystemSaveLunMap(lunNumber);
+}
+#endif
+
 // Function to scan for SCSI LUN image file on the mounted file system
 // and check the image is valid.
 bool filesystemCheckLunImage(uint8_t lunNumber)
 {
    uint32_t lunFileSize;
    FRESULT fsResult;
+
+   // Opened already by filesystemPrefetchNextLun(): all there is left to do
+   // is start it
+   if (filesystemState.fsLunPrepared[lunNumber]) {
+      filesystemState.fsLunPrepared[lunNumber] = false;
+      filesystemState.fsLunStatus[lunNumber] = true;
+   }
+
    if (filesystemState.fsLunStatus[lunNumber])
    {
       if (debugFlag_filesystem) debugString_P(PSTR("File system: filesystemCheckLunImage(): Lun already open\r\n"));
@@ -689,21 +1106,31 @@ bool filesystemCheckLunImage(uint8_t lunNumber)
    }
 
 #if FF_USE_FASTSEEK
-   filesystemState.clmt[lunNumber][0] = SZ_TBL;
-   ((FIL*)(&filesystemState.fileObject[lunNumber]))->cltbl = filesystemState.clmt[lunNumber];
-   if (f_lseek(&filesystemState.fileObject[lunNumber], CREATE_LINKMAP) != FR_OK ){
-       // if f_lseek fails then file is very fragmented.
-       // fall back to slow seek.
-       ((FIL*)(&filesystemState.fileObject[lunNumber]))->cltbl = 0;
-          if (debugFlag_filesystem) debugString_P(PSTR("File system: filesystemCheckLunImage(): LUN very fragmented falling back to slow seek "));
-   }
+   filesystemLinkLunImage(lunNumber);
 #endif
 
    // Opening the LUN image was successful
    if (debugFlag_filesystem) debugString_P(PSTR("File system: filesystemCheckLunImage(): LUN image found\r\n"));
 
+   // A sparse image has a header and a map in front of its sectors
+   sparseLunInitialise(filesystemImageRead, filesystemImageWrite, filesystemBaseRead);
+   if (!sparseLunOpen(lunNumber, (uint32_t)f_size(&filesystemState.fileObject[lunNumber]))) {
+      if (debugFlag_filesystem) debugString_P(PSTR("File system: filesystemCheckLunImage(): ERROR: Sparse LUN image is damaged or too big\r\n"));
+      f_close(&filesystemState.fileObject[lunNumber]);
+      return false;
+   }
+
+   // ... and a packed one an index in front of its chunks
+   packedLunInitialise(filesystemPackedRead);
+   if (!sparseLunIsSparse(lunNumber)
+       && !packedLunOpen(lunNumber, (uint32_t)f_size(&filesystemState.fileObject[lunNumber]))) {
+      if (debugFlag_filesystem) debugString_P(PSTR("File system: filesystemCheckLunImage(): ERROR: Packed LUN image is damaged or too big\r\n"));
+      f_close(&filesystemState.fileObject[lunNumber]);
+      return false;
+   }
+
    // Get the size of the LUN image in bytes
-   lunFileSize = (uint32_t)f_size(&filesystemState.fileObject[lunNumber]);
+   lunFileSize = filesystemLunImageBytes(lunNumber);
    if (debugFlag_filesystem) debugStringInt32_P(PSTR("File system: filesystemCheckLunImage(): LUN size in bytes (according to .dat) = "), lunFileSize, 1);
 
    // Check that the LUN file size is actually a size which ADFS can support (the number of sectors is limited to a 21 bit number)
@@ -730,6 +1157,12 @@ bool filesystemCheckLunImage(uint8_t lunNumber)
       if (debugFlag_filesystem) debugString_P(PSTR("File system: filesystemCheckLunImage(): WARNING: File size and cfg parameters are NOT consistent\r\n"));
    }
 
+   // The Beeb's writes may go to an overlay rather than the image
+   if (!filesystemCheckLunOverlay(lunNumber)) {
+      filesystemSetLunStatus(lunNumber, false);
+      return false;
+   }
+
    // Exit with success
    if (debugFlag_filesystem) debugString_P(PSTR("File system: filesystemCheckLunImage(): Successful\r\n"));
    return true;
@@ -809,11 +1242,18 @@ void filesystemSetLunDirectory(uint8_t scsiHostID, uint8_t lunDirectoryNumber)
    if (debugFlag_filesystem) debugStringInt16_P(PSTR("File system: filesystemSetLunDirectory(): setting lun directory\r\n"), lunDirectoryNumber, 0);
    if (debugFlag_filesystem) debugStringInt16_P(PSTR("File system: filesystemSetLunDirectory(): setting scsihostid directory\r\n"), scsiHostID, 0);
 
+   // Close what was opened ahead of the Beeb in the old directory
+   for (uint8_t lunNumber = (scsiHostID < 16) ? 0 : 8; lunNumber < ((scsiHostID < 16) ? 8 : MAX_LUNS); lunNumber++)
+      if (filesystemState.fsLunPrepared[lunNumber])
+         filesystemSetLunStatus(lunNumber, false);
+
    // Change the current LUN directory number
    if (scsiHostID < 16)
       filesystemState.lunDirectory = lunDirectoryNumber;
    else
       filesystemState.lunDirectoryVFS = lunDirectoryNumber;
+
+   if (filesystemState.fsMountState) filesystemRestartPrefetch();
 }
 
 // Function to read the current LUN directory (for the LUN jukeboxing functionality)
@@ -822,6 +1262,12 @@ uint8_t filesystemGetLunDirectory(void)
    return filesystemState.lunDirectory;
 }
 
+// ... and the VFS one (set with a scsiHostID of 16 or more)
+uint8_t filesystemGetLunDirectoryVFS(void)
+{
+   return filesystemState.lunDirectoryVFS;
+}
+
 // Functions for creating LUNs and LUN descriptors ---------------------------------------------------------------------------
 
 // Beeb_write_protect rule of thumb for the functions below and their write
@@ -1003,24 +1449,85 @@ bool filesystemWriteAttributes(uint8_t lunNumber)
    return false;
 }
 
-// Function to format a LUN image
-bool filesystemFormatLun(uint8_t lunNumber, uint8_t dataPattern)
+// FORMAT of a sparse LUN image: a header and an empty map, so every sector
+// reads as dataPattern.  It is written through the LUN's own file object,
+// which has just been closed, as that is what the sparse layer writes to.
+static bool filesystemFormatSparseLun(uint8_t lunNumber, uint8_t dataPattern)
+{
+   bool formatted;
+
+   if (f_open(&filesystemState.fileObject[lunNumber], fileName, FA_READ | FA_WRITE | FA_CREATE_ALWAYS) != FR_OK) {
+      if (debugFlag_filesystem) debugString_P(PSTR("File system: filesystemFormatLun(): ERROR: Could not open .dat\r\n"));
+      return false;
+   }
+   sparseLunInitialise(filesystemImageRead, filesystemImageWrite, filesystemBaseRead);
+   formatted = sparseLunFormat(lunNumber, filesystemGetLunTotalSectors(lunNumber), dataPattern);
+   f_close(&filesystemState.fileObject[lunNumber]);
+
+   if (debugFlag_filesystem) {
+      if (formatted) {debugString_P(PSTR("File system: filesystemFormatLun(): Sparse format successful\r\n"));}
+      else debugString_P(PSTR("File system: filesystemFormatLun(): ERROR: Could not write sparse .dat\r\n"));
+   }
+   return formatted;
+}
+
+// FORMAT of an overlay LUN leaves its image alone and empties the overlay,
+// which puts the disc back as the image has it
+static bool filesystemResetOverlay(uint8_t lunNumber)
 {
    FIL fileObject;
+
+   filesystemSetLunStatus(lunNumber, false);
+   filesystemOverlayName(lunNumber);
+   if (f_open(&fileObject, fileName, FA_WRITE | FA_CREATE_ALWAYS) != FR_OK) {
+      if (debugFlag_filesystem) debugString_P(PSTR("File system: filesystemFormatLun(): ERROR: Could not empty overlay\r\n"));
+      return false;
+   }
+   f_close(&fileObject);
+
+   if (debugFlag_filesystem) debugString_P(PSTR("File system: filesystemFormatLun(): Overlay emptied\r\n"));
+   return true;
+}
+
+// Function to format a LUN image
+//
+// A sparse image, an overlay or a write-protected card is done at once (a
+// sparse FORMAT writes only the header and map).  A flat image is created
+// here and grown by filesystemFormatLunContinue() a piece a poll pass, so
+// FILESYSTEM_JOB_BUSY means call that until it is not.
+enum filesystemJobStatus filesystemFormatLun(uint8_t lunNumber, uint8_t dataPattern)
+{
    FRESULT fsResult;
+   bool sparse;
 
    // Write-protect: ignore FORMAT (which would truncate via FA_CREATE_ALWAYS),
    // report success. Gated before any f_open so nothing is destroyed.
-   if (config_beeb_write_protected()) return true;
+   if (config_beeb_write_protected()) return FILESYSTEM_JOB_DONE;
+
+   // Only one FORMAT at a time: the bus is held until it finishes, so this
+   // is a FORMAT the host gave up on
+   filesystemFormatLunAbandon();
+
+   filesystemOverlayName(lunNumber);
+   if (f_stat(fileName, NULL) == FR_OK)
+      return filesystemResetOverlay(lunNumber) ? FILESYSTEM_JOB_DONE : FILESYSTEM_JOB_FAILED;
 
    if (lunNumber >7)
    {
       // VFS doesn't support creating .dat files
-      return false;
+      return FILESYSTEM_JOB_FAILED;
+   }
+
+   // Nor is a packed image to be thrown away for a flat one
+   if (packedLunIsPacked(lunNumber)) {
+      if (debugFlag_filesystem) debugString_P(PSTR("File system: filesystemFormatLun(): ERROR: A packed LUN image is read-only\r\n"));
+      return FILESYSTEM_JOB_FAILED;
    }
 
    if (debugFlag_filesystem) debugStringInt16_P(PSTR("File system: filesystemFormatLun(): Formatting LUN image "), lunNumber, true);
 
+   // A sparse image stays sparse; scsi_sparse makes every image sparse
+   sparse = config_get_bool("scsi_sparse") || sparseLunIsSparse(lunNumber);
    filesystemSetLunStatus(lunNumber, false );
 
    if (debugFlag_filesystem) debugStringInt32_P(PSTR("File system: filesystemFormatLun(): Sectors required = "), filesystemGetLunTotalSectors(lunNumber), true);
@@ -1028,51 +1535,69 @@ bool filesystemFormatLun(uint8_t lunNumber, uint8_t dataPattern)
    // Assemble the .dat file name
    snprintf(fileName, sizeof(fileName), "/BeebSCSI%d/scsi%d.dat", filesystemState.lunDirectory, lunNumber);
 
-   // Note: We are using the expand FAT method to create the LUN image... the dataPattern byte
-   // will be ignored.
-   // Fill the sector buffer with the required data pattern
-   // for (counter = 0; counter < 256; counter++) sectorBuffer[counter] = dataPattern;
+   if (sparse)
+      return filesystemFormatSparseLun(lunNumber, dataPattern) ? FILESYSTEM_JOB_DONE : FILESYSTEM_JOB_FAILED;
 
-   // Create the .dat file (the old .dat file, if present, will be unlinked (i.e. gone forever))
+   // Note: the image is only allocated, not written, so the dataPattern byte
+   // is ignored.
 
-   fsResult = f_open(&fileObject, fileName, FA_READ | FA_WRITE | FA_CREATE_ALWAYS);
-   if (fsResult == FR_OK) {
-      // Write the required number of sectors to the DAT file
-      if (debugFlag_filesystem) debugString_P(PSTR("File system: filesystemFormatLun(): Performing format...\r\n"));
-
-      // If we try to write 512MBs of data to the SD card in 256 byte chunks
-      // via SPI it will take a very long time to complete...
-      //
-      // So instead we use the FAT FS expand command to allocate a file of the required
-      // LUN size
-      //
-      // Note: This allocates a contiguous area for the file which can help to
-      // speed up read/write times.  If you would prefer the file to be small
-      // and grow as used, just remove the f_expand and the fsResult check.  Every
-      // thing will work fine without them.
-      //
-      // This ignores the data pattern (since the file is only allocated - not
-      // actually written).
-      fsResult = f_expand(&fileObject /*&filesystemState.fileObject[lunNumber]*/, (FSIZE_t)(filesystemGetLunTotalBytes(lunNumber)), 1);
-
-      if (debugFlag_filesystem) debugString_P(PSTR("File system: filesystemFormatLun(): Format complete\r\n"));
-
-      // Check that the file was written OK
-      if (fsResult != FR_OK) {
-         // Something went wrong writing to the .dat
-         if (debugFlag_filesystem) debugStringInt8Hex_P(PSTR("File system: filesystemFormatLun(): ERROR: Could not write .dat : \r\n"),fsResult,1);
-         return false;
-      }
-   } else {
+   // Create the .dat file (the old .dat file, if present, will be unlinked (i.e. gone forever))
+   fsResult = f_open(&fileObjectFormat, fileName, FA_READ | FA_WRITE | FA_CREATE_ALWAYS);
+   if (fsResult != FR_OK) {
       // Something went wrong opening the .dat
       if (debugFlag_filesystem) debugString_P(PSTR("File system: filesystemFormatLun(): ERROR: Could not open .dat\r\n"));
-      return false;
+      return FILESYSTEM_JOB_FAILED;
    }
 
+   if (debugFlag_filesystem) debugString_P(PSTR("File system: filesystemFormatLun(): Performing format...\r\n"));
+   formatJob.running = true;
+   formatJob.lunNumber = lunNumber;
+   formatJob.size = (FSIZE_t)filesystemGetLunTotalBytes(lunNumber);
+   return FILESYSTEM_JOB_BUSY;
+}
+
+// Grow the image a flat FORMAT is making by FORMAT_CHUNK_BYTES
+//
+// This used to be one f_expand() of the whole image, which on a large card
+// is a scan of the FAT for a free run of that length - seconds with nothing
+// else polled.  Seeking past the end of a file opened for writing allocates
+// the clusters without writing them, a chunk at a time.  FatFs hands out
+// clusters from after the last one it gave, so on a card with room the
+// image is still contiguous; when it is not, the fast seek map covers it,
+// and a fragmented card no longer fails the FORMAT outright.
+enum filesystemJobStatus filesystemFormatLunContinue(void)
+{
+   FSIZE_t target;
+
+   if (!formatJob.running) return FILESYSTEM_JOB_FAILED;
+
+   target = f_size(&fileObjectFormat) + FORMAT_CHUNK_BYTES;
+   if (target > formatJob.size) target = formatJob.size;
+
+   // A full card stops the seek short of where it was asked to go
+   if (f_lseek(&fileObjectFormat, target) != FR_OK || f_tell(&fileObjectFormat) != target) {
+      if (debugFlag_filesystem) debugString_P(PSTR("File system: filesystemFormatLunContinue(): ERROR: Could not write .dat\r\n"));
+      filesystemFormatLunAbandon();
+      return FILESYSTEM_JOB_FAILED;
+   }
+   if (target < formatJob.size) return FILESYSTEM_JOB_BUSY;
+
    // Formatting successful
-   f_close(&fileObject);
+   formatJob.running = false;
+   if (f_close(&fileObjectFormat) != FR_OK) return FILESYSTEM_JOB_FAILED;
    if (debugFlag_filesystem) debugString_P(PSTR("File system: filesystemFormatLun(): Successful\r\n"));
-   return true;
+   return FILESYSTEM_JOB_DONE;
+}
+
+// Stop a flat FORMAT part way (a SCSI reset, or the card going away).  The
+// image is left short, and the LUN stopped, until it is formatted again.
+void filesystemFormatLunAbandon(void)
+{
+   if (!formatJob.running) return;
+
+   formatJob.running = false;
+   f_close(&fileObjectFormat);
+   if (debugFlag_filesystem) debugString_P(PSTR("File system: filesystemFormatLunAbandon(): FORMAT abandoned\r\n"));
 }
 
 // Check an extended attributes file is available for that LUN
@@ -1162,7 +1687,7 @@ void filesystemLunToconfigGeometry(uint8_t lunNumber)
 
 void filesytemdattoconfigGeometry(uint8_t lunNumber)
 {
-      uint32_t lunFileSize = (uint32_t)f_size(&filesystemState.fileObject[lunNumber]);
+      uint32_t lunFileSize = filesystemLunImageBytes(lunNumber);
 
       lunFileSize = lunFileSize / (filesystemState.fsLunGeometry[lunNumber].SectorsPerTrack * filesystemState.fsLunGeometry[lunNumber].BlockSize);
       uint8_t heads = 16;
@@ -1319,26 +1844,101 @@ void filesystemCopyPage4toPage0(uint8_t lunNumber)
 
 // Functions for reading and writing LUN images --------------------------------------------------------------------
 
+// The file a LUN's writes go to, and its fast seek link map: the overlay of
+// an overlay LUN, or the image itself
+static FIL *filesystemLunFile(uint8_t lunNumber)
+{
+   if (filesystemState.fsLunOverlay[lunNumber])
+      return &filesystemState.overlayObject[lunNumber];
+   return &filesystemState.fileObject[lunNumber];
+}
+
+#if FF_USE_FASTSEEK
+static DWORD *filesystemLunClmt(uint8_t lunNumber)
+{
+   if (filesystemState.fsLunOverlay[lunNumber])
+      return filesystemState.overlayClmt[lunNumber];
+   return filesystemState.clmt[lunNumber];
+}
+#endif
+
+// Read bytes of a file.  Reads past the end of a growing image must not
+// extend it (a plain f_lseek on a write-mode file allocates clusters), so
+// they do not seek at all and read as zeros.
+static bool filesystemFileRead(FIL *fp, uint32_t offset, uint8_t *buffer, uint32_t length)
+{
+   UINT fsCounter = 0;
+
+   if (offset < f_size(fp)) {
+      if (f_lseek(fp, offset) != FR_OK || f_read(fp, buffer, length, &fsCounter) != FR_OK) {
+         // Something went wrong
+         if (debugFlag_filesystem) debugString_P(PSTR("File system: filesystemFileRead(): ERROR: Cannot read from LUN image!\r\n"));
+         return false;
+      }
+   }
+
+   // A short read means the host is reading past the end of an image that
+   // has not been grown to full geometry yet - unwritten sectors read as
+   // zeros rather than whatever the buffer last held
+   memset(buffer + fsCounter, 0, length - fsCounter);
+   return true;
+}
+
+// Read bytes of the file a LUN's writes go to: what the sparse layer reads
+static bool filesystemImageRead(uint8_t lunNumber, uint32_t offset, uint8_t *buffer, uint32_t length)
+{
+   return filesystemFileRead(filesystemLunFile(lunNumber), offset, buffer, length);
+}
+
+// Read bytes of a LUN's image, never its overlay: what the packed layer reads
+static bool filesystemPackedRead(uint8_t lunNumber, uint32_t offset, uint8_t *buffer, uint32_t length)
+{
+   return filesystemFileRead(&filesystemState.fileObject[lunNumber], offset, buffer, length);
+}
+
+// Read sectors of the image under an overlay, which may be packed
+static bool filesystemBaseRead(uint8_t lunNumber, uint32_t firstSector, uint8_t *buffer, uint32_t sectors)
+{
+   if (packedLunIsPacked(lunNumber))
+      return packedLunRead(lunNumber, firstSector, buffer, sectors);
+   return filesystemFileRead(&filesystemState.fileObject[lunNumber], firstSector * 256, buffer, sectors * 256);
+}
+
+// Read sectors of a LUN: through the map of a sparse image, the index of a
+// packed one, or straight from a flat one
+static bool filesystemReadLunSectors(uint8_t lunNumber, uint32_t firstSector, uint8_t *buffer, uint32_t sectors)
+{
+   // Sectors held by the write cache must be on the card before they are
+   // read back.  That is every sector read here, not just those the host
+   // asked for: the sector cache fills whole blocks and reads ahead, so a
+   // held sector next to the request would otherwise be cached as it was.
+   if (!writeCacheFlushRange(lunNumber, firstSector, sectors)) {
+      if (debugFlag_filesystem) debugString_P(PSTR("File system: filesystemReadLunSectors(): ERROR: Cannot write to LUN image!\r\n"));
+      return false;
+   }
+
+   if (sparseLunIsSparse(lunNumber))
+      return sparseLunRead(lunNumber, firstSector, buffer, sectors);
+   if (packedLunIsPacked(lunNumber))
+      return packedLunRead(lunNumber, firstSector, buffer, sectors);
+   return filesystemImageRead(lunNumber, firstSector * 256, buffer, sectors * 256);
+}
+
 // Function to open a LUN ready for reading
 // Note: The read functions use a multi-sector buffer to lower the number of required
 // reads from the physical media.  This is to allow more efficient (larger) reads of data.
 bool filesystemOpenLunForRead(uint8_t lunNumber, uint32_t startSector, uint32_t requiredNumberOfSectors)
 {
-   // Move to the correct point in the DAT file
-   // Check that the file seek was OK
-
-   // Reads past the end of a growing image must not extend it (a plain
-   // f_lseek on a write-mode file allocates clusters): clamp the seek to the
-   // file size and let the short read return zeros for the unwritten sectors
-   uint32_t seekPoint = startSector * 256;
-   if (seekPoint > f_size(&filesystemState.fileObject[lunNumber]))
-      seekPoint = (uint32_t)f_size(&filesystemState.fileObject[lunNumber]);
-
-   if (f_lseek(&filesystemState.fileObject[lunNumber], seekPoint) != FR_OK) {
-      // Something went wrong with seeking, do not retry
-      if (debugFlag_filesystem) debugString_P(PSTR("File system: filesystemOpenLunForRead(): ERROR: Unable to seek to required sector in LUN image file!\r\n"));
-      return false;
+   // The sector cache reads block by block, and only on a miss
+   if (sectorCacheInitialise(filesystemReadLunSectors, sectorBuffer, SECTOR_BUFFER_SIZE)) {
+      sectorCacheOpenRead(lunNumber, (filesystemLunImageBytes(lunNumber) + 255) / 256, startSector, requiredNumberOfSectors);
+      filesystemState.fsLunStatus[lunNumber] = true;
+      if (debugFlag_filesystem) debugString_P(PSTR("File system: filesystemOpenLunForRead(): Successful\r\n"));
+      return true;
    }
+
+   // Each refill of the sector buffer seeks to where it reads from
+   readSector = startSector;
    sectorsRemaining = requiredNumberOfSectors;
    sectorsInBuffer = 0;
 
@@ -1351,30 +1951,24 @@ bool filesystemOpenLunForRead(uint8_t lunNumber, uint32_t startSector, uint32_t
 // Function to read next sector from a LUN
 bool filesystemReadNextSector(uint8_t lunNumber, uint8_t **buffer)
 {
+   if (sectorCacheEnabled()) {
+      if (!sectorCacheReadNext(lunNumber, buffer)) {
+         if (debugFlag_filesystem) debugString_P(PSTR("File system: filesystemReadNextSector(): ERROR: Cannot read from LUN image!\r\n"));
+         return false;
+      }
+      return true;
+   }
+
    if (sectorsInBuffer == 0)
    {
       uint32_t sectorsToRead = sectorsRemaining;
-      FRESULT fsResult;
-      UINT fsCounter;
       if (sectorsToRead > SECTOR_BUFFER_LENGTH) sectorsToRead = SECTOR_BUFFER_LENGTH;
 
       // Read the required data into the sector buffer
-      fsResult = f_read(&filesystemState.fileObject[lunNumber], sectorBuffer, sectorsToRead * 256, &fsCounter);
-
-      // Check that the file was read OK
-      if (fsResult != FR_OK) {
-         // Something went wrong
-         if (debugFlag_filesystem) debugString_P(PSTR("File system: filesystemReadNextSector(): ERROR: Cannot read from LUN image!\r\n"));
+      if (!filesystemReadLunSectors(lunNumber, readSector, sectorBuffer, sectorsToRead))
          return false;
-      }
-
-      // A short read means the host is reading past the end of an image that
-      // has not been grown to full geometry yet - unwritten sectors read as
-      // zeros rather than whatever the buffer last held
-      if (fsCounter < sectorsToRead * 256) {
-         memset(sectorBuffer + fsCounter, 0, (sectorsToRead * 256) - fsCounter);
-      }
 
+      readSector += sectorsToRead;
       sectorsInBuffer = (uint8_t)sectorsToRead;
       currentBufferSector = 0;
       sectorsRemaining = sectorsRemaining - sectorsInBuffer;
@@ -1395,22 +1989,13 @@ bool filesystemCloseLunForRead(uint8_t lunNumber)
    return true;
 }
 
-// Function to open a LUN ready for writing
-bool filesystemOpenLunForWrite(uint8_t lunNumber, uint32_t startSector, uint32_t requiredNumberOfSectors)
+// Seek the file a LUN's writes go to to offset
+static bool filesystemSeekForWrite(uint8_t lunNumber, uint32_t offset)
 {
-   // VFS LUNs (>= 8, the /BeebVFS* images) are READ-ONLY.  Every other
-   // mutating entry point already refuses them - filesystemFormatLun,
-   // filesystemCreateLunImage, filesystemCreateLunDescriptor and
-   // filesystemWriteAttributes all bail on lunNumber > 7 - but the WRITE6
-   // path did not, so a host that simply addressed LUN 8-15 (the SCSI id is
-   // taken straight off the databus) could overwrite a Domesday image.
-   if (lunNumber > 7)
-      return false;
+   FIL *fp = filesystemLunFile(lunNumber);
 
 #if FF_USE_FASTSEEK
-   FIL *fp = &filesystemState.fileObject[lunNumber];
-
-   if (fp->cltbl != 0 && startSector * 256 > f_size(fp)) {
+   if (fp->cltbl != 0 && offset > f_size(fp)) {
       // Fast seek clips seeks at the current file size and cannot allocate
       // clusters, so a write starting beyond the end of a growing image
       // would land at the wrong offset. Extend the file with fast seek
@@ -1418,20 +2003,20 @@ bool filesystemOpenLunForWrite(uint8_t lunNumber, uint32_t startSector, uint32_t
       FRESULT fsResult;
 
       fp->cltbl = 0;
-      fsResult = f_lseek(fp, startSector * 256);
+      fsResult = f_lseek(fp, offset);
 
-      filesystemState.clmt[lunNumber][0] = SZ_TBL;
-      fp->cltbl = filesystemState.clmt[lunNumber];
+      fp->cltbl = filesystemLunClmt(lunNumber);
+      fp->cltbl[0] = SZ_TBL;
       if (f_lseek(fp, CREATE_LINKMAP) != FR_OK) {
          // Too fragmented for the map - fall back to slow seek (as at open)
          fp->cltbl = 0;
-         if (debugFlag_filesystem) debugString_P(PSTR("File system: filesystemOpenLunForWrite(): LUN very fragmented falling back to slow seek\r\n"));
+         if (debugFlag_filesystem) debugString_P(PSTR("File system: filesystemSeekForWrite(): LUN very fragmented falling back to slow seek\r\n"));
       }
 
       // A seek that stopped short of the target means the SD card filled up
       // while the image was being extended
-      if (fsResult != FR_OK || f_tell(fp) != startSector * 256) {
-         if (debugFlag_filesystem) debugString_P(PSTR("File system: filesystemOpenLunForWrite(): ERROR: Unable to grow LUN image file!\r\n"));
+      if (fsResult != FR_OK || f_tell(fp) != offset) {
+         if (debugFlag_filesystem) debugString_P(PSTR("File system: filesystemSeekForWrite(): ERROR: Unable to grow LUN image file!\r\n"));
          return false;
       }
    }
@@ -1439,20 +2024,117 @@ bool filesystemOpenLunForWrite(uint8_t lunNumber, uint32_t startSector, uint32_t
 
    // Move to the correct point in the DAT file
    // Check that the file seek was OK
-   if (f_lseek(&filesystemState.fileObject[lunNumber], startSector * 256) != FR_OK) {
+   if (f_lseek(fp, offset) != FR_OK) {
       // Something went wrong with seeking, do not retry
-      if (debugFlag_filesystem) debugString_P(PSTR("File system: filesystemOpenLunForWrite(): ERROR: Unable to seek to required sector in LUN image file!\r\n"));
+      if (debugFlag_filesystem) debugString_P(PSTR("File system: filesystemSeekForWrite(): ERROR: Unable to seek to required sector in LUN image file!\r\n"));
+      return false;
+   }
+   return true;
+}
+
+// Write bytes of the file a LUN's writes go to at offset, growing it if
+// need be
+static bool filesystemImageWrite(uint8_t lunNumber, uint32_t offset, const uint8_t *data, uint32_t length)
+{
+   FIL *fp = filesystemLunFile(lunNumber);
+   FRESULT fsResult;
+   UINT fsCounter;
+
+   if (!filesystemSeekForWrite(lunNumber, offset))
+      return false;
+
+   // Write the required data
+   fsResult = f_write(fp, data, length, &fsCounter);
+
+#if FF_USE_FASTSEEK
+   if (fsResult == FR_OK && fsCounter != length && fp->cltbl != 0) {
+      // In fast seek mode f_write cannot allocate new clusters, so a write
+      // that grows the image stops at the end of the mapped cluster chain
+      // and reports a short transfer. Grow the file with fast seek
+      // disabled, then rebuild the link map to cover the new clusters.
+      UINT fsExtended = 0;
+
+      fp->cltbl = 0;
+      fsResult = f_write(fp, data + fsCounter, length - fsCounter, &fsExtended);
+      fsCounter += fsExtended;
+
+      fp->cltbl = filesystemLunClmt(lunNumber);
+      fp->cltbl[0] = SZ_TBL;
+      if (f_lseek(fp, CREATE_LINKMAP) != FR_OK) {
+         // Too fragmented for the map - fall back to slow seek (as at open)
+         fp->cltbl = 0;
+         if (debugFlag_filesystem) debugString_P(PSTR("File system: filesystemImageWrite(): LUN very fragmented falling back to slow seek\r\n"));
+      }
+   }
+#endif
+
+   // Check that the file was written OK and in full (a short transfer
+   // here means the SD card is full)
+   if (fsResult != FR_OK || fsCounter != length) {
+      if (debugFlag_filesystem) debugString_P(PSTR("File system: filesystemImageWrite(): ERROR: Cannot write to LUN image!\r\n"));
       return false;
    }
+   return true;
+}
+
+// Write sectors of a LUN, through the map of a sparse image.  This is also
+// how the write cache sends a run of a write-back LUN to the card.
+static bool filesystemWriteLunSectors(uint8_t lunNumber, uint32_t firstSector, const uint8_t *data, uint32_t sectors)
+{
+   bool written;
+
+   if (sparseLunIsSparse(lunNumber))
+      written = sparseLunWrite(lunNumber, firstSector, data, sectors);
+   else
+      written = filesystemImageWrite(lunNumber, firstSector * 256, data, sectors * 256);
+
+   // Something went wrong; what is in the image now is anyone's guess, and
+   // the sector cache may have been given these sectors when they were written
+   if (!written)
+      sectorCacheInvalidateLun(lunNumber);
+   return written;
+}
+
+static bool filesystemSyncLun(uint8_t lunNumber)
+{
+   return f_sync(filesystemLunFile(lunNumber)) == FR_OK;
+}
+
+// Function to open a LUN ready for writing
+bool filesystemOpenLunForWrite(uint8_t lunNumber, uint32_t startSector, uint32_t requiredNumberOfSectors)
+{
+   // VFS LUNs (>= 8, the /BeebVFS* images) are READ-ONLY.  Every other
+   // mutating entry point already refuses them - filesystemFormatLun,
+   // filesystemCreateLunImage, filesystemCreateLunDescriptor and
+   // filesystemWriteAttributes all bail on lunNumber > 7 - but the WRITE6
+   // path did not, so a host that simply addressed LUN 8-15 (the SCSI id is
+   // taken straight off the databus) could overwrite a Domesday image.
+   // One with an overlay can take writes, as they go to its scsiN.cow.
+   // So can a packed image, which is read-only wherever it is.
+   if ((lunNumber > 7 || packedLunIsPacked(lunNumber)) && !filesystemState.fsLunOverlay[lunNumber])
+      return false;
+
+   // A write-back LUN's sectors go to the write cache, which sends them on
+   // when it is ready; either way each write seeks to where it goes
+   writeCacheInitialise(filesystemWriteLunSectors, filesystemSyncLun);
 
    sectorsRemaining = requiredNumberOfSectors;
    currentBufferSector = 0;
+   writeSector = startSector;
 
    // Exit with success
    if (debugFlag_filesystem) debugString_P(PSTR("File system: filesystemOpenLunForWrite(): Successful\r\n"));
    return true;
 }
 
+// Where the next sector of a write should be put: filling it there rather
+// than passing filesystemWriteNextSector() a buffer saves copying each sector
+// into the sector buffer
+uint8_t *filesystemWriteSectorBuffer(void)
+{
+   return sectorBuffer + (currentBufferSector * 256);
+}
+
 // Function to write next sector to a LUN
 bool filesystemWriteNextSector(uint8_t lunNumber, uint8_t const buffer[])
 {
@@ -1460,12 +2142,12 @@ bool filesystemWriteNextSector(uint8_t lunNumber, uint8_t const buffer[])
    // Returning true (never false) keeps a mounted ADFS from seeing an error.
    if (config_beeb_write_protected()) return true;
 
-   memcpy(sectorBuffer + (currentBufferSector * 256), buffer , 256 );
+   if (buffer != sectorBuffer + (currentBufferSector * 256))
+      memcpy(sectorBuffer + (currentBufferSector * 256), buffer , 256 );
    currentBufferSector++;
 
    if ( (currentBufferSector == SECTOR_BUFFER_LENGTH) || ( currentBufferSector == sectorsRemaining)) {
-      FRESULT fsResult;
-      UINT fsCounter;
+      bool writeBack = writeCacheEnabled(lunNumber);
       uint32_t sectorsToWrite;
 
       if (currentBufferSector == SECTOR_BUFFER_LENGTH)
@@ -1473,46 +2155,23 @@ bool filesystemWriteNextSector(uint8_t lunNumber, uint8_t const buffer[])
       else
          sectorsToWrite = sectorsRemaining;
 
-      // Write the required data
-      fsResult = f_write(&filesystemState.fileObject[lunNumber], sectorBuffer, sectorsToWrite * 256, &fsCounter);
-
-#if FF_USE_FASTSEEK
-      if (fsResult == FR_OK && fsCounter != sectorsToWrite * 256 &&
-          filesystemState.fileObject[lunNumber].cltbl != 0) {
-         // In fast seek mode f_write cannot allocate new clusters, so a write
-         // that grows the image stops at the end of the mapped cluster chain
-         // and reports a short transfer. Grow the file with fast seek
-         // disabled, then rebuild the link map to cover the new clusters.
-         FIL *fp = &filesystemState.fileObject[lunNumber];
-         UINT fsExtended = 0;
-
-         fp->cltbl = 0;
-         fsResult = f_write(fp, sectorBuffer + fsCounter, (sectorsToWrite * 256) - fsCounter, &fsExtended);
-         fsCounter += fsExtended;
-
-         filesystemState.clmt[lunNumber][0] = SZ_TBL;
-         fp->cltbl = filesystemState.clmt[lunNumber];
-         if (f_lseek(fp, CREATE_LINKMAP) != FR_OK) {
-            // Too fragmented for the map - fall back to slow seek (as at open)
-            fp->cltbl = 0;
-            if (debugFlag_filesystem) debugString_P(PSTR("File system: filesystemWriteNextSector(): LUN very fragmented falling back to slow seek\r\n"));
+      if (writeBack) {
+         if (!writeCacheWrite(lunNumber, writeSector, sectorBuffer, sectorsToWrite)) {
+            if (debugFlag_filesystem) debugString_P(PSTR("File system: filesystemWriteNextSector(): ERROR: Cannot write to LUN image!\r\n"));
+            return false;
          }
-      }
-#endif
-
-      // Check that the file was written OK and in full (a short transfer
-      // here means the SD card is full)
-      if (fsResult != FR_OK || fsCounter != sectorsToWrite * 256) {
-         // Something went wrong
-         if (debugFlag_filesystem) debugString_P(PSTR("File system: filesystemWriteNextSector(): ERROR: Cannot write to LUN image!\r\n"));
+      } else if (!filesystemWriteLunSectors(lunNumber, writeSector, sectorBuffer, sectorsToWrite))
          return false;
-      }
+
+      // Keep any cached copies of these sectors up to date
+      sectorCacheWrite(lunNumber, writeSector, sectorBuffer, sectorsToWrite);
+      writeSector += sectorsToWrite;
 
       currentBufferSector = 0;
       sectorsRemaining -= sectorsToWrite;
 
-      if (sectorsRemaining == 0)
-         f_sync(&filesystemState.fileObject[lunNumber]);
+      if (sectorsRemaining == 0 && !writeBack)
+         f_sync(filesystemLunFile(lunNumber));
    }
    // Exit with success
    return true;
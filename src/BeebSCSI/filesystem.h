@@ -55,6 +55,14 @@ struct HDGeometry
 	uint16_t Interleave;				// doesn't really matter for BeebSCSI
 };
 
+// Progress of a long job (a FORMAT) done a piece a poll pass
+enum filesystemJobStatus
+{
+	FILESYSTEM_JOB_DONE,
+	FILESYSTEM_JOB_BUSY,		// call the job's Continue function again
+	FILESYSTEM_JOB_FAILED
+};
+
 // External prototypes
 void filesystemInitialise(uint8_t scsijuke, uint8_t vfsjuke);
 void filesystemReset(void);
@@ -63,9 +71,11 @@ bool filesystemMount(void);
 bool filesystemDismount(void);
 
 bool filesystemCheckLunImage(uint8_t lunNumber);
+bool filesystemPrefetchNextLun(void);
 
 void filesystemSetLunDirectory(uint8_t scsiHostID, uint8_t lunDirectoryNumber);
 uint8_t filesystemGetLunDirectory(void);
+uint8_t filesystemGetLunDirectoryVFS(void);
 
 bool filesystemSetLunStatus(uint8_t lunNumber, bool lunStatus);
 bool filesystemReadLunStatus(uint8_t lunNumber);
@@ -92,10 +102,13 @@ bool filesystemCreateLunImage(uint8_t lunNumber);
 bool filesystemCreateLunDescriptor(uint8_t lunNumber);
 bool filesystemReadLunDescriptor(uint8_t lunNumber);
 bool filesystemWriteAttributes(uint8_t lunNumber);
-bool filesystemFormatLun(uint8_t lunNumber, uint8_t dataPattern);
+enum filesystemJobStatus filesystemFormatLun(uint8_t lunNumber, uint8_t dataPattern);
+enum filesystemJobStatus filesystemFormatLunContinue(void);
+void filesystemFormatLunAbandon(void);
 
 // Host-side (MTP / WebDAV) write interlock -- see filesystem.c
 bool   filesystemHostPathBusy(const char *path);
+void   filesystemReleasePreparedLun(const char *path);
 int8_t filesystemLunFromHostPath(const char *path);
 void   filesystemHostLockLun(int8_t lunNumber, bool lock);
 bool   filesystemLunHostLocked(uint8_t lunNumber);
@@ -107,6 +120,7 @@ bool filesystemReadNextSector(uint8_t lunNumber, uint8_t **buffer);
 bool filesystemCloseLunForRead(uint8_t lunNumber);
 bool filesystemOpenLunForWrite(uint8_t lunNumber, uint32_t startSector, uint32_t requiredNumberOfSectors);
 bool filesystemWriteNextSector(uint8_t lunNumber, uint8_t const buffer[]);
+uint8_t *filesystemWriteSectorBuffer(void);
 bool filesystemCloseLunForWrite(uint8_t lunNumber);
 
 char * filesystemGetInquiryData(uint8_t lunNumber, size_t * length);
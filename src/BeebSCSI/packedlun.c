@@ -0,0 +1,274 @@
+/************************************************************************
+	packedlun.c
+
+	BeebSCSI compressed (packed) read-only LUN images - see packedlun.h
+	Part of BeebSCSI as used in Pi1MHz; GPL v3 like the rest of it.
+
+************************************************************************/
+
+/*
+ An open packed image keeps its whole index in memory - 8 bytes a chunk, so
+ 64K for a 512MB disc of 64K chunks - and finding a chunk is an index into
+ it.
+
+ Decompressed chunks are kept in a few 64K slots shared by every packed
+ LUN, the one used longest ago going first.  The sector cache above reads
+ a few sectors at a time, and ADFS and VFS read a file through from start
+ to end, so most reads find their chunk already there; one that does not
+ costs one read of the card, of the chunk's compressed length, and a
+ decompression that takes less time than reading the rest of the chunk
+ flat would.  A chunk held as it is goes straight into its slot.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "packedlun.h"
+#include "filesystem.h"
+#include "../lz4_block.h"
+
+#define PACKED_LUN_MAGIC   "BSCSILZ4"
+#define PACKED_LUN_VERSION 1
+
+// Decompressed chunks kept, for all the LUNs together
+#define PACKED_LUN_SLOTS   4
+
+struct packedLunChunk
+{
+   uint32_t offset;
+   uint32_t length;
+};
+
+struct packedLun
+{
+   struct packedLunChunk *index;    // NULL when the image is not packed
+   uint32_t chunks;
+   uint32_t chunkSectors;
+   uint32_t sectors;
+   uint32_t reads;
+   uint32_t hits;
+};
+
+struct packedLunSlot
+{
+   uint8_t *data;
+   uint32_t chunk;
+   uint32_t lastUsed;
+   uint8_t lunNumber;               // MAX_LUNS when the slot is empty
+};
+
+static packedLunReadFn packedRead;
+static uint8_t *compressed;
+static uint32_t useCounter;
+static struct packedLunSlot slots[PACKED_LUN_SLOTS];
+static struct packedLun packedLuns[MAX_LUNS];
+
+static uint32_t packedLunGet32(const uint8_t *p)
+{
+   return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+// Where the chunks may start in an image of chunks
+static uint32_t packedLunDataStart(uint32_t chunks)
+{
+   return (PACKED_LUN_HEADER_SIZE + chunks * 8 + 511) / 512 * 512;
+}
+
+// The bytes of the disc a chunk holds: all of a chunk, but for the last
+static uint32_t packedLunChunkBytes(const struct packedLun *p, uint32_t chunk)
+{
+   uint32_t first = chunk * p->chunkSectors;
+
+   if (p->sectors - first < p->chunkSectors)
+      return (p->sectors - first) * 256;
+   return p->chunkSectors * 256;
+}
+
+// The slots and the compressed chunk buffer, the first time a packed image
+// is opened
+static bool packedLunBuffers(void)
+{
+   if (compressed == NULL)
+      compressed = malloc(PACKED_LUN_CHUNK_SIZE);
+   for (int s = 0; s < PACKED_LUN_SLOTS && compressed != NULL; s++) {
+      if (slots[s].data == NULL) {
+         slots[s].data = malloc(PACKED_LUN_CHUNK_SIZE);
+         if (slots[s].data == NULL)
+            return false;
+         slots[s].lunNumber = MAX_LUNS;
+      }
+   }
+   return compressed != NULL;
+}
+
+void packedLunInitialise(packedLunReadFn read)
+{
+   packedRead = read;
+}
+
+bool packedLunOpen(uint8_t lunNumber, uint32_t fileSize)
+{
+   struct packedLun *p = &packedLuns[lunNumber];
+   uint8_t header[PACKED_LUN_HEADER_SIZE];
+   uint32_t chunkSectors;
+   uint32_t dataStart;
+
+   packedLunClose(lunNumber);
+   if (fileSize < PACKED_LUN_HEADER_SIZE)
+      return true;
+   if (!packedRead(lunNumber, 0, header, PACKED_LUN_HEADER_SIZE))
+      return false;
+   if (memcmp(header, PACKED_LUN_MAGIC, 8) != 0)
+      return true;
+
+   chunkSectors = packedLunGet32(header + 12);
+   if (packedLunGet32(header + 8) != PACKED_LUN_VERSION
+       || chunkSectors < PACKED_LUN_CHUNK_SECTORS_MIN || chunkSectors > PACKED_LUN_CHUNK_SECTORS
+       || (chunkSectors & (chunkSectors - 1)) != 0
+       || packedLunGet32(header + 16) == 0
+       || packedLunGet32(header + 16) > (1u << 21))
+      return false;
+   p->sectors = packedLunGet32(header + 16);
+   p->chunkSectors = chunkSectors;
+   p->chunks = (p->sectors + chunkSectors - 1) / chunkSectors;
+   dataStart = packedLunDataStart(p->chunks);
+   if (fileSize < dataStart || !packedLunBuffers()) {
+      packedLunClose(lunNumber);
+      return false;
+   }
+
+   p->index = malloc(p->chunks * sizeof(struct packedLunChunk));
+   if (p->index == NULL) {
+      packedLunClose(lunNumber);
+      return false;
+   }
+   if (!packedRead(lunNumber, PACKED_LUN_HEADER_SIZE, (uint8_t *)p->index, p->chunks * 8)) {
+      packedLunClose(lunNumber);
+      return false;
+   }
+
+   // The index is read as it is on the card, then put into this end's
+   // order, and every chunk must lie within the file after the index
+   for (uint32_t c = 0; c < p->chunks; c++) {
+      const uint8_t *entry = (const uint8_t *)&p->index[c];
+      uint32_t offset = packedLunGet32(entry);
+      uint32_t length = packedLunGet32(entry + 4);
+
+      if (offset < dataStart || offset > fileSize || length == 0 || length > fileSize - offset
+          || length > packedLunChunkBytes(p, c)) {
+         packedLunClose(lunNumber);
+         return false;
+      }
+      p->index[c].offset = offset;
+      p->index[c].length = length;
+   }
+   return true;
+}
+
+void packedLunClose(uint8_t lunNumber)
+{
+   struct packedLun *p = &packedLuns[lunNumber];
+
+   // What was decompressed from this image may not be what the next one holds
+   for (int s = 0; s < PACKED_LUN_SLOTS; s++)
+      if (slots[s].lunNumber == lunNumber)
+         slots[s].lunNumber = MAX_LUNS;
+   free(p->index);
+   memset(p, 0, sizeof *p);
+}
+
+bool packedLunIsPacked(uint8_t lunNumber)
+{
+   return packedLuns[lunNumber].index != NULL;
+}
+
+uint32_t packedLunSectors(uint8_t lunNumber)
+{
+   return packedLuns[lunNumber].sectors;
+}
+
+// The slot holding a chunk decompressed, reading it from the card into the
+// one used longest ago if it is not there already.  NULL if it cannot be
+// read or is damaged.
+static const uint8_t *packedLunChunk(uint8_t lunNumber, uint32_t chunk)
+{
+   struct packedLun *p = &packedLuns[lunNumber];
+   const struct packedLunChunk *entry = &p->index[chunk];
+   uint32_t bytes = packedLunChunkBytes(p, chunk);
+   // A chunk is read to the end of its last card sector, which it is padded
+   // to, so that FatFs reads it all straight into the buffer rather than
+   // the last sector into a buffer of its own first.  That is never more
+   // than a whole chunk, as a chunk is whole sectors of the disc.
+   uint32_t padded = (entry->length + 511) / 512 * 512;
+   struct packedLunSlot *slot = NULL;
+   uint32_t oldest = 0;
+   bool unpacked;
+
+   useCounter++;
+   for (int s = 0; s < PACKED_LUN_SLOTS; s++) {
+      // An empty slot is older than any
+      uint32_t age = slots[s].lunNumber == MAX_LUNS ? UINT32_MAX : useCounter - slots[s].lastUsed;
+
+      if (slots[s].lunNumber == lunNumber && slots[s].chunk == chunk) {
+         slots[s].lastUsed = useCounter;
+         p->hits++;
+         return slots[s].data;
+      }
+      if (slot == NULL || age > oldest) {
+         slot = &slots[s];
+         oldest = age;
+      }
+   }
+
+   // The slot is not to be trusted until the chunk is in it
+   slot->lunNumber = MAX_LUNS;
+   p->reads++;
+   if (entry->length == bytes)
+      unpacked = packedRead(lunNumber, entry->offset, slot->data, padded);
+   else
+      unpacked = packedRead(lunNumber, entry->offset, compressed, padded)
+                 && lz4_decompress_block(compressed, entry->length, slot->data, bytes);
+   if (!unpacked)
+      return NULL;
+   slot->lunNumber = lunNumber;
+   slot->chunk = chunk;
+   slot->lastUsed = useCounter;
+   return slot->data;
+}
+
+bool packedLunRead(uint8_t lunNumber, uint32_t firstSector, uint8_t *buffer, uint32_t sectors)
+{
+   const struct packedLun *p = &packedLuns[lunNumber];
+
+   while (sectors != 0) {
+      uint32_t chunk = firstSector / p->chunkSectors;
+      uint32_t offset = firstSector % p->chunkSectors;
+      uint32_t n = p->chunkSectors - offset;
+      const uint8_t *data;
+
+      if (n > sectors)
+         n = sectors;
+      if (firstSector >= p->sectors) {
+         memset(buffer, 0, sectors * 256);
+         return true;
+      }
+      if (n > p->sectors - firstSector)
+         n = p->sectors - firstSector;
+
+      data = packedLunChunk(lunNumber, chunk);
+      if (data == NULL)
+         return false;
+      memcpy(buffer, data + offset * 256, n * 256);
+      firstSector += n;
+      buffer += n * 256;
+      sectors -= n;
+   }
+   return true;
+}
+
+void packedLunGetStats(uint8_t lunNumber, struct packedLunStats *stats)
+{
+   stats->chunks = packedLuns[lunNumber].chunks;
+   stats->reads = packedLuns[lunNumber].reads;
+   stats->hits = packedLuns[lunNumber].hits;
+}
@@ -0,0 +1,82 @@
+/************************************************************************
+	packedlun.h
+
+	BeebSCSI compressed (packed) read-only LUN images
+	Part of BeebSCSI as used in Pi1MHz; GPL v3 like the rest of it.
+
+************************************************************************/
+
+#ifndef PACKEDLUN_H_
+#define PACKEDLUN_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// A scsiN.dat can be a packed image rather than a flat copy of the disc.
+//
+// VFS volumes are never written, and a Domesday volume is mostly text and
+// maps that compress well, so holding them flat costs SD card space and,
+// worse, time: every sector the Beeb reads has to come off the card.  A
+// packed image holds the disc in chunks, each compressed on its own as an
+// LZ4 block (lz4_block.h), with an index of where each one is, so a read
+// of the disc is a read of a chunk's compressed bytes and a decompression.
+// The last few chunks decompressed are kept, so reading a chunk through a
+// sector or a few at a time reads the card once.
+//
+// Chunks of 64K pack best and make reading a volume through fastest, but
+// a sector read on its own costs a whole chunk; a disc read a sector here
+// and there, as ADFS reads its directories, is better off in smaller ones.
+//
+// A packed image is read-only: writes to it are refused, unless the LUN
+// has an overlay (a scsiN.cow) to take them.  tools/pack_lun.py packs a
+// flat image on a PC, unpacks one, and checks one.
+//
+// The layout, little endian throughout:
+//
+//    0     8 bytes "BSCSILZ4"
+//    8     version (1)
+//    12    sectors per chunk: a power of two from 16 (4K) to 256 (64K)
+//    16    sectors on the disc
+//    512   the index: for each chunk, the 32 bit offset of its data in the
+//          file, then its 32 bit length
+//    ...   the chunks, each starting on a 512 byte boundary and padded to
+//          the next so that it is read in whole card sectors.  One whose
+//          length is that of the chunk (the last may be short) is held as
+//          it is, not compressed.
+
+#define PACKED_LUN_CHUNK_SECTORS     256   // the most a chunk can hold
+#define PACKED_LUN_CHUNK_SECTORS_MIN 16
+#define PACKED_LUN_CHUNK_SIZE        (PACKED_LUN_CHUNK_SECTORS * 256)
+#define PACKED_LUN_HEADER_SIZE   512
+
+// How the packed layer reads bytes of the image file; a read past its end
+// must give zeros
+typedef bool (*packedLunReadFn)(uint8_t lunNumber, uint32_t offset, uint8_t *buffer, uint32_t length);
+
+struct packedLunStats
+{
+   uint32_t chunks;        // chunks of the disc
+   uint32_t reads;         // ... read from the card since the LUN was opened
+   uint32_t hits;          // ... found already decompressed
+};
+
+void packedLunInitialise(packedLunReadFn read);
+
+// Look at the header of a LUN image fileSize bytes long that has just been
+// opened.  False if it is a packed image that cannot be used (damaged, or
+// no memory for its index); a flat image is fine, and is left to
+// filesystem.c.
+bool packedLunOpen(uint8_t lunNumber, uint32_t fileSize);
+
+void packedLunClose(uint8_t lunNumber);
+bool packedLunIsPacked(uint8_t lunNumber);
+
+// Sectors on the disc of an open packed image
+uint32_t packedLunSectors(uint8_t lunNumber);
+
+// Sectors past the end of the disc read as zeros, as a short flat image's do
+bool packedLunRead(uint8_t lunNumber, uint32_t firstSector, uint8_t *buffer, uint32_t sectors);
+
+void packedLunGetStats(uint8_t lunNumber, struct packedLunStats *stats);
+
+#endif /* PACKEDLUN_H_ */
@@ -88,6 +88,9 @@
 #define BAD_ARG         (0x24u<<24)
 #define INTERLEAVE_ERROR (0x1Au<<24)
 
+// The most 256 byte blocks a LUN image can have: FAT files stop short of 4GB
+#define SCSI_MAX_BLOCKS 0x00FFFFFFu
+
 // REQUEST SENSE command error reporting structure
 static uint32_t requestSenseData[MAX_LUNS];
 
@@ -122,9 +125,17 @@ static uint8_t scsiCommandTestUnitReady(void);
 static uint8_t scsiCommandRezeroUnit(void);
 static uint8_t scsiCommandRequestSense(void);
 static uint8_t scsiCommandFormat(void);
+static uint8_t scsiCommandFormatBusy(void);
+static uint8_t scsiFormatFinished(enum filesystemJobStatus formatStatus);
 static uint8_t scsiCommandReassignBlocks(void);
 static uint8_t scsiCommandRead6(void);
 static uint8_t scsiCommandWrite6(void);
+static uint8_t scsiCommandRead10(void);
+static uint8_t scsiCommandWrite10(void);
+static bool scsiAutoStartLun(void);
+static bool scsiGroup1Blocks(uint32_t *logicalBlockAddress, uint32_t *numberOfBlocks);
+static uint8_t scsiReadBlocks(uint32_t logicalBlockAddress, uint32_t numberOfBlocks);
+static uint8_t scsiWriteBlocks(uint32_t logicalBlockAddress, uint32_t numberOfBlocks);
 static uint8_t scsiCommandSeek(void);
 static uint8_t scsiCommandTranslate(void);
 static uint8_t scsiCommandModeSelect6(void);
@@ -132,6 +143,8 @@ static uint8_t scsiCommandModeSense6(void);
 static uint8_t scsiCommandStartStop(void);
 static uint8_t scsiCommandCertify(void);
 static uint8_t scsiCommandVerify(void);
+static uint8_t scsiCommandVerifyBusy(void);
+static uint8_t scsiVerifyFailed(void);
 static uint8_t scsiCommandReadCapacity(void);
 static uint8_t scsiCommandReadDefectData10(void);
 static uint8_t scsiCommandInquiry(void);
@@ -225,10 +238,26 @@ void scsiReset(uint8_t scsiid)
    ourscsiid = scsiid; // Set the SCSI ID for this device
    fcodeClearBuffer(); // clear the FCODE buffer
 
+   // Drop a FORMAT or VERIFY that was part way through
+   filesystemFormatLunAbandon();
+
    // Ensure the SCSI bus phase is BUS FREE
    scsiState = SCSI_BUSFREE;
 }
 
+// Where scsiEmulationBusFree() is: 0 about to drop the bus, 1 waiting to be
+// selected
+static uint8_t scsiEmulationBusFreestate = 0;
+
+// True while the emulation is parked in BUS FREE waiting for the host to
+// select it.  Nothing can change that but the host's nSEL write, so until
+// then scsiProcessEmulation() has nothing to do.
+bool scsiWaitingForSelection(void)
+{
+   return (scsiState == SCSI_BUSFREE) && (scsiEmulationBusFreestate == 1)
+          && !hostadapterReadSelectFlag();
+}
+
 // Process the SCSI emulation
 void scsiProcessEmulation(void)
 {
@@ -248,6 +277,8 @@ void scsiProcessEmulation(void)
       case SCSI_REASSIGNBLOCKS:scsiState = scsiCommandReassignBlocks();break;
       case SCSI_READ6:         scsiState = scsiCommandRead6();         break;
       case SCSI_WRITE6:        scsiState = scsiCommandWrite6();        break;
+      case SCSI_READ10:        scsiState = scsiCommandRead10();        break;
+      case SCSI_WRITE10:       scsiState = scsiCommandWrite10();       break;
       case SCSI_SEEK:          scsiState = scsiCommandSeek();          break;
       case SCSI_TRANSLATE:     scsiState = scsiCommandTranslate();     break;
       case SCSI_MODESELECT6:   scsiState = scsiCommandModeSelect6();   break;
@@ -273,6 +304,10 @@ void scsiProcessEmulation(void)
       // Handle Vendor specific group 7 commands
       case SCSI_CERTIFY: scsiState = scsiCommandCertify(); break;
 
+      // Commands too long for one pass, carried on from the last
+      case SCSI_FORMAT_BUSY: scsiState = scsiCommandFormatBusy(); break;
+      case SCSI_VERIFY_BUSY: scsiState = scsiCommandVerifyBusy(); break;
+
       default:
       if (debugFlag_scsiState) debugString_P(PSTR("SCSI State: ERROR: Invalid SCSI state!\r\n"));
    }
@@ -334,7 +369,6 @@ static void scsiInformationTransferPhase(uint8_t transferPhase)
 // SCSI Bus free state
 static uint8_t scsiEmulationBusFree(void)
 {
-   static uint8_t scsiEmulationBusFreestate = 0;
    switch (scsiEmulationBusFreestate)
    {
       case 0:
@@ -467,6 +501,8 @@ uint8_t scsiEmulationCommand(void)
       // Select group 1 command type
       switch (opCode) {
          case 0x05: return SCSI_READCAPACITY;     break;
+         case 0x08: return SCSI_READ10;           break;
+         case 0x0A: return SCSI_WRITE10;          break;
          case 0x0F: return SCSI_VERIFY;           break;
          case 0x17: return SCSI_READDEFECTDATA10; break;
       }
@@ -775,7 +811,29 @@ static uint8_t scsiCommandFormat(void)
 
    // Create/recreate the LUN data file according to the drive descriptor and fill
    // with the required data pattern byte:
-   if (!filesystemFormatLun(commandDataBlock.targetLUN, dataPattern)) {
+   return scsiFormatFinished(filesystemFormatLun(commandDataBlock.targetLUN, dataPattern));
+}
+
+// The rest of a FORMAT: the image is grown a piece a pass.  BSY stays set
+// and REQ does not, which to the host is a drive busy formatting, as a real
+// one would be.
+static uint8_t scsiCommandFormatBusy(void)
+{
+   // Reset?  The image is left short, and the LUN stopped
+   if (hostadapterReadResetFlag()) {
+      filesystemFormatLunAbandon();
+      return SCSI_BUSFREE;
+   }
+
+   return scsiFormatFinished(filesystemFormatLunContinue());
+}
+
+// Carry on with, fail or finish a FORMAT
+static uint8_t scsiFormatFinished(enum filesystemJobStatus formatStatus)
+{
+   if (formatStatus == FILESYSTEM_JOB_BUSY) return SCSI_FORMAT_BUSY;
+
+   if (formatStatus == FILESYSTEM_JOB_FAILED) {
       // Formatting failed...
       if (debugFlag_scsiCommands) debugString_P(PSTR("SCSI Commands: Format failed\r\n"));
 
@@ -931,8 +989,6 @@ static uint8_t scsiCommandRead6(void)
 {
    uint32_t logicalBlockAddress = 0;
    uint32_t numberOfBlocks = 0;
-   uint32_t currentBlock = 0;
-   uint8_t *sectorPtr = 0;
 
    if (debugFlag_scsiCommands) {
       debugString_P(PSTR("SCSI Commands: READ6 command (0x08) received\r\n"));
@@ -940,48 +996,114 @@ static uint8_t scsiCommandRead6(void)
    }
 
    // Make sure the target LUN is started
-   if (!filesystemReadLunStatus(commandDataBlock.targetLUN)) {
-      // Target LUN is not started.  If the LUN is present, then start it, otherwise
-      // return an error.  Note: The original Adaptec SCSI host adapter would always
-      // auto-start a LUN if it was present, so we duplicate that behavior here even
-      // though it is 'more correct' (according to the specs) to return with error
+   if (!scsiAutoStartLun()) return SCSI_STATUS;
 
-      // Is the requested LUN available?
-      if (debugFlag_scsiCommands) debugString_P(PSTR("\r\nSCSI Commands: Attempting to Auto-Start LUN (as it is currently STOPped)\r\n"));
+   // Get the starting logical block address from the CDB
+   logicalBlockAddress = (((uint32_t)commandDataBlock.data[1] & 0x1F) << 16) |
+   ((uint32_t)commandDataBlock.data[2] << 8) |
+   ((uint32_t)commandDataBlock.data[3]);
 
-      // If a host transfer (MTP/WebDAV) is rewriting this image, take it back
-      // rather than refusing the Beeb: the transfer aborts itself when it
-      // notices, and the LUN starts normally here. Refusing instead is what
-      // hung the machine in 8d8389e.
-      filesystemHostRevokeLun(commandDataBlock.targetLUN);
+   // Get the requested number of blocks from the CDB
+   numberOfBlocks = (uint32_t)commandDataBlock.data[4];
+   if (numberOfBlocks == 0) numberOfBlocks = 256; // 0 = 256 blocks according to the SCSI specification
 
-      // Auto-start the LUN
-      if (!filesystemSetLunStatus(commandDataBlock.targetLUN, true)) {
-         // Could not start LUN... return with error status
-         if (debugFlag_scsiCommands) debugStringInt16_P(PSTR("SCSI Commands: Could not auto-start LUN #"), commandDataBlock.targetLUN, true);
-         commandDataBlock.status = SCSI_STATUS_CHECK_COND; // 0x02 = Bad
+   return scsiReadBlocks(logicalBlockAddress, numberOfBlocks);
+}
 
-         // Set request sense error globals
-         requestSenseData[commandDataBlock.targetLUN] = BAD_FORMAT; // 1C Bad format
+// SCSI Command (0x28) Read10
+//
+// The group 1 form of READ: a 4 byte LBA and a 16-bit number of blocks, so
+// an image can be larger than the 21-bit LBA of READ6 allows (512MB) and a
+// transfer longer than 256 blocks.  Unlike READ6 a number of blocks of 0
+// means no blocks.  An LBA past 4GB, the largest file FAT allows, is
+// rejected rather than wrapped.
+static uint8_t scsiCommandRead10(void)
+{
+   uint32_t logicalBlockAddress = 0;
+   uint32_t numberOfBlocks = 0;
 
-         return SCSI_STATUS;
-      }
+   if (debugFlag_scsiCommands) {
+      debugString_P(PSTR("SCSI Commands: READ10 command (0x28) received\r\n"));
+      debugStringInt16_P(PSTR("SCSI Commands: Target LUN = "), commandDataBlock.targetLUN, false);
+   }
+
+   // Make sure the target LUN is started
+   if (!scsiAutoStartLun()) return SCSI_STATUS;
+
+   if (!scsiGroup1Blocks(&logicalBlockAddress, &numberOfBlocks)) return SCSI_STATUS;
+
+   return scsiReadBlocks(logicalBlockAddress, numberOfBlocks);
+}
+
+// Auto-start the target LUN of a READ or WRITE if it is stopped.  False,
+// with the error status set, if it cannot be started.
+static bool scsiAutoStartLun(void)
+{
+   if (filesystemReadLunStatus(commandDataBlock.targetLUN)) return true;
+
+   // Target LUN is not started.  If the LUN is present, then start it, otherwise
+   // return an error.  Note: The original Adaptec SCSI host adapter would always
+   // auto-start a LUN if it was present, so we duplicate that behavior here even
+   // though it is 'more correct' (according to the specs) to return with error
+
+   // Is the requested LUN available?
+   if (debugFlag_scsiCommands) debugString_P(PSTR("\r\nSCSI Commands: Attempting to Auto-Start LUN (as it is currently STOPped)\r\n"));
+
+   // If a host transfer (MTP/WebDAV) is rewriting this image, take it back
+   // rather than refusing the Beeb: the transfer aborts itself when it
+   // notices, and the LUN starts normally here. Refusing instead is what
+   // hung the machine in 8d8389e.
+   filesystemHostRevokeLun(commandDataBlock.targetLUN);
+
+   // Auto-start the LUN
+   if (!filesystemSetLunStatus(commandDataBlock.targetLUN, true)) {
+      // Could not start LUN... return with error status
+      if (debugFlag_scsiCommands) debugStringInt16_P(PSTR("SCSI Commands: Could not auto-start LUN #"), commandDataBlock.targetLUN, true);
+      commandDataBlock.status = SCSI_STATUS_CHECK_COND; // 0x02 = Bad
+
+      // Set request sense error globals
+      requestSenseData[commandDataBlock.targetLUN] = BAD_FORMAT; // 1C Bad format
+
+      return false;
+   }
+
+   if (debugFlag_scsiCommands) {
+      debugString_P(PSTR("SCSI Commands: Requested LUN has been auto-started\r\n"));
+      // Output the initial debug again (as the command debug information is appended to it)
+      debugStringInt16_P(PSTR("SCSI Commands: Target LUN = "), commandDataBlock.targetLUN, false);
+   }
+   return true;
+}
+
+// Get the LBA and number of blocks of a group 1 READ, WRITE or VERIFY from
+// the CDB.  False, with the error status set, if they go past 4GB.
+static bool scsiGroup1Blocks(uint32_t *logicalBlockAddress, uint32_t *numberOfBlocks)
+{
+   *logicalBlockAddress =
+      ((uint32_t)commandDataBlock.data[2] << 24) |
+      ((uint32_t)commandDataBlock.data[3] << 16) |
+      ((uint32_t)commandDataBlock.data[4] << 8) |
+      ((uint32_t)commandDataBlock.data[5]);
+   *numberOfBlocks = ((uint32_t)commandDataBlock.data[7] << 8) | ((uint32_t)commandDataBlock.data[8]);
 
+   if (*logicalBlockAddress > SCSI_MAX_BLOCKS || *numberOfBlocks > SCSI_MAX_BLOCKS - *logicalBlockAddress) {
       if (debugFlag_scsiCommands) {
-         debugString_P(PSTR("SCSI Commands: Requested LUN has been auto-started\r\n"));
-         // Output the initial debug again (as the command debug information is appended to it)
-         debugStringInt16_P(PSTR("SCSI Commands: Target LUN = "), commandDataBlock.targetLUN, false);
+         debugStringInt32_P(PSTR(", LBA = "), *logicalBlockAddress, false);
+         debugStringInt32_P(PSTR(", Blocks = "), *numberOfBlocks, true);
+         debugString_P(PSTR("SCSI Commands: ERROR: Requested LBA is out-of-range\r\n"));
       }
+      commandDataBlock.status = SCSI_STATUS_CHECK_COND; // 0x02 = Bad
+      requestSenseData[commandDataBlock.targetLUN] = ILLEGAL_ADDR | (*logicalBlockAddress & 0x00FFFFFF); // Illegal block address
+      return false;
    }
+   return true;
+}
 
-   // Get the starting logical block address from the CDB
-   logicalBlockAddress = (((uint32_t)commandDataBlock.data[1] & 0x1F) << 16) |
-   ((uint32_t)commandDataBlock.data[2] << 8) |
-   ((uint32_t)commandDataBlock.data[3]);
-
-   // Get the requested number of blocks from the CDB
-   numberOfBlocks = (uint32_t)commandDataBlock.data[4];
-   if (numberOfBlocks == 0) numberOfBlocks = 256; // 0 = 256 blocks according to the SCSI specification
+// Send blocks from the LUN image to the host: the data phase of READ6 and READ10
+static uint8_t scsiReadBlocks(uint32_t logicalBlockAddress, uint32_t numberOfBlocks)
+{
+   uint32_t currentBlock = 0;
+   uint8_t *sectorPtr = 0;
 
    // Show the command debug information
    if (debugFlag_scsiCommands) {
@@ -989,6 +1111,12 @@ static uint8_t scsiCommandRead6(void)
       debugStringInt32_P(PSTR(", Blocks = "), numberOfBlocks, true);
    }
 
+   // A group 1 command may ask for no blocks at all, which has no data phase
+   if (numberOfBlocks == 0) {
+      commandDataBlock.status = SCSI_STATUS_OK; // 0x00 = Good
+      return SCSI_STATUS;
+   }
+
    // Set up the control signals ready for the data in phase
    scsiInformationTransferPhase(ITPHASE_DATAIN);
 
@@ -1060,7 +1188,7 @@ static uint8_t scsiCommandRead6(void)
 
    // Indicate successful transfer in status and message
    commandDataBlock.status = SCSI_STATUS_OK; // 0x00 = Good
-   if (debugFlag_scsiCommands) debugString_P(PSTR("SCSI Commands: Read6 command successful\r\n"));
+   if (debugFlag_scsiCommands) debugString_P(PSTR("SCSI Commands: Read command successful\r\n"));
 
    // Transition to the successful state
    return SCSI_STATUS;
@@ -1084,7 +1212,6 @@ static uint8_t scsiCommandWrite6(void)
 {
    uint32_t logicalBlockAddress = 0;
    uint32_t numberOfBlocks = 0;
-   uint32_t currentBlock = 0;
 
    if (debugFlag_scsiCommands) {
       debugString_P(PSTR("SCSI Commands: WRITE6 command (0x0A) received\r\n"));
@@ -1092,34 +1219,7 @@ static uint8_t scsiCommandWrite6(void)
    }
 
    // Make sure the target LUN is started
-   if (!filesystemReadLunStatus(commandDataBlock.targetLUN)) {
-      // Target LUN is not started.  If the LUN is present, then start it, otherwise
-      // return an error.  Note: The original Adaptec SCSI host adapter would always
-      // auto-start a LUN if it was present, so we duplicate that behavior here even
-      // though it is 'more correct' (according to the specs) to return with error
-
-      // Is the requested LUN available?
-      if (debugFlag_scsiCommands) debugString_P(PSTR("\r\nSCSI Commands: Attempting to Auto-Start LUN (as it is currently STOPped)\r\n"));
-
-      // If a host transfer (MTP/WebDAV) is rewriting this image, take it back
-      // rather than refusing the Beeb: the transfer aborts itself when it
-      // notices, and the LUN starts normally here. Refusing instead is what
-      // hung the machine in 8d8389e.
-      filesystemHostRevokeLun(commandDataBlock.targetLUN);
-
-      // Auto-start the LUN
-      if (!filesystemSetLunStatus(commandDataBlock.targetLUN, true)) {
-         // Could not start LUN... return with error status
-         if (debugFlag_scsiCommands) debugStringInt16_P(PSTR("SCSI Commands: Could not auto-start LUN #"), commandDataBlock.targetLUN, true);
-         commandDataBlock.status = SCSI_STATUS_CHECK_COND; // 0x02 = Bad
-
-         // Set request sense error globals
-         requestSenseData[commandDataBlock.targetLUN] = BAD_FORMAT; // 1C Bad format
-         return SCSI_STATUS;
-      }
-
-      if (debugFlag_scsiCommands) debugString_P(PSTR("SCSI Commands: Requested LUN has been auto-started\r\n"));
-   }
+   if (!scsiAutoStartLun()) return SCSI_STATUS;
 
    // Get the starting logical block address from the CDB
    logicalBlockAddress = (((uint32_t)commandDataBlock.data[1] & 0x1F) << 16) |
@@ -1130,12 +1230,48 @@ static uint8_t scsiCommandWrite6(void)
    numberOfBlocks = (uint32_t)commandDataBlock.data[4];
    if (numberOfBlocks == 0) numberOfBlocks = 256; // 0 = 256 blocks according to the SCSI specification
 
+   return scsiWriteBlocks(logicalBlockAddress, numberOfBlocks);
+}
+
+// SCSI Command (0x2A) Write10
+//
+// The group 1 form of WRITE - see Read10.
+static uint8_t scsiCommandWrite10(void)
+{
+   uint32_t logicalBlockAddress = 0;
+   uint32_t numberOfBlocks = 0;
+
+   if (debugFlag_scsiCommands) {
+      debugString_P(PSTR("SCSI Commands: WRITE10 command (0x2A) received\r\n"));
+      debugStringInt16_P(PSTR("SCSI Commands: Target LUN = "), commandDataBlock.targetLUN, false);
+   }
+
+   // Make sure the target LUN is started
+   if (!scsiAutoStartLun()) return SCSI_STATUS;
+
+   if (!scsiGroup1Blocks(&logicalBlockAddress, &numberOfBlocks)) return SCSI_STATUS;
+
+   return scsiWriteBlocks(logicalBlockAddress, numberOfBlocks);
+}
+
+// Take blocks from the host and write them to the LUN image: the data phase
+// of WRITE6 and WRITE10
+static uint8_t scsiWriteBlocks(uint32_t logicalBlockAddress, uint32_t numberOfBlocks)
+{
+   uint32_t currentBlock = 0;
+
    // Show the command debug information
    if (debugFlag_scsiCommands) {
       debugStringInt32_P(PSTR(", LBA = "), logicalBlockAddress, false);
       debugStringInt32_P(PSTR(", Blocks = "), numberOfBlocks, true);
    }
 
+   // A group 1 command may ask for no blocks at all, which has no data phase
+   if (numberOfBlocks == 0) {
+      commandDataBlock.status = SCSI_STATUS_OK; // 0x00 = Good
+      return SCSI_STATUS;
+   }
+
    // Set up the control signals ready for the data out phase
    scsiInformationTransferPhase(ITPHASE_DATAOUT);
 
@@ -1157,8 +1293,8 @@ static uint8_t scsiCommandWrite6(void)
    // Transfer the requested blocks from the host to the LUN image
    if (debugFlag_scsiCommands) debugString_P(PSTR("SCSI Commands: Transferring requested blocks from the host...\r\n"));
    for (currentBlock = 0; currentBlock < numberOfBlocks; currentBlock++) {
-      uint8_t Buffer[256];
-      // Get the data from the host
+      // Get the data from the host, straight into the file system's sector buffer
+      uint8_t *Buffer = filesystemWriteSectorBuffer();
       cli();
       DEBUG_bytesTransferred(hostadapterPerformWriteDMA(Buffer));
       sei();
@@ -1207,7 +1343,7 @@ static uint8_t scsiCommandWrite6(void)
 
    // Indicate successful transfer in status and message
    commandDataBlock.status = SCSI_STATUS_OK; // 0x00 = Good
-   if (debugFlag_scsiCommands) debugString_P(PSTR("SCSI Commands: Write6 command successful\r\n"));
+   if (debugFlag_scsiCommands) debugString_P(PSTR("SCSI Commands: Write command successful\r\n"));
 
    // Transition to the successful state
    return SCSI_STATUS;
@@ -1729,6 +1865,9 @@ static uint8_t scsiCommandStartStop(void)
    return SCSI_STATUS;
 }
 
+// Blocks of the VERIFY in progress still to be read
+static uint32_t scsiVerifyBlocksLeft = 0;
+
 // SCSI Command (0x2F) Verify
 //
 // Adaptec ACB-4000 Manual notes:
@@ -1745,12 +1884,15 @@ static uint8_t scsiCommandStartStop(void)
 // Note: This function is used by the *VERIFY command provided in the
 //       library directory of the BBC Master welcome disc
 //
-// This implementation only verifies the LUN is available, and the LBAs
-// given are within range on the LUN.
+// This implementation checks the LUN is available and the blocks given are
+// within range on it, and reads them from the LUN image.  A number of blocks
+// of 0 checks only the LBA.  The reading is done by scsiCommandVerifyBusy(),
+// a sector buffer a pass: 65535 blocks is 16MB of the card.
 //
 static uint8_t scsiCommandVerify(void)
 {
    uint32_t logicalBlockAddress = 0;
+   uint32_t numberOfBlocks = 0;
    uint32_t lunSizeInSectors = 0;
 
    if (debugFlag_scsiCommands) {
@@ -1767,32 +1909,21 @@ static uint8_t scsiCommandVerify(void)
       return SCSI_STATUS;
    }
 
-   // Get the logical block address from the CDB (note: this is different from G0 commands
-   // as 4 bytes of LBA are provided)
-   logicalBlockAddress =
-      ((uint32_t)commandDataBlock.data[2] << 24) |
-      ((uint32_t)commandDataBlock.data[3] << 16) |
-      ((uint32_t)commandDataBlock.data[4] << 8) |
-      ((uint32_t)commandDataBlock.data[5]);
+   // Get the logical block address and number of blocks from the CDB (note: this is
+   // different from G0 commands as 4 bytes of LBA are provided)
+   if (!scsiGroup1Blocks(&logicalBlockAddress, &numberOfBlocks)) return SCSI_STATUS;
 
    // Show the command debug information
    if (debugFlag_scsiCommands) {
-      // Get the requested number of blocks
-      // Get the requested number of blocks from the CDB
-
-      // If the number of blocks is 0, set to the maximum of 65536
       debugStringInt32_P(PSTR(", LBA = "), logicalBlockAddress, false);
-      debugStringInt32_P(PSTR(", number of blocks = "),
-      ((((uint32_t)commandDataBlock.data[7] << 8) | ((uint32_t)commandDataBlock.data[8]))==0)?65536:
-        ((uint32_t)commandDataBlock.data[7] << 8) | ((uint32_t)commandDataBlock.data[8])
-      , true);
+      debugStringInt32_P(PSTR(", number of blocks = "), numberOfBlocks, true);
    }
 
 	// Read the cached parameters
 	lunSizeInSectors = filesystemGetLunTotalSectors(commandDataBlock.targetLUN);
 
-   // Check that the LBA is within range of the LUN size
-   if (logicalBlockAddress >= lunSizeInSectors) {
+   // Check that the blocks are within range of the LUN size
+   if (logicalBlockAddress >= lunSizeInSectors || numberOfBlocks > lunSizeInSectors - logicalBlockAddress) {
       // Out of range
       if (debugFlag_scsiCommands) debugString_P(PSTR("SCSI Commands: ERROR: Requested LBA is out-of-range for the LUN size - Verify failed\r\n"));
 
@@ -1803,16 +1934,45 @@ static uint8_t scsiCommandVerify(void)
       requestSenseData[commandDataBlock.targetLUN] = ILLEGAL_ADDR | (logicalBlockAddress & 0x00FFFFFF); // Illegal block address
 
       return SCSI_STATUS;
-   } else {
-      // In range
+   }
 
-      // Indicate successful command in status and message
-      commandDataBlock.status = SCSI_STATUS_OK; // 0x00 = Good
+   // The medium is the SD card: verifying a block is reading it
+   scsiVerifyBlocksLeft = numberOfBlocks;
+   if (numberOfBlocks != 0 && !filesystemOpenLunForRead(commandDataBlock.targetLUN, logicalBlockAddress, numberOfBlocks))
+      return scsiVerifyFailed();
+
+   return scsiCommandVerifyBusy();
+}
+
+// Read the next sector buffer's worth of the blocks a VERIFY covers
+static uint8_t scsiCommandVerifyBusy(void)
+{
+   uint8_t *sectorPtr;
+
+   // Reset?
+   if (hostadapterReadResetFlag()) return SCSI_BUSFREE;
+
+   for (uint32_t sector = 0; sector < SECTOR_BUFFER_LENGTH && scsiVerifyBlocksLeft != 0; sector++) {
+      if (!filesystemReadNextSector(commandDataBlock.targetLUN, &sectorPtr))
+         return scsiVerifyFailed();
+      scsiVerifyBlocksLeft--;
    }
+   if (scsiVerifyBlocksLeft != 0) return SCSI_VERIFY_BUSY;
+
+   // Indicate successful command in status and message
+   commandDataBlock.status = SCSI_STATUS_OK; // 0x00 = Good
 
    return SCSI_STATUS;
 }
 
+static uint8_t scsiVerifyFailed(void)
+{
+   if (debugFlag_scsiCommands) debugString_P(PSTR("SCSI Commands: ERROR: Could not read LUN image - Verify failed\r\n"));
+   commandDataBlock.status = SCSI_STATUS_CHECK_COND; // 0x02 = Bad
+   requestSenseData[commandDataBlock.targetLUN] = DRIVE_NOT_READY; // Drive not ready
+   return SCSI_STATUS;
+}
+
 // SCSI Command (0x25) Read Capacity
 //
 // Adaptec ACB-4000 Manual notes:
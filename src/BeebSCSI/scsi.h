@@ -58,6 +58,8 @@
 #define SCSI_VERIFY			24
 #define SCSI_READCAPACITY	25
 #define SCSI_READDEFECTDATA10 26
+#define SCSI_READ10			27
+#define SCSI_WRITE10		28
 
 // SCSI emulation command states (Group 7 commands)
 // vendor unique
@@ -67,6 +69,10 @@
 #define SCSI_WRITE_FCODE	30
 #define SCSI_READ_FCODE		31
 
+// SCSI emulation states of a command carried on a piece a poll pass
+#define SCSI_FORMAT_BUSY	32
+#define SCSI_VERIFY_BUSY	33
+
 // SCSI emulation command states (BeebSCSI Group 6 commands)
 #define SCSI_BEEBSCSI_SENSE		40
 #define SCSI_BEEBSCSI_SELECT	41
@@ -93,5 +99,6 @@ void scsiReset(uint8_t scsiid);
 bool scsiJukebox (uint8_t lun);
 
 void scsiProcessEmulation(void);
+bool scsiWaitingForSelection(void);
 
 #endif /* SCSI_H_ */
\ No newline at end of file
@@ -0,0 +1,284 @@
+/************************************************************************
+	sectorcache.c
+
+	BeebSCSI LUN sector cache - see sectorcache.h
+	Part of BeebSCSI as used in Pi1MHz; GPL v3 like the rest of it.
+
+************************************************************************/
+
+/*
+ The blocks are a plain array searched from the start: there are a few
+ dozen of them, and a read looks one up once per 16 sectors. Each block has
+ an LRU stamp from a running clock; 0 means let go first, which is where a
+ free block and a block a stream has finished with both sit.
+
+ A miss reads the block and the ones after it that are not cached, up to the
+ end of the request plus the LUN's read-ahead window. A single block is read
+ straight into place; a run of them is read in one go into the buffer
+ filesystem.c lends, which is its sector buffer - a write never has
+ anything in that while a read is going on - and copied out. Read-ahead
+ stops at the end of the image; blocks of the request itself past the end
+ read as zeros, as they always have, without asking filesystem.c at all.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "sectorcache.h"
+#include "filesystem.h"
+#include "../config.h"
+
+#define SECTOR_CACHE_DEFAULT   (256 * 1024)
+#define SECTOR_CACHE_MIN       16    // blocks, or it is not worth having
+#define SECTOR_CACHE_AHEAD_MIN 2     // blocks read ahead once a stream is seen
+#define SECTOR_CACHE_AHEAD_MAX 16    // ... doubling up to 64K
+#define SECTOR_CACHE_NONE      0xFFFFFFFF
+
+struct sectorCacheBlock
+{
+   uint32_t block;         // block number in the image, SECTOR_CACHE_NONE when free
+   uint32_t used;          // LRU stamp
+   uint32_t command;       // the read it was fetched for
+   uint8_t lun;
+   bool ahead;             // read ahead and not yet read by the host
+   uint8_t *data;
+};
+
+struct sectorCacheLun
+{
+   uint32_t imageSectors;
+   uint32_t sector;        // next sector of the current read
+   uint32_t end;           // the sector after it
+   uint32_t nextSector;    // where the last read finished
+   uint32_t window;        // blocks to read ahead, 0 when not streaming
+   struct sectorCacheBlock *current;
+   struct sectorCacheStats stats;
+};
+
+static sectorCacheReadFn cacheRead;
+static struct sectorCacheBlock *cacheBlocks;
+static uint32_t cacheCount;
+static uint8_t *cacheBounce;
+static uint32_t cacheRun;          // blocks cacheBounce holds
+static uint32_t cacheClock;
+static uint32_t cacheCommand;
+static bool cacheTried;
+static struct sectorCacheLun cacheLun[MAX_LUNS];
+
+// scsi_cache from Pi1MHz.cfg, in bytes: a number with K or M after it
+static uint32_t sectorCacheConfigSize(void)
+{
+   const char *v = config_get("scsi_cache");
+   char *end;
+   unsigned long n;
+
+   if (v == NULL || v[0] == '\0')
+      return SECTOR_CACHE_DEFAULT;
+   n = strtoul(v, &end, 0);
+   if (*end == 'K' || *end == 'k')
+      n <<= 10;
+   else if (*end == 'M' || *end == 'm')
+      n <<= 20;
+   return (uint32_t)n;
+}
+
+bool sectorCacheInitialise(sectorCacheReadFn read, uint8_t *bounce, uint32_t bounceSize)
+{
+   cacheRead = read;
+   if (cacheTried)
+      return cacheBlocks != NULL;
+   cacheTried = true;
+
+   for (uint8_t lun = 0; lun < MAX_LUNS; lun++)
+      cacheLun[lun].nextSector = SECTOR_CACHE_NONE;
+
+   uint32_t count = sectorCacheConfigSize() / SECTOR_CACHE_BLOCK_SIZE;
+   if (count < SECTOR_CACHE_MIN)
+      return false;
+
+   cacheBlocks = calloc(count, sizeof *cacheBlocks);
+   uint8_t *pool = malloc((size_t)count * SECTOR_CACHE_BLOCK_SIZE);
+   if (cacheBlocks == NULL || pool == NULL) {
+      free(cacheBlocks);
+      free(pool);
+      cacheBlocks = NULL;
+      return false;
+   }
+   cacheBounce = bounce;
+   cacheRun = bounceSize / SECTOR_CACHE_BLOCK_SIZE;
+   if (cacheRun == 0)
+      cacheRun = 1;
+   for (uint32_t i = 0; i < count; i++) {
+      cacheBlocks[i].block = SECTOR_CACHE_NONE;
+      cacheBlocks[i].data = pool + (size_t)i * SECTOR_CACHE_BLOCK_SIZE;
+   }
+   cacheCount = count;
+   return true;
+}
+
+bool sectorCacheEnabled(void)
+{
+   return cacheBlocks != NULL;
+}
+
+static struct sectorCacheBlock *sectorCacheFind(uint8_t lunNumber, uint32_t block)
+{
+   for (uint32_t i = 0; i < cacheCount; i++)
+      if (cacheBlocks[i].block == block && cacheBlocks[i].lun == lunNumber)
+         return &cacheBlocks[i];
+   return NULL;
+}
+
+// The least recently used block; the blocks of the run being read have the
+// newest stamps, so are never it
+static struct sectorCacheBlock *sectorCacheVictim(void)
+{
+   struct sectorCacheBlock *victim = &cacheBlocks[0];
+
+   for (uint32_t i = 1; i < cacheCount && victim->used != 0; i++)
+      if (cacheBlocks[i].used < victim->used)
+         victim = &cacheBlocks[i];
+   return victim;
+}
+
+// Read up to count blocks from block into the cache, stopping short of one
+// already there; those from aheadFrom on are read-ahead.  The first block,
+// or NULL if the card could not be read.
+static struct sectorCacheBlock *sectorCacheFill(uint8_t lunNumber, uint32_t block, uint32_t count,
+                                                uint32_t aheadFrom)
+{
+   struct sectorCacheLun *l = &cacheLun[lunNumber];
+   struct sectorCacheBlock *first = NULL;
+   uint32_t sector = block * SECTOR_CACHE_BLOCK_SECTORS;
+   uint32_t n = 1;
+   uint8_t *buffer = cacheBounce;
+
+   while (n < count && n < cacheRun && sectorCacheFind(lunNumber, block + n) == NULL)
+      n++;
+   if (n == 1) {
+      first = sectorCacheVictim();
+      first->block = SECTOR_CACHE_NONE;
+      buffer = first->data;
+   }
+
+   // Past the end of a growing image is zeros
+   if (sector < l->imageSectors) {
+      if (!cacheRead(lunNumber, sector, buffer, n * SECTOR_CACHE_BLOCK_SECTORS))
+         return NULL;
+   } else
+      memset(buffer, 0, n * SECTOR_CACHE_BLOCK_SIZE);
+
+   for (uint32_t i = 0; i < n; i++) {
+      struct sectorCacheBlock *b = (n == 1) ? first : sectorCacheVictim();
+
+      b->block = block + i;
+      b->lun = lunNumber;
+      b->used = ++cacheClock;
+      b->command = cacheCommand;
+      b->ahead = block + i >= aheadFrom;
+      if (n != 1)
+         memcpy(b->data, cacheBounce + i * SECTOR_CACHE_BLOCK_SIZE, SECTOR_CACHE_BLOCK_SIZE);
+      if (b->ahead)
+         l->stats.readAhead++;
+      if (i == 0)
+         first = b;
+   }
+   return first;
+}
+
+void sectorCacheOpenRead(uint8_t lunNumber, uint32_t imageSectors, uint32_t startSector, uint32_t sectors)
+{
+   struct sectorCacheLun *l = &cacheLun[lunNumber];
+
+   // Carrying on from where the last read stopped: read further ahead
+   if (startSector == l->nextSector)
+      l->window = l->window ? l->window * 2 : SECTOR_CACHE_AHEAD_MIN;
+   else
+      l->window = 0;
+   if (l->window > SECTOR_CACHE_AHEAD_MAX)
+      l->window = SECTOR_CACHE_AHEAD_MAX;
+
+   l->imageSectors = imageSectors;
+   l->sector = startSector;
+   l->end = startSector + sectors;
+   l->nextSector = l->end;
+   l->current = NULL;
+   cacheCommand++;
+}
+
+bool sectorCacheReadNext(uint8_t lunNumber, uint8_t **buffer)
+{
+   struct sectorCacheLun *l = &cacheLun[lunNumber];
+   uint32_t block = l->sector / SECTOR_CACHE_BLOCK_SECTORS;
+   struct sectorCacheBlock *b = l->current;
+
+   if (b == NULL || b->block != block || b->lun != lunNumber) {
+      b = sectorCacheFind(lunNumber, block);
+      if (b == NULL) {
+         uint32_t endBlock = (l->end + SECTOR_CACHE_BLOCK_SECTORS - 1) / SECTOR_CACHE_BLOCK_SECTORS;
+         uint32_t imageBlocks = (l->imageSectors + SECTOR_CACHE_BLOCK_SECTORS - 1) / SECTOR_CACHE_BLOCK_SECTORS;
+         uint32_t limit = endBlock + l->window;
+
+         if (limit > imageBlocks)
+            limit = (imageBlocks > endBlock) ? imageBlocks : endBlock;
+         b = sectorCacheFill(lunNumber, block, limit - block, endBlock);
+         if (b == NULL)
+            return false;
+      } else if (b->ahead) {
+         b->ahead = false;
+         l->stats.readAheadUsed++;
+      }
+      l->current = b;
+   }
+
+   if (b->command == cacheCommand)
+      l->stats.misses++;
+   else
+      l->stats.hits++;
+   *buffer = b->data + (l->sector % SECTOR_CACHE_BLOCK_SECTORS) * 256;
+   l->sector++;
+
+   // A stream will not be back for a block it has read to the end
+   if (l->window != 0 && l->sector % SECTOR_CACHE_BLOCK_SECTORS == 0)
+      b->used = 0;
+   else
+      b->used = ++cacheClock;
+   return true;
+}
+
+void sectorCacheWrite(uint8_t lunNumber, uint32_t firstSector, const uint8_t *data, uint32_t sectors)
+{
+   uint32_t end = firstSector + sectors;
+
+   for (uint32_t i = 0; i < cacheCount; i++) {
+      struct sectorCacheBlock *b = &cacheBlocks[i];
+      uint32_t from = b->block * SECTOR_CACHE_BLOCK_SECTORS;
+      uint32_t to = from + SECTOR_CACHE_BLOCK_SECTORS;
+
+      if (b->block == SECTOR_CACHE_NONE || b->lun != lunNumber || to <= firstSector || from >= end)
+         continue;
+      if (from < firstSector)
+         from = firstSector;
+      if (to > end)
+         to = end;
+      memcpy(b->data + (from % SECTOR_CACHE_BLOCK_SECTORS) * 256,
+             data + (from - firstSector) * 256, (to - from) * 256);
+   }
+}
+
+void sectorCacheInvalidateLun(uint8_t lunNumber)
+{
+   for (uint32_t i = 0; i < cacheCount; i++)
+      if (cacheBlocks[i].lun == lunNumber) {
+         cacheBlocks[i].block = SECTOR_CACHE_NONE;
+         cacheBlocks[i].used = 0;
+      }
+   cacheLun[lunNumber].current = NULL;
+   cacheLun[lunNumber].window = 0;
+   cacheLun[lunNumber].nextSector = SECTOR_CACHE_NONE;
+}
+
+void sectorCacheGetStats(uint8_t lunNumber, struct sectorCacheStats *stats)
+{
+   *stats = cacheLun[lunNumber].stats;
+}
@@ -0,0 +1,73 @@
+/************************************************************************
+	sectorcache.h
+
+	BeebSCSI LUN sector cache
+	Part of BeebSCSI as used in Pi1MHz; GPL v3 like the rest of it.
+
+************************************************************************/
+
+#ifndef SECTORCACHE_H_
+#define SECTORCACHE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// LUN sectors cached under filesystemReadNextSector().
+//
+// ADFS reads its free space map and the directories it walks over and
+// over, and each read used to go to the SD card: the sector buffer was
+// refilled for every command.  The cache holds 4K blocks of the LUN
+// images - 16 sectors, lined up with the image so a block is one run of
+// SD card sectors - shared between all the LUNs, the least recently used
+// block making way.  A size of scsi_cache in Pi1MHz.cfg (default 256K, 0
+// for none) sets how much memory it takes.
+//
+// Each LUN notes where its last read finished.  A read that carries on
+// from there is a sequential stream - *LOAD, *COPY, a game loading - and
+// the cache reads further ahead of it each time, up to 64K past the end
+// of the request, so the next command finds its sectors already there.
+// Blocks a stream has read are put at the cold end of the LRU order, so
+// copying a large file does not push the catalogue out.
+//
+// The host's writes are copied into any blocks they cover, and a LUN's
+// blocks are dropped when it is stopped, so nothing stale is ever read.
+
+#define SECTOR_CACHE_BLOCK_SECTORS 16
+#define SECTOR_CACHE_BLOCK_SIZE    (SECTOR_CACHE_BLOCK_SECTORS * 256)
+
+struct sectorCacheStats
+{
+   uint32_t hits;          // sectors read from the cache
+   uint32_t misses;        // sectors that had to come from the card
+   uint32_t readAhead;     // blocks read ahead of the host
+   uint32_t readAheadUsed; // ... and then read by it
+};
+
+// How the cache reads sectors of a LUN image; it is only asked for
+// sectors that start inside the image, and any past its end must read as
+// zeros
+typedef bool (*sectorCacheReadFn)(uint8_t lunNumber, uint32_t firstSector, uint8_t *buffer, uint32_t sectors);
+
+// Allocate the cache, once; false if it is off or there is no memory.
+// bounce is lent for reading runs of blocks in one go, and is only used
+// inside sectorCacheReadNext().
+bool sectorCacheInitialise(sectorCacheReadFn read, uint8_t *bounce, uint32_t bounceSize);
+bool sectorCacheEnabled(void);
+
+// Start a read of sectors from startSector of a LUN image imageSectors long
+void sectorCacheOpenRead(uint8_t lunNumber, uint32_t imageSectors, uint32_t startSector, uint32_t sectors);
+
+// The next sector of the read, valid until the next call.  False if the
+// card could not be read.
+bool sectorCacheReadNext(uint8_t lunNumber, uint8_t **buffer);
+
+// The host has written sectors from firstSector: copy them into any
+// cached blocks they cover
+void sectorCacheWrite(uint8_t lunNumber, uint32_t firstSector, const uint8_t *data, uint32_t sectors);
+
+// Forget the LUN's blocks (it has been stopped or its image changed)
+void sectorCacheInvalidateLun(uint8_t lunNumber);
+
+void sectorCacheGetStats(uint8_t lunNumber, struct sectorCacheStats *stats);
+
+#endif /* SECTORCACHE_H_ */
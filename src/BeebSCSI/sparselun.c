@@ -0,0 +1,317 @@
+/************************************************************************
+	sparselun.c
+
+	BeebSCSI thin-provisioned (sparse) LUN images - see sparselun.h
+	Part of BeebSCSI as used in Pi1MHz; GPL v3 like the rest of it.
+
+************************************************************************/
+
+/*
+ An open sparse image keeps its whole map in memory - 4 bytes a block, so
+ 128K for a 512MB disc - and a lookup is an index into it.  A map entry n
+ is the block of data at dataStart + (n - 1) * 16K; allocated is the
+ highest entry in the map, so the next block to be written goes after it.
+
+ The first write to a block writes all 16K of it: the sectors written, and
+ the pattern - or for an overlay, the base image - around them, put
+ together in scratch.  Sectors that are all the pattern would read back the
+ same without a block, so do not get one; that keeps an image that is
+ written full of the pattern sparse.  Runs of blocks never written are
+ read in one go too, which for an overlay is one read of the base image.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "sparselun.h"
+#include "filesystem.h"
+
+#define SPARSE_LUN_MAGIC   "BSCSISPR"
+#define SPARSE_LUN_VERSION 1
+#define SPARSE_LUN_OVERLAY 0x01
+
+struct sparseLun
+{
+   uint32_t *map;          // NULL when the image is not sparse
+   uint32_t blocks;
+   uint32_t sectors;
+   uint32_t allocated;
+   uint32_t dataStart;
+   uint8_t pattern;
+   bool overlay;
+};
+
+static sparseLunReadFn sparseRead;
+static sparseLunWriteFn sparseWrite;
+static sparseLunBaseFn sparseBase;
+static uint8_t *scratch;
+static struct sparseLun sparseLuns[MAX_LUNS];
+
+static uint32_t sparseLunGet32(const uint8_t *p)
+{
+   return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static void sparseLunPut32(uint8_t *p, uint32_t v)
+{
+   p[0] = (uint8_t)v;
+   p[1] = (uint8_t)(v >> 8);
+   p[2] = (uint8_t)(v >> 16);
+   p[3] = (uint8_t)(v >> 24);
+}
+
+// Where the data starts in an image of blocks
+static uint32_t sparseLunDataStart(uint32_t blocks)
+{
+   uint32_t end = SPARSE_LUN_HEADER_SIZE + blocks * 4;
+
+   return (end + SPARSE_LUN_BLOCK_SIZE - 1) / SPARSE_LUN_BLOCK_SIZE * SPARSE_LUN_BLOCK_SIZE;
+}
+
+static uint32_t sparseLunBlockOffset(const struct sparseLun *s, uint32_t entry)
+{
+   return s->dataStart + (entry - 1) * SPARSE_LUN_BLOCK_SIZE;
+}
+
+static bool sparseLunScratch(void)
+{
+   if (scratch == NULL)
+      scratch = malloc(SPARSE_LUN_BLOCK_SIZE);
+   return scratch != NULL;
+}
+
+void sparseLunInitialise(sparseLunReadFn read, sparseLunWriteFn write, sparseLunBaseFn base)
+{
+   sparseRead = read;
+   sparseWrite = write;
+   sparseBase = base;
+}
+
+// The header, then the rest of the map up to the data, a block at a time
+static bool sparseLunWriteHeader(uint8_t lunNumber, uint32_t sectors, uint8_t dataPattern, uint8_t flags)
+{
+   uint32_t blocks = (sectors + SPARSE_LUN_BLOCK_SECTORS - 1) / SPARSE_LUN_BLOCK_SECTORS;
+   uint32_t dataStart = sparseLunDataStart(blocks);
+
+   if (sectors == 0 || !sparseLunScratch())
+      return false;
+
+   memset(scratch, 0, SPARSE_LUN_BLOCK_SIZE);
+   memcpy(scratch, SPARSE_LUN_MAGIC, 8);
+   sparseLunPut32(scratch + 8, SPARSE_LUN_VERSION);
+   sparseLunPut32(scratch + 12, SPARSE_LUN_BLOCK_SECTORS);
+   sparseLunPut32(scratch + 16, sectors);
+   scratch[20] = dataPattern;
+   scratch[21] = flags;
+
+   for (uint32_t pos = 0; pos < dataStart; pos += SPARSE_LUN_BLOCK_SIZE) {
+      if (!sparseWrite(lunNumber, pos, scratch, SPARSE_LUN_BLOCK_SIZE))
+         return false;
+      memset(scratch, 0, SPARSE_LUN_HEADER_SIZE);
+   }
+   return true;
+}
+
+static bool sparseLunOpenImage(uint8_t lunNumber, uint32_t fileSize, bool overlay)
+{
+   struct sparseLun *s = &sparseLuns[lunNumber];
+   uint8_t header[SPARSE_LUN_HEADER_SIZE];
+   uint32_t blocks;
+
+   sparseLunClose(lunNumber);
+   if (fileSize < SPARSE_LUN_HEADER_SIZE)
+      return true;
+   if (!sparseRead(lunNumber, 0, header, SPARSE_LUN_HEADER_SIZE))
+      return false;
+   if (memcmp(header, SPARSE_LUN_MAGIC, 8) != 0)
+      return true;
+
+   if (sparseLunGet32(header + 8) != SPARSE_LUN_VERSION
+       || sparseLunGet32(header + 12) != SPARSE_LUN_BLOCK_SECTORS
+       || sparseLunGet32(header + 16) == 0
+       || ((header[21] & SPARSE_LUN_OVERLAY) != 0) != overlay)
+      return false;
+   s->sectors = sparseLunGet32(header + 16);
+   s->pattern = header[20];
+   s->overlay = overlay;
+   blocks = (s->sectors + SPARSE_LUN_BLOCK_SECTORS - 1) / SPARSE_LUN_BLOCK_SECTORS;
+   s->dataStart = sparseLunDataStart(blocks);
+   if (fileSize < s->dataStart || !sparseLunScratch())
+      return false;
+
+   s->map = malloc(blocks * 4);
+   if (s->map == NULL)
+      return false;
+   if (!sparseRead(lunNumber, SPARSE_LUN_HEADER_SIZE, (uint8_t *)s->map, blocks * 4)) {
+      sparseLunClose(lunNumber);
+      return false;
+   }
+
+   // The map is read as it is on the card, then put into this end's order
+   for (uint32_t b = 0; b < blocks; b++) {
+      uint32_t entry = sparseLunGet32((const uint8_t *)&s->map[b]);
+
+      // A block past the end of the file was never written
+      if (entry != 0 && sparseLunBlockOffset(s, entry) + SPARSE_LUN_BLOCK_SIZE > fileSize) {
+         sparseLunClose(lunNumber);
+         return false;
+      }
+      s->map[b] = entry;
+      if (entry > s->allocated)
+         s->allocated = entry;
+   }
+   s->blocks = blocks;
+   return true;
+}
+
+bool sparseLunOpen(uint8_t lunNumber, uint32_t fileSize)
+{
+   return sparseLunOpenImage(lunNumber, fileSize, false);
+}
+
+bool sparseLunOpenOverlay(uint8_t lunNumber, uint32_t fileSize, uint32_t sectors)
+{
+   sparseLunClose(lunNumber);
+   if (fileSize == 0) {
+      if (!sparseLunWriteHeader(lunNumber, sectors, 0, SPARSE_LUN_OVERLAY))
+         return false;
+      fileSize = sparseLunDataStart((sectors + SPARSE_LUN_BLOCK_SECTORS - 1) / SPARSE_LUN_BLOCK_SECTORS);
+   }
+   // Not a sparse image at all is no good either
+   if (!sparseLunOpenImage(lunNumber, fileSize, true) || !sparseLunIsSparse(lunNumber)
+       || sparseLunSectors(lunNumber) != sectors) {
+      sparseLunClose(lunNumber);
+      return false;
+   }
+   return true;
+}
+
+void sparseLunClose(uint8_t lunNumber)
+{
+   struct sparseLun *s = &sparseLuns[lunNumber];
+
+   free(s->map);
+   memset(s, 0, sizeof *s);
+}
+
+bool sparseLunIsSparse(uint8_t lunNumber)
+{
+   return sparseLuns[lunNumber].map != NULL;
+}
+
+bool sparseLunIsOverlay(uint8_t lunNumber)
+{
+   return sparseLuns[lunNumber].overlay;
+}
+
+uint32_t sparseLunSectors(uint8_t lunNumber)
+{
+   return sparseLuns[lunNumber].sectors;
+}
+
+bool sparseLunRead(uint8_t lunNumber, uint32_t firstSector, uint8_t *buffer, uint32_t sectors)
+{
+   const struct sparseLun *s = &sparseLuns[lunNumber];
+
+   while (sectors != 0) {
+      uint32_t block = firstSector / SPARSE_LUN_BLOCK_SECTORS;
+      uint32_t offset = firstSector % SPARSE_LUN_BLOCK_SECTORS;
+      uint32_t entry = block < s->blocks ? s->map[block] : 0;
+      uint32_t n = SPARSE_LUN_BLOCK_SECTORS - offset;
+
+      if (n > sectors)
+         n = sectors;
+      // Blocks written one after the other, or not written at all, are
+      // read in one go
+      for (uint32_t next = block + 1; n < sectors && next < s->blocks
+           && s->map[next] == (entry == 0 ? 0 : entry + (next - block)); next++)
+         n += (sectors - n < SPARSE_LUN_BLOCK_SECTORS) ? sectors - n : SPARSE_LUN_BLOCK_SECTORS;
+
+      if (entry == 0 && s->overlay) {
+         if (!sparseBase(lunNumber, firstSector, buffer, n))
+            return false;
+      } else if (entry == 0)
+         memset(buffer, s->pattern, n * 256);
+      else if (!sparseRead(lunNumber, sparseLunBlockOffset(s, entry) + offset * 256, buffer, n * 256))
+         return false;
+      firstSector += n;
+      buffer += n * 256;
+      sectors -= n;
+   }
+   return true;
+}
+
+static bool sparseLunIsPattern(const uint8_t *data, uint32_t length, uint8_t pattern)
+{
+   for (uint32_t i = 0; i < length; i++)
+      if (data[i] != pattern)
+         return false;
+   return true;
+}
+
+// The first write to a block: the block goes on the end of the image, then
+// its map entry
+static bool sparseLunAllocate(uint8_t lunNumber, uint32_t block, uint32_t offset,
+                              const uint8_t *data, uint32_t sectors)
+{
+   struct sparseLun *s = &sparseLuns[lunNumber];
+   uint32_t entry = s->allocated + 1;
+   uint8_t le[4];
+
+   if (!s->overlay && sparseLunIsPattern(data, sectors * 256, s->pattern))
+      return true;
+   if (sectors != SPARSE_LUN_BLOCK_SECTORS) {
+      if (!s->overlay)
+         memset(scratch, s->pattern, SPARSE_LUN_BLOCK_SIZE);
+      else if (!sparseBase(lunNumber, block * SPARSE_LUN_BLOCK_SECTORS, scratch, SPARSE_LUN_BLOCK_SECTORS))
+         return false;
+      memcpy(scratch + offset * 256, data, sectors * 256);
+      data = scratch;
+   }
+   if (!sparseWrite(lunNumber, sparseLunBlockOffset(s, entry), data, SPARSE_LUN_BLOCK_SIZE))
+      return false;
+
+   sparseLunPut32(le, entry);
+   if (!sparseWrite(lunNumber, SPARSE_LUN_HEADER_SIZE + block * 4, le, 4))
+      return false;
+   s->map[block] = entry;
+   s->allocated = entry;
+   return true;
+}
+
+bool sparseLunWrite(uint8_t lunNumber, uint32_t firstSector, const uint8_t *data, uint32_t sectors)
+{
+   const struct sparseLun *s = &sparseLuns[lunNumber];
+
+   if (firstSector > s->sectors || sectors > s->sectors - firstSector)
+      return false;
+   while (sectors != 0) {
+      uint32_t block = firstSector / SPARSE_LUN_BLOCK_SECTORS;
+      uint32_t offset = firstSector % SPARSE_LUN_BLOCK_SECTORS;
+      uint32_t n = SPARSE_LUN_BLOCK_SECTORS - offset;
+
+      if (n > sectors)
+         n = sectors;
+      if (s->map[block] != 0) {
+         if (!sparseWrite(lunNumber, sparseLunBlockOffset(s, s->map[block]) + offset * 256, data, n * 256))
+            return false;
+      } else if (!sparseLunAllocate(lunNumber, block, offset, data, n))
+         return false;
+      firstSector += n;
+      data += n * 256;
+      sectors -= n;
+   }
+   return true;
+}
+
+bool sparseLunFormat(uint8_t lunNumber, uint32_t sectors, uint8_t dataPattern)
+{
+   sparseLunClose(lunNumber);
+   return sparseLunWriteHeader(lunNumber, sectors, dataPattern, 0);
+}
+
+void sparseLunGetStats(uint8_t lunNumber, struct sparseLunStats *stats)
+{
+   stats->blocks = sparseLuns[lunNumber].blocks;
+   stats->allocated = sparseLuns[lunNumber].allocated;
+}
@@ -0,0 +1,100 @@
+/************************************************************************
+	sparselun.h
+
+	BeebSCSI thin-provisioned (sparse) LUN images
+	Part of BeebSCSI as used in Pi1MHz; GPL v3 like the rest of it.
+
+************************************************************************/
+
+#ifndef SPARSELUN_H_
+#define SPARSELUN_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// A scsiN.dat can be a sparse image rather than a flat copy of the disc.
+//
+// A flat image has to be as big as the disc it holds, so FORMAT has to
+// find the SD card room for all of it, and what it held before is what
+// the freshly formatted disc reads as.  A sparse image starts with a
+// header and a block allocation map, and only holds the 16K blocks of the
+// disc that have been written, in the order they were first written.  A
+// block that has never been written reads as the FORMAT data pattern, so
+// FORMAT writes the header and an empty map and is done in milliseconds.
+//
+// The image is recognised by its header, whatever made it: FORMAT makes
+// one when scsi_sparse is set in Pi1MHz.cfg, or when the image it
+// replaces was sparse, and tools/sparse_lun.py turns flat images into
+// sparse ones and back on a PC.
+//
+// The same format makes a copy-on-write overlay: a scsiN.cow next to a
+// flat scsiN.dat takes every write to the LUN, and its blocks never
+// written read from scsiN.dat instead of as the pattern, so the .dat is
+// never changed.  An empty .cow is an overlay with nothing in it yet,
+// which is how a LUN gets one and how it is put back as the .dat has it.
+//
+// The layout, little endian throughout:
+//
+//    0     8 bytes "BSCSISPR"
+//    8     version (1)
+//    12    sectors per block (64)
+//    16    sectors on the disc
+//    20    FORMAT data pattern (one byte)
+//    21    flags: bit 0 set for an overlay
+//    512   the map: one 32 bit entry per block of the disc; 0 is a block
+//          never written, n is the nth block of data
+//    ...   the blocks of data, from the first 16K boundary after the map
+//
+// A block is written to the card before its map entry, so a sparse image
+// that was being written when the power went is at worst a block longer
+// than it needs to be.
+
+#define SPARSE_LUN_BLOCK_SECTORS 64
+#define SPARSE_LUN_BLOCK_SIZE    (SPARSE_LUN_BLOCK_SECTORS * 256)
+#define SPARSE_LUN_HEADER_SIZE   512
+
+// How the sparse layer reads and writes bytes of the image file; a read
+// past its end must give zeros, and a write past it must grow it
+typedef bool (*sparseLunReadFn)(uint8_t lunNumber, uint32_t offset, uint8_t *buffer, uint32_t length);
+typedef bool (*sparseLunWriteFn)(uint8_t lunNumber, uint32_t offset, const uint8_t *data, uint32_t length);
+
+// How an overlay reads sectors of the image underneath it
+typedef bool (*sparseLunBaseFn)(uint8_t lunNumber, uint32_t firstSector, uint8_t *buffer, uint32_t sectors);
+
+struct sparseLunStats
+{
+   uint32_t blocks;        // blocks of the disc
+   uint32_t allocated;     // ... held in the image
+};
+
+void sparseLunInitialise(sparseLunReadFn read, sparseLunWriteFn write, sparseLunBaseFn base);
+
+// Look at the header of a LUN image fileSize bytes long that has just been
+// opened.  False if it is a sparse image that cannot be used (damaged, an
+// overlay, or no memory for its map); a flat image is fine, and is left to
+// filesystem.c.
+bool sparseLunOpen(uint8_t lunNumber, uint32_t fileSize);
+
+// Open the overlay of a LUN of sectors, fileSize bytes long; an empty one
+// is given its header first.  False if it is not an overlay of that many
+// sectors, or cannot be used.
+bool sparseLunOpenOverlay(uint8_t lunNumber, uint32_t fileSize, uint32_t sectors);
+
+void sparseLunClose(uint8_t lunNumber);
+bool sparseLunIsSparse(uint8_t lunNumber);      // an overlay is, too
+bool sparseLunIsOverlay(uint8_t lunNumber);
+
+// Sectors on the disc of an open sparse image
+uint32_t sparseLunSectors(uint8_t lunNumber);
+
+bool sparseLunRead(uint8_t lunNumber, uint32_t firstSector, uint8_t *buffer, uint32_t sectors);
+bool sparseLunWrite(uint8_t lunNumber, uint32_t firstSector, const uint8_t *data, uint32_t sectors);
+
+// Write the header and an empty map of a sparse image of sectors, every
+// one reading as dataPattern, to the start of an empty file.  The LUN is
+// left closed.
+bool sparseLunFormat(uint8_t lunNumber, uint32_t sectors, uint8_t dataPattern);
+
+void sparseLunGetStats(uint8_t lunNumber, struct sparseLunStats *stats);
+
+#endif /* SPARSELUN_H_ */
@@ -0,0 +1,186 @@
+/************************************************************************
+	writecache.c
+
+	BeebSCSI LUN write-back cache - see writecache.h
+	Part of BeebSCSI as used in Pi1MHz; GPL v3 like the rest of it.
+
+************************************************************************/
+
+/*
+ There is one run, shared by the LUNs: ADFS works on one drive at a time,
+ and a write to another LUN simply sends the run to the card first.  The
+ run is runSectors sectors from runFirst of runLun; a write joins it if it
+ starts inside it or straight after it and ends within the 16K.
+
+ unsynced has bit n set once LUN n has had an f_write without an f_sync.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "writecache.h"
+#include "filesystem.h"
+#include "../config.h"
+
+#define WRITE_CACHE_IDLE_DEFAULT 1000u    // ms
+
+static writeCacheWriteFn cacheWrite;
+static writeCacheSyncFn cacheSync;
+static bool cacheTried;
+static uint16_t enabledMask;
+static uint32_t idleUs;
+
+static uint8_t *run;
+static uint8_t runLun;
+static uint32_t runFirst;
+static uint32_t runSectors;
+
+static uint16_t unsynced;
+static bool active;                 // written since the last writeCacheIdle()
+static uint32_t quietFrom;
+
+static struct writeCacheStats cacheStats[MAX_LUNS];
+
+// scsi_writeback: "all", or LUN numbers and ranges, e.g. "0,2-4".  VFS
+// LUNs are read-only, so only 0-7 are taken.
+static uint16_t writeCacheConfigLuns(void)
+{
+   const char *v = config_get("scsi_writeback");
+   uint16_t mask = 0;
+
+   if (v == NULL)
+      return 0;
+   if (strcmp(v, "all") == 0)
+      return 0xFF;
+   while (*v != '\0') {
+      char *end;
+      unsigned long from = strtoul(v, &end, 10), to = from;
+
+      if (end == v)
+         break;
+      if (*end == '-') {
+         v = end + 1;
+         to = strtoul(v, &end, 10);
+         if (end == v)
+            break;
+      }
+      for (unsigned long lun = from; lun <= to && lun < 8; lun++)
+         mask |= (uint16_t)(1u << lun);
+      v = end;
+      while (*v == ',' || *v == ' ')
+         v++;
+   }
+   return mask;
+}
+
+void writeCacheInitialise(writeCacheWriteFn write, writeCacheSyncFn sync)
+{
+   const char *ms;
+
+   cacheWrite = write;
+   cacheSync = sync;
+   if (cacheTried)
+      return;
+   cacheTried = true;
+
+   enabledMask = writeCacheConfigLuns();
+   ms = config_get("scsi_writeback_ms");
+   idleUs = (ms != NULL ? (uint32_t)strtoul(ms, NULL, 10) : WRITE_CACHE_IDLE_DEFAULT) * 1000u;
+   if (enabledMask != 0) {
+      run = malloc(WRITE_CACHE_SECTORS * 256);
+      if (run == NULL)
+         enabledMask = 0;
+   }
+}
+
+bool writeCacheEnabled(uint8_t lunNumber)
+{
+   return (enabledMask & (1u << lunNumber)) != 0;
+}
+
+// Send the run to the card.  It is gone either way: a run the card would
+// not take is not one to keep trying.
+static bool writeCacheFlush(void)
+{
+   bool ok;
+
+   if (runSectors == 0)
+      return true;
+   ok = cacheWrite(runLun, runFirst, run, runSectors);
+   cacheStats[runLun].dirty -= runSectors;
+   cacheStats[runLun].flushes++;
+   unsynced |= (uint16_t)(1u << runLun);
+   runSectors = 0;
+   return ok;
+}
+
+bool writeCacheWrite(uint8_t lunNumber, uint32_t firstSector, const uint8_t *data, uint32_t sectors)
+{
+   bool ok = true;
+
+   active = true;
+   cacheStats[lunNumber].sectors += sectors;
+
+   if (runSectors == 0 || lunNumber != runLun || firstSector < runFirst
+       || firstSector > runFirst + runSectors
+       || firstSector + sectors > runFirst + WRITE_CACHE_SECTORS) {
+      ok = writeCacheFlush();
+      runLun = lunNumber;
+      runFirst = firstSector;
+   }
+   if (sectors > WRITE_CACHE_SECTORS) {
+      // Too big to hold: straight to the card
+      unsynced |= (uint16_t)(1u << lunNumber);
+      cacheStats[lunNumber].flushes++;
+      return cacheWrite(lunNumber, firstSector, data, sectors) && ok;
+   }
+
+   memcpy(run + (firstSector - runFirst) * 256, data, sectors * 256);
+   if (firstSector + sectors > runFirst + runSectors) {
+      uint32_t grown = firstSector + sectors - runFirst;
+
+      cacheStats[lunNumber].dirty += grown - runSectors;
+      runSectors = grown;
+   }
+   return ok;
+}
+
+bool writeCacheFlushRange(uint8_t lunNumber, uint32_t firstSector, uint32_t sectors)
+{
+   if (runSectors == 0 || lunNumber != runLun
+       || firstSector >= runFirst + runSectors || firstSector + sectors <= runFirst)
+      return true;
+   return writeCacheFlush();
+}
+
+bool writeCacheSync(uint8_t lunNumber)
+{
+   bool ok = true;
+
+   if (runSectors != 0 && lunNumber == runLun)
+      ok = writeCacheFlush();
+   if (unsynced & (1u << lunNumber)) {
+      unsynced &= (uint16_t)~(1u << lunNumber);
+      cacheStats[lunNumber].syncs++;
+      ok = cacheSync(lunNumber) && ok;
+   }
+   return ok;
+}
+
+void writeCacheIdle(uint32_t nowUs)
+{
+   if (active) {
+      active = false;
+      quietFrom = nowUs;
+      return;
+   }
+   if ((runSectors == 0 && unsynced == 0) || nowUs - quietFrom < idleUs)
+      return;
+   for (uint8_t lun = 0; lun < 8; lun++)
+      (void)writeCacheSync(lun);
+}
+
+void writeCacheGetStats(uint8_t lunNumber, struct writeCacheStats *stats)
+{
+   *stats = cacheStats[lunNumber];
+}
@@ -0,0 +1,66 @@
+/************************************************************************
+	writecache.h
+
+	BeebSCSI LUN write-back cache
+	Part of BeebSCSI as used in Pi1MHz; GPL v3 like the rest of it.
+
+************************************************************************/
+
+#ifndef WRITECACHE_H_
+#define WRITECACHE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Deferred writes for the LUNs listed in scsi_writeback in Pi1MHz.cfg.
+//
+// Each WRITE6 used to end with an f_sync, so ADFS updating its free space
+// map and then a directory a sector at a time cost a FAT and directory
+// entry update on the SD card for every command.  For a write-back LUN the
+// sectors are held in a 16K run instead, and a write that carries on from
+// or overlaps the run joins it, across commands.  The run goes to the card
+// when a write does not fit it, or when a read wants its sectors; the
+// f_sync waits until the LUNs have been quiet for scsi_writeback_ms
+// (default 1000), or a LUN is stopped, or the Beeb is reset.
+//
+// The price is that a write which fails on the card after the command has
+// finished cannot be reported to the Beeb, and a power cut loses up to
+// the timeout's worth of writes - which is why it is off unless asked for.
+
+#define WRITE_CACHE_SECTORS 64
+
+struct writeCacheStats
+{
+   uint32_t dirty;         // sectors held and not yet on the card
+   uint32_t sectors;       // sectors the host has written
+   uint32_t flushes;       // f_writes of a run
+   uint32_t syncs;         // f_syncs
+};
+
+// Write sectors of a LUN image to the card, and sync it: supplied by
+// filesystem.c, which knows how to grow an image
+typedef bool (*writeCacheWriteFn)(uint8_t lunNumber, uint32_t firstSector, const uint8_t *data, uint32_t sectors);
+typedef bool (*writeCacheSyncFn)(uint8_t lunNumber);
+
+// Read the configuration and allocate the run, once
+void writeCacheInitialise(writeCacheWriteFn write, writeCacheSyncFn sync);
+bool writeCacheEnabled(uint8_t lunNumber);
+
+// The host has written sectors from firstSector.  False if a run had to
+// go to the card to make room and could not.
+bool writeCacheWrite(uint8_t lunNumber, uint32_t firstSector, const uint8_t *data, uint32_t sectors);
+
+// Put any held sectors of the LUN between firstSector and firstSector +
+// sectors on the card, before reading them from it
+bool writeCacheFlushRange(uint8_t lunNumber, uint32_t firstSector, uint32_t sectors);
+
+// Put everything the LUN has written on the card and sync it
+bool writeCacheSync(uint8_t lunNumber);
+
+// Called now and then with the time in microseconds: syncs the LUNs once
+// they have been quiet long enough
+void writeCacheIdle(uint32_t nowUs);
+
+void writeCacheGetStats(uint8_t lunNumber, struct writeCacheStats *stats);
+
+#endif /* WRITECACHE_H_ */
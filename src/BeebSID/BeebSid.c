@@ -67,5 +67,16 @@ void BeebSID_emulator_init(uint8_t instance, uint8_t address)
     for (i = 0; i < 32u; i++) {
         Pi1MHz_Register_Memory(WRITE_FRED, (address + i), beebsid_write);
     }
-    Pi1MHz_Register_Poll(beebsid_poll);
+    /* same DMA half-buffer as the M5000: see M5000_emulator_init */
+    Pi1MHz_Register_Poll_Sched(beebsid_poll, POLL_URGENT, 0u, 2000u);
+}
+
+size_t BeebSID_snapshot_save(uint8_t *buf, size_t size)
+{
+    return beebsid_sid_state_save(buf, size);
+}
+
+bool BeebSID_snapshot_restore(const uint8_t *buf, size_t len)
+{
+    return beebsid_sid_state_restore(buf, len);
 }
@@ -1,4 +1,10 @@
 #pragma once
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 void BeebSID_emulator_init(uint8_t instance, uint8_t address);
+
+/* Snapshot section (snapshot.c): the SID chip, while BeebSID is running. */
+size_t BeebSID_snapshot_save(uint8_t *buf, size_t size);
+bool BeebSID_snapshot_restore(const uint8_t *buf, size_t len);
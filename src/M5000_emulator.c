@@ -481,8 +481,10 @@ void M5000_emulator_init(uint8_t instance, uint8_t address)
 
    M5000_audio_range = (int)(rpi_audio_init(46875)) * M5000_DIVIDER;
 
-   // register polling function
-   Pi1MHz_Register_Poll(music5000_emulate);
+   // register polling function: the PWM DMA drains a half-buffer (224
+   // samples, 4.8 ms) while we fill the other, so run ahead of the network
+   // pollers and get slotted in between them once 2 ms have gone by
+   Pi1MHz_Register_Poll_Sched(music5000_emulate, POLL_URGENT, 0u, 2000u);
 }
 
 uint8_t M5000_emulator_read_instance(void)
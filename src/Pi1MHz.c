@@ -36,10 +36,31 @@
          This registers a polling function that is called in a tight loop while idle.
          tasks must yield otherwise the system will lock up.
 
+   Pi1MHz_Register_Poll_Sched( func_ptr *func_ptr, priority, period_us, deadline_us )
+         As above, with a scheduling class.  POLL_URGENT pollers with a deadline are
+         run between the others whenever that deadline has passed, so a slow poller
+         cannot starve them; a period rate-limits a POLL_BACKGROUND poller.  See
+         poll_sched.c.
+
+   Pi1MHz_Register_Poll_Event( func_ptr *func_ptr, priority, period_us, events )
+         A poller that only has work when something happens: it is not called until
+         one of its POLL_EVENT_ bits is raised with Pi1MHz_Poll_Wake_FIQ() (from a
+         FIQ callback) or Pi1MHz_Poll_Wake() (from the main loop), or period_us has
+         gone by.
+
    Pi1MHz_Memory[]
          This array is used for reads by FIQ function. Tasks must put the data to be read by the
          host in the correct location.
 
+   Pi1MHz_EmulatedMemoryByte
+         A write callback that just stores the byte so it reads back.  Where both addresses of
+         a FRED pair use it, the VPU does the store itself and no FIQ happens at all; read
+         such registers with Pi1MHz_MemoryRead() and use Pi1MHz_MemorySync() to notice writes.
+
+   vpu_stream_arm( port, addr, limit, step, addr_reg ) / vpu_stream_take( port )
+         Hand an auto-incrementing data register to the VPU, which then serves it from JIM
+         RAM with one FIQ per 256 bytes instead of one per byte.  See vpu_stream.h.
+
    For reference from mdfs :
 
    Page &FC (252) - FRED I/O Space
@@ -127,39 +148,66 @@ See mdfs.net/Docs/Comp/BBC/Hardware/JIMAddrs for full details
 #include "AUN/aun_emulator.h"
 #include "teletext_emulator.h"
 #include "watchdog.h"
+#include "bus_trace.h"
+#include "poll_sched.h"
+#include "profiler.h"
+#include "vpu_stream.h"
+#include "snapshot.h"
+
+/* INIT_DEFERRED emulators are not needed for the Beeb to find the Pi on
+   the bus - nothing in them answers a FRED or JIM access the OS makes at
+   BREAK - but are slow to start: TinyUSB, the video player's index and
+   decoder, the HDMI mode set.  init_emulator() leaves them to the poll
+   loop, one per pass in table order, once every other emulator is up. */
+#define INIT_NOW      0u
+#define INIT_DEFERRED 1u
 
 typedef struct {
    const char *name;
    const func_ptr_parameter init;
    uint8_t address;
    uint8_t enable;
+   uint8_t stage;
 } emulator_list;
 
 static emulator_list emulator[] = {
-   {"Helpers",helpers_init, 0x88, 1 }, // needs to be before framebuffer so it can write to the screen
-   {"Rampage",rampage_emulator_init, 0xFD, 1},
-   {"Rambyte",rambyte_emulator_init, 0x00, 1},
-   {"Harddisc",harddisc_emulator_init, 0x40, 1},
-   {"M5000",M5000_emulator_init, 0, 1},
+   {"Helpers",helpers_init, 0x88, 1, INIT_NOW }, // needs to be before framebuffer so it can write to the screen
+   {"Rampage",rampage_emulator_init, 0xFD, 1, INIT_NOW },
+   {"Rambyte",rambyte_emulator_init, 0x00, 1, INIT_NOW },
+   {"Harddisc",harddisc_emulator_init, 0x40, 1, INIT_NOW },
+   {"M5000",M5000_emulator_init, 0, 1, INIT_NOW },
    /* Default off — enable with BeebSID_addr=0x20 in Pi1MHz.cfg (disables M5000). */
-   {"BeebSID", BeebSID_emulator_init, 0x20, 0},
+   {"BeebSID", BeebSID_emulator_init, 0x20, 0, INIT_NOW },
    /* The services port: FAT/SD commands plus the ranges other services
       (AUN) claim via services_register(). */
-   {"Services",services_emulator_init, 0xA6, 1 },
-   {"Videoplayer",videoplayer_init, 0x00, 1},  // start before frame buffer , but after filesystem
-   {"Framebuffer",fb_emulator_init, 0xA0, 1},
-   {"Mouseredirect",mouse_redirect_init, 0xAC, 1 },
-   {"usb",usb_init, 0x00, 1 },
-   {"wifi",wifi_emulator_init, 0x00, 1 },
-   {"aun",aun_emulator_init, 0x00, 1 },
+   {"Services",services_emulator_init, 0xA6, 1, INIT_NOW },
+   {"Videoplayer",videoplayer_init, 0x00, 1, INIT_DEFERRED },  // start before frame buffer , but after filesystem
+   {"Framebuffer",fb_emulator_init, 0xA0, 1, INIT_DEFERRED },
+   {"Mouseredirect",mouse_redirect_init, 0xAC, 1, INIT_NOW },
+   {"usb",usb_init, 0x00, 1, INIT_DEFERRED },
+   {"wifi",wifi_emulator_init, 0x00, 1, INIT_DEFERRED },
+   {"aun",aun_emulator_init, 0x00, 1, INIT_DEFERRED },
    /* IP sockets on the services port (commands 45-79). After wifi and aun so
       its poll runs once lwIP has drained inbound frames; off unless
       net_enable=1 in Pi1MHz.cfg. */
-   {"net",net_service_init, 0x00, 1 },
-   {"Teletext",teletext_emulator_init, 0x10, 1 },  // Acorn Teletext Adapter at &FC10
+   {"net",net_service_init, 0x00, 1, INIT_DEFERRED },
+   {"Teletext",teletext_emulator_init, 0x10, 1, INIT_NOW },  // Acorn Teletext Adapter at &FC10
+   /* Poll/FIQ profiler, off until *FX147,202,15 : *FX147,203,1 or /profile.
+      Its fx slot is its index here, so keep it at 15.  Before Bustrace,
+      whose init re-hooks the table the profiler counts through. */
+   {"Profiler",profiler_init, 0x00, 1, INIT_NOW },
+   /* Bus-access recorder: does nothing unless bus_trace=<file> is set or
+      /bustrace.bin is fetched.  After every emulator that registers bus
+      callbacks, so a capture spanning a BBC RST re-hooks a complete table;
+      a deferred one registering later goes through bus_trace_register(). */
+   {"Bustrace",bus_trace_init, 0x00, 1, INIT_NOW },
+   /* Puts back what snapshot_resume_jim() kept from a snapshot, so after
+      every emulator whose state it restores; its fx register (slot 17)
+      takes save requests. */
+   {"Snapshot",snapshot_init, 0x00, 1, INIT_NOW },
    /* Last, so its poll callback re-arms the watchdog only after every other
       emulator has had its turn - a poll that stops responding still trips it. */
-   {"Watchdog",watchdog_init, 0x00, 1 }
+   {"Watchdog",watchdog_init, 0x00, 1, INIT_NOW }
 };
 
 #define NUM_EMULATORS (sizeof(emulator)/sizeof(emulator_list))
@@ -167,10 +215,9 @@ static emulator_list emulator[] = {
 // Memory for VPU to read FRED and JIM
 static volatile uint32_t * const Pi1MHz_Memory_VPU = (uint32_t *)Pi1MHz_MEM_BASE;
 
-// Table of polling functions to call while idle
-NOINIT_SECTION static func_ptr Pi1MHz_poll_table[NUM_EMULATORS];
-// holds the total number of polling functions to call
-static uint8_t  Pi1MHz_polls_max;
+// The same, a byte at a time: address a's data is byte 2a, its half's flags 2a + 1
+static volatile uint8_t * const Pi1MHz_Memory_VPU8 = (uint8_t *)Pi1MHz_MEM_BASE;
+
 
 // *fx register buffer
 NOINIT_SECTION uint8_t fx_register[256];
@@ -181,6 +228,102 @@ _Static_assert(Pi1MHz_STRUCT_VADDR + offsetof(Pi1MHz_t, callback_table) == Pi1MH
 
 _Static_assert(sizeof(Pi1MHz_t) <= 0x2000, "Pi1MHz_t must fit into low memory");
 
+/* The top byte of each VPU half-word.  Bit 13 tells the nOE loop the byte
+   has been written; bit 14 tells the VPU to store the Beeb's writes to the
+   pair itself; bit 12 marks a data register the VPU is streaming
+   (vpu_stream.c), and is the only one set per half (Pi1MHzvc.s).  Zero, as
+   init_emulator() clears the window to, is an ordinary pair. */
+#define VPU_HALF        0xAF00u
+#define VPU_HALF_LOCAL  0xEF00u
+#define VPU_HALF_STREAM 0xBF00u
+
+/* Plain echo registers - a write callback that is Pi1MHz_EmulatedMemoryByte
+   and nothing else: the mouse position, the framebuffer's JMP target.  Each
+   of those writes cost a doorbell FIQ, ~250 ns of ARM time, to store one
+   byte so that it reads back.  When both addresses of a FRED pair are
+   plain echoes the VPU does that store itself and never rings the
+   doorbell.  The callback stays registered, so nothing changes if the pair
+   is handed back to the ARM.
+
+   Both, not either, because the ARM writes an ordinary pair's whole word
+   from the shadow, which would lose a byte the VPU had kept in the other
+   half.  FRED only, because the JIM page is the page-RAM window that
+   Pi1MHz_MemoryWritePage() rewrites wholesale.
+
+   Neither side reads a local pair's word to write it back.  The VPU stores
+   the Beeb's byte on its own (stb), and the ARM stores just its data byte
+   too, so a Beeb write to one address of the pair cannot be undone by the
+   ARM writing the other.  The flag bytes are the ARM's alone, and
+   vpu_local_update() changes them in an order that keeps every write.
+
+   A stored-locally byte is not in the shadow.  Pi1MHz_MemoryRead() and
+   Pi1MHz_MemoryWrite() go to the VPU word for those pairs, and a poller
+   that wants to know the Beeb has written one asks Pi1MHz_MemorySync():
+   however many writes there were, that is one VPU read.  A bus capture
+   hands every pair back to the ARM (Pi1MHz_MemoryLocal) so it sees the
+   writes; the profiler does not, so its FIQ counts are the real ones. */
+#define VPU_LOCAL_WORDS (PAGE_SIZE / 2u)
+
+static uint32_t vpu_echo[PAGE_SIZE / 32u];          // per FRED address
+static uint32_t vpu_local[VPU_LOCAL_WORDS / 32u];   // per VPU word, as set
+static bool vpu_local_enabled = true;
+
+static inline bool vpu_word_local(uint32_t w)
+{
+   return w < VPU_LOCAL_WORDS && (vpu_local[w >> 5] & (1u << (w & 31u))) != 0u;
+}
+
+static void vpu_local_write(uint32_t addr, uint8_t data)
+{
+   Pi1MHz_Memory_VPU8[2u * addr] = data;
+   Pi1MHz->Memory[addr] = data;
+}
+
+static void vpu_local_update(uint32_t w)
+{
+   bool want = vpu_local_enabled
+               && (vpu_echo[(2u * w) >> 5] & (3u << ((2u * w) & 31u))) == (3u << ((2u * w) & 31u));
+
+   if (want == vpu_word_local(w))
+      return;
+
+   if (want) {
+      // Until the flags are in, the Beeb's writes reach the ARM and the
+      // shadow is the pair; a FIQ between building the word and storing it
+      // would be lost.  One already rung for an earlier write arrives after
+      // and, the pair now being local, stores just its byte.
+      unsigned int cpsr = _disable_interrupts_cspr();
+      vpu_local[w >> 5] |= 1u << (w & 31u);
+      Pi1MHz_Memory_VPU[w] = (VPU_HALF_LOCAL | Pi1MHz->Memory[2u * w])
+                             | ((VPU_HALF_LOCAL | Pi1MHz->Memory[2u * w + 1u]) << 16);
+      _restore_cpsr(cpsr);
+      return;
+   }
+
+   // Hand the pair back: the flags first, leaving the data bytes alone, so
+   // the Beeb's writes ring the ARM from here on; while vpu_local still has
+   // the pair, the FIQ stores just the byte written.  A write the VPU
+   // took for local before it saw the flags lands within a bus cycle; after
+   // that the word holds everything, and the shadow takes it with no FIQ
+   // in between to write one of the bytes again.
+   Pi1MHz_Memory_VPU8[4u * w + 1u] = (uint8_t)(VPU_HALF >> 8);
+   Pi1MHz_Memory_VPU8[4u * w + 3u] = (uint8_t)(VPU_HALF >> 8);
+   RPI_WaitMicroSeconds(2);
+   unsigned int cpsr = _disable_interrupts_cspr();
+   (void)Pi1MHz_MemorySync(2u * w);
+   vpu_local[w >> 5] &= ~(1u << (w & 31u));
+   _restore_cpsr(cpsr);
+}
+
+static void vpu_echo_note(uint32_t addr, bool echo)
+{
+   if (echo)
+      vpu_echo[addr >> 5] |= 1u << (addr & 31u);
+   else
+      vpu_echo[addr >> 5] &= ~(1u << (addr & 31u));
+   vpu_local_update(addr >> 1);
+}
+
 void Pi1MHz_MemoryWrite(uint32_t addr, uint8_t data)
 {
    // One VPU word holds two adjacent bus addresses, so this used to read the
@@ -218,8 +361,16 @@ void Pi1MHz_MemoryWrite(uint32_t addr, uint8_t data)
    // The reversal also skews which side sees the update first, in the better
    // direction: the bus now gets the new byte immediately and the CPU-side
    // copy lags by a few ns, rather than the other way round.
-   uint32_t other = Pi1MHz->Memory[addr ^ 1u] | 0xff00u;
-   uint32_t mine  = 0xff00u | data;
+   //
+   // A pair the VPU stores locally (see above) is the exception: the Beeb's
+   // writes to it never reach the shadow, so the other half cannot be
+   // rebuilt from it, and only this address's byte is stored.
+   if (vpu_word_local(addr >> 1)) {
+      vpu_local_write(addr, data);
+      return;
+   }
+   uint32_t other = Pi1MHz->Memory[addr ^ 1u] | VPU_HALF;
+   uint32_t mine  = VPU_HALF | data;
 
    Pi1MHz_Memory_VPU[addr>>1] = (addr & 1u) ? ((mine << 16) | other)
                                             : (mine | (other << 16));
@@ -236,7 +387,8 @@ void Pi1MHz_MemoryWrite16(uint32_t addr, uint32_t data)
    uint16_t v = (uint16_t) data;
    memcpy(__builtin_assume_aligned(&Pi1MHz->Memory[addr], 2), &v, sizeof v);
 
-   Pi1MHz_Memory_VPU[addr >> 1] = 0xFF00FF00 | (data&0xFF) | (data<<8);
+   uint32_t half = vpu_word_local(addr >> 1) ? VPU_HALF_LOCAL : VPU_HALF;
+   Pi1MHz_Memory_VPU[addr >> 1] = (half << 16 | half) | (data&0xFF) | (data<<8);
 }
 
 // cppcheck-suppress unusedFunction
@@ -248,16 +400,66 @@ void Pi1MHz_MemoryWrite32(uint32_t addr, uint32_t data)
    memcpy(__builtin_assume_aligned(&Pi1MHz->Memory[addr], 4), &data, sizeof data);
 
    uint32_t ad = addr >> 1;
+   uint32_t half = vpu_word_local(ad) ? VPU_HALF_LOCAL : VPU_HALF;
 
-   Pi1MHz_Memory_VPU[ad++] = 0xFF00FF00 | (data&0xFF) | (data<<8);
-   Pi1MHz_Memory_VPU[ad] = 0xFF00FF00 | (data>>16) | (data>>24)<<16;
+   Pi1MHz_Memory_VPU[ad++] = (half << 16 | half) | (data&0xFF) | (data<<8);
+   half = vpu_word_local(ad) ? VPU_HALF_LOCAL : VPU_HALF;
+   Pi1MHz_Memory_VPU[ad] = (half << 16 | half) | (data>>16) | (data>>24)<<16;
 }
 
 uint8_t Pi1MHz_MemoryRead(uint32_t addr)
 {
+   if (vpu_word_local(addr >> 1))
+      return (uint8_t)(Pi1MHz_Memory_VPU[addr >> 1] >> ((addr & 1u) * 16u));
    return Pi1MHz->Memory[addr];
 }
 
+bool Pi1MHz_MemorySync(uint32_t addr)
+{
+   uint32_t w = addr >> 1;
+
+   if (!vpu_word_local(w))
+      return false;
+   uint32_t word = Pi1MHz_Memory_VPU[w];
+   uint8_t lo = (uint8_t)word;
+   uint8_t hi = (uint8_t)(word >> 16);
+   bool changed = Pi1MHz->Memory[2u * w] != lo || Pi1MHz->Memory[2u * w + 1u] != hi;
+   Pi1MHz->Memory[2u * w] = lo;
+   Pi1MHz->Memory[2u * w + 1u] = hi;
+   return changed;
+}
+
+void Pi1MHz_MemoryStream(uint32_t addr, bool on)
+{
+   uint32_t w = addr >> 1;
+   uint32_t word = Pi1MHz_Memory_VPU[w];
+   uint32_t mine, other;
+
+   // the VPU has been moving these bytes on by itself
+   Pi1MHz->Memory[2u * w] = (uint8_t)word;
+   Pi1MHz->Memory[2u * w + 1u] = (uint8_t)(word >> 16);
+
+   mine  = (on ? VPU_HALF_STREAM : VPU_HALF) | Pi1MHz->Memory[addr];
+   other = VPU_HALF | Pi1MHz->Memory[addr ^ 1u];
+   Pi1MHz_Memory_VPU[w] = (addr & 1u) ? ((mine << 16) | other)
+                                      : (mine | (other << 16));
+}
+
+void Pi1MHz_MemoryLocal(bool enable)
+{
+   vpu_stream_enable(enable);
+   vpu_local_enabled = enable;
+   for (uint32_t w = 0; w < VPU_LOCAL_WORDS; w++)
+      vpu_local_update(w);
+}
+
+void Pi1MHz_MemoryRestoreEcho(const uint8_t *fred)
+{
+   for (uint32_t addr = 0; addr < PAGE_SIZE; addr++)
+      if ((vpu_echo[addr >> 5] & (1u << (addr & 31u))) != 0u)
+         Pi1MHz_MemoryWrite(addr, fred[addr]);
+}
+
 void Pi1MHz_EmulatedMemoryByte(unsigned int gpio)
 {
    Pi1MHz_MemoryWrite(GET_ADDR(gpio), GET_DATA(gpio));
@@ -268,33 +470,13 @@ void Pi1MHz_EmulatedMemoryByte(unsigned int gpio)
 // for access variable use WRITE_FRED WRITE_JIM READ_FRED READ_JIM
 void Pi1MHz_Register_Memory(unsigned int access, unsigned int addr, callback_func_ptr function_ptr )
 {
+   if (access == WRITE_FRED && addr < PAGE_SIZE)
+      vpu_echo_note(addr, function_ptr == Pi1MHz_EmulatedMemoryByte);
+   if (bus_trace_register(access+addr, function_ptr))
+      return;                 // a capture owns the live table; see bus_trace.c
    Pi1MHz->callback_table[access+addr] = function_ptr;
 }
 
-// For each task that needs to be polled during idle it must register itself.
-// is can only register once
-void Pi1MHz_Register_Poll( func_ptr function_ptr )
-{
-   uint8_t i;
-
-   if (function_ptr == NULL)
-      return;
-
-   for (i = 0u; i < Pi1MHz_polls_max; ++i) {
-      if (Pi1MHz_poll_table[i] == function_ptr)
-         return;
-   }
-
-   if (Pi1MHz_polls_max >= NUM_EMULATORS) {
-      LOG_INFO("Poll registration ignored: table full (%u)\r\n",
-               (unsigned int)NUM_EMULATORS);
-      return;
-   }
-
-   Pi1MHz_poll_table[Pi1MHz_polls_max] = function_ptr;
-   Pi1MHz_polls_max++;
-}
-
 bool Pi1MHz_is_rst_active(void) {
    return ((RPI_GpioBase->GPLEV0 & NRST_MASK) == 0);
 }
@@ -392,7 +574,46 @@ void IRQHandler_main(void) {
    _data_memory_barrier();
 }
 
+/* The deferred half of init_emulator(), run from the poll loop. */
+static uint8_t init_deferred[NUM_EMULATORS];
+static uint8_t init_deferred_count, init_deferred_next;
+static uint32_t init_start_us, init_bus_live_us;
+
+/* Run emulator i's init under its own boot stage, so a hang inside it is
+   named on the next boot, and log what it cost. */
+static void init_one(uint8_t i)
+{
+   uint32_t us;
+
+   RPI_BootStage(BOOT_STAGE_INIT_OF(i));
+   emulator[i].init(i, emulator[i].address);
+   us = RPI_BootStageElapsed();
+   LOG_DEBUG("%s init took %lu us\r\n", emulator[i].name, (unsigned long)us);
+   if (us >= 100000u)
+      LOG_INFO("%s init took %lu ms\r\n", emulator[i].name, (unsigned long)(us / 1000u));
+}
+
+/* One deferred init per pass, so the Beeb's pollers - SCSI, services, the
+   audio refill - get a turn between them; then out of the table. */
+static void init_deferred_poll(void)
+{
+   if (init_deferred_next < init_deferred_count) {
+      uint8_t i = init_deferred[init_deferred_next++];
+      /* The configured timeout may be shorter than the init. */
+      watchdog_init_kick();
+      init_one(i);
+      if (init_deferred_next < init_deferred_count)
+         return;
+      LOG_INFO("Bus live in %lu ms, everything up in %lu ms\r\n",
+               (unsigned long)((init_bus_live_us - init_start_us) / 1000u),
+               (unsigned long)((RPI_GetSystemTime() - init_start_us) / 1000u));
+   }
+   RPI_BootStage(BOOT_STAGE_RUNNING);
+   Pi1MHz_Unregister_Poll(init_deferred_poll);
+}
+
 static void init_emulator(void) {
+   init_start_us = RPI_GetSystemTime();
    LOG_INFO("\r\n\r\n**** Raspberry Pi 1MHz Emulator %s %s " BUILD_DATE " ****\r\n\r\n",RELEASENAME, GITVERSION);
 
    // Load Pi1MHz.cfg from the SD card before any emulator reads its config.
@@ -410,7 +631,10 @@ static void init_emulator(void) {
       64 KB TX ring had drained. */
    {
       boot_stage_t prev = RPI_BootStagePrevious();
-      if (prev != 0u && prev != BOOT_STAGE_RUNNING)
+      if (prev >= BOOT_STAGE_INIT && prev < BOOT_STAGE_INIT_OF(NUM_EMULATORS))
+         LOG_WARN("PREVIOUS BOOT DIED IN %s INIT\r\n",
+                  emulator[prev - BOOT_STAGE_INIT].name);
+      else if (prev != 0u && prev != BOOT_STAGE_RUNNING)
          LOG_WARN("PREVIOUS BOOT DIED AT STAGE %u\r\n", (unsigned int)prev);
    }
 
@@ -460,13 +684,18 @@ static void init_emulator(void) {
       }
    }
 
-   Pi1MHz_polls_max = 0;
+   poll_sched_reset();
 
+   bus_trace_unhook();
    memset(&Pi1MHz->callback_table[0], 0, Pi1MHz_CB_SIZE);
    memset(&Pi1MHz->Memory[0],0,sizeof(Pi1MHz->Memory)); // Clear FRED and JIM memory
 
    for(int i=255; i>=0; i--)
       Pi1MHz_Memory_VPU[i]=0;             // Clear VPU ram.
+   memset(vpu_echo, 0, sizeof vpu_echo);  // ... and with it every local pair
+   memset(vpu_local, 0, sizeof vpu_local);
+   vpu_local_enabled = true;
+   vpu_stream_reset();                    // ... and any streaming register
 
    RPI_PropertyStart(TAG_LAUNCH_VPU1, 7);
    RPI_PropertyAdd((uint32_t)Pi1MHzvc_asm); // VPU function
@@ -487,7 +716,7 @@ static void init_emulator(void) {
 
    RPI_PropertyAdd(DATABUS_TO_OUTPUTS); // r3
    RPI_PropertyAdd(TEST_PINS_OUTPUTS | (1<<(NOE_PIN<<3))); // r4
-   RPI_PropertyAdd(0); // r5 TEST_MASK
+   RPI_PropertyAdd(vpu_stream_bus()); // r5 stream control block
    RPI_PropertyProcess(false);
 
    RPI_IRQBase->FIQ_control = 0x80 + 67; // doorbell FIQ
@@ -515,13 +744,19 @@ static void init_emulator(void) {
       rpi_audio_mute_beeb(bp && atoi(bp) == 1);
    }
 
+   /* A BBC RST part-way through the deferred inits starts them again. */
+   init_deferred_count = 0u;
+   init_deferred_next = 0u;
+
    for( uint8_t i=0; i <NUM_EMULATORS; i++)
       {
          LOG_DEBUG("Init %s at 0x%02x\r\n",emulator[i].name, emulator[i].address);
          /* Each emulator's init is well under the boot timeout, but the
             sequence as a whole is not - so feed the dog between them. */
          watchdog_boot_kick();
-         if (emulator[i].enable == 1) emulator[i].init(i, emulator[i].address);
+         if (emulator[i].enable == 1 && emulator[i].stage == INIT_DEFERRED)
+            init_deferred[init_deferred_count++] = i;
+         else if (emulator[i].enable == 1) init_one(i);
          /* watchdog_init() is what takes ownership of the boot watchdog -
             it either registers the kicking poll or stands the dog down. If
             the config disabled this entry ("Watchdog_addr=-1", the documented
@@ -532,6 +767,11 @@ static void init_emulator(void) {
          else if (emulator[i].init == watchdog_init) watchdog_stop();
       }
    RPI_BootStage(BOOT_STAGE_EMULATORS);
+   init_bus_live_us = RPI_GetSystemTime();
+
+   /* Background: whatever the Beeb is doing comes first.  Registered even
+      with nothing deferred, as it is what stamps BOOT_STAGE_RUNNING. */
+   Pi1MHz_Register_Poll_Sched(init_deferred_poll, POLL_BACKGROUND, 0u, 0u);
 }
 
 static uint8_t led_pin;
@@ -579,112 +819,6 @@ static void init_hardware(void)
 /* Published once per poll-loop pass; see the loop in kernel_main. */
 uint32_t Pi1MHz_now_us;
 
-/* Poll-loop cycle profiler.  Off by default; set to 1, rebuild, and the
-   firmware prints a per-callback cycle breakdown once after
-   POLL_PROFILE_PASSES passes and then stops.  Uses the ARM1176 cycle counter
-   (CP15 c15,c12) rather than RPI_GetSystemTime(), because the system timer is
-   a Strongly-Ordered peripheral read - reading it per callback would cost more
-   than most callbacks do. */
-#define POLL_PROFILE 0
-#define POLL_PROFILE_PASSES 200000u
-
-#if (__ARM_ARCH >= 7)
-/* Cortex-A53 (kernel7.img): the ARM1176 CP15 c15 performance-monitor
-   registers do NOT exist on the A53 and every access faults as an Undefined
-   Instruction - this crashed every kernel7 boot at STAGE 2, latent until a
-   Pi Zero 2 was actually run (kernel7 had only ever been built, never
-   booted, on real A53 silicon).  The c15 counter was purely an arm1176
-   micro-optimisation to dodge the Strongly-Ordered system-timer read per
-   callback; here just use the 1 MHz system timer.  poll_ticks is measured in
-   microseconds, so POLL_TICKS_PER_MS is 1000 and the reported duration and
-   the 50 ms threshold below both come out correct without further scaling. */
-#define POLL_TICKS_PER_MS 1000u
-static inline uint32_t poll_ticks(void) { return RPI_GetSystemTime(); }
-static void poll_ticks_start(void) { }
-
-#else
-/* ARM1176 (kernel.img): the low-overhead CP15 c15 cycle counter, ticking
-   once per 64 processor cycles (the /64 divider keeps a 32-bit counter from
-   wrapping inside any interval we care about: ~275 s at 1 GHz).  A CP15
-   register read costs a couple of cycles against 47 for RPI_GetSystemTime(),
-   which is a Strongly-Ordered peripheral load - and the slow-poll check
-   wants a timestamp per callback, so seven peripheral reads per pass were
-   costing ~330 cycles, over 10% of the idle loop, purely to police a 50 ms
-   threshold. */
-#define POLL_TICKS_PER_MS 15625u          /* 1 GHz / 64 / 1000 */
-
-static inline uint32_t poll_ticks(void)
-{
-   uint32_t v;
-   __asm volatile ("mrc p15,0,%0,c15,c12,1" : "=r" (v));
-   return v;
-}
-
-static void poll_ticks_start(void)
-{
-   /* enable counters, reset them, reset CCNT, /64 divider on */
-   uint32_t ctrl = 0x000Fu;
-   __asm volatile ("mcr p15,0,%0,c15,c12,0" :: "r" (ctrl) : "memory");
-}
-#endif
-
-#define POLL_SLOW_TICKS (50u * POLL_TICKS_PER_MS)
-
-#if POLL_PROFILE
-#if (__ARM_ARCH >= 7)
-#error "POLL_PROFILE uses the ARM1176 CP15 c15 cycle counter, which faults on the A53 (kernel7). Profile on kernel.img (rpi) instead."
-#endif
-static uint32_t poll_prof_cycles[NUM_EMULATORS];
-static uint32_t poll_prof_overhead;
-static uint32_t poll_prof_passes;
-
-static inline uint32_t poll_prof_ccnt(void)
-{
-   uint32_t v;
-   __asm volatile ("mrc p15,0,%0,c15,c12,1" : "=r" (v));
-   return v;
-}
-
-static void poll_prof_start(void)
-{
-   /* enable counters + reset CCNT; divider bit (8) left clear so CCNT counts
-      every cycle rather than every 64th */
-   uint32_t ctrl = 0x0007u;
-   __asm volatile ("mcr p15,0,%0,c15,c12,0" :: "r" (ctrl) : "memory");
-}
-
-static void poll_prof_report(void)
-{
-   uint32_t total = poll_prof_overhead;
-   for (unsigned int i = 0; i < Pi1MHz_polls_max; i++)
-      total += poll_prof_cycles[i];
-
-   LOG_INFO("POLL PROFILE over %lu passes, %u callbacks\r\n",
-            (unsigned long)poll_prof_passes, (unsigned int)Pi1MHz_polls_max);
-   for (unsigned int i = 0; i < Pi1MHz_polls_max; i++)
-      LOG_INFO("  idx %2u @%08lx: %6lu cycles/pass\r\n", i,
-               (unsigned long)(uintptr_t)Pi1MHz_poll_table[i],
-               (unsigned long)(poll_prof_cycles[i] / poll_prof_passes));
-   LOG_INFO("  loop overhead: %6lu cycles/pass\r\n",
-            (unsigned long)(poll_prof_overhead / poll_prof_passes));
-   LOG_INFO("  TOTAL: %lu cycles/pass\r\n",
-            (unsigned long)(total / poll_prof_passes));
-
-   /* What does one system-timer read actually cost?  It is a
-      Strongly-Ordered peripheral load, so the core cannot proceed until the
-      peripheral bus answers - and the pollers call it repeatedly per pass. */
-   {
-      uint32_t t0 = poll_prof_ccnt();
-      uint32_t sink = 0u;
-      for (unsigned int i = 0; i < 1000u; i++)
-         sink += RPI_GetSystemTime();
-      LOG_INFO("  RPI_GetSystemTime: %lu cycles each (sink %lu)\r\n",
-               (unsigned long)((poll_prof_ccnt() - t0) / 1000u),
-               (unsigned long)(sink & 1u));
-   }
-}
-#endif
-
 _Noreturn void kernel_main(void)
 {
    unsigned int baud_rate = 115200;
@@ -745,12 +879,7 @@ _Noreturn void kernel_main(void)
    filesystemInitialise(0,0); // default filesystem
 
    init_emulator();
-#if POLL_PROFILE
-   poll_prof_start();
-#else
-   poll_ticks_start();
-#endif
-   RPI_BootStage(BOOT_STAGE_RUNNING);
+   poll_sched_start();
 
    bool oldreset = Pi1MHz_is_rst_active();
    uint32_t main_poll_loops = 0u;
@@ -767,64 +896,19 @@ _Noreturn void kernel_main(void)
       {
          oldreset = false;
       }
-      /* One system-timer read per poll, not two.  RPI_GetSystemTime() is a
-         Strongly-Ordered peripheral load the core waits on, and each poll's
-         "after" timestamp is the next poll's "before", so carrying it over
-         halves the round trips across the whole loop. */
-#if POLL_PROFILE
-      {
-         uint32_t pass_start = poll_prof_ccnt();
-         uint32_t mark = pass_start;
-
-         for (size_t i = 0, n = Pi1MHz_polls_max; i < n; i++) {
-            uint32_t after;
-            Pi1MHz_poll_table[i]();
-            after = poll_prof_ccnt();
-            poll_prof_cycles[i] += after - mark;
-            mark = after;
-         }
-         poll_prof_overhead += poll_prof_ccnt() - mark;
-
-         if (++poll_prof_passes >= POLL_PROFILE_PASSES) {
-            poll_prof_report();
-            poll_prof_passes = 0u;
-            poll_prof_overhead = 0u;
-            for (unsigned int i = 0; i < NUM_EMULATORS; i++)
-               poll_prof_cycles[i] = 0u;
-         }
-      }
-#else
       /* One peripheral clock read per pass, published for the pollers whose
          deadlines are measured in milliseconds or longer - see
          Pi1MHz_now_us.  Anything needing sub-pass precision (teletext field
-         phases, SDIO command timeouts) still reads the timer itself. */
+         phases, SDIO command timeouts) still reads the timer itself.  Which
+         pollers run, and in what order, is poll_sched.c's business. */
       Pi1MHz_now_us = RPI_GetSystemTime();
-
-      uint32_t before_ticks = poll_ticks();
-      for (size_t i=0 , n=Pi1MHz_polls_max ; i<n; i++ )
-      {
-         func_ptr poll_fn = Pi1MHz_poll_table[i];
-
-            poll_fn();
-            {
-               uint32_t after_ticks = poll_ticks();
-               uint32_t duration_ticks = after_ticks - before_ticks;
-               before_ticks = after_ticks;
-
-               if (duration_ticks > POLL_SLOW_TICKS) {
-               LOG_INFO("Slow poll callback idx=%u duration_us=%lu\r\n",
-                        (unsigned int)i,
-                        (unsigned long)(duration_ticks / (POLL_TICKS_PER_MS / 1000u)));
-               }
-            }
-      }
-#endif
+      poll_sched_pass();
 
       main_poll_loops++;
       if ((main_poll_loops % 10000000u) == 0u) {
          LOG_INFO("Main poll heartbeat loops=%lu callbacks=%u\r\n",
                   (unsigned long)main_poll_loops,
-                  (unsigned int)Pi1MHz_polls_max);
+                  poll_sched_count());
       }
    } while (1);
 }
@@ -213,6 +213,49 @@ void Pi1MHz_LED(int led);
 void Pi1MHz_Register_Memory(unsigned int access, unsigned int addr, callback_func_ptr function_ptr );
 void Pi1MHz_Register_Poll( func_ptr function_ptr );
 
+/* Poll classes for Pi1MHz_Register_Poll_Sched - see poll_sched.c.
+   Pi1MHz_Register_Poll() is POLL_NORMAL, every pass. */
+#define POLL_URGENT      0u
+#define POLL_NORMAL      1u
+#define POLL_BACKGROUND  2u
+
+/* period_us: run at most once per period (0 = every pass).
+   deadline_us: POLL_URGENT only - the longest it should wait between runs;
+   the scheduler slots it in between other pollers to keep to it (0 = none). */
+void Pi1MHz_Register_Poll_Sched( func_ptr function_ptr, uint8_t priority,
+                                 uint32_t period_us, uint32_t deadline_us );
+
+/* Take a poller out of the table, for one whose work is done.  Safe from
+   inside a poll, including the poller's own. */
+void Pi1MHz_Unregister_Poll( func_ptr function_ptr );
+
+/* Work-pending events.  A poller registered with Pi1MHz_Register_Poll_Event()
+   is skipped until one of its events is raised, or until period_us has gone
+   by (0 = never: wait for the event).  The event is taken just before the
+   poller runs, so one raised while it runs runs it again next pass; a poller
+   that stops with work left raises its own event to come back. */
+#define POLL_EVENT_SCSI  (1u << 0)
+#define POLL_EVENT_NET   (1u << 1)
+#define POLL_EVENT_AUN   (1u << 2)
+#define POLL_EVENT_JIM   (1u << 3)
+#define POLL_EVENT_JIMCMD (1u << 4)
+#define POLL_EVENT_JIMTIER (1u << 5)
+
+extern volatile uint32_t Pi1MHz_poll_events;
+
+void Pi1MHz_Register_Poll_Event( func_ptr function_ptr, uint8_t priority,
+                                 uint32_t period_us, uint32_t events );
+
+/* Raise from a FIQ callback: nothing can interrupt it, so a plain OR. */
+static inline void Pi1MHz_Poll_Wake_FIQ(uint32_t events)
+{
+   Pi1MHz_poll_events |= events;
+}
+
+/* Raise from the main loop (lwIP callbacks, a poller re-arming itself): the
+   OR is masked against a FIQ raising another event mid-update. */
+void Pi1MHz_Poll_Wake(uint32_t events);
+
 void Pi1MHz_nIRQ_ASSERT(uint8_t src);
 void Pi1MHz_nIRQ_CLEAR(uint8_t src);
 
@@ -223,8 +266,28 @@ void Pi1MHz_MemoryWrite16(uint32_t addr, uint32_t data);
 void Pi1MHz_MemoryWrite32(uint32_t addr, uint32_t data);
 uint8_t Pi1MHz_MemoryRead(uint32_t addr);
 
+/* Registering this as the write callback for both addresses of a FRED pair
+   lets the VPU keep the Beeb's writes itself, without a FIQ (Pi1MHz.c). */
 void Pi1MHz_EmulatedMemoryByte(unsigned int gpio);
 
+/* For such a pair: refresh the shadow from the VPU, true if the Beeb has
+   written either byte since the last call.  False for any other address. */
+bool Pi1MHz_MemorySync(uint32_t addr);
+
+/* Let the VPU keep echo pairs and stream data registers (the default), or
+   hand them all back to the ARM so every access raises its FIQ - the bus
+   recorder needs to see them. */
+void Pi1MHz_MemoryLocal(bool enable);
+
+/* For vpu_stream.c: mark addr as the data register the VPU is streaming,
+   or unmark it.  Either way the shadow of addr's pair is first refreshed
+   from the VPU word, which the VPU has been writing. */
+void Pi1MHz_MemoryStream(uint32_t addr, bool on);
+
+/* For snapshot.c: put back the FRED registers that only echo the Beeb's
+   writes (Pi1MHz_EmulatedMemoryByte) from a saved copy of the page. */
+void Pi1MHz_MemoryRestoreEcho(const uint8_t *fred);
+
 bool Pi1MHz_is_rst_active(void);
 
 // This is an assembler function for performance.
@@ -1,25 +1,50 @@
 __attribute__((aligned(32))) const unsigned char Pi1MHzvc_asm[] = {
   0x05, 0x00, 0x43, 0x4d, 0x06, 0xe8, 0x00, 0x00, 0x20, 0x7e, 0x0d, 0xe8,
-  0x44, 0xb8, 0x00, 0x7e, 0x02, 0x6a, 0xbe, 0x18, 0x06, 0x1f, 0x01, 0x00,
+  0x44, 0xb8, 0x00, 0x7e, 0x02, 0x6a, 0x00, 0x91, 0x96, 0x00, 0x05, 0x1f,
   0x01, 0x00, 0x01, 0x00, 0x01, 0x00, 0x01, 0x00, 0x6c, 0x2d, 0x8c, 0x6d,
   0x8c, 0xc1, 0xd9, 0x60, 0xfc, 0x18, 0xbc, 0x6d, 0x0a, 0x18, 0x6c, 0x2d,
   0x8c, 0x6d, 0x8c, 0xc1, 0xd9, 0x60, 0xf5, 0x18, 0xbc, 0x6d, 0xfa, 0x18,
   0x01, 0x00, 0x01, 0x00, 0x48, 0xc3, 0x51, 0x67, 0x6c, 0x2d, 0x88, 0x6e,
   0x08, 0xa0, 0x08, 0x07, 0xbc, 0x6d, 0x79, 0x18, 0x8c, 0x6d, 0x8c, 0xc1,
   0xd9, 0x60, 0xe5, 0x18, 0xac, 0x6c, 0x13, 0x18, 0x0c, 0x6d, 0x48, 0xc3,
-  0xce, 0x40, 0x88, 0xc3, 0x42, 0x40, 0xa8, 0x6e, 0x68, 0x37, 0x63, 0x30,
-  0x1c, 0x09, 0xdc, 0x09, 0x6c, 0x2d, 0xbc, 0x6d, 0xfe, 0x18, 0x64, 0x30,
-  0x68, 0x3a, 0x53, 0x1f, 0x01, 0x00, 0x01, 0x00, 0xc8, 0x40, 0x6c, 0x2d,
-  0xbc, 0x6d, 0xfd, 0x18, 0x18, 0x09, 0xd8, 0x09, 0x4a, 0x1f, 0xa9, 0x60,
-  0x65, 0x3a, 0x6c, 0x2d, 0x8c, 0x6d, 0x8c, 0xc1, 0xd9, 0x60, 0xfc, 0x18,
-  0x65, 0x37, 0xbc, 0x6d, 0x08, 0x18, 0x6c, 0x2d, 0x8c, 0x6d, 0x8c, 0xc1,
-  0xd9, 0x60, 0xf3, 0x18, 0xbc, 0x6d, 0xfa, 0x18, 0x48, 0xc3, 0x51, 0x67,
-  0x6c, 0x2d, 0x88, 0x6e, 0x08, 0xa0, 0x08, 0x07, 0xbc, 0x6d, 0x79, 0x18,
-  0x8c, 0x6d, 0x8c, 0xc1, 0xd9, 0x60, 0xe5, 0x18, 0xac, 0x6c, 0x16, 0x18,
-  0x0c, 0x6d, 0x48, 0xc3, 0xce, 0x40, 0x88, 0xc3, 0x42, 0x40, 0xf8, 0x6c,
-  0xa8, 0x6e, 0x68, 0x37, 0x63, 0x30, 0x03, 0x18, 0x22, 0xa0, 0x09, 0x37,
-  0x1c, 0x09, 0xdc, 0x09, 0x6c, 0x2d, 0xbc, 0x6d, 0xfe, 0x18, 0x62, 0x37,
-  0x64, 0x30, 0x68, 0x3a, 0x4e, 0x1f, 0x62, 0x3a, 0xc8, 0x40, 0x6c, 0x2d,
-  0xbc, 0x6d, 0xfd, 0x18, 0x18, 0x09, 0xd8, 0x09, 0x62, 0x37, 0x45, 0x1f
+  0xce, 0x40, 0x88, 0xc3, 0x42, 0x40, 0xe8, 0x6c, 0xa8, 0x6e, 0x68, 0x37,
+  0x63, 0x30, 0xa3, 0x18, 0x1c, 0x09, 0xdc, 0x09, 0x6c, 0x2d, 0xbc, 0x6d,
+  0xfe, 0x18, 0x64, 0x30, 0x68, 0x3a, 0x51, 0x1f, 0x8a, 0x40, 0xc8, 0x40,
+  0x6c, 0x2d, 0xbc, 0x6d, 0xfd, 0x18, 0x08, 0x6d, 0x4a, 0xc3, 0xd0, 0x50,
+  0xea, 0x6c, 0x86, 0x18, 0xca, 0x6c, 0x9f, 0x18, 0x18, 0x09, 0xd8, 0x09,
+  0x42, 0x1f, 0x4e, 0xc3, 0x50, 0x47, 0x4b, 0xc3, 0x42, 0x47, 0x9e, 0x6e,
+  0x8b, 0x6e, 0x1e, 0x7c, 0x0e, 0x42, 0xeb, 0x0d, 0x7f, 0x9e, 0xb8, 0xff,
+  0xca, 0x40, 0x6c, 0x2d, 0xbc, 0x6d, 0xfe, 0x18, 0x64, 0x30, 0x68, 0x3a,
+  0x5b, 0x20, 0x0b, 0x6a, 0x04, 0x18, 0x80, 0x90, 0x17, 0x00, 0x6a, 0x1f,
+  0x1a, 0x09, 0xda, 0x09, 0x7f, 0x9e, 0xa8, 0xff, 0x5b, 0x20, 0x0b, 0x6a,
+  0x0a, 0x18, 0x5e, 0x21, 0x4f, 0xc3, 0x42, 0x47, 0xef, 0x0d, 0x5b, 0x35,
+  0x8a, 0x40, 0x80, 0x90, 0x07, 0x00, 0x5a, 0x1f, 0x18, 0x09, 0xd8, 0x09,
+  0x7f, 0x9e, 0x98, 0xff, 0x1b, 0x66, 0x5b, 0x30, 0x5e, 0x21, 0x5f, 0x22,
+  0xfe, 0x42, 0x5e, 0x31, 0x5f, 0x24, 0x0f, 0x6a, 0x94, 0x1d, 0x5b, 0x23,
+  0xcb, 0xc0, 0x0b, 0x77, 0x50, 0xc3, 0x48, 0x5f, 0x8b, 0x6e, 0xd0, 0xc1,
+  0x48, 0x87, 0x90, 0xc3, 0x50, 0x87, 0xab, 0xc1, 0x10, 0x5f, 0x10, 0xe8,
+  0x00, 0xaf, 0x00, 0xaf, 0xab, 0xc1, 0x10, 0x5f, 0x2b, 0xa0, 0x0f, 0x07,
+  0xeb, 0x0c, 0x0f, 0xe8, 0xfc, 0x03, 0x00, 0x00, 0xa8, 0x40, 0xf8, 0x43,
+  0x2b, 0x7c, 0xb8, 0x4d, 0x5a, 0x00, 0xa9, 0x60, 0x6c, 0x2d, 0x8c, 0x6d,
+  0x8c, 0xc1, 0xd9, 0x60, 0xfc, 0x18, 0xbc, 0x6d, 0x0a, 0x18, 0x6c, 0x2d,
+  0x8c, 0x6d, 0x8c, 0xc1, 0xd9, 0x60, 0xf5, 0x18, 0xbc, 0x6d, 0xfa, 0x18,
+  0x01, 0x00, 0x01, 0x00, 0x48, 0xc3, 0x51, 0x67, 0x6c, 0x2d, 0x88, 0x6e,
+  0x08, 0xa0, 0x08, 0x07, 0xbc, 0x6d, 0x79, 0x18, 0x8c, 0x6d, 0x8c, 0xc1,
+  0xd9, 0x60, 0xe5, 0x18, 0xac, 0x6c, 0x1a, 0x18, 0x0c, 0x6d, 0x48, 0xc3,
+  0xce, 0x40, 0x88, 0xc3, 0x42, 0x40, 0x8a, 0x40, 0xf8, 0x6c, 0xa8, 0x6e,
+  0x68, 0x37, 0x63, 0x30, 0x03, 0x18, 0x22, 0xa0, 0x09, 0x37, 0xea, 0x6c,
+  0xa9, 0x18, 0x1c, 0x09, 0xdc, 0x09, 0x01, 0x00, 0x6c, 0x2d, 0xbc, 0x6d,
+  0xfe, 0x18, 0x62, 0x37, 0x64, 0x30, 0x68, 0x3a, 0x4a, 0x1f, 0x62, 0x3a,
+  0x8a, 0x40, 0xc8, 0x40, 0x6c, 0x2d, 0xbc, 0x6d, 0xfd, 0x18, 0x08, 0x6d,
+  0x4a, 0xc3, 0xd0, 0x50, 0xea, 0x6c, 0x88, 0x18, 0xca, 0x6c, 0xa3, 0x18,
+  0x18, 0x09, 0xd8, 0x09, 0x62, 0x37, 0x7f, 0x9e, 0xb9, 0xff, 0x62, 0x37,
+  0x4e, 0xc3, 0x50, 0x47, 0x4b, 0xc3, 0x42, 0x47, 0x9e, 0x6e, 0x8b, 0x6e,
+  0x1e, 0x7c, 0x0e, 0x42, 0xeb, 0x0d, 0x7f, 0x9e, 0xad, 0xff, 0xca, 0x40,
+  0x6c, 0x2d, 0xbc, 0x6d, 0xfe, 0x18, 0x62, 0x37, 0x64, 0x30, 0x68, 0x3a,
+  0x5b, 0x20, 0x0b, 0x6a, 0x04, 0x18, 0xff, 0x9f, 0x7b, 0xff, 0x68, 0x1f,
+  0x1a, 0x09, 0xda, 0x09, 0x7f, 0x9e, 0x9c, 0xff, 0x62, 0x37, 0x5b, 0x20,
+  0x0b, 0x6a, 0x0a, 0x18, 0x5e, 0x21, 0x4f, 0xc3, 0x42, 0x47, 0xef, 0x0d,
+  0x5b, 0x35, 0x8a, 0x40, 0xff, 0x9f, 0x6a, 0xff, 0x57, 0x1f, 0x18, 0x09,
+  0xd8, 0x09, 0x7f, 0x9e, 0x8b, 0xff
 };
-unsigned int Pi1MHzvc_asm_len = 264;
+unsigned int Pi1MHzvc_asm_len = 558;
@@ -0,0 +1,367 @@
+/* FRED/JIM bus-access trace recorder - see bus_trace.h for the file format.
+ *
+ * The recorder is not a hook in FIQ.s.  Starting a capture copies the
+ * callback table aside and points every one of its 1024 entries at
+ * bus_trace_fiq(), which stamps the access, pushes it, and calls whatever
+ * the copy says the slot really does.  Stopping copies the table back.  So
+ * with no capture running the FIQ path is the same instructions it always
+ * was, and the cost of a capture lands only while one is running:
+ *
+ *    - a claimed access pays the record (a cycle-counter read and two
+ *      stores, about a dozen instructions) on top of its own callback;
+ *    - an unclaimed access, which FIQ.s would otherwise retire straight
+ *      from the NULL test, now makes a call - the same cost as the
+ *      cheapest callback there is.
+ *
+ * The profiler borrows the same hook to count callbacks per slot (see
+ * bus_trace_count()); the table goes back only once neither wants it.
+ * A capture also stops the VPU keeping echo-register writes to itself
+ * (Pi1MHz_MemoryLocal), or they would never reach the recorder; counting
+ * leaves it alone, so the profile is of the FIQs that really happen.
+ *
+ * Neither depends on what the sink is doing.  The ring is single-producer
+ * (the FIQ) single-consumer (the poll loop) on one core, so it needs no
+ * lock: each side owns one index, and a FIQ can only run between the
+ * consumer's instructions, never alongside them.  When the sink falls
+ * behind the FIQ drops the access rather than wait, counts it, and writes
+ * a BUS_TRACE_DROPPED record into the next gap so the capture says where
+ * it lost time.  64K records is ~65 ms of a saturated 1 MHz bus - more
+ * than the ~50 ms a card garbage-collect can stall an f_write for - and
+ * real 6502 code reaches a fraction of that.
+ *
+ * The swap is done entry by entry with FIQs left on: the forwarding table
+ * is complete before the first live entry changes, and one word store is
+ * atomic, so a FIQ that lands mid-swap finds either the real callback or
+ * the recorder, and both do the right thing.  Everything that writes the
+ * table runs in the poll loop, so nothing else races it.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "Pi1MHz.h"
+#include "config.h"
+#include "rpi/systimer.h"
+#include "rpi/performance.h"
+#include "BeebSCSI/fatfs/ff.h"
+#include "bus_trace.h"
+
+#define BUS_TRACE_RING         65536u          /* records, power of two */
+#define BUS_TRACE_RING_MASK    (BUS_TRACE_RING - 1u)
+#define BUS_TRACE_SD_CHUNK     16384u          /* bytes per f_write */
+#define BUS_TRACE_DEFAULT_RECORDS (1024u * 1024u)
+#define BUS_TRACE_MAX_RECORDS  (64u * 1024u * 1024u)
+
+_Static_assert((BUS_TRACE_RING & BUS_TRACE_RING_MASK) == 0u, "ring size must be a power of two");
+
+#if (__ARM_ARCH >= 7)
+/* Cortex-A53: the ARM1176 c15 counter faults here (see poll_ticks() in
+   Pi1MHz.c), so stamp with the 1 MHz system timer.  That is a
+   Strongly-Ordered load, ~47 cycles per access traced, and microsecond
+   resolution: enough to see bursts, not to separate back-to-back cycles. */
+#define BUS_TRACE_TICKS_PER_MS 1000u
+static inline uint32_t bus_trace_ticks(void) { return RPI_GetSystemTime(); }
+static void bus_trace_ticks_start(void) { }
+#else
+/* ARM1176: the c15 cycle counter with the /64 divider, exactly as the poll
+   loop runs it - 64 ns a tick for the price of a coprocessor read. */
+#define BUS_TRACE_TICKS_PER_MS 15625u          /* 1 GHz / 64 / 1000 */
+static inline uint32_t bus_trace_ticks(void)
+{
+   uint32_t v;
+   __asm volatile ("mrc p15,0,%0,c15,c12,1" : "=r" (v));
+   return v;
+}
+static void bus_trace_ticks_start(void)
+{
+   /* A capture from boot starts before kernel_main has enabled the counter.
+      Enable it with the divider, but without the reset bits, so the poll
+      loop's timing is not disturbed when it is already running.  (Under
+      a profile, which runs it the same way, nothing changes.) */
+   uint32_t ctrl = 0x0009u;
+   __asm volatile ("mcr p15,0,%0,c15,c12,0" :: "r" (ctrl) : "memory");
+}
+#endif
+
+typedef struct {
+   uint32_t gpio;
+   uint32_t stamp;
+} bus_trace_rec_t;
+
+_Static_assert(sizeof(bus_trace_rec_t) == BUS_TRACE_RECORD, "record layout");
+
+static bus_trace_rec_t *bus_trace_ring;
+static volatile uint32_t bus_trace_head;       /* written by the FIQ only */
+static volatile uint32_t bus_trace_tail;       /* written by the consumer only */
+static volatile uint32_t bus_trace_lost;       /* drops not yet in the ring */
+static uint32_t bus_trace_lost_total;
+
+/* What the live table held before the recorder replaced it. */
+static callback_func_ptr bus_trace_forward[PAGE_SIZE * 2 * 2];
+static bool bus_trace_hooked;
+static bus_trace_counts_t *volatile bus_trace_counts;
+
+static bool bus_trace_active;
+static uint32_t bus_trace_want;                /* records in this capture */
+static uint32_t bus_trace_done;                /* records handed to the sink */
+static bool bus_trace_header_sent;
+
+/* SD sink */
+static FIL bus_trace_file;
+static bool bus_trace_file_open;
+static bool bus_trace_boot_capture_done;
+static uint8_t *bus_trace_staging;
+static size_t bus_trace_staged;
+
+static void bus_trace_fiq(unsigned int gpio)
+{
+   if (bus_trace_active) {
+      uint32_t stamp = bus_trace_ticks();
+      uint32_t head = bus_trace_head;
+      uint32_t space = (bus_trace_tail - head - 1u) & BUS_TRACE_RING_MASK;
+      uint32_t lost = bus_trace_lost;
+
+      if (space > (lost != 0u)) {
+         if (lost != 0u) {
+            bus_trace_ring[head].gpio = BUS_TRACE_DROPPED;
+            bus_trace_ring[head].stamp = lost;
+            head = (head + 1u) & BUS_TRACE_RING_MASK;
+            bus_trace_lost = 0u;
+         }
+         bus_trace_ring[head].gpio = gpio;
+         bus_trace_ring[head].stamp = stamp;
+         bus_trace_head = (head + 1u) & BUS_TRACE_RING_MASK;
+      } else {
+         bus_trace_lost = lost + 1u;
+      }
+   }
+
+   /* the callback_table index FIQ.s would have used */
+   unsigned int index = GET_ADDR(gpio)
+                      | (((gpio >> (NPCFC_PIN - DATABUS_SHIFT)) & 1u) << 8)
+                      | (((gpio >> (RNW_PIN - DATABUS_SHIFT)) & 1u) << 9);
+   callback_func_ptr fn = bus_trace_forward[index];
+   bus_trace_counts_t *counts = bus_trace_counts;
+   if (counts != NULL) {
+      counts->calls[index]++;
+      if (fn != NULL) {
+         unsigned int c0 = read_cycle_counter();
+         fn(gpio);
+         counts->cycles[index] += read_cycle_counter() - c0;
+      }
+      return;
+   }
+   if (fn != NULL)
+      fn(gpio);
+}
+
+static void bus_trace_hook(void)
+{
+   if (bus_trace_hooked)
+      return;
+   memcpy(bus_trace_forward, Pi1MHz->callback_table, sizeof bus_trace_forward);
+   bus_trace_hooked = true;
+   for (unsigned int i = 0; i < PAGE_SIZE * 2 * 2; i++)
+      Pi1MHz->callback_table[i] = bus_trace_fiq;
+}
+
+static void bus_trace_restore(void)
+{
+   if (!bus_trace_hooked)
+      return;
+   for (unsigned int i = 0; i < PAGE_SIZE * 2 * 2; i++)
+      Pi1MHz->callback_table[i] = bus_trace_forward[i];
+   bus_trace_hooked = false;
+}
+
+bool bus_trace_register(unsigned int index, callback_func_ptr function_ptr)
+{
+   if (!bus_trace_hooked)
+      return false;
+   bus_trace_forward[index] = function_ptr;
+   return true;
+}
+
+void bus_trace_unhook(void)
+{
+   bus_trace_hooked = false;
+}
+
+bool bus_trace_running(void)
+{
+   return bus_trace_active;
+}
+
+void bus_trace_count(bus_trace_counts_t *counts)
+{
+   bus_trace_counts = counts;
+   if (counts != NULL)
+      bus_trace_hook();
+   else if (!bus_trace_active)
+      bus_trace_restore();
+}
+
+bool bus_trace_start(uint32_t records)
+{
+   if (bus_trace_active || records == 0u)
+      return false;
+   if (bus_trace_ring == NULL) {
+      bus_trace_ring = malloc(BUS_TRACE_RING * sizeof(bus_trace_rec_t));
+      if (bus_trace_ring == NULL)
+         return false;
+   }
+   if (records > BUS_TRACE_MAX_RECORDS)
+      records = BUS_TRACE_MAX_RECORDS;
+
+   bus_trace_head = 0u;
+   bus_trace_tail = 0u;
+   bus_trace_lost = 0u;
+   bus_trace_lost_total = 0u;
+   bus_trace_want = records;
+   bus_trace_done = 0u;
+   bus_trace_header_sent = false;
+   bus_trace_ticks_start();
+   bus_trace_active = true;
+   bus_trace_hook();
+   Pi1MHz_MemoryLocal(false);      /* echo writes the VPU keeps are accesses too */
+   LOG_INFO("Bus trace: capturing %lu accesses\r\n", (unsigned long)records);
+   return true;
+}
+
+void bus_trace_stop(void)
+{
+   if (!bus_trace_active)
+      return;
+   bus_trace_active = false;
+   Pi1MHz_MemoryLocal(true);
+   if (bus_trace_counts == NULL)
+      bus_trace_restore();
+   LOG_INFO("Bus trace: stopped after %lu records, %lu accesses dropped\r\n",
+            (unsigned long)bus_trace_done, (unsigned long)bus_trace_lost_total);
+}
+
+size_t bus_trace_read(void *buf, size_t size)
+{
+   uint8_t *out = buf;
+   size_t n = 0u;
+
+   if (!bus_trace_active)
+      return 0u;
+
+   if (!bus_trace_header_sent) {
+      uint8_t h[BUS_TRACE_HEADER] = BUS_TRACE_MAGIC;
+      const uint32_t ticks = BUS_TRACE_TICKS_PER_MS;
+      if (size < BUS_TRACE_HEADER)
+         return 0u;
+      h[4] = (uint8_t)BUS_TRACE_VERSION;
+      h[6] = (uint8_t)BUS_TRACE_RECORD;
+      memcpy(&h[8], &ticks, sizeof ticks);
+      memcpy(out, h, sizeof h);
+      n = sizeof h;
+      bus_trace_header_sent = true;
+   }
+
+   uint32_t tail = bus_trace_tail;
+   uint32_t avail = (bus_trace_head - tail) & BUS_TRACE_RING_MASK;
+   uint32_t room = (uint32_t)((size - n) / BUS_TRACE_RECORD);
+   uint32_t left = bus_trace_want - bus_trace_done;
+
+   if (avail > room)
+      avail = room;
+   if (avail > left)
+      avail = left;
+   for (uint32_t i = 0; i < avail; i++) {
+      const bus_trace_rec_t *r = &bus_trace_ring[tail];
+      if (r->gpio == BUS_TRACE_DROPPED)
+         bus_trace_lost_total += r->stamp;
+      memcpy(out + n, r, BUS_TRACE_RECORD);
+      n += BUS_TRACE_RECORD;
+      tail = (tail + 1u) & BUS_TRACE_RING_MASK;
+   }
+   bus_trace_tail = tail;
+   bus_trace_done += avail;
+
+   if (bus_trace_done == bus_trace_want)
+      bus_trace_stop();
+   return n;
+}
+
+/* SD sink: stage a card-friendly burst, then write it.  The capture keeps
+   running through the f_write - that is what the ring is for. */
+static void bus_trace_poll(void)
+{
+   UINT written;
+
+   if (!bus_trace_file_open)
+      return;
+
+   bus_trace_staged += bus_trace_read(bus_trace_staging + bus_trace_staged,
+                                      BUS_TRACE_SD_CHUNK - bus_trace_staged);
+   if (bus_trace_staged + BUS_TRACE_RECORD <= BUS_TRACE_SD_CHUNK && bus_trace_active)
+      return;
+
+   if (bus_trace_staged != 0u
+       && (f_write(&bus_trace_file, bus_trace_staging, (UINT)bus_trace_staged, &written) != FR_OK
+           || written != bus_trace_staged)) {
+      LOG_WARN("Bus trace: SD write failed, capture abandoned\r\n");
+      bus_trace_stop();
+   }
+   bus_trace_staged = 0u;
+
+   if (!bus_trace_active) {
+      f_close(&bus_trace_file);
+      bus_trace_file_open = false;
+      free(bus_trace_staging);
+      bus_trace_staging = NULL;
+   }
+}
+
+// cppcheck-suppress unusedFunction
+void bus_trace_init(uint8_t instance, uint8_t address)
+{
+   const char *file = config_get("bus_trace");
+
+   (void)instance;
+   (void)address;
+
+   /* A BBC RST re-runs every init and clears the callback table; a capture
+      or a profile that spans it carries on once the emulators are back. */
+   if (bus_trace_active || bus_trace_counts != NULL)
+      bus_trace_hook();
+   if (bus_trace_active) {
+      Pi1MHz_MemoryLocal(false);
+      if (bus_trace_file_open)
+         Pi1MHz_Register_Poll(bus_trace_poll);
+      return;
+   }
+
+   /* From-boot capture: once per power-on, not once per BBC RST. */
+   if (file == NULL || file[0] == '\0' || bus_trace_boot_capture_done)
+      return;
+   bus_trace_boot_capture_done = true;
+
+   uint32_t records = BUS_TRACE_DEFAULT_RECORDS;
+   const char *prop = config_get("bus_trace_records");
+   if (prop != NULL && strtoul(prop, NULL, 0) != 0u)
+      records = (uint32_t)strtoul(prop, NULL, 0);
+
+   bus_trace_staging = malloc(BUS_TRACE_SD_CHUNK);
+   if (bus_trace_staging == NULL)
+      return;
+   if (f_open(&bus_trace_file, file, FA_CREATE_ALWAYS | FA_WRITE) != FR_OK) {
+      LOG_WARN("Bus trace: cannot create %s\r\n", file);
+      free(bus_trace_staging);
+      bus_trace_staging = NULL;
+      return;
+   }
+   bus_trace_file_open = true;
+   bus_trace_staged = 0u;
+   if (!bus_trace_start(records)) {
+      f_close(&bus_trace_file);
+      bus_trace_file_open = false;
+      free(bus_trace_staging);
+      bus_trace_staging = NULL;
+      return;
+   }
+   Pi1MHz_Register_Poll(bus_trace_poll);
+}
@@ -0,0 +1,81 @@
+#ifndef BUS_TRACE_H
+#define BUS_TRACE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* FRED/JIM bus-access trace recorder.
+ *
+ * While a capture runs, every access the FIQ sees - claimed or not - is
+ * stamped and pushed into a ring, and a sink (a file on the SD card, or a
+ * /bustrace.bin download) drains it.  Off, it costs nothing: the FIQ path is
+ * untouched and no poll is registered.
+ *
+ * The capture is a binary file, little-endian:
+ *
+ *    header  16 bytes   "P1MT", u16 version (1), u16 record size (8),
+ *                       u32 stamp ticks per millisecond, u32 reserved (0)
+ *    record   8 bytes   u32 gpio   the word the FIQ hands a callback
+ *                                  (GPLEV0 >> DATABUS_SHIFT: decode with
+ *                                  GET_ADDR/GET_DATA; RnW is bit 8, nPCFC
+ *                                  bit 22 is set for a JIM access)
+ *                       u32 stamp  free-running, wraps
+ *
+ * A record with gpio == BUS_TRACE_DROPPED is not an access: the ring was
+ * full and `stamp` accesses were lost just before the next real record.
+ * tests/bus can replay a capture directly. */
+
+#define BUS_TRACE_MAGIC      "P1MT"
+#define BUS_TRACE_VERSION    1u
+#define BUS_TRACE_HEADER     16u
+#define BUS_TRACE_RECORD     8u
+#define BUS_TRACE_DROPPED    0xFFFFFFFFu
+
+/* Starts a capture of `records` records for the caller to drain with
+   bus_trace_read().  False if a capture is already running. */
+bool bus_trace_start(uint32_t records);
+
+/* Ends the capture early and puts the callback table back.  Safe to call
+   when nothing is running. */
+void bus_trace_stop(void);
+
+bool bus_trace_running(void);
+
+/* Copies the next part of the capture - the header first, then whole
+   records - into buf and returns the byte count.  0 means nothing is
+   waiting yet, not the end: the end is when all 16 + 8 * records bytes have
+   been returned, at which point the capture stops itself. */
+size_t bus_trace_read(void *buf, size_t size);
+
+/* Pi1MHz_Register_Memory() hook: while the recorder is in the live table,
+   a registration belongs in the table it forwards to.  True if it was
+   taken there. */
+bool bus_trace_register(unsigned int index, void (*function_ptr)(unsigned int));
+
+/* init_emulator() is about to clear the callback table: forget the
+   forwarding table too.  A capture in progress carries on, and
+   bus_trace_init() puts the recorder back once the emulators have
+   re-registered. */
+void bus_trace_unhook(void);
+
+/* Per-slot FIQ callback counts for the profiler (profiler.c), indexed as
+   callback_table is.  cycles are read_cycle_counter() counts spent in the
+   real callback, so 0 for an unclaimed slot. */
+typedef struct {
+   uint32_t calls[1024];
+   uint32_t cycles[1024];
+} bus_trace_counts_t;
+
+/* Counts every FIQ callback into *counts until called with NULL.  Uses the
+   recorder's hook, so it runs alongside a capture or without one; switching
+   to another buffer is a single pointer store the FIQ picks up on its next
+   access. */
+void bus_trace_count(bus_trace_counts_t *counts);
+
+/* Emulator-table entry.  "bus_trace=<file>" in Pi1MHz.cfg captures from
+   boot into that file; "bus_trace_records=<n>" sets the length (default
+   1M records, 8 MB). */
+void bus_trace_init(uint8_t instance, uint8_t address);
+
+#endif
@@ -1,5 +1,6 @@
 #include "beebsid_sid.h"
 
+#include <stdbool.h>
 #include <string.h>
 
 #include "fastsid.h"
@@ -74,3 +75,40 @@ uint32_t beebsid_sid_sample_rate(void)
 {
     return g_sample_rate;
 }
+
+/* The chip as fastsid sees it, and the clock its register writes are
+ * stamped against. */
+typedef struct {
+    sid_fastsid_snapshot_state_t sid;
+    CLOCK clk;
+    BYTE regs[32];
+} beebsid_sid_snapshot_t;
+
+size_t beebsid_sid_state_save(uint8_t *buf, size_t size)
+{
+    beebsid_sid_snapshot_t s;
+
+    if (!g_psid || size < sizeof(s)) {
+        return 0;
+    }
+    memset(&s, 0, sizeof(s));
+    fastsid_state_read(g_psid, &s.sid);
+    s.clk = maincpu_clk;
+    memcpy(s.regs, g_sidstate, sizeof(s.regs));
+    memcpy(buf, &s, sizeof(s));
+    return sizeof(s);
+}
+
+bool beebsid_sid_state_restore(const uint8_t *buf, size_t len)
+{
+    beebsid_sid_snapshot_t s;
+
+    if (!g_psid || len != sizeof(s)) {
+        return false;
+    }
+    memcpy(&s, buf, sizeof(s));
+    maincpu_clk = s.clk;
+    memcpy(g_sidstate, s.regs, sizeof(g_sidstate));
+    fastsid_state_write(g_psid, &s.sid);
+    return true;
+}
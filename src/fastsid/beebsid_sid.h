@@ -1,4 +1,5 @@
 #pragma once
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
@@ -12,3 +13,9 @@ void beebsid_sid_write(uint8_t reg /*0..24*/, uint8_t value);
 size_t beebsid_sid_render(int16_t *out, size_t frames);
 
 uint32_t beebsid_sid_sample_rate(void);
+
+/* Snapshot of the chip and its clock (snapshot.c, through BeebSid.c).
+ * Save returns the bytes written, 0 if the SID is not running or size is
+ * too small; restore is false unless len is what save wrote. */
+size_t beebsid_sid_state_save(uint8_t *buf, size_t size);
+bool beebsid_sid_state_restore(const uint8_t *buf, size_t len);
@@ -10,6 +10,7 @@
 #include "rpi/info.h"
 #include "rpi/systimer.h"
 #include "config.h"
+#include "harddisc_emulator.h"
 
 #include <stdbool.h>
 
@@ -18,6 +19,9 @@
 #include "BeebSCSI/filesystem.h"
 #include "BeebSCSI/hostadapter.h"
 #include "BeebSCSI/scsi.h"
+#include "BeebSCSI/writecache.h"
+
+#define HD_IDLE_POLL_US 100000u
 
 static uint8_t HD_ADDR;
 static uint8_t IRQ_NUM;
@@ -66,6 +70,7 @@ static void hd_emulator_nSEL(unsigned int gpio)
 {
    HD_DATA = GET_DATA(gpio);
    HD_SEL = ACTIVE;
+   Pi1MHz_Poll_Wake_FIQ(POLL_EVENT_SCSI);
 }
 
 static void hd_emulator_status(uint8_t bit, bool state)
@@ -173,6 +178,27 @@ static void hd_emulator_write_scsijuke(unsigned int gpio)
    scsiJukebox(GET_DATA(gpio));
 }
 
+// Only runs the SCSI state machine while there is a transaction: between
+// them it is parked in BUS FREE and hd_emulator_nSEL() wakes it.
+static void hd_emulator_poll(void)
+{
+   scsiProcessEmulation();
+   if (!scsiWaitingForSelection())
+      Pi1MHz_Poll_Wake(POLL_EVENT_SCSI);
+}
+
+// Syncs write-back LUNs once the Beeb has stopped writing to them, and opens
+// the LUN images ahead of it, one a pass, so its first READ after a boot or
+// *MOUNT need not wait for the card; never in the middle of a command, where
+// the image's file position is in use.
+static void hd_emulator_idle_poll(void)
+{
+   if (scsiWaitingForSelection()) {
+      writeCacheIdle(Pi1MHz_now_us);
+      filesystemPrefetchNextLun();
+   }
+}
+
 void harddisc_emulator_init( uint8_t instance , uint8_t address)
 {
    static bool PowerOn = 0 ;
@@ -239,13 +265,38 @@ void harddisc_emulator_init( uint8_t instance , uint8_t address)
       cancels an in-progress upload" is reasonable - the Beeb owns the card. */
    filesystemReset();
    // register polling function
-   Pi1MHz_Register_Poll(scsiProcessEmulation);
+   Pi1MHz_Register_Poll_Event(hd_emulator_poll, POLL_NORMAL, 0u, POLL_EVENT_SCSI);
+   Pi1MHz_Register_Poll_Sched(hd_emulator_idle_poll, POLL_BACKGROUND, HD_IDLE_POLL_US, 0u);
 }
 
 uint8_t harddisc_emulator_get_address(void)
 {
    return HD_ADDR;
 }
+
+// Snapshot section: the *SCSIJUKE / VFS LUN directories, which outlive a
+// BBC RST and so are worth resuming.  Only put back while no LUN is started,
+// the same rule scsiJukebox() keeps.
+size_t harddisc_snapshot_save(uint8_t *buf, size_t size)
+{
+   if (size < 2)
+      return 0;
+   buf[0] = filesystemGetLunDirectory();
+   buf[1] = filesystemGetLunDirectoryVFS();
+   return 2;
+}
+
+bool harddisc_snapshot_restore(const uint8_t *buf, size_t len)
+{
+   if (len != 2)
+      return false;
+   for (uint8_t lun = 0; lun < MAX_LUNS; lun++)
+      if (filesystemReadLunStatus(lun))
+         return false;
+   filesystemSetLunDirectory(0, buf[0]);
+   filesystemSetLunDirectory(16, buf[1]);
+   return true;
+}
 /************************************************************************
    hostadapter.c
 
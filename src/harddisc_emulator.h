@@ -1,2 +1,9 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
 void harddisc_emulator_init( uint8_t instance , uint8_t address);
-uint8_t harddisc_emulator_get_address(void);
\ No newline at end of file
+uint8_t harddisc_emulator_get_address(void);
+/* Snapshot section (snapshot.c): the SCSI and VFS LUN directories. */
+size_t harddisc_snapshot_save(uint8_t *buf, size_t size);
+bool harddisc_snapshot_restore(const uint8_t *buf, size_t len);
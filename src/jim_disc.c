@@ -0,0 +1,231 @@
+/* JIM RAM disc kept on the SD card - see jim_disc.h.
+ *
+ * The image is the range byte for byte, so it can be copied to or from a
+ * PC as it is.  It is held open from power-on.  The poller takes the first
+ * marked region at or after where it last stopped, and the marked regions
+ * that follow it, up to JIM_DISC_BURST regions; it clears their bits with
+ * FIQs masked before it writes, so a write from the Beeb while the run goes
+ * out marks it again and it goes out again.  f_sync() after every run puts
+ * the directory entry right, so a power cut loses at most what was still
+ * marked.
+ *
+ * The file only ever grows from its end: a run that starts past the end
+ * is started at the end instead, which writes the RAM in between as well.
+ * A file cut short - new, or a first write-out interrupted - therefore
+ * never has a hole, and at power-on it loads as far as it goes and the
+ * rest is marked to be written.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "Pi1MHz.h"
+#include "config.h"
+#include "BeebSCSI/fatfs/ff.h"
+#include "rpi/asm-helpers.h"
+#include "watchdog.h"
+#include "vpu_stream.h"
+#include "jim_pages.h"
+#include "jim_disc.h"
+
+#define JIM_DISC_DEFAULT_SIZE (16u * 1024u * 1024u)
+#define JIM_DISC_BURST        16u          /* regions per write: 64 KB */
+#define JIM_DISC_POLL_US      250000u
+#define JIM_DISC_LOAD_CHUNK   65536u
+
+size_t jim_disc_base;
+size_t jim_disc_len;
+uint32_t *jim_disc_dirty;
+volatile bool jim_disc_pending;
+
+static FIL disc_file;
+static bool disc_open;              // the file is open and may be written
+static uint32_t disc_regions;
+static uint32_t disc_cursor;        // the region the next search starts at
+
+/* A size or offset from Pi1MHz.cfg: a number, K or M after it for units. */
+static size_t jim_disc_bytes(const char *key, size_t fallback)
+{
+   const char *v = config_get(key);
+   char *end;
+   unsigned long n;
+
+   if (v == NULL || v[0] == '\0')
+      return fallback;
+   n = strtoul(v, &end, 0);
+   if (*end == 'K' || *end == 'k')
+      n <<= 10;
+   else if (*end == 'M' || *end == 'm')
+      n <<= 20;
+   return (size_t)n;
+}
+
+static bool jim_disc_test(uint32_t region)
+{
+   return (jim_disc_dirty[region >> 5] & (1u << (region & 31u))) != 0u;
+}
+
+/* First marked region at or after from, or disc_regions. */
+static uint32_t jim_disc_next(uint32_t from)
+{
+   while (from < disc_regions) {
+      uint32_t word = jim_disc_dirty[from >> 5] >> (from & 31u);
+
+      if (word != 0u)
+         return from + (uint32_t)__builtin_ctz(word);
+      from = (from | 31u) + 1u;
+   }
+   return disc_regions;
+}
+
+static void jim_disc_mark_from(uint32_t region)
+{
+   for (; region < disc_regions; region++)
+      jim_disc_dirty[region >> 5] |= 1u << (region & 31u);
+   jim_disc_pending = true;
+}
+
+/* Load the range from the file, as far as the file goes.  A block of zeros
+   is not copied, so paged JIM RAM (jim_pages.h) does not page it in. */
+static uint32_t jim_disc_load(uint8_t *buf, size_t len)
+{
+   uint32_t size = (uint32_t)f_size(&disc_file);
+   uint32_t done = 0u;
+
+   if (size > len)
+      size = (uint32_t)len;
+   size &= ~(JIM_DISC_REGION - 1u);
+   while (done < size) {
+      UINT got = 0;
+      uint32_t n = size - done;
+
+      if (n > JIM_DISC_LOAD_CHUNK)
+         n = JIM_DISC_LOAD_CHUNK;
+      if (f_read(&disc_file, buf, n, &got) != FR_OK || got != n)
+         break;
+      for (uint32_t o = 0u; o < n; o += JIM_DISC_REGION) {
+         size_t at = jim_disc_base + done + o;
+         bool zero = true;
+
+         for (uint32_t i = 0u; i < JIM_DISC_REGION && zero; i++)
+            zero = buf[o + i] == 0u;
+         if (!zero)
+            memcpy(Pi1MHz->JIM_ram + at, buf + o, JIM_DISC_REGION);
+         else if (!jim_pages_zero(at, JIM_DISC_REGION))
+            memset(Pi1MHz->JIM_ram + at, 0, JIM_DISC_REGION);
+      }
+      done += n;
+      watchdog_boot_kick();
+   }
+   return done;
+}
+
+void jim_disc_open(void)
+{
+   const char *file = config_get("jim_disc");
+   size_t ram = (size_t)Pi1MHz->JIM_ram_size << 24;
+   uint8_t *buf;
+   uint32_t loaded;
+
+   if (file == NULL || file[0] == '\0' || Pi1MHz->JIM_ram == NULL || jim_disc_len != 0u)
+      return;
+
+   size_t base = jim_disc_bytes("jim_disc_addr", 0u) & ~(size_t)(JIM_DISC_REGION - 1u);
+   size_t len = jim_disc_bytes("jim_disc_size", JIM_DISC_DEFAULT_SIZE) & ~(size_t)(JIM_DISC_REGION - 1u);
+   if (len == 0u || base >= ram || len > ram - base) {
+      LOG_WARN("JIM disc: %s does not fit the %u MB of JIM RAM\r\n", file, 16u * Pi1MHz->JIM_ram_size);
+      return;
+   }
+
+   BYTE mode = config_beeb_write_protected() ? FA_READ : (FA_READ | FA_WRITE | FA_OPEN_ALWAYS);
+   if (f_open(&disc_file, file, mode) != FR_OK) {
+      LOG_WARN("JIM disc: cannot open %s\r\n", file);
+      return;
+   }
+
+   disc_regions = (uint32_t)(len >> JIM_DISC_REGION_SHIFT);
+   jim_disc_dirty = calloc((disc_regions + 31u) >> 5, sizeof *jim_disc_dirty);
+   buf = malloc(JIM_DISC_LOAD_CHUNK);
+   if (jim_disc_dirty == NULL || buf == NULL) {
+      free(jim_disc_dirty);
+      free(buf);
+      jim_disc_dirty = NULL;
+      f_close(&disc_file);
+      return;
+   }
+
+   jim_disc_base = base;
+   loaded = jim_disc_load(buf, len);
+   free(buf);
+   disc_open = (mode & FA_WRITE) != 0u;
+   if (disc_open && loaded < len)
+      jim_disc_mark_from(loaded >> JIM_DISC_REGION_SHIFT);
+   jim_disc_len = len;                 // last: marking starts here
+   LOG_INFO("JIM disc: %s at JIM &%06lX, %lu KB loaded of %lu KB%s\r\n", file,
+            (unsigned long)base, (unsigned long)(loaded >> 10), (unsigned long)(len >> 10),
+            disc_open ? "" : ", read-only");
+}
+
+size_t jim_disc_init_limit(size_t size)
+{
+   if (jim_disc_len != 0u && jim_disc_base < size)
+      return jim_disc_base;
+   return size;
+}
+
+/* Write one run out.  A failure stops write-back for the session: the RAM
+   is still right, and the Beeb is not told, as it would not be for a
+   failing SD card under any other emulator. */
+static void jim_disc_poll(void)
+{
+   uint32_t first, count, size;
+   UINT written = 0;
+
+   if (!disc_open || !jim_disc_pending)
+      return;
+
+   first = jim_disc_next(disc_cursor);
+   if (first == disc_regions) {
+      first = jim_disc_next(0u);
+      if (first == disc_regions) {
+         jim_disc_pending = false;
+         return;
+      }
+   }
+
+   // never leave a hole: a run past the end of the file starts at the end
+   size = (uint32_t)f_size(&disc_file) >> JIM_DISC_REGION_SHIFT;
+   if (first > size)
+      first = size;
+
+   unsigned int cpsr = _disable_interrupts_cspr();
+   count = 0u;
+   while (count < JIM_DISC_BURST && first + count < disc_regions
+          && (first + count >= size || jim_disc_test(first + count))) {
+      uint32_t r = first + count;
+      jim_disc_dirty[r >> 5] &= ~(1u << (r & 31u));
+      count++;
+   }
+   _restore_cpsr(cpsr);
+
+   if (count == 0u)
+      return;
+   vpu_stream_release();
+   if (f_lseek(&disc_file, (FSIZE_t)first << JIM_DISC_REGION_SHIFT) != FR_OK
+       || f_write(&disc_file, Pi1MHz->JIM_ram + jim_disc_base + ((size_t)first << JIM_DISC_REGION_SHIFT),
+                  count << JIM_DISC_REGION_SHIFT, &written) != FR_OK
+       || written != (count << JIM_DISC_REGION_SHIFT)
+       || f_sync(&disc_file) != FR_OK) {
+      LOG_WARN("JIM disc: write failed - the RAM disc is no longer being saved\r\n");
+      f_close(&disc_file);
+      disc_open = false;
+      return;
+   }
+   disc_cursor = first + count;
+}
+
+void jim_disc_start(void)
+{
+   if (disc_open)
+      Pi1MHz_Register_Poll_Sched(jim_disc_poll, POLL_BACKGROUND, JIM_DISC_POLL_US, 0u);
+}
@@ -0,0 +1,76 @@
+#ifndef JIM_DISC_H
+#define JIM_DISC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* A range of JIM RAM kept in an image file on the SD card, so a RAM disc
+ * survives the Pi being switched off.
+ *
+ * With jim_disc=<file> in Pi1MHz.cfg the range (jim_disc_addr, default 0,
+ * for jim_disc_size bytes, default 16 MB - the whole of byte-mode RAM) is
+ * loaded from the file at power-on, over a snapshot; JIM_Init.bin is only
+ * loaded up to the start of the range.  The Beeb's writes
+ * to it through the page and byte registers mark the 4 KB regions they
+ * touch; a background poller writes the marked regions back a few at a
+ * time, runs of neighbours in one go, so the file follows the RAM a second
+ * or so behind without the Beeb ever waiting for a whole-RAM save.
+ *
+ * Only those writes, and the JIM memory commands' (jim_service.c), are
+ * tracked.  The Pi's own writes to JIM RAM - the services disc buffer,
+ * network and Music 5000 buffers - live elsewhere in it and are not
+ * expected in the range.  A new file starts as whatever the
+ * RAM holds and is written out in the background.  With Beeb_write_protect
+ * set the file is loaded but never written. */
+
+#define JIM_DISC_REGION_SHIFT 12u
+#define JIM_DISC_REGION       (1u << JIM_DISC_REGION_SHIFT)
+
+/* For jim_disc_mark(): the range, and a bit per region.  len is 0 with no
+   disc, so the mark costs a subtract and a compare. */
+extern size_t jim_disc_base;
+extern size_t jim_disc_len;
+extern uint32_t *jim_disc_dirty;
+extern volatile bool jim_disc_pending;
+
+/* From the FIQ callbacks: the byte at JIM offset addr has been written.
+   Nothing can interrupt a FIQ, so the bitmap is updated without masking;
+   the poller masks FIQs to take bits out. */
+static inline void jim_disc_mark(size_t addr)
+{
+   size_t off = addr - jim_disc_base;
+
+   if (off < jim_disc_len) {
+      off >>= JIM_DISC_REGION_SHIFT;
+      jim_disc_dirty[off >> 5] |= 1u << (off & 31u);
+      jim_disc_pending = true;
+   }
+}
+
+/* jim_disc_mark() for every region of [addr, addr + len), for the JIM
+   memory commands (jim_service.c) writing on the Beeb's behalf from the main
+   loop.  With FIQs masked, as the FIQ marks the same bitmap. */
+static inline void jim_disc_mark_range(size_t addr, size_t len)
+{
+   if (jim_disc_len == 0u)
+      return;
+   for (size_t a = addr; a < addr + len; a = (a | (JIM_DISC_REGION - 1u)) + 1u)
+      jim_disc_mark(a);
+}
+
+/* From rampage_emulator_init() at power-on, after a snapshot has been
+   loaded and before JIM_Init.bin is: open or create the image and load the
+   range from it.  Nothing if jim_disc is not set. */
+void jim_disc_open(void);
+
+/* From rampage_emulator_init() each time, after jim_disc_open(): how much
+   of [0, size) of JIM RAM JIM_Init.bin may be loaded into without
+   overwriting the disc - the largest size that stops short of it. */
+size_t jim_disc_init_limit(size_t size);
+
+/* Register the write-back poller; every rampage_emulator_init(), as the
+   poll table is cleared with the emulators. */
+void jim_disc_start(void);
+
+#endif
@@ -0,0 +1,310 @@
+/* JIM_Init.bin streamed into JIM RAM - see jim_init.h.
+ *
+ * A region is read from the card into a bounce buffer with FIQs on, then
+ * copied into JIM RAM 256 bytes at a time with FIQs masked, skipping the
+ * bytes its keep mask says the Beeb has written.  A Beeb write lands either
+ * before a piece is copied, and is in the mask, or after, and overwrites
+ * it; either way it stands.  The region's bit is set, and the JIM window
+ * and the byte data register put right if they show it, under the same
+ * mask as its last piece, so the Beeb never reads a half-arrived region as
+ * arrived.  FIQs are masked for a 256-byte copy at a time, well inside a
+ * bus cycle's slack.
+ *
+ * The background poller reads up to JIM_INIT_BURST regions a pass in one
+ * f_read(), the urgent one a region at a time; a region the urgent one has
+ * read is skipped over by the background one.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "Pi1MHz.h"
+#include "config.h"
+#include "BeebSCSI/filesystem.h"
+#include "BeebSCSI/fatfs/ff.h"
+#include "rpi/asm-helpers.h"
+#include "rpi/systimer.h"
+#include "watchdog.h"
+#include "jim_pages.h"
+#include "ram_emulator.h"
+#include "jim_init.h"
+
+#define JIM_INIT_FILE   "JIM_Init.bin"
+#define JIM_INIT_BURST  4u                /* regions per background read: 64 KB */
+#define JIM_INIT_KEEP   4u                /* regions the Beeb can write ahead of */
+#define JIM_INIT_PIECE  256u              /* bytes copied per FIQ mask */
+#define JIM_INIT_WANTS  8u                /* regions asked for, not yet read */
+#define JIM_INIT_NONE   0xFFFFFFFFu
+
+size_t jim_init_len;
+uint32_t *jim_init_loaded;
+
+typedef struct {
+   uint32_t region;                       // JIM_INIT_NONE when free
+   uint32_t mask[JIM_INIT_REGION / 32u];  // a bit per byte the Beeb has written
+} jim_init_keep_t;
+
+static jim_init_keep_t keep[JIM_INIT_KEEP];
+static uint32_t keep_lost;                // regions given up on, masks full
+
+// regions asked for from the FIQ: it owns want_head, the urgent poller want_tail
+static volatile uint32_t want[JIM_INIT_WANTS];
+static volatile uint32_t want_head;
+static uint32_t want_tail;
+
+static FIL init_file;
+static bool init_open;
+static uint8_t *init_buf;
+static uint32_t init_regions;             // regions up to jim_init_len
+static uint32_t init_cursor;              // where the background poller goes on from
+static size_t init_end;                   // jim_init_len, kept once that is cleared
+static uint32_t init_start;
+
+static bool jim_init_arrived(uint32_t r)
+{
+   return ((jim_init_loaded[r >> 5] >> (r & 31u)) & 1u) != 0u;
+}
+
+static jim_init_keep_t *jim_init_keep_find(uint32_t r)
+{
+   for (unsigned int i = 0; i < JIM_INIT_KEEP; i++)
+      if (keep[i].region == r)
+         return &keep[i];
+   return NULL;
+}
+
+void jim_init_fault(size_t addr)
+{
+   uint32_t r = (uint32_t)(addr >> JIM_INIT_REGION_SHIFT);
+
+   // the three page register writes ask for the same region over and over
+   if (want_head != want_tail && want[(want_head - 1u) % JIM_INIT_WANTS] == r)
+      return;
+   want[want_head % JIM_INIT_WANTS] = r;
+   want_head++;
+   Pi1MHz_Poll_Wake_FIQ(POLL_EVENT_JIM);
+}
+
+void jim_init_keep(size_t addr)
+{
+   uint32_t r = (uint32_t)(addr >> JIM_INIT_REGION_SHIFT);
+   uint32_t off = (uint32_t)addr & (JIM_INIT_REGION - 1u);
+   jim_init_keep_t *k = jim_init_keep_find(r);
+
+   if (k == NULL) {
+      k = jim_init_keep_find(JIM_INIT_NONE);
+      if (k == NULL) {
+         // no mask to spare: the region is the Beeb's from now on
+         jim_init_loaded[r >> 5] |= 1u << (r & 31u);
+         keep_lost++;
+         return;
+      }
+      memset(k->mask, 0, sizeof k->mask);
+      k->region = r;
+   }
+   k->mask[off >> 5] |= 1u << (off & 31u);
+}
+
+/* Copy one region in from buf, len bytes of it (less for the last one). */
+static void jim_init_merge(uint32_t r, const uint8_t *buf, size_t len)
+{
+   size_t at = (size_t)r << JIM_INIT_REGION_SHIFT;
+   uint8_t *ram = Pi1MHz->JIM_ram + at;
+   bool zero = true;
+
+   for (size_t i = 0; i < len && zero; i++)
+      zero = buf[i] == 0u;
+
+   for (size_t o = 0; o < len; o += JIM_INIT_PIECE) {
+      size_t n = (len - o < JIM_INIT_PIECE) ? len - o : JIM_INIT_PIECE;
+      bool last = o + n >= len;
+      unsigned int cpsr = _disable_interrupts_cspr();
+
+      if (jim_init_arrived(r)) {          // given up on by the FIQ
+         _restore_cpsr(cpsr);
+         return;
+      }
+      const jim_init_keep_t *k = jim_init_keep_find(r);
+      if (k == NULL) {
+         // a region of zeros need not page JIM RAM in (jim_pages.h)
+         if (!(zero && len == JIM_INIT_REGION && o == 0u && jim_pages_zero(at, len)))
+            memcpy(ram + o, buf + o, n);
+         else
+            last = true;
+      } else {
+         for (size_t i = o; i < o + n; i++)
+            if ((k->mask[i >> 5] & (1u << (i & 31u))) == 0u)
+               ram[i] = buf[i];
+      }
+      if (last) {
+         jim_init_loaded[r >> 5] |= 1u << (r & 31u);
+         if (k != NULL)
+            keep[k - keep].region = JIM_INIT_NONE;
+         ram_emulator_refresh(at, JIM_INIT_REGION);
+      }
+      _restore_cpsr(cpsr);
+      if (last)
+         return;
+   }
+}
+
+static void jim_init_done(void);
+
+/* Read count regions from r, all not yet arrived when asked for. */
+static void jim_init_read(uint32_t r, uint32_t count)
+{
+   size_t at = (size_t)r << JIM_INIT_REGION_SHIFT;
+   size_t len = (size_t)count << JIM_INIT_REGION_SHIFT;
+   UINT got = 0;
+
+   if (len > init_end - at)
+      len = init_end - at;
+   if (f_lseek(&init_file, (FSIZE_t)at) != FR_OK
+       || f_read(&init_file, init_buf, (UINT)len, &got) != FR_OK || got != len) {
+      LOG_WARN("JIM_Init.bin: read failed at &%06lX - the rest is not loaded\r\n", (unsigned long)at);
+      jim_init_done();
+      return;
+   }
+   for (uint32_t i = 0; i < count; i++) {
+      size_t o = (size_t)i << JIM_INIT_REGION_SHIFT;
+      size_t n = (len - o < JIM_INIT_REGION) ? len - o : JIM_INIT_REGION;
+      jim_init_merge(r + i, init_buf + o, n);
+   }
+}
+
+/* Urgent: the regions the Beeb has asked for. */
+static void jim_init_fault_poll(void)
+{
+   while (init_open && want_tail != want_head) {
+      uint32_t r;
+
+      if (want_head - want_tail > JIM_INIT_WANTS)   // overrun: the oldest went
+         want_tail = want_head - JIM_INIT_WANTS;
+      r = want[want_tail % JIM_INIT_WANTS];
+      want_tail++;
+      if (r < init_regions && !jim_init_arrived(r))
+         jim_init_read(r, 1u);
+   }
+}
+
+/* Background: the next run of regions not yet arrived. */
+static void jim_init_poll(void)
+{
+   uint32_t r = init_cursor, count = 0u;
+
+   if (!init_open)
+      return;
+   while (r < init_regions && jim_init_arrived(r))
+      r++;
+   if (r == init_regions) {
+      jim_init_done();
+      return;
+   }
+   while (count < JIM_INIT_BURST && r + count < init_regions && !jim_init_arrived(r + count))
+      count++;
+   jim_init_read(r, count);
+   init_cursor = r + count;
+}
+
+/* All in, or given up: stop the FIQ checks and the pollers. */
+static void jim_init_stop(void)
+{
+   jim_init_len = 0u;                     // first: the FIQ checks end here
+   if (init_open)
+      f_close(&init_file);
+   init_open = false;
+   free(jim_init_loaded);
+   free(init_buf);
+   jim_init_loaded = NULL;
+   init_buf = NULL;
+   Pi1MHz_Unregister_Poll(jim_init_fault_poll);
+   Pi1MHz_Unregister_Poll(jim_init_poll);
+}
+
+static void jim_init_done(void)
+{
+   jim_init_stop();
+   LOG_INFO("JIM_Init.bin: all %lu KB in, %lu ms after the first 64 KB\r\n",
+            (unsigned long)(init_end >> 10), (unsigned long)((RPI_GetSystemTime() - init_start) / 1000u));
+   if (keep_lost != 0u)
+      LOG_WARN("JIM_Init.bin: %lu regions written to by the Beeb before they arrived were not loaded\r\n",
+               (unsigned long)keep_lost);
+}
+
+/* The part of the file from `from` to `to`, now. */
+static bool jim_init_read_now(size_t from, size_t to)
+{
+   UINT got = 0;
+
+   if (to <= from)
+      return true;
+   return f_lseek(&init_file, (FSIZE_t)from) == FR_OK
+          && f_read(&init_file, Pi1MHz->JIM_ram + from, (UINT)(to - from), &got) == FR_OK
+          && got == to - from;
+}
+
+bool jim_init_load(size_t size)
+{
+   bool stream = config_get_bool("jim_init_stream");
+   size_t ram = (size_t)Pi1MHz->JIM_ram_size << 24;
+   size_t head = (stream && size > JIM_INIT_HEAD) ? JIM_INIT_HEAD : size;
+   size_t end, shared;
+
+   if (init_open)                         // a BBC RST part-way through
+      jim_init_stop();
+
+   // filesystemReadFile() mounts the card if need be
+   if (!filesystemReadFile(JIM_INIT_FILE, &Pi1MHz->JIM_ram, (unsigned int)head))
+      return false;
+   if (head == size || f_open(&init_file, JIM_INIT_FILE, FA_READ) != FR_OK)
+      return true;
+   init_open = true;
+   end = (size_t)f_size(&init_file);
+   if (end > size)
+      end = size;
+
+   // the Pi-side buffers at the top are read now, as before
+   shared = (ram > DISC_RAM_SIZE) ? ram - DISC_RAM_SIZE : 0u;
+   if (shared < head)
+      shared = head;
+   if (!jim_init_read_now(shared, end))
+      LOG_WARN("JIM_Init.bin: read failed\r\n");
+   if (end > shared)
+      end = shared;
+
+   init_regions = (uint32_t)((end + JIM_INIT_REGION - 1u) >> JIM_INIT_REGION_SHIFT);
+   jim_init_loaded = calloc((init_regions + 31u) >> 5, sizeof *jim_init_loaded);
+   init_buf = malloc(JIM_INIT_BURST * JIM_INIT_REGION);
+   if (end <= head || jim_init_loaded == NULL || init_buf == NULL) {
+      // nothing to stream, or no memory to stream it with: read it now
+      if (!jim_init_read_now(head, end))
+         LOG_WARN("JIM_Init.bin: read failed\r\n");
+      jim_init_stop();
+      return true;
+   }
+
+   for (uint32_t r = 0; r < (head >> JIM_INIT_REGION_SHIFT); r++)
+      jim_init_loaded[r >> 5] |= 1u << (r & 31u);
+   for (unsigned int i = 0; i < JIM_INIT_KEEP; i++)
+      keep[i].region = JIM_INIT_NONE;
+   keep_lost = 0u;
+   want_tail = want_head;
+   init_cursor = (uint32_t)(head >> JIM_INIT_REGION_SHIFT);
+   init_end = end;
+   init_start = RPI_GetSystemTime();
+   jim_init_len = end;                    // last: the FIQ checks start here
+
+   Pi1MHz_Register_Poll_Event(jim_init_fault_poll, POLL_URGENT, 0u, POLL_EVENT_JIM);
+   Pi1MHz_Register_Poll_Sched(jim_init_poll, POLL_BACKGROUND, 0u, 0u);
+   LOG_INFO("JIM_Init.bin: %lu KB loaded, %lu KB to follow\r\n",
+            (unsigned long)(head >> 10), (unsigned long)((end - head) >> 10));
+   return true;
+}
+
+void jim_init_finish(void)
+{
+   while (init_open) {
+      jim_init_poll();
+      watchdog_kick();
+   }
+}
@@ -0,0 +1,76 @@
+#ifndef JIM_INIT_H
+#define JIM_INIT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* JIM_Init.bin streamed into JIM RAM rather than read whole before the Beeb
+ * is answered.
+ *
+ * Reading a few hundred MB from the card held up power-on, and every BBC
+ * RST, for seconds.  Now the first JIM_INIT_HEAD bytes - the greeting page,
+ * the Music 5000 wave RAM - are read at once, and a background poller reads
+ * the rest a few 16 KB regions a pass.  A bit per region says what has
+ * arrived.  A page or byte address the Beeb sets in a region that has not
+ * arrived yet asks for it from the FIQ; an urgent poller woken by
+ * POLL_EVENT_JIM reads it ahead of the rest.  Nothing holds the Beeb while
+ * it does: until the region is in, the Beeb reads whatever the RAM held
+ * before - zeros, at power-on - so a program that reads JIM straight after
+ * power-on or a BBC RST can see the wrong data.  Streaming is therefore
+ * only done with jim_init_stream=1 in Pi1MHz.cfg; by default the whole
+ * image is read at once, as before.
+ *
+ * The Beeb may write to a region before it arrives.  Those writes are kept:
+ * the bytes written are noted in one of a few per-region masks, and the
+ * region is merged in around them.  If the masks run out the region is
+ * given up on - the Beeb's writes stand and the rest of it is not loaded -
+ * and that is logged.
+ *
+ * The top DISC_RAM_SIZE of JIM RAM, which the services, network and Music
+ * 5000 recorder use from the Pi side, is still read at once, as the Pi's
+ * writes there are not tracked. */
+
+#define JIM_INIT_HEAD          (64u * 1024u)
+#define JIM_INIT_REGION_SHIFT  14u
+#define JIM_INIT_REGION        (1u << JIM_INIT_REGION_SHIFT)
+
+/* For the inline checks: the end of the streamed range (0 once it has all
+   arrived, so the check is one compare) and a bit per region arrived. */
+extern size_t jim_init_len;
+extern uint32_t *jim_init_loaded;
+
+/* From the FIQ callbacks, for a region not yet arrived. */
+void jim_init_fault(size_t addr);
+void jim_init_keep(size_t addr);
+
+static inline bool jim_init_ready(size_t addr)
+{
+   size_t r = addr >> JIM_INIT_REGION_SHIFT;
+
+   return addr >= jim_init_len || ((jim_init_loaded[r >> 5] >> (r & 31u)) & 1u) != 0u;
+}
+
+/* The Beeb has set a page or byte address: have its region read next. */
+static inline void jim_init_need(size_t addr)
+{
+   if (!jim_init_ready(addr))
+      jim_init_fault(addr);
+}
+
+/* The Beeb has written the byte at addr: keep it over the image. */
+static inline void jim_init_write(size_t addr)
+{
+   if (!jim_init_ready(addr))
+      jim_init_keep(addr);
+}
+
+/* From rampage_emulator_init(): load size bytes of JIM_Init.bin at most -
+   with jim_init_stream, the head now and the rest in the background.  False if there is no
+   JIM_Init.bin to load.  Restarts a load still going from a BBC RST. */
+bool jim_init_load(size_t size);
+
+/* Bring in whatever has not arrived yet, now - for a snapshot save. */
+void jim_init_finish(void);
+
+#endif
@@ -0,0 +1,244 @@
+/* JIM RAM paged in on demand - see jim_pages.h.
+ *
+ * The window is hung off the L1 entries at JIM_VA_BASE, which
+ * enable_MMU_and_IDCaches() leaves empty: above the VC alias, which ends at
+ * 0xC0000000 on a 1 GB Pi.  Its second-level tables, 1 KB per MB, start
+ * out all zeros - a translation fault on every page - so setting up even
+ * 480 MB is a memset of 480 KB rather than a descriptor per page.  Faults
+ * then fill them in:
+ *
+ *    read of a page never touched     map the zero page, read-only
+ *    write of a page never touched    give it a page of its own, writable
+ *    write of a zero-page page        the same
+ *
+ * and the instruction is retried.  jim_pages_zero() puts pages back to the
+ * zero page.  frames[] holds each page's memory (NULL for none), so nothing
+ * has to read the tables back.
+ *
+ * The abort can be taken from the main loop or from inside a FIQ callback
+ * writing JIM RAM, and it runs with FIQs masked.  Everything here that
+ * changes frames[] or the free list from the main loop does the same. */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "rpi/asm-helpers.h"
+#include "rpi/armc-cstubs.h"
+#include "rpi/cache.h"
+#include "jim_pages.h"
+
+// DFSR: fault status is bits [10] and [3:0]; bit 11 says the access was a write
+#define DFSR_FS(dfsr)          (((dfsr) & 0xFu) | (((dfsr) >> 6) & 0x10u))
+#define DFSR_WNR               (1u << 11)
+#define FS_TRANSLATION_PAGE    0x07u
+#define FS_PERMISSION_PAGE     0x0Fu
+
+#define JIM_VA_PAGE            (JIM_VA_BASE >> JIM_PAGE_SHIFT)
+
+static bool active;
+static uint32_t page_count;
+static uint8_t **frames;
+static uint8_t *zero_page;
+static uint8_t *sink_page;
+static uint8_t *free_head;     // released pages, linked through their first word
+static jim_pages_stats_t counts;
+
+static uint32_t page_phys(const uint8_t *frame)
+{
+   return (uint32_t)(uintptr_t)frame;
+}
+
+static void map_page(uint32_t page, const uint8_t *frame, bool writable)
+{
+   map_small_page(JIM_VA_PAGE + page, page_phys(frame) >> JIM_PAGE_SHIFT, writable);
+}
+
+/* A page of memory for the window, zeroed: the free list first, then the
+   heap.  NULL if neither has one. */
+static uint8_t *take_frame(void)
+{
+   uint8_t *frame = free_head;
+
+   if (frame != NULL) {
+      memcpy(&free_head, frame, sizeof free_head);
+      counts.free--;
+   } else {
+      frame = arm_heap_take_top(JIM_PAGE_SIZE);
+      if (frame == NULL)
+         return NULL;
+      counts.taken++;
+   }
+   memset(frame, 0, JIM_PAGE_SIZE);
+   return frame;
+}
+
+/* Give page memory of its own and map it writable.  The scratch page stands
+   in if there is none to be had; a page already on it tries again. */
+static bool back_page(uint32_t page)
+{
+   uint8_t *frame = frames[page];
+
+   if (frame != NULL && frame != sink_page)
+      return true;
+   frame = take_frame();
+   if (frame == NULL) {
+      counts.sink_faults++;
+      frames[page] = sink_page;
+      map_page(page, sink_page, true);
+      return false;
+   }
+   frames[page] = frame;
+   counts.backed++;
+   map_page(page, frame, true);
+   return true;
+}
+
+/* Back to the zero page, the page's memory onto the free list. */
+static void release_page(uint32_t page)
+{
+   uint8_t *frame = frames[page];
+
+   if (frame == NULL)
+      return;
+   frames[page] = NULL;
+   map_page(page, zero_page, false);
+   if (frame == sink_page)
+      return;
+   memcpy(frame, &free_head, sizeof free_head);
+   free_head = frame;
+   counts.free++;
+   counts.backed--;
+}
+
+bool jim_pages_init(size_t bytes)
+{
+   uint32_t mb = (uint32_t)(bytes >> 20);
+   unsigned int *tables;
+
+   if (active)
+      return true;
+
+   if (mb == 0u || (bytes & 0xFFFFFu) != 0u || mb > 4096u - (JIM_VA_BASE >> 20))
+      return false;
+
+   // Taken from the heap top for good; a failure part way strands at most
+   // the tables, which is less than one MB.
+   tables = arm_heap_take_top((size_t)mb * 256u * sizeof(unsigned int));
+   zero_page = arm_heap_take_top(2u * JIM_PAGE_SIZE);
+   frames = calloc((size_t)mb << (20u - JIM_PAGE_SHIFT), sizeof *frames);
+   if (tables == NULL || zero_page == NULL || frames == NULL) {
+      free(frames);
+      frames = NULL;
+      return false;
+   }
+   sink_page = zero_page + JIM_PAGE_SIZE;
+   memset(zero_page, 0, 2u * JIM_PAGE_SIZE);
+   memset(tables, 0, (size_t)mb * 256u * sizeof(unsigned int));
+
+   if (!map_l2_tables(JIM_VA_BASE >> 20, mb, tables)) {
+      free(frames);
+      frames = NULL;
+      return false;
+   }
+   page_count = mb << (20u - JIM_PAGE_SHIFT);
+   counts.pages = page_count;
+   active = true;
+   return true;
+}
+
+bool jim_pages_active(void)
+{
+   return active;
+}
+
+int jim_pages_abort(uint32_t dfar, uint32_t dfsr)
+{
+   uint32_t fs = DFSR_FS(dfsr);
+   uint32_t page = (dfar - JIM_VA_BASE) >> JIM_PAGE_SHIFT;
+
+   if (!active || dfar < JIM_VA_BASE || page >= page_count)
+      return 0;
+
+   if (fs == FS_TRANSLATION_PAGE) {
+      if ((dfsr & DFSR_WNR) == 0u) {
+         map_page(page, zero_page, false);
+         return 1;
+      }
+   } else if (fs != FS_PERMISSION_PAGE || frames[page] != NULL) {
+      // a writable page faulting is not ours to paper over
+      return 0;
+   }
+   back_page(page);
+   return 1;
+}
+
+bool jim_pages_back(size_t offset)
+{
+   if (!active)
+      return true;
+   if ((offset >> JIM_PAGE_SHIFT) >= page_count)
+      return false;
+
+   unsigned int cpsr = _disable_interrupts_cspr();
+   bool ok = back_page((uint32_t)(offset >> JIM_PAGE_SHIFT));
+   _restore_cpsr(cpsr);
+   return ok;
+}
+
+bool jim_pages_backed(size_t offset)
+{
+   if (!active)
+      return true;
+   if ((offset >> JIM_PAGE_SHIFT) >= page_count)
+      return false;
+
+   const uint8_t *frame = frames[offset >> JIM_PAGE_SHIFT];
+   return frame != NULL && frame != sink_page;
+}
+
+uint32_t jim_pages_phys(size_t offset)
+{
+   const uint8_t *frame = zero_page;
+
+   if ((offset >> JIM_PAGE_SHIFT) < page_count && frames[offset >> JIM_PAGE_SHIFT] != NULL)
+      frame = frames[offset >> JIM_PAGE_SHIFT];
+   return page_phys(frame) + (uint32_t)(offset & (JIM_PAGE_SIZE - 1u));
+}
+
+bool jim_pages_zero(size_t offset, size_t len)
+{
+   size_t end = offset + len;
+
+   if (!active)
+      return false;
+   if (end < offset || end > (size_t)page_count << JIM_PAGE_SHIFT)
+      end = (size_t)page_count << JIM_PAGE_SHIFT;
+
+   while (offset < end) {
+      uint32_t page = (uint32_t)(offset >> JIM_PAGE_SHIFT);
+      size_t in = offset & (JIM_PAGE_SIZE - 1u);
+      size_t n = JIM_PAGE_SIZE - in;
+
+      if (n > end - offset)
+         n = end - offset;
+
+      unsigned int cpsr = _disable_interrupts_cspr();
+      uint8_t *frame = frames[page];
+      // a whole page, or a part of the scratch page whose bytes are lost
+      // anyway, goes back to the zero page; part of a real page is cleared
+      if (n == JIM_PAGE_SIZE || frame == sink_page)
+         release_page(page);
+      else if (frame != NULL)
+         memset(frame + in, 0, n);
+      _restore_cpsr(cpsr);
+      offset += n;
+   }
+   return true;
+}
+
+void jim_pages_stats(jim_pages_stats_t *stats)
+{
+   unsigned int cpsr = _disable_interrupts_cspr();
+   *stats = counts;
+   _restore_cpsr(cpsr);
+}
@@ -0,0 +1,75 @@
+#ifndef JIM_PAGES_H
+#define JIM_PAGES_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* JIM RAM paged in on demand.
+ *
+ * JIM RAM is as much of the Pi's memory as can be spared - up to 480 MB -
+ * and most Beeb software touches a few MB of it.  Rather than malloc the
+ * lot at power-on, it is reserved as a virtual window at JIM_VA_BASE whose
+ * 4 KB pages all start out mapped read-only to one shared page of zeros, so
+ * reading anywhere costs nothing.  The first write to a page faults; the
+ * data abort handler calls jim_pages_abort(), which takes a page of real
+ * memory, zeroes it, maps it writable in place of the zero page and has
+ * the store retried.  Memory not yet written stays free for lwIP, the
+ * webserver and the video buffers, and boot no longer zeroes or loads
+ * hundreds of MB.
+ *
+ * Pages come off the top of the heap (arm_heap_take_top()) and are not
+ * given back to it; pages released by jim_pages_zero() go on a free list
+ * and are reused first.  If the heap cannot spare another page the write
+ * goes to a scratch page instead and is lost - counted in sink_faults -
+ * rather than stopping the Pi.
+ *
+ * Anything that reaches JIM RAM other than through the ARM's MMU - the VPU
+ * streaming a data register - needs the page's physical address from
+ * jim_pages_phys(), and must jim_pages_back() a page it may write first. */
+
+#define JIM_VA_BASE   0xC0000000u
+#define JIM_PAGE_SHIFT 12u
+#define JIM_PAGE_SIZE  (1u << JIM_PAGE_SHIFT)
+
+typedef struct {
+   uint32_t pages;        // pages in the window
+   uint32_t backed;       // pages with memory of their own
+   uint32_t free;         // released pages waiting for reuse
+   uint32_t taken;        // pages ever taken from the heap
+   uint32_t sink_faults;  // writes lost for want of memory
+} jim_pages_stats_t;
+
+/* Reserve bytes (a multiple of 1 MB) of JIM RAM at JIM_VA_BASE, all of it
+   reading as zeros.  False, with nothing changed, if the page tables or the
+   zero page cannot be had or the window is already in use - the caller then
+   mallocs JIM RAM as before.  Once it has succeeded, later calls just
+   return true. */
+bool jim_pages_init(size_t bytes);
+
+bool jim_pages_active(void);
+
+/* From the data abort handler, with FIQs masked: dfar/dfsr as the CPU left
+   them.  1 if the fault was a write to a page of the window that is now
+   writable and the instruction should be retried, 0 for any other fault. */
+int jim_pages_abort(uint32_t dfar, uint32_t dfsr);
+
+/* Give the page holding offset memory of its own now, as a first write
+   would.  False if it ends up on the scratch page. */
+bool jim_pages_back(size_t offset);
+
+/* Whether the page holding offset has been written to since it was last
+   released.  True for everything when paging is off. */
+bool jim_pages_backed(size_t offset);
+
+/* Physical address of JIM byte offset: the zero page for a page not backed. */
+uint32_t jim_pages_phys(size_t offset);
+
+/* Make len bytes at offset read as zero: whole pages are released back to
+   the zero page, the ends are cleared.  False, doing nothing, when paging
+   is off, so the caller can memset instead. */
+bool jim_pages_zero(size_t offset, size_t len);
+
+void jim_pages_stats(jim_pages_stats_t *stats);
+
+#endif
@@ -0,0 +1,396 @@
+/*
+  The JIM memory service: commands 80-89 on the services port (&FCA6).
+
+  Moving a block from one part of JIM RAM to another from the Beeb means a
+  byte loop through &FD00 with a page switch at &FCFD-&FCFF every 256
+  bytes, or one through the byte registers setting the address each time.
+  These commands do it on the Pi with memmove()/memset()/memcmp()/memchr(),
+  which are the optimised lib/armstring routines - a few hundred MB a
+  second against a few tens of KB - so a RAM disc, a sprite engine or the
+  Music 5000 recorder can hand its bulk copies over and wait for the result.
+
+  Addresses are JIM RAM byte addresses, page number * 256, so any part of
+  the RAM can be reached, not only the services buffer the FAT commands
+  use.  Multi-byte fields are little-endian:
+
+   80 MOVE     +4 u32 source  +8 u32 destination  +12 u32 length
+               (overlapping ranges are moved as memmove() would)
+   81 FILL     +1 byte  +8 u32 destination  +12 u32 length
+   82 COMPARE  +4 u32 first  +8 u32 second  +12 u32 length
+               result 0 same, 1 different; fills +16 u32 offset of the
+               first byte that differs (length if none)
+   83 SEARCH   +1 pattern length (1-32)  +4 u32 start  +12 u32 length
+               +32 the pattern; result 0 found, 1 not; fills +16 u32
+               offset of the first match from start (length if none)
+
+  Other results: 2 a range outside JIM RAM, 3 a bad pattern length or a
+  command number not used yet.
+
+  Execution context: the command arrives in the FIQ, which only notes it
+  (the AUN service is the pattern), and a poller does the work from the
+  main loop JIM_SERVICE_SLICE bytes a pass, so a 100 MB move holds up the
+  network and the SD card for a slice's worth at a time rather than for a
+  third of a second.  The port has already echoed the block's page number,
+  &F0-&FF, to the command register; the result, below &80, is written there
+  once the whole job is done, so the Beeb polls the register until bit 7
+  clears, as for the FAT commands.  A command sent while one is running
+  abandons it.
+
+  Written bytes are treated as the Beeb's own writes: part of a RAM disc
+  kept on the card is saved (jim_disc.h), and the JIM window and byte data
+  register are put right if they show them.  Parts of JIM_Init.bin still to
+  arrive (jim_init.h) are asked for and waited on before being read or
+  written.  A fill with zeros, or a move from pages never written, gives
+  pages back rather than taking more (jim_pages.h).
+*/
+
+#include <string.h>
+
+#include "Pi1MHz.h"
+#include "services.h"
+#include "rpi/asm-helpers.h"
+#include "ram_emulator.h"
+#include "vpu_stream.h"
+#include "jim_pages.h"
+#include "jim_disc.h"
+#include "jim_init.h"
+
+#define JIM_CMD_MOVE     80u
+#define JIM_CMD_FILL     81u
+#define JIM_CMD_COMPARE  82u
+#define JIM_CMD_SEARCH   83u
+
+#define JIM_RESULT_OK        0u   /* done; same; found */
+#define JIM_RESULT_MISMATCH  1u   /* different; not found */
+#define JIM_RESULT_RANGE     2u
+#define JIM_RESULT_PARAM     3u
+
+#define JIM_SERVICE_SLICE    (256u * 1024u)  /* bytes a poll pass: well under a ms */
+#define JIM_SERVICE_PATTERN  32u
+
+_Static_assert(JIM_CMD_SEARCH <= SERVICE_CMD_JIM_LAST,
+               "JIM commands out of step with services.h");
+
+/* One-slot command mailbox: written by the FIQ, taken by the poller. */
+static volatile bool     jim_pending;
+static volatile uint32_t jim_pending_cp;
+static volatile uint32_t jim_pending_addr;
+
+typedef struct {
+   uint8_t  cmd;             // 0 when idle
+   uint32_t cp;              // command block, for the returned offset
+   uint32_t result_addr;     // FRED register the result goes to
+   size_t   src, dst, len;
+   size_t   done;            // bytes moved, filled or compared; positions searched
+   bool     backwards;       // a move to higher addresses over its own source
+   uint8_t  fill;
+   uint8_t  pattern_len;
+   uint8_t  pattern[JIM_SERVICE_PATTERN];
+} jim_job_t;
+
+static jim_job_t job;
+
+static uint32_t jim_read32(uint32_t off)
+{
+   uint32_t v;
+   memcpy(&v, __builtin_assume_aligned(&Pi1MHz->JIM_ram[off], 4), sizeof v);
+   return v;
+}
+
+static void jim_write32(uint32_t off, uint32_t v)
+{
+   memcpy(__builtin_assume_aligned(&Pi1MHz->JIM_ram[off], 4), &v, sizeof v);
+}
+
+static void jim_service_finish(uint8_t result)
+{
+   job.cmd = 0u;
+   Pi1MHz_MemoryWrite(job.result_addr, result);
+}
+
+/* Whether [addr, addr + len) has all arrived from JIM_Init.bin, asking for
+   the regions that have not as a page register write would. */
+static bool jim_service_arrived(size_t addr, size_t len)
+{
+   bool ready = true;
+
+   for (size_t a = addr & ~(size_t)(JIM_INIT_REGION - 1u); a < addr + len && a < jim_init_len;
+        a += JIM_INIT_REGION)
+      if (!jim_init_ready(a)) {
+         unsigned int cpsr = _disable_interrupts_cspr();
+         jim_init_fault(a);
+         _restore_cpsr(cpsr);
+         ready = false;
+      }
+   return ready;
+}
+
+/* [addr, addr + len) has been written: as for a write from the Beeb. */
+static void jim_service_wrote(size_t addr, size_t len)
+{
+   size_t first = addr & ~(size_t)(PAGE_SIZE - 1u);
+   size_t end = (addr + len + PAGE_SIZE - 1u) & ~(size_t)(PAGE_SIZE - 1u);
+   unsigned int cpsr = _disable_interrupts_cspr();
+
+   jim_disc_mark_range(addr, len);
+   ram_emulator_refresh(first, end - first);
+   _restore_cpsr(cpsr);
+}
+
+/* Move n bytes from s to d a source page at a time, in the job's
+   direction; a page never written reads as zeros, so d is zeroed instead,
+   which takes no memory. */
+static void jim_service_move(size_t s, size_t d, size_t n)
+{
+   uint8_t *ram = Pi1MHz->JIM_ram;
+
+   while (n != 0u) {
+      size_t at, k;
+
+      if (job.backwards) {
+         size_t last = s + n - 1u;
+         k = (last & (JIM_PAGE_SIZE - 1u)) + 1u;
+         if (k > n)
+            k = n;
+         at = n - k;
+      } else {
+         k = JIM_PAGE_SIZE - (s & (JIM_PAGE_SIZE - 1u));
+         if (k > n)
+            k = n;
+         at = 0u;
+      }
+      if (jim_pages_backed(s + at) || !jim_pages_zero(d + at, k))
+         memmove(ram + d + at, ram + s + at, k);
+      if (!job.backwards) {
+         s += k;
+         d += k;
+      }
+      n -= k;
+   }
+}
+
+/* Offset of the first byte that differs in n bytes known to differ. */
+static size_t jim_service_differs(const uint8_t *a, const uint8_t *b, size_t n)
+{
+   size_t off = 0u;
+
+   while (n > 64u) {
+      size_t half = n / 2u;
+
+      if (memcmp(a + off, b + off, half) != 0) {
+         n = half;
+      } else {
+         off += half;
+         n -= half;
+      }
+   }
+   while (a[off] == b[off])
+      off++;
+   return off;
+}
+
+/* One slice of the job.  True once it is finished. */
+static bool jim_service_step(void)
+{
+   const uint8_t *ram = Pi1MHz->JIM_ram;
+   size_t n = job.len - job.done;
+
+   if (n > JIM_SERVICE_SLICE)
+      n = JIM_SERVICE_SLICE;
+
+   switch (job.cmd) {
+   case JIM_CMD_MOVE:
+   {
+      size_t off = job.backwards ? job.len - job.done - n : job.done;
+      // both asked for before waiting on either
+      bool src_in = jim_service_arrived(job.src + off, n);
+      bool dst_in = jim_service_arrived(job.dst + off, n);
+
+      if (!src_in || !dst_in)
+         return false;
+      vpu_stream_release();
+      jim_service_move(job.src + off, job.dst + off, n);
+      jim_service_wrote(job.dst + off, n);
+      break;
+   }
+
+   case JIM_CMD_FILL:
+      if (!jim_service_arrived(job.dst + job.done, n))
+         return false;
+      vpu_stream_release();
+      if (job.fill != 0u || !jim_pages_zero(job.dst + job.done, n))
+         memset(Pi1MHz->JIM_ram + job.dst + job.done, job.fill, n);
+      jim_service_wrote(job.dst + job.done, n);
+      break;
+
+   case JIM_CMD_COMPARE:
+   {
+      bool first_in = jim_service_arrived(job.src + job.done, n);
+      bool second_in = jim_service_arrived(job.dst + job.done, n);
+
+      if (!first_in || !second_in)
+         return false;
+      if (memcmp(ram + job.src + job.done, ram + job.dst + job.done, n) != 0) {
+         jim_write32(job.cp + 16u, (uint32_t)(job.done
+            + jim_service_differs(ram + job.src + job.done, ram + job.dst + job.done, n)));
+         jim_service_finish(JIM_RESULT_MISMATCH);
+         return true;
+      }
+      break;
+   }
+
+   case JIM_CMD_SEARCH:
+   {
+      // job.len is the number of places a match can start; a match starting
+      // in this slice may run on past it
+      const uint8_t *p = ram + job.src + job.done;
+      const uint8_t *last = p + n;
+
+      if (!jim_service_arrived(job.src + job.done, n + job.pattern_len - 1u))
+         return false;
+      while ((p = memchr(p, job.pattern[0], (size_t)(last - p))) != NULL) {
+         if (memcmp(p + 1, job.pattern + 1, job.pattern_len - 1u) == 0) {
+            jim_write32(job.cp + 16u, (uint32_t)(p - (ram + job.src)));
+            jim_service_finish(JIM_RESULT_OK);
+            return true;
+         }
+         p++;
+      }
+      break;
+   }
+
+   default:
+      return true;
+   }
+
+   job.done += n;
+   if (job.done < job.len)
+      return false;
+   switch (job.cmd) {
+   case JIM_CMD_COMPARE:
+      jim_write32(job.cp + 16u, (uint32_t)job.len);
+      jim_service_finish(JIM_RESULT_OK);
+      break;
+   case JIM_CMD_SEARCH:
+      jim_write32(job.cp + 16u, (uint32_t)(job.len + job.pattern_len - 1u));
+      jim_service_finish(JIM_RESULT_MISMATCH);
+      break;
+   default:
+      jim_service_finish(JIM_RESULT_OK);
+      break;
+   }
+   return true;
+}
+
+/* Whether [addr, addr + len) lies wholly inside JIM RAM. */
+static bool jim_service_range_ok(uint32_t addr, uint32_t len)
+{
+   size_t ram = (size_t)Pi1MHz->JIM_ram_size << 24;
+
+   return addr <= ram && len <= ram - addr;
+}
+
+/* Read the block at cp and set the job up, or answer it now. */
+static void jim_service_start(uint32_t cp, uint32_t addr)
+{
+   uint8_t cmd = Pi1MHz->JIM_ram[cp];
+   uint32_t src = jim_read32(cp + 4u);
+   uint32_t dst = jim_read32(cp + 8u);
+   uint32_t len = jim_read32(cp + 12u);
+
+   job.cmd = 0u;
+   job.cp = cp;
+   job.result_addr = addr;
+   job.done = 0u;
+   job.backwards = false;
+
+   switch (cmd) {
+   case JIM_CMD_MOVE:
+   case JIM_CMD_COMPARE:
+      if (!jim_service_range_ok(src, len) || !jim_service_range_ok(dst, len)) {
+         jim_service_finish(JIM_RESULT_RANGE);
+         return;
+      }
+      job.backwards = dst > src && dst - src < len;
+      break;
+
+   case JIM_CMD_FILL:
+      if (!jim_service_range_ok(dst, len)) {
+         jim_service_finish(JIM_RESULT_RANGE);
+         return;
+      }
+      job.fill = Pi1MHz->JIM_ram[cp + 1u];
+      break;
+
+   case JIM_CMD_SEARCH:
+      job.pattern_len = Pi1MHz->JIM_ram[cp + 1u];
+      if (job.pattern_len == 0u || job.pattern_len > JIM_SERVICE_PATTERN) {
+         jim_service_finish(JIM_RESULT_PARAM);
+         return;
+      }
+      if (!jim_service_range_ok(src, len)) {
+         jim_service_finish(JIM_RESULT_RANGE);
+         return;
+      }
+      memcpy(job.pattern, &Pi1MHz->JIM_ram[cp + 32u], job.pattern_len);
+      if (len < job.pattern_len) {
+         jim_write32(cp + 16u, len);
+         jim_service_finish(JIM_RESULT_MISMATCH);
+         return;
+      }
+      len -= job.pattern_len - 1u;   // the places a match can start
+      break;
+
+   default:
+      /* 84-89 are reserved within the JIM range. */
+      jim_service_finish(JIM_RESULT_PARAM);
+      return;
+   }
+
+   job.src = src;
+   job.dst = dst;
+   job.len = len;
+   if (len == 0u) {
+      if (cmd == JIM_CMD_COMPARE)
+         jim_write32(cp + 16u, 0u);
+      jim_service_finish(JIM_RESULT_OK);
+      return;
+   }
+   job.cmd = cmd;
+}
+
+static void jim_service_poll(void)
+{
+   if (jim_pending) {
+      unsigned int cpsr = _disable_interrupts_cspr();
+      uint32_t cp = jim_pending_cp;
+      uint32_t addr = jim_pending_addr;
+
+      jim_pending = false;
+      _restore_cpsr(cpsr);
+      jim_service_start(cp, addr);
+   }
+   if (job.cmd != 0u && !jim_service_step())
+      Pi1MHz_Poll_Wake(POLL_EVENT_JIMCMD);   // more to do next pass
+}
+
+/* FIQ context: queue only, for jim_service_poll(). */
+static void jim_service_command(uint32_t cp, uint32_t addr, uint8_t data)
+{
+   (void)data;
+   jim_pending_cp = cp;
+   jim_pending_addr = addr;
+   jim_pending = true;
+   Pi1MHz_Poll_Wake_FIQ(POLL_EVENT_JIMCMD);
+}
+
+void jim_service_init(void)
+{
+   /* A BBC RST drops a job part-way through: the Beeb is no longer
+      waiting for it. */
+   jim_pending = false;
+   job.cmd = 0u;
+   (void)services_register(SERVICE_CMD_JIM_FIRST, SERVICE_CMD_JIM_LAST,
+                           jim_service_command);
+   Pi1MHz_Register_Poll_Event(jim_service_poll, POLL_NORMAL, 0u, POLL_EVENT_JIMCMD);
+}
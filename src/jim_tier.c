@@ -0,0 +1,558 @@
+/* Compressed JIM RAM above the Pi's memory - see jim_tier.h.
+ *
+ * A stored region is a blob: the end of each page's block, as 256 16-bit
+ * offsets into the data after them, then the blocks.  A block of 0 bytes
+ * is a page of zeros, of 256 a page that did not compress and is kept as
+ * it is, and anything between an LZ4 block.  The blocks come to at most
+ * 64 KB, so the only offset that can wrap is the last one, and the length
+ * taken as the difference of two wraps round right.
+ *
+ * Only the urgent poller changes a blob, the hot cache's regions and the
+ * staging pages' ownership; the FIQ only reads blobs and slot_of, writes
+ * to the page it has shown and sets its dirty flag, and takes a clean
+ * staging page for a cold one.  The poller compresses and decompresses
+ * whole regions with FIQs on and takes the mask only to switch a region
+ * between hot and cold, so a write the Beeb makes in the meantime is either
+ * seen - the eviction is given up, and tried again - or copied in from its
+ * staging page.
+ *
+ * A written staging page is folded into its region's blob by the poller,
+ * the one page compressed again and spliced in, without making the region
+ * hot.  Its copy is taken and its dirty flag cleared under the mask, and
+ * it is marked folding so the FIQ does not take it until the new blob is
+ * in; a write in between sets the flag again and it is folded again.  The
+ * FIQ never takes a written staging page.  With all of them written it
+ * shows the page from the spare, which the poller moves into a staging
+ * page once one is free; only if the Beeb writes to a second page before
+ * that are the spare's writes not kept.
+ *
+ * A blob can grow.  A reserve taken at jim_tier_init() - or no tier - is
+ * let go the first time memory runs out, so that whatever is hot or staged
+ * then can still be compressed back.  After that a region that cannot be
+ * compressed stays hot, and staging pages that cannot be folded stay
+ * written, so nothing the tier has taken is lost.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "Pi1MHz.h"
+#include "config.h"
+#include "rpi/asm-helpers.h"
+#include "ram_emulator.h"
+#include "lz4_block.h"
+#include "jim_tier.h"
+
+#define JIM_TIER_PAGES   (JIM_TIER_REGION / PAGE_SIZE)
+#define JIM_TIER_HEADER  (JIM_TIER_PAGES * sizeof(uint16_t))
+#define JIM_TIER_SLOTS   32u              /* hot regions: 2 MB */
+#define JIM_TIER_STAGE   32u              /* cold pages the Beeb can be ahead by */
+#define JIM_TIER_COLD    0xFFu
+#define JIM_TIER_NONE    0xFFFFFFFFu
+#define JIM_TIER_BLOB_MAX (JIM_TIER_HEADER + JIM_TIER_REGION)
+/* enough to compress back every hot region and fold every staging page */
+#define JIM_TIER_RESERVE ((JIM_TIER_SLOTS + JIM_TIER_STAGE) * JIM_TIER_BLOB_MAX)
+
+typedef struct {
+   uint32_t region;                       // JIM_TIER_NONE when free
+   uint32_t used;                         // tier_clock when last shown
+   bool dirty;                            // written since it was decompressed
+} jim_tier_slot_t;
+
+typedef struct {
+   size_t addr;                           // SIZE_MAX when free
+   uint32_t used;
+   bool dirty;
+   bool folding;                          // its blob is being made: the FIQ leaves it
+   uint8_t ram[PAGE_SIZE];
+} jim_tier_stage_t;
+
+size_t jim_tier_base = SIZE_MAX;
+bool *jim_tier_dirty;
+
+static uint32_t tier_regions;
+static uint8_t **tier_blob;               // a region's blob, NULL for zeros
+static uint8_t *tier_slot_of;             // a region's hot slot, or JIM_TIER_COLD
+static uint8_t *tier_hot;                 // JIM_TIER_SLOTS regions
+static uint8_t *tier_scratch;             // a blob being made
+static jim_tier_slot_t slot[JIM_TIER_SLOTS];
+static jim_tier_stage_t stage[JIM_TIER_STAGE];
+static jim_tier_stage_t spare = { .addr = SIZE_MAX }; // shown with every stage written
+static void *tier_reserve;                // let go when memory runs out
+static uint32_t tier_clock;
+static const uint8_t *tier_shown;         // the page jim_tier_page() last returned
+static volatile uint32_t tier_want = JIM_TIER_NONE;
+static bool tier_stuck;                   // an eviction found no memory
+static jim_tier_stats_t stats;
+static uint32_t reported_refused, reported_full;
+
+/* jim_overflow in 16 MB sets, rounded down. */
+static unsigned int jim_tier_config_sets(void)
+{
+   const char *v = config_get("jim_overflow");
+   char *end;
+   unsigned long n;
+
+   if (v == NULL || v[0] == '\0')
+      return 0u;
+   n = strtoul(v, &end, 0);
+   if (*end == 'G' || *end == 'g')
+      n = (n > 4u ? 4u : n) << 6;
+   else if (*end == 'M' || *end == 'm')
+      n >>= 4;
+   else if (*end == 'K' || *end == 'k')
+      n >>= 14;
+   else
+      n >>= 24;
+   return (unsigned int)n;
+}
+
+static bool jim_tier_zero_page(const uint8_t *page)
+{
+   const uint32_t *w = (const uint32_t *)page;
+
+   for (unsigned int i = 0; i < PAGE_SIZE / 4u; i++)
+      if (w[i] != 0u)
+         return false;
+   return true;
+}
+
+static size_t jim_tier_blob_size(const uint8_t *blob)
+{
+   const uint16_t *ends = (const uint16_t *)blob;
+
+   if (blob == NULL)
+      return 0u;
+   // only a region of pages none of which compressed wraps to 0
+   return JIM_TIER_HEADER + (ends[JIM_TIER_PAGES - 1u] ? ends[JIM_TIER_PAGES - 1u] : JIM_TIER_REGION);
+}
+
+/* Page p of the region stored as blob, into dst. */
+static void jim_tier_decode(const uint8_t *blob, unsigned int p, uint8_t *dst)
+{
+   const uint16_t *ends = (const uint16_t *)blob;
+   size_t start, n;
+
+   if (blob == NULL) {
+      memset(dst, 0, PAGE_SIZE);
+      return;
+   }
+   start = p ? ends[p - 1u] : 0u;
+   n = (uint16_t)(ends[p] - start);
+   if (n == PAGE_SIZE)
+      memcpy(dst, blob + JIM_TIER_HEADER + start, PAGE_SIZE);
+   else if (n == 0u || !lz4_decompress_block(blob + JIM_TIER_HEADER + start, n, dst, PAGE_SIZE))
+      memset(dst, 0, PAGE_SIZE);
+}
+
+/* One page as its block at dst: its size. */
+static size_t jim_tier_pack(const uint8_t *page, uint8_t *dst)
+{
+   size_t n = 0;
+
+   if (!jim_tier_zero_page(page)) {
+      n = lz4_compress_block(page, PAGE_SIZE, dst, PAGE_SIZE - 1u);
+      if (n == 0u) {
+         memcpy(dst, page, PAGE_SIZE);
+         n = PAGE_SIZE;
+      }
+   }
+   return n;
+}
+
+/* The region at ram as a blob in tier_scratch: its size, 0 if it is all
+   zeros. */
+static size_t jim_tier_encode(const uint8_t *ram)
+{
+   uint16_t *ends = (uint16_t *)tier_scratch;
+   uint8_t *data = tier_scratch + JIM_TIER_HEADER;
+   size_t at = 0;
+
+   for (unsigned int p = 0; p < JIM_TIER_PAGES; p++) {
+      at += jim_tier_pack(ram + p * PAGE_SIZE, data + at);
+      ends[p] = (uint16_t)at;
+   }
+   return at ? JIM_TIER_HEADER + at : 0u;
+}
+
+/* blob with page p replaced by page, as a blob in tier_scratch: its size,
+   0 if it is all zeros. */
+static size_t jim_tier_splice(const uint8_t *blob, unsigned int p, const uint8_t *page)
+{
+   const uint16_t *was = (const uint16_t *)blob;
+   uint16_t *ends = (uint16_t *)tier_scratch;
+   uint8_t *data = tier_scratch + JIM_TIER_HEADER;
+   size_t at = 0;
+
+   for (unsigned int q = 0; q < JIM_TIER_PAGES; q++) {
+      if (q == p) {
+         at += jim_tier_pack(page, data + at);
+      } else if (blob != NULL) {
+         size_t start = q ? was[q - 1u] : 0u;
+         size_t n = (uint16_t)(was[q] - start);
+
+         memcpy(data + at, blob + JIM_TIER_HEADER + start, n);
+         at += n;
+      }
+      ends[q] = (uint16_t)at;
+   }
+   return at ? JIM_TIER_HEADER + at : 0u;
+}
+
+/* n bytes for a blob, letting the reserve go if that is what it takes. */
+static uint8_t *jim_tier_alloc(size_t n)
+{
+   uint8_t *blob = malloc(n);
+
+   if (blob == NULL && tier_reserve != NULL) {
+      free(tier_reserve);
+      tier_reserve = NULL;
+      LOG_WARN("JIM overflow: memory is running out (%lu KB held)\r\n",
+               (unsigned long)(stats.bytes >> 10));
+      blob = malloc(n);
+   }
+   if (blob == NULL) {
+      stats.full++;
+      tier_stuck = true;
+   }
+   return blob;
+}
+
+uint8_t *jim_tier_page(size_t addr)
+{
+   size_t off = addr - jim_tier_base;
+   uint32_t r = (uint32_t)(off >> JIM_TIER_REGION_SHIFT);
+   unsigned int s = tier_slot_of[r];
+   jim_tier_stage_t *e = NULL, *clean = NULL;
+
+   tier_clock++;
+   if (s != JIM_TIER_COLD) {
+      slot[s].used = tier_clock;
+      jim_tier_dirty = &slot[s].dirty;
+      tier_shown = tier_hot + ((size_t)s << JIM_TIER_REGION_SHIFT) + (off & (JIM_TIER_REGION - 1u));
+      return (uint8_t *)tier_shown;
+   }
+
+   for (unsigned int i = 0; i < JIM_TIER_STAGE && e == NULL; i++) {
+      jim_tier_stage_t *t = &stage[i];
+
+      if (t->addr == addr)
+         e = t;
+      else if (!t->dirty && !t->folding && (clean == NULL || t->used < clean->used))
+         clean = t;
+   }
+   if (e == NULL && spare.addr == addr)
+      e = &spare;
+   if (e == NULL) {
+      // never a written one: with all of them waiting, the spare
+      e = clean ? clean : &spare;
+      if (e->dirty)
+         stats.refused++;
+      e->addr = addr;
+      e->dirty = false;
+      jim_tier_decode(tier_blob[r], (unsigned int)(off >> 8) & (JIM_TIER_PAGES - 1u), e->ram);
+   }
+   e->used = tier_clock;
+   jim_tier_dirty = &e->dirty;
+   tier_shown = e->ram;
+   tier_want = r;
+   Pi1MHz_Poll_Wake_FIQ(POLL_EVENT_JIMTIER);
+   return e->ram;
+}
+
+static bool jim_tier_showing(unsigned int s)
+{
+   const uint8_t *ram = tier_hot + ((size_t)s << JIM_TIER_REGION_SHIFT);
+
+   return tier_shown >= ram && tier_shown < ram + JIM_TIER_REGION;
+}
+
+/* Make slot s free, compressing its region back if it was written.  False
+   if it cannot be yet. */
+static bool jim_tier_evict(unsigned int s)
+{
+   uint32_t r = slot[s].region;
+   unsigned int cpsr = _disable_interrupts_cspr();
+   bool dirty = slot[s].dirty;
+   uint8_t *blob = NULL, *old;
+   size_t n = 0;
+
+   slot[s].dirty = false;
+   _restore_cpsr(cpsr);
+
+   if (dirty) {
+      n = jim_tier_encode(tier_hot + ((size_t)s << JIM_TIER_REGION_SHIFT));
+      if (n != 0u && (blob = jim_tier_alloc(n)) == NULL) {
+         cpsr = _disable_interrupts_cspr();
+         slot[s].dirty = true;
+         _restore_cpsr(cpsr);
+         return false;
+      }
+      if (blob != NULL)
+         memcpy(blob, tier_scratch, n);
+   }
+
+   cpsr = _disable_interrupts_cspr();
+   if (slot[s].dirty || jim_tier_showing(s)) {
+      // the Beeb went back to it: keep it hot and try again later
+      slot[s].dirty |= dirty;
+      _restore_cpsr(cpsr);
+      free(blob);
+      return false;
+   }
+   old = tier_blob[r];
+   if (dirty) {
+      stats.bytes = stats.bytes - jim_tier_blob_size(old) + n;
+      tier_blob[r] = blob;
+      stats.stored = stats.stored - (old != NULL) + (blob != NULL);
+   }
+   tier_slot_of[r] = JIM_TIER_COLD;
+   slot[s].region = JIM_TIER_NONE;
+   _restore_cpsr(cpsr);
+
+   if (dirty)
+      free(old);
+   stats.evictions++;
+   stats.hot--;
+   return true;
+}
+
+/* A slot to load into: a free one, or the least recently shown, never the
+   one the Beeb is looking at.  Once memory has run out, one that need not
+   be compressed if there is one. */
+static int jim_tier_victim(void)
+{
+   int best = -1, clean = -1;
+
+   for (unsigned int s = 0; s < JIM_TIER_SLOTS; s++) {
+      if (slot[s].region == JIM_TIER_NONE)
+         return (int)s;
+      if (jim_tier_showing(s))
+         continue;
+      if (best < 0 || slot[s].used < slot[best].used)
+         best = (int)s;
+      if (!slot[s].dirty && (clean < 0 || slot[s].used < slot[clean].used))
+         clean = (int)s;
+   }
+   return (tier_stuck && clean >= 0) ? clean : best;
+}
+
+/* Region r into the hot cache.  False if no slot could be had. */
+static bool jim_tier_load(uint32_t r)
+{
+   int v = jim_tier_victim();
+   bool dirty = false;
+
+   if (v < 0 || (slot[v].region != JIM_TIER_NONE && !jim_tier_evict((unsigned int)v)))
+      return false;
+
+   unsigned int s = (unsigned int)v;
+   uint8_t *ram = tier_hot + ((size_t)s << JIM_TIER_REGION_SHIFT);
+   size_t base = jim_tier_base + ((size_t)r << JIM_TIER_REGION_SHIFT);
+
+   for (unsigned int p = 0; p < JIM_TIER_PAGES; p++)
+      jim_tier_decode(tier_blob[r], p, ram + p * PAGE_SIZE);
+
+   unsigned int cpsr = _disable_interrupts_cspr();
+   // what the Beeb wrote while it was cold, and the staged copies let go
+   for (unsigned int i = 0; i <= JIM_TIER_STAGE; i++) {
+      jim_tier_stage_t *e = (i < JIM_TIER_STAGE) ? &stage[i] : &spare;
+
+      if (e->addr - base < JIM_TIER_REGION) {
+         if (e->dirty) {
+            memcpy(ram + (e->addr - base), e->ram, PAGE_SIZE);
+            dirty = true;
+         }
+         e->addr = SIZE_MAX;
+         e->dirty = false;
+      }
+   }
+   slot[s].region = r;
+   slot[s].used = ++tier_clock;
+   slot[s].dirty = dirty;
+   tier_slot_of[r] = (uint8_t)s;
+   ram_emulator_refresh(base, JIM_TIER_REGION);
+   _restore_cpsr(cpsr);
+
+   stats.loads++;
+   stats.hot++;
+   return true;
+}
+
+/* Staged page e into its region's blob, the region left cold.  False if
+   there was no memory for it; it stays written. */
+static bool jim_tier_fold(jim_tier_stage_t *e)
+{
+   size_t off = e->addr - jim_tier_base;
+   uint32_t r = (uint32_t)(off >> JIM_TIER_REGION_SHIFT);
+   uint8_t page[PAGE_SIZE];
+   uint8_t *blob = NULL, *old = tier_blob[r];
+   unsigned int cpsr = _disable_interrupts_cspr();
+   size_t n;
+
+   memcpy(page, e->ram, PAGE_SIZE);
+   e->dirty = false;
+   e->folding = true;
+   _restore_cpsr(cpsr);
+
+   n = jim_tier_splice(old, (unsigned int)(off >> 8) & (JIM_TIER_PAGES - 1u), page);
+   if (n != 0u) {
+      if ((blob = jim_tier_alloc(n)) == NULL) {
+         cpsr = _disable_interrupts_cspr();
+         e->dirty = true;
+         e->folding = false;
+         _restore_cpsr(cpsr);
+         return false;
+      }
+      memcpy(blob, tier_scratch, n);
+   }
+
+   cpsr = _disable_interrupts_cspr();
+   tier_blob[r] = blob;
+   e->folding = false;
+   _restore_cpsr(cpsr);
+
+   stats.bytes = stats.bytes - jim_tier_blob_size(old) + n;
+   stats.stored = stats.stored - (old != NULL) + (blob != NULL);
+   stats.folds++;
+   free(old);
+   return true;
+}
+
+/* The spare's page into a staging page now one is free, and the JIM window
+   moved over if it shows it. */
+static void jim_tier_adopt(void)
+{
+   unsigned int cpsr = _disable_interrupts_cspr();
+
+   if (spare.dirty) {
+      for (unsigned int i = 0; i < JIM_TIER_STAGE; i++) {
+         jim_tier_stage_t *e = &stage[i];
+
+         if (!e->dirty && !e->folding) {
+            memcpy(e->ram, spare.ram, PAGE_SIZE);
+            e->addr = spare.addr;
+            e->used = spare.used;
+            e->dirty = true;
+            spare.addr = SIZE_MAX;
+            spare.dirty = false;
+            ram_emulator_refresh(e->addr, PAGE_SIZE);
+            break;
+         }
+      }
+   }
+   _restore_cpsr(cpsr);
+}
+
+/* The next region to load: the one the Beeb is in. */
+static uint32_t jim_tier_next(void)
+{
+   unsigned int cpsr = _disable_interrupts_cspr();
+   uint32_t r = tier_want;
+
+   tier_want = JIM_TIER_NONE;
+   if (r != JIM_TIER_NONE && tier_slot_of[r] != JIM_TIER_COLD)
+      r = JIM_TIER_NONE;
+   _restore_cpsr(cpsr);
+   return r;
+}
+
+static void jim_tier_poll(void)
+{
+   uint32_t r;
+
+   // staged writes first, so that the FIQ has staging pages to spare
+   for (unsigned int i = 0; i < JIM_TIER_STAGE; i++)
+      if (stage[i].dirty && !jim_tier_fold(&stage[i]))
+         break;
+   jim_tier_adopt();
+
+   r = jim_tier_next();
+
+   // Out of memory, it waits for the FIQ to ask again rather than spin.
+   if (r != JIM_TIER_NONE) {
+      if (jim_tier_load(r))
+         tier_stuck = false;
+      else {
+         unsigned int cpsr = _disable_interrupts_cspr();
+         if (tier_want == JIM_TIER_NONE)
+            tier_want = r;
+         _restore_cpsr(cpsr);
+      }
+      // another go at this one
+      if (!tier_stuck)
+         Pi1MHz_Poll_Wake(POLL_EVENT_JIMTIER);
+   }
+
+   if (stats.full != reported_full) {
+      reported_full = stats.full;
+      LOG_WARN("JIM overflow: no memory to compress into (%lu KB held), regions kept hot\r\n",
+               (unsigned long)(stats.bytes >> 10));
+   }
+   if (stats.refused != reported_refused) {
+      reported_refused = stats.refused;
+      LOG_WARN("JIM overflow: %lu pages written with every staging page full were not kept\r\n",
+               (unsigned long)stats.refused);
+   }
+}
+
+unsigned int jim_tier_init(size_t base, unsigned int max_sets)
+{
+   unsigned int sets = jim_tier_config_sets();
+
+   if (sets > max_sets)
+      sets = max_sets;
+   if (sets == 0u || tier_hot != NULL)
+      return 0u;
+
+   tier_regions = sets << (24u - JIM_TIER_REGION_SHIFT);
+   tier_blob = calloc(tier_regions, sizeof *tier_blob);
+   tier_slot_of = malloc(tier_regions);
+   tier_scratch = malloc(JIM_TIER_BLOB_MAX);
+   tier_hot = malloc((size_t)JIM_TIER_SLOTS << JIM_TIER_REGION_SHIFT);
+   tier_reserve = malloc(JIM_TIER_RESERVE);
+   if (tier_blob == NULL || tier_slot_of == NULL || tier_scratch == NULL || tier_hot == NULL
+       || tier_reserve == NULL) {
+      free(tier_blob);
+      free(tier_slot_of);
+      free(tier_scratch);
+      free(tier_hot);
+      free(tier_reserve);
+      tier_hot = NULL;
+      tier_reserve = NULL;
+      LOG_WARN("JIM overflow: no memory for the hot cache - no overflow\r\n");
+      return 0u;
+   }
+   memset(tier_slot_of, JIM_TIER_COLD, tier_regions);
+   for (unsigned int s = 0; s < JIM_TIER_SLOTS; s++)
+      slot[s].region = JIM_TIER_NONE;
+   for (unsigned int i = 0; i < JIM_TIER_STAGE; i++)
+      stage[i].addr = SIZE_MAX;
+   stats.regions = tier_regions;
+   jim_tier_base = base;
+   LOG_INFO("JIM overflow: %u MB compressed above %lu MB\r\n", 16u * sets,
+            (unsigned long)(base >> 20));
+   return sets;
+}
+
+void jim_tier_start(void)
+{
+   if (tier_hot != NULL)
+      Pi1MHz_Register_Poll_Event(jim_tier_poll, POLL_URGENT, 0u, POLL_EVENT_JIMTIER);
+}
+
+void jim_tier_stats(jim_tier_stats_t *st)
+{
+   *st = stats;
+}
+
+bool jim_tier_holds_data(void)
+{
+   bool held = stats.stored != 0u || spare.dirty;
+
+   for (unsigned int s = 0; s < JIM_TIER_SLOTS && !held; s++)
+      held = slot[s].region != JIM_TIER_NONE && slot[s].dirty;
+   for (unsigned int i = 0; i < JIM_TIER_STAGE && !held; i++)
+      held = stage[i].dirty || stage[i].folding;
+   return held;
+}
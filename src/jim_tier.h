@@ -0,0 +1,95 @@
+#ifndef JIM_TIER_H
+#define JIM_TIER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* JIM RAM beyond the Pi's memory, kept LZ4-compressed.
+ *
+ * JIM RAM proper is what the Pi can spare, in 16 MB sets - a few hundred
+ * MB - while the page registers reach 4 GB.  jim_overflow=<size> in
+ * Pi1MHz.cfg puts that much more above it, for page mode only: byte mode,
+ * the services port and the Pi-side buffers stay in JIM RAM proper.  RAM
+ * disc images are mostly empty or very repetitive, so a tier several
+ * times the Pi's memory fits as long as what is in it compresses.
+ *
+ * The tier is cut into 64 KB regions.  A region nothing has written is
+ * nothing at all; one that has is a blob of its 256 pages each compressed
+ * on its own (lz4_block.h), so any one page can be had without the rest.
+ * Regions the Beeb is using are held decompressed in a hot cache of
+ * JIM_TIER_SLOTS; the least recently shown one is compressed again, if it
+ * was written, to make room.
+ *
+ * Selecting a page in a cold region cannot wait for the region: the FIQ
+ * decompresses just that page into one of a few staging pages, which the
+ * Beeb then reads and writes, and asks the urgent poller for the region.
+ * The poller folds a written staging page back into its region's blob,
+ * and when the region is hot the Beeb's writes to its staged pages are
+ * copied in and the JIM window moved over.  A written staging page is
+ * never taken for another page.  If the Beeb gets more cold pages ahead of
+ * the poller than there are staging pages - the poll loop held up by a
+ * snapshot save or a card sync - the next page is shown from a spare, kept
+ * once a staging page is free; only what is written to a further page
+ * before then is refused, and the count logged.
+ *
+ * Memory to compress into is reserved at jim_tier_init(), which sets up no
+ * tier at all without it.  If it still runs out, regions that cannot be
+ * compressed back stay hot and staged pages stay staged: the tier stops
+ * taking new cold pages rather than losing what it holds.
+ *
+ * The tier is not part of a snapshot (snapshot.h), and starts empty at
+ * every power-on.  snapshot_save() refuses once the Beeb has written to it,
+ * so a snapshot that puts the page register in the tier resumes it empty,
+ * as it was saved.
+ */
+
+#define JIM_TIER_REGION_SHIFT  16u
+#define JIM_TIER_REGION        (1u << JIM_TIER_REGION_SHIFT)
+
+/* Where the tier starts - the end of JIM RAM proper - or SIZE_MAX with no
+   tier, so the FIQ's test is one compare. */
+extern size_t jim_tier_base;
+
+/* The dirty flag of the page jim_tier_page() last returned. */
+extern bool *jim_tier_dirty;
+
+typedef struct {
+   uint32_t regions;     // 64 KB regions in the tier
+   uint32_t stored;      // regions holding anything but zeros
+   uint32_t hot;         // regions decompressed in the hot cache
+   size_t   bytes;       // compressed size of the stored regions
+   uint32_t loads;       // regions decompressed into the hot cache
+   uint32_t evictions;   // regions dropped from it
+   uint32_t folds;       // staged pages folded into their region's blob
+   uint32_t refused;     // pages written with every staging page full, not kept
+   uint32_t full;        // evictions given up for want of memory
+} jim_tier_stats_t;
+
+/* From rampage_emulator_init(), once: set up jim_overflow's tier above base,
+   at most max_sets of 16 MB.  The sets it adds - 0 with none configured or
+   no memory for the hot cache and the reserve. */
+unsigned int jim_tier_init(size_t base, unsigned int max_sets);
+
+/* From rampage_emulator_init(), every time: the poller, which a BBC RST
+   takes away. */
+void jim_tier_start(void);
+
+/* From the FIQ callbacks: the 256 bytes to show as the JIM page at addr, a
+   page-aligned address in the tier.  Valid until the next call, or until
+   ram_emulator_refresh() moves the window over. */
+uint8_t *jim_tier_page(size_t addr);
+
+/* From the FIQ callbacks: the Beeb has written to that page. */
+static inline void jim_tier_write(void)
+{
+   *jim_tier_dirty = true;
+}
+
+void jim_tier_stats(jim_tier_stats_t *st);
+
+/* Whether the tier holds anything but zeros, or may - stored, hot and
+   written, or staged - for snapshot_save(). */
+bool jim_tier_holds_data(void);
+
+#endif
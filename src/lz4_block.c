@@ -0,0 +1,176 @@
+/* LZ4 blocks - see lz4_block.h.
+ *
+ * A sequence is a token (literal count in the high nibble, match length
+ * less four in the low one, 15 meaning more follows in bytes of up to 255),
+ * the literals, then a two-byte little-endian offset back to the match.
+ * The last sequence is literals only.  The format's end rules are kept so
+ * that any decoder takes what is written here: the last five bytes are
+ * always literals, and no match starts in the last twelve.
+ */
+
+#include <string.h>
+
+#include "lz4_block.h"
+
+#define LZ4_MINMATCH       4u
+#define LZ4_LAST_LITERALS  5u
+#define LZ4_MF_LIMIT       12u
+#define LZ4_HASH_MAX_BITS  12u
+
+static uint32_t lz4_read32(const uint8_t *p)
+{
+   uint32_t v;
+
+   memcpy(&v, p, sizeof v);
+   return v;
+}
+
+static unsigned int lz4_hash(uint32_t v, unsigned int bits)
+{
+   return (unsigned int)((v * 2654435761u) >> (32u - bits));
+}
+
+/* The bytes after a nibble of 15. */
+static uint8_t *lz4_put_length(uint8_t *op, size_t n)
+{
+   for (; n >= 255u; n -= 255u)
+      *op++ = 255u;
+   *op++ = (uint8_t)n;
+   return op;
+}
+
+/* One sequence: lit literals from anchor, then a match of mlen at offset
+   (none when mlen is 0).  NULL if it would not fit before oend. */
+static uint8_t *lz4_put_sequence(uint8_t *op, const uint8_t *oend, const uint8_t *anchor,
+                                 size_t lit, size_t offset, size_t mlen)
+{
+   size_t ml = mlen ? mlen - LZ4_MINMATCH : 0u;
+   size_t need = 1u + lit + (lit >= 15u ? (lit - 15u) / 255u + 1u : 0u)
+                 + (mlen ? 2u + (ml >= 15u ? (ml - 15u) / 255u + 1u : 0u) : 0u);
+   uint8_t *token = op;
+
+   if (need > (size_t)(oend - op))
+      return NULL;
+   op++;
+   *token = (uint8_t)((lit >= 15u ? 15u : lit) << 4);
+   if (lit >= 15u)
+      op = lz4_put_length(op, lit - 15u);
+   memcpy(op, anchor, lit);
+   op += lit;
+   if (mlen) {
+      *op++ = (uint8_t)offset;
+      *op++ = (uint8_t)(offset >> 8);
+      *token |= (uint8_t)(ml >= 15u ? 15u : ml);
+      if (ml >= 15u)
+         op = lz4_put_length(op, ml - 15u);
+   }
+   return op;
+}
+
+size_t lz4_compress_block(const uint8_t *src, size_t len, uint8_t *dst, size_t cap)
+{
+   uint16_t table[1u << LZ4_HASH_MAX_BITS];
+   unsigned int bits = LZ4_HASH_MAX_BITS;
+   const uint8_t *ip = src, *anchor = src, *end = src + len;
+   const uint8_t *oend = dst + cap;
+   uint8_t *op = dst;
+
+   if (len > LZ4_BLOCK_MAX)
+      return 0;
+   // a table much bigger than the block is all clearing and no finding
+   while (bits > 8u && ((size_t)1u << bits) > len)
+      bits--;
+   memset(table, 0, sizeof table[0] << bits);
+
+   if (len > LZ4_MF_LIMIT) {
+      const uint8_t *mflimit = end - LZ4_MF_LIMIT;
+      const uint8_t *matchlimit = end - LZ4_LAST_LITERALS;
+
+      while (ip < mflimit) {
+         uint32_t seq = lz4_read32(ip);
+         unsigned int h = lz4_hash(seq, bits);
+         const uint8_t *ref = src + table[h];
+
+         table[h] = (uint16_t)(ip - src);
+         if (ref >= ip || (size_t)(ip - ref) > 65535u || lz4_read32(ref) != seq) {
+            ip++;
+            continue;
+         }
+         while (ip > anchor && ref > src && ip[-1] == ref[-1]) {
+            ip--;
+            ref--;
+         }
+         const uint8_t *m = ip + LZ4_MINMATCH, *r = ref + LZ4_MINMATCH;
+         while (m < matchlimit && *m == *r) {
+            m++;
+            r++;
+         }
+         op = lz4_put_sequence(op, oend, anchor, (size_t)(ip - anchor),
+                               (size_t)(ip - ref), (size_t)(m - ip));
+         if (op == NULL)
+            return 0;
+         ip = anchor = m;
+      }
+   }
+   op = lz4_put_sequence(op, oend, anchor, (size_t)(end - anchor), 0u, 0u);
+   return op ? (size_t)(op - dst) : 0u;
+}
+
+/* The bytes after a nibble of 15, adding to *n.  False at the end of the
+   input. */
+static bool lz4_get_length(const uint8_t **ip, const uint8_t *iend, size_t *n)
+{
+   uint8_t b;
+
+   do {
+      if (*ip >= iend)
+         return false;
+      b = *(*ip)++;
+      *n += b;
+   } while (b == 255u);
+   return true;
+}
+
+bool lz4_decompress_block(const uint8_t *src, size_t len, uint8_t *dst, size_t out)
+{
+   const uint8_t *ip = src, *iend = src + len;
+   uint8_t *op = dst, *oend = dst + out;
+
+   for (;;) {
+      if (ip >= iend)
+         return false;
+      unsigned int token = *ip++;
+      size_t lit = token >> 4;
+
+      if (lit == 15u && !lz4_get_length(&ip, iend, &lit))
+         return false;
+      if (lit > (size_t)(iend - ip) || lit > (size_t)(oend - op))
+         return false;
+      memcpy(op, ip, lit);
+      op += lit;
+      ip += lit;
+      if (ip == iend)                     // the last sequence has no match
+         return op == oend;
+
+      if (iend - ip < 2)
+         return false;
+      size_t offset = (size_t)ip[0] | ((size_t)ip[1] << 8);
+      size_t mlen = token & 15u;
+      ip += 2;
+      if (offset == 0u || offset > (size_t)(op - dst))
+         return false;
+      if (mlen == 15u && !lz4_get_length(&ip, iend, &mlen))
+         return false;
+      mlen += LZ4_MINMATCH;
+      if (mlen > (size_t)(oend - op))
+         return false;
+
+      const uint8_t *m = op - offset;
+      if (offset >= mlen)
+         memcpy(op, m, mlen);
+      else                                // overlapping: a run, byte by byte
+         for (size_t i = 0; i < mlen; i++)
+            op[i] = m[i];
+      op += mlen;
+   }
+}
@@ -0,0 +1,37 @@
+#ifndef LZ4_BLOCK_H
+#define LZ4_BLOCK_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* LZ4 blocks, in C, for data the Pi compresses and decompresses itself.
+ *
+ * The format is the standard LZ4 block (no frame header), so anything
+ * written here reads back with lz4 on a PC.  rpi/decompress.S, which the
+ * video player uses on frames made by lz4 -12, cannot be used instead: it
+ * reads a match offset after the last literals and copies a match from it,
+ * so it writes at least four bytes past the end of its output, and it
+ * takes the output size on trust.  lz4_decompress_block() is told the
+ * size it must come to and refuses a block that would run past it.
+ *
+ * The compressor is the plain greedy one: a hash of the next four bytes
+ * finds the last place they were seen.  It is for blocks of up to 64 KB,
+ * so every match is within reach, and is tuned for small ones - the JIM
+ * overflow tier compresses 256-byte pages. */
+
+#define LZ4_BLOCK_MAX  65536u
+
+/* The most a block of len bytes can take: a run of literals. */
+#define LZ4_BLOCK_BOUND(len)  ((len) + (len) / 255u + 16u)
+
+/* Compress len bytes (at most LZ4_BLOCK_MAX) into dst, of cap bytes.  The
+   compressed size, or 0 if it does not fit in cap. */
+size_t lz4_compress_block(const uint8_t *src, size_t len, uint8_t *dst, size_t cap);
+
+/* Decompress the len-byte block at src into exactly out bytes at dst.
+   False if the block is malformed or does not come to out bytes; dst may
+   then have been written, but never past out. */
+bool lz4_decompress_block(const uint8_t *src, size_t len, uint8_t *dst, size_t out);
+
+#endif
@@ -283,6 +283,7 @@ static void net_udp_recv(void *arg, struct udp_pcb *pcb, struct pbuf *p,
       hdr[6] = (uint8_t)p->tot_len; hdr[7] = (uint8_t)(p->tot_len >> 8);
       ring_put_mem(h, hdr, 8u);
       ring_put_pbuf(h, p);
+      Pi1MHz_Poll_Wake(POLL_EVENT_NET);      /* rx_count moved: re-check nIRQ */
    }
    pbuf_free(p);
 }
@@ -337,9 +338,11 @@ static err_t net_tcp_recv(void *arg, struct altcp_pcb *pcb, struct pbuf *p,
       h->rx_parked = false;
       altcp_recved(pcb, p->tot_len);
       pbuf_free(p);
+      Pi1MHz_Poll_Wake(POLL_EVENT_NET);
       return ERR_OK;
    }
    ring_put_pbuf(h, p);
+   Pi1MHz_Poll_Wake(POLL_EVENT_NET);
    h->rx_parked = false;
    altcp_recved(pcb, p->tot_len);
    pbuf_free(p);
@@ -1557,6 +1560,7 @@ static void net_service_command(uint32_t command_pointer, uint32_t addr,
    net_pending_data = data;
    net_pending      = true;
    Pi1MHz_MemoryWrite(addr, NET_BUSY);
+   Pi1MHz_Poll_Wake_FIQ(POLL_EVENT_NET);
 }
 
 static void net_service_poll(void)
@@ -1610,7 +1614,11 @@ void net_service_init(uint8_t instance, uint8_t address)
    /* Both dedupe, so re-running on a BBC reset is safe. */
    (void)services_register(SERVICE_CMD_NET_FIRST, SERVICE_CMD_NET_LAST,
                            net_service_command);
-   Pi1MHz_Register_Poll(net_service_poll);
+   /* Its only work is a latched command, the reset teardown, or an nIRQ
+      change - and nIRQ follows rx_count, which only the receive hooks
+      raise.  All three wake it; otherwise it is not called.  Registration
+      raises the event, which covers net_reset_pending. */
+   Pi1MHz_Register_Poll_Event(net_service_poll, POLL_NORMAL, 0u, POLL_EVENT_NET);
 
    services_irq_set(net_source, false);   /* start with our nIRQ line clear */
 }
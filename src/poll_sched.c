@@ -0,0 +1,342 @@
+/* Idle-loop poll scheduler.
+ *
+ * This used to be a flat table that kernel_main called front to back on
+ * every pass, so the Music 5000 refill - which has a 4.8 ms half-buffer to
+ * fill before the PWM DMA runs dry - queued behind lwIP, USB, AUN and the
+ * webserver however empty the buffer was.  A webserver pass that walks the
+ * FAT, or an SDIO burst, is easily longer than that.
+ *
+ * Now each poller has a class:
+ *
+ *    POLL_URGENT      runs first every pass.  With a deadline it also runs
+ *                     BETWEEN the other pollers whenever that long has gone
+ *                     by since it last ran - audio does not wait for the
+ *                     rest of the pass, only for the one poller in front of
+ *                     it.
+ *    POLL_NORMAL      every pass, in registration order, as before.
+ *    POLL_BACKGROUND  housekeeping, after everything else.
+ *
+ * Any class can have a period, which rate-limits it: it is skipped until
+ * that long after it last ran.  Pi1MHz_Register_Poll() is POLL_NORMAL with
+ * no period, so a poller that does not ask is scheduled exactly as before.
+ *
+ * Most pollers spend nearly every pass finding nothing to do: the SCSI
+ * state machine sits in BUS FREE until the Beeb writes nSEL, and the
+ * services-port pollers (net, AUN) until a command is latched or a packet
+ * comes in.  A poller registered with Pi1MHz_Register_Poll_Event() instead
+ * names the events that give it work - bits in Pi1MHz_poll_events, raised by
+ * the FIQ callbacks and lwIP receive hooks that make the work - and is not
+ * called at all until one is raised.  Its period, if any, becomes the
+ * longest it sleeps regardless: a timeout for the engine timers (AUN
+ * retransmits) that no event covers.  The check is one load and an AND.
+ *
+ * All of it runs on the per-poller timestamp the slow-poll check already
+ * took, so the only new per-pass work is a compare per periodic poller and
+ * one per deadline after each non-urgent poller.  Pollers still have to
+ * yield: a deadline can only be met between pollers, never inside one, and
+ * the slow-poll report names the ones that do not.  For more than that -
+ * what each poller costs, not just which are slow - switch on the profiler
+ * (profiler.h), which costs a pass one load and branch while it is off.
+ */
+
+#include <stddef.h>
+
+#include "Pi1MHz.h"
+#include "rpi/asm-helpers.h"
+#include "rpi/performance.h"
+#include "rpi/systimer.h"
+#include "poll_sched.h"
+#include "profiler.h"
+
+#if (__ARM_ARCH >= 7)
+/* Cortex-A53 (kernel7.img): the ARM1176 CP15 c15 performance-monitor
+   registers do NOT exist on the A53 and every access faults as an Undefined
+   Instruction - this crashed every kernel7 boot at STAGE 2, latent until a
+   Pi Zero 2 was actually run (kernel7 had only ever been built, never
+   booted, on real A53 silicon).  The c15 counter was purely an arm1176
+   micro-optimisation to dodge the Strongly-Ordered system-timer read per
+   callback; here just use the 1 MHz system timer.  poll_ticks is measured in
+   microseconds, so POLL_TICKS_PER_MS is 1000 and the reported duration and
+   the 50 ms threshold below both come out correct without further scaling. */
+#define POLL_TICKS_PER_MS 1000u
+static inline uint32_t poll_ticks(void) { return RPI_GetSystemTime(); }
+static void poll_ticks_start(void) { }
+
+#else
+/* ARM1176 (kernel.img): the low-overhead CP15 c15 cycle counter, ticking
+   once per 64 processor cycles (the /64 divider keeps a 32-bit counter from
+   wrapping inside any interval we care about: ~275 s at 1 GHz).  A CP15
+   register read costs a couple of cycles against 47 for RPI_GetSystemTime(),
+   which is a Strongly-Ordered peripheral load - and the slow-poll check
+   wants a timestamp per callback, so seven peripheral reads per pass were
+   costing ~330 cycles, over 10% of the idle loop, purely to police a 50 ms
+   threshold. */
+#define POLL_TICKS_PER_MS 15625u          /* 1 GHz / 64 / 1000 */
+
+static inline uint32_t poll_ticks(void)
+{
+   uint32_t v;
+   __asm volatile ("mrc p15,0,%0,c15,c12,1" : "=r" (v));
+   return v;
+}
+
+static void poll_ticks_start(void)
+{
+   /* enable counters, reset them, reset CCNT, /64 divider on */
+   uint32_t ctrl = 0x000Fu;
+   __asm volatile ("mcr p15,0,%0,c15,c12,0" :: "r" (ctrl) : "memory");
+}
+#endif
+
+#define POLL_SLOW_TICKS (50u * POLL_TICKS_PER_MS)
+
+static uint32_t poll_us_to_ticks(uint32_t us)
+{
+   return (uint32_t)(((uint64_t)us * POLL_TICKS_PER_MS) / 1000u);
+}
+
+typedef struct {
+   func_ptr fn;
+   uint8_t  priority;
+   uint32_t period;        /* ticks; 0 = every pass */
+   uint32_t deadline;      /* ticks; 0 = none (POLL_URGENT only) */
+   uint32_t events;        /* POLL_EVENT_ bits; 0 = not event-driven */
+   uint32_t last_run;      /* tick count when it last returned */
+} poll_entry_t;
+
+// Kept sorted by priority, registration order within one
+NOINIT_SECTION static poll_entry_t poll_table[POLL_SCHED_MAX];
+// holds the total number of polling functions to call
+static uint8_t poll_count;
+// entries [0, poll_urgent) are POLL_URGENT
+static uint8_t poll_urgent;
+// any urgent entry has a deadline, so the interleave check is worth doing
+static bool poll_any_deadline;
+// profiler_on as this pass started: a pass is profiled whole or not at all
+static bool poll_profiling;
+/* Set whenever an entry is added, moved or removed.  A poller that
+   registers another - a deferred emulator init run from the loop - shifts
+   the table under the pass, which then stops and lets the next pass start
+   from the top rather than run entries twice or skip them. */
+static bool poll_changed;
+
+/* Not cleared by poll_sched_reset(): an event raised around a BBC RST (a
+   command the FIQ latched as the Beeb reset) still has work behind it. */
+volatile uint32_t Pi1MHz_poll_events;
+
+void Pi1MHz_Poll_Wake(uint32_t events)
+{
+   unsigned int cpsr = _disable_interrupts_cspr();
+   Pi1MHz_poll_events |= events;
+   _restore_cpsr(cpsr);
+}
+
+static void poll_events_take(uint32_t events)
+{
+   unsigned int cpsr = _disable_interrupts_cspr();
+   Pi1MHz_poll_events &= ~events;
+   _restore_cpsr(cpsr);
+}
+
+void poll_sched_reset(void)
+{
+   poll_count = 0u;
+   poll_urgent = 0u;
+   poll_any_deadline = false;
+}
+
+unsigned int poll_sched_count(void)
+{
+   return poll_count;
+}
+
+static void poll_sched_reindex(void)
+{
+   poll_urgent = 0u;
+   poll_any_deadline = false;
+   for (uint8_t i = 0u; i < poll_count; ++i) {
+      if (poll_table[i].priority != POLL_URGENT)
+         break;
+      poll_urgent++;
+      if (poll_table[i].deadline != 0u)
+         poll_any_deadline = true;
+   }
+}
+
+// For each task that needs to be polled during idle it must register itself.
+// Registering again replaces its scheduling parameters.
+static void poll_sched_insert( func_ptr function_ptr, uint8_t priority,
+                               uint32_t period_us, uint32_t deadline_us,
+                               uint32_t events )
+{
+   poll_entry_t e;
+   uint8_t i;
+
+   if (function_ptr == NULL)
+      return;
+   if (priority > POLL_BACKGROUND)
+      priority = POLL_BACKGROUND;
+
+   e.fn = function_ptr;
+   e.priority = priority;
+   e.period = poll_us_to_ticks(period_us);
+   e.deadline = (priority == POLL_URGENT) ? poll_us_to_ticks(deadline_us) : 0u;
+   e.events = events;
+   e.last_run = poll_ticks() - e.period;    /* due on the first pass */
+
+   for (i = 0u; i < poll_count; ++i) {
+      if (poll_table[i].fn == function_ptr)
+         break;
+   }
+   if (i < poll_count) {
+      /* already registered: take it out, re-insert below */
+      for (; i + 1u < poll_count; ++i)
+         poll_table[i] = poll_table[i + 1u];
+      poll_count--;
+   } else if (poll_count >= POLL_SCHED_MAX) {
+      LOG_INFO("Poll registration ignored: table full (%u)\r\n",
+               (unsigned int)POLL_SCHED_MAX);
+      return;
+   }
+
+   /* after the last entry of the same or a more urgent class */
+   for (i = poll_count; i > 0u && poll_table[i - 1u].priority > priority; --i)
+      poll_table[i] = poll_table[i - 1u];
+   poll_table[i] = e;
+   poll_count++;
+   poll_sched_reindex();
+   poll_changed = true;
+}
+
+void Pi1MHz_Register_Poll_Sched( func_ptr function_ptr, uint8_t priority,
+                                 uint32_t period_us, uint32_t deadline_us )
+{
+   poll_sched_insert(function_ptr, priority, period_us, deadline_us, 0u);
+}
+
+void Pi1MHz_Register_Poll_Event( func_ptr function_ptr, uint8_t priority,
+                                 uint32_t period_us, uint32_t events )
+{
+   poll_sched_insert(function_ptr, priority, period_us, 0u, events);
+   /* run once on the first pass, to pick up whatever init left it */
+   Pi1MHz_Poll_Wake(events);
+}
+
+/* Whether entry e wants to run at tick count now. */
+static inline bool poll_sched_due(const poll_entry_t *e, uint32_t now)
+{
+   bool timed_out = (e->period != 0u) && (uint32_t)(now - e->last_run) >= e->period;
+
+   if (e->events != 0u)
+      return ((Pi1MHz_poll_events & e->events) != 0u) || timed_out;
+   return (e->period == 0u) || timed_out;
+}
+
+void Pi1MHz_Unregister_Poll( func_ptr function_ptr )
+{
+   uint8_t i;
+
+   for (i = 0u; i < poll_count; ++i) {
+      if (poll_table[i].fn == function_ptr)
+         break;
+   }
+   if (i == poll_count)
+      return;
+   for (; i + 1u < poll_count; ++i)
+      poll_table[i] = poll_table[i + 1u];
+   poll_count--;
+   poll_sched_reindex();
+   poll_changed = true;
+}
+
+void Pi1MHz_Register_Poll( func_ptr function_ptr )
+{
+   for (uint8_t i = 0u; i < poll_count; ++i) {
+      if (poll_table[i].fn == function_ptr)
+         return;                 // keeps whatever class it registered with
+   }
+   Pi1MHz_Register_Poll_Sched(function_ptr, POLL_NORMAL, 0u, 0u);
+}
+
+void poll_sched_start(void)
+{
+   poll_ticks_start();
+   for (uint8_t i = 0u; i < poll_count; ++i)
+      poll_table[i].last_run = poll_ticks() - poll_table[i].period;
+}
+
+/* Run one entry.  *now is the tick count when it was called and becomes the
+   one when it returned: each poll's "after" is the next one's "before", so
+   one counter read per poll serves both. */
+static void poll_sched_run(poll_entry_t *e, unsigned int idx, uint32_t *now)
+{
+   func_ptr fn = e->fn;
+   uint32_t after;
+
+   if (e->events != 0u)
+      poll_events_take(e->events);
+   if (poll_profiling) {
+      unsigned int c0 = read_cycle_counter();
+      fn();
+      profiler_poll_record(idx, fn, read_cycle_counter() - c0);
+   } else {
+      fn();
+   }
+   after = poll_ticks();
+   if (poll_changed) {
+      /* e may now be some other poller's slot, or fn may be gone */
+      e = NULL;
+      for (uint8_t i = 0u; i < poll_count; ++i) {
+         if (poll_table[i].fn == fn) {
+            e = &poll_table[i];
+            break;
+         }
+      }
+   }
+   if (e != NULL)
+      e->last_run = after;
+
+   uint32_t duration_ticks = after - *now;
+   *now = after;
+   if (duration_ticks > POLL_SLOW_TICKS) {
+      LOG_INFO("Slow poll callback idx=%u duration_us=%lu\r\n",
+               idx, (unsigned long)(duration_ticks / (POLL_TICKS_PER_MS / 1000u)));
+   }
+}
+
+void poll_sched_pass(void)
+{
+   uint32_t now = poll_ticks();
+   unsigned int pass_c0 = 0u;
+
+   poll_profiling = profiler_on;
+   if (poll_profiling)
+      pass_c0 = read_cycle_counter();
+
+   poll_changed = false;
+   for (unsigned int i = 0u, n = poll_count; i < n; ++i) {
+      poll_entry_t *e = &poll_table[i];
+
+      if (!poll_sched_due(e, now))
+         continue;
+      poll_sched_run(e, i, &now);
+      if (poll_changed)
+         break;
+
+      /* Something slow just ran: let any urgent poller whose deadline has
+         come round go now, rather than after the rest of the pass. */
+      if (poll_any_deadline && i >= poll_urgent) {
+         for (unsigned int u = 0u; u < poll_urgent; ++u) {
+            poll_entry_t *ue = &poll_table[u];
+            if (ue->deadline != 0u && (uint32_t)(now - ue->last_run) >= ue->deadline)
+               poll_sched_run(ue, u, &now);
+            if (poll_changed)
+               break;
+         }
+         if (poll_changed)
+            break;
+      }
+   }
+   if (poll_profiling)
+      profiler_pass_record(read_cycle_counter() - pass_c0);
+}
@@ -0,0 +1,24 @@
+#ifndef POLL_SCHED_H
+#define POLL_SCHED_H
+
+#include <stdint.h>
+
+/* Plenty for the emulator table; Pi1MHz_Register_Poll logs if not. */
+#define POLL_SCHED_MAX 24u
+
+/* The idle-loop poll scheduler.  Pollers register through
+   Pi1MHz_Register_Poll() / Pi1MHz_Register_Poll_Sched() (Pi1MHz.h); the
+   main loop only drives it. */
+
+/* Forget every poller: init_emulator() re-registers them all on BBC RST. */
+void poll_sched_reset(void);
+
+/* Start the tick counter the slow-poll and deadline accounting use. */
+void poll_sched_start(void);
+
+/* One pass of the idle loop.  Pi1MHz_now_us must be current. */
+void poll_sched_pass(void);
+
+unsigned int poll_sched_count(void);
+
+#endif
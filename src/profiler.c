@@ -0,0 +1,266 @@
+/* Runtime poll-loop and FIQ profiler - see profiler.h.
+ *
+ * This replaces the old compile-time POLL_PROFILE, which needed a rebuild,
+ * printed once over the UART and could not run on the A53 at all because it
+ * read the ARM1176's c15 counter.  Here the counter comes from
+ * rpi/performance.h: CCNT on the ARM1176 (ticking every 64 cycles, as the
+ * poll loop already runs it) and PMCCNTR on the A53 (every cycle).  Figures
+ * are reported in cycles either way, so the ARM1176 ones are to the nearest
+ * 64.
+ *
+ * Two windows are kept: the one being filled and the last complete one,
+ * which is what /profile shows, so a reading is always a whole second and
+ * never a window that has only just started.  Rotating is a pointer swap -
+ * the FIQ side is handed the new window's counts through bus_trace_count()
+ * - so nothing is copied.  A FIQ that was already part-way through its
+ * count when the swap happened lands one access in the old window, which
+ * is noise.  The ~21 KB of windows are only allocated the first time the
+ * profiler is switched on.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Pi1MHz.h"
+#include "rpi/performance.h"
+#include "bus_trace.h"
+#include "poll_sched.h"
+#include "profiler.h"
+
+#define PROF_BUCKETS       20u      /* under 64 cycles, then doubling: 64, 128 ... 16M+ */
+#define PROF_BUCKET_SHIFT  6u
+#define PROF_WINDOW_US     1000000u
+#define PROF_CHECK_US      100000u  /* how often the fx register is looked at */
+#define PROF_TOP_FIQ       16u
+
+typedef struct {
+   func_ptr fn;
+   uint32_t calls;
+   uint32_t max;
+   uint64_t total;
+   uint32_t hist[PROF_BUCKETS];
+} prof_poll_t;
+
+typedef struct {
+   uint32_t start_us;
+   uint32_t len_us;            /* 0 while it is being filled */
+   uint32_t passes;
+   uint64_t pass_cycles;
+   prof_poll_t poll[POLL_SCHED_MAX];
+   bus_trace_counts_t fiq;
+} prof_window_t;
+
+bool profiler_on;
+
+static prof_window_t *prof_win;     /* [2] */
+static unsigned int prof_cur;
+static bool prof_rotate_due;
+static uint8_t prof_fx;
+
+static unsigned int prof_bucket(uint32_t cycles)
+{
+   if (cycles < (1u << PROF_BUCKET_SHIFT))
+      return 0u;
+   unsigned int b = (31u - (unsigned int)__builtin_clz(cycles)) - PROF_BUCKET_SHIFT + 1u;
+   return (b < PROF_BUCKETS) ? b : PROF_BUCKETS - 1u;
+}
+
+void profiler_poll_record(unsigned int idx, func_ptr fn, uint32_t cycles)
+{
+   prof_poll_t *p;
+
+   if (!profiler_on || idx >= POLL_SCHED_MAX)
+      return;
+   cycles *= CYCLE_COUNTER_SCALE;
+   p = &prof_win[prof_cur].poll[idx];
+   if (p->fn != fn) {               /* the table changed under us (BBC RST) */
+      memset(p, 0, sizeof *p);
+      p->fn = fn;
+   }
+   p->calls++;
+   p->total += cycles;
+   if (cycles > p->max)
+      p->max = cycles;
+   p->hist[prof_bucket(cycles)]++;
+}
+
+static void prof_rotate(void);
+
+void profiler_pass_record(uint32_t cycles)
+{
+   if (!profiler_on)
+      return;
+   prof_win[prof_cur].passes++;
+   prof_win[prof_cur].pass_cycles += (uint64_t)cycles * CYCLE_COUNTER_SCALE;
+   /* windows end between passes, so a pass and its pollers share one */
+   if (prof_rotate_due)
+      prof_rotate();
+}
+
+static void prof_window_clear(prof_window_t *w)
+{
+   memset(w, 0, sizeof *w);
+   w->start_us = Pi1MHz_now_us;
+}
+
+void profiler_reset(void)
+{
+   if (prof_win == NULL)
+      return;
+   prof_window_clear(&prof_win[prof_cur]);
+}
+
+static void prof_rotate(void)
+{
+   unsigned int next = prof_cur ^ 1u;
+
+   prof_window_clear(&prof_win[next]);
+   prof_win[prof_cur].len_us = Pi1MHz_now_us - prof_win[prof_cur].start_us;
+   prof_cur = next;
+   prof_rotate_due = false;
+   bus_trace_count(&prof_win[next].fiq);
+}
+
+void profiler_set(bool on)
+{
+   if (on == profiler_on)
+      return;
+
+   if (on) {
+      if (prof_win == NULL) {
+         prof_win = malloc(2u * sizeof *prof_win);
+         if (prof_win == NULL) {
+            LOG_WARN("Profiler: no memory for %u bytes\r\n",
+                     (unsigned int)(2u * sizeof *prof_win));
+            fx_register[prof_fx] = 0u;
+            return;
+         }
+      }
+      start_cycle_counter();
+      prof_window_clear(&prof_win[0]);
+      prof_window_clear(&prof_win[1]);
+      prof_cur = 0u;
+      prof_rotate_due = false;
+      profiler_on = true;
+      bus_trace_count(&prof_win[0].fiq);
+      LOG_INFO("Profiler: on\r\n");
+   } else {
+      bus_trace_count(NULL);
+      profiler_on = false;
+      /* what was being filled is the last reading now */
+      prof_win[prof_cur].len_us = Pi1MHz_now_us - prof_win[prof_cur].start_us;
+      prof_cur ^= 1u;
+      LOG_INFO("Profiler: off\r\n");
+   }
+   fx_register[prof_fx] = on ? 1u : 0u;
+}
+
+static void profiler_poll(void)
+{
+   bool want = (fx_register[prof_fx] != 0u);
+
+   if (want != profiler_on)
+      profiler_set(want);
+   if (profiler_on
+       && (uint32_t)(Pi1MHz_now_us - prof_win[prof_cur].start_us) >= PROF_WINDOW_US)
+      prof_rotate_due = true;
+}
+
+/* ---- report -------------------------------------------------------------- */
+
+void profiler_status_text(char *buf, size_t size)
+{
+   size_t n = 0;
+   #define APPEND(...) do { if (n < size) \
+      n += (size_t)snprintf(buf + n, size - n, __VA_ARGS__); } while (0)
+
+   if (size == 0u)
+      return;
+   buf[0] = '\0';
+   APPEND("profiler     %s  (fx slot %u: *FX147,202,%u : *FX147,203,%u)\n",
+          profiler_on ? "on" : "off", (unsigned int)prof_fx,
+          (unsigned int)prof_fx, profiler_on ? 0u : 1u);
+   if (prof_win == NULL) {
+      APPEND("no readings yet\n");
+      return;
+   }
+
+   /* the last complete window; the current one if there is none yet */
+   const prof_window_t *w = &prof_win[prof_cur ^ 1u];
+   if (w->len_us == 0u)
+      w = &prof_win[prof_cur];
+   uint32_t len_us = (w->len_us != 0u) ? w->len_us : Pi1MHz_now_us - w->start_us;
+
+   uint64_t in_pollers = 0u;
+   for (unsigned int i = 0; i < POLL_SCHED_MAX; i++)
+      in_pollers += w->poll[i].total;
+   APPEND("window       %lu ms, %lu passes\n",
+          (unsigned long)(len_us / 1000u), (unsigned long)w->passes);
+   if (w->passes != 0u && w->pass_cycles >= in_pollers)
+      APPEND("per pass     %lu cycles: %lu in pollers, %lu loop overhead\n",
+             (unsigned long)(w->pass_cycles / w->passes),
+             (unsigned long)(in_pollers / w->passes),
+             (unsigned long)((w->pass_cycles - in_pollers) / w->passes));
+
+   APPEND("\nidx function     calls      avg      max  histogram (cycles: calls)\n");
+   for (unsigned int i = 0; i < POLL_SCHED_MAX; i++) {
+      const prof_poll_t *p = &w->poll[i];
+      if (p->fn == NULL || p->calls == 0u)
+         continue;
+      APPEND("%3u %08lx %8lu %8lu %8lu ", i, (unsigned long)(uintptr_t)p->fn,
+             (unsigned long)p->calls, (unsigned long)(p->total / p->calls),
+             (unsigned long)p->max);
+      for (unsigned int b = 0; b < PROF_BUCKETS; b++) {
+         if (p->hist[b] == 0u)
+            continue;
+         if (b == 0u)
+            APPEND(" <64:%lu", (unsigned long)p->hist[b]);
+         else
+            APPEND(" %lu+:%lu", 1ul << (b + PROF_BUCKET_SHIFT - 1u),
+                   (unsigned long)p->hist[b]);
+      }
+      APPEND("\n");
+   }
+
+   /* busiest FIQ slots, by accesses */
+   uint16_t top[PROF_TOP_FIQ];
+   unsigned int ntop = 0u;
+   uint64_t accesses = 0u;
+   for (unsigned int s = 0; s < PAGE_SIZE * 2 * 2; s++) {
+      uint32_t calls = w->fiq.calls[s];
+      if (calls == 0u)
+         continue;
+      accesses += calls;
+      unsigned int at = ntop;
+      while (at > 0u && w->fiq.calls[top[at - 1u]] < calls)
+         at--;
+      if (at >= PROF_TOP_FIQ)
+         continue;
+      if (ntop < PROF_TOP_FIQ)
+         ntop++;
+      memmove(&top[at + 1u], &top[at], (ntop - 1u - at) * sizeof top[0]);
+      top[at] = (uint16_t)s;
+   }
+   APPEND("\nFIQ          %lu accesses; busiest slots:\n", (unsigned long)accesses);
+   for (unsigned int i = 0; i < ntop; i++) {
+      unsigned int s = top[i];
+      uint32_t calls = w->fiq.calls[s];
+      APPEND("  %c &%s%02X %9lu  avg %lu cycles\n",
+             (s & Pi1MHz_MEM_RNW) ? 'R' : 'W',
+             (s & Pi1MHz_MEM_PAGE) ? "FD" : "FC", s & 0xFFu,
+             (unsigned long)calls,
+             (unsigned long)(((uint64_t)w->fiq.cycles[s] * CYCLE_COUNTER_SCALE) / calls));
+   }
+   #undef APPEND
+}
+
+// cppcheck-suppress unusedFunction
+void profiler_init(uint8_t instance, uint8_t address)
+{
+   (void)address;
+   prof_fx = instance;
+   /* keep running across a BBC RST: the fx register survives it */
+   fx_register[prof_fx] = profiler_on ? 1u : 0u;
+   Pi1MHz_Register_Poll_Sched(profiler_poll, POLL_BACKGROUND, PROF_CHECK_US, 0u);
+}
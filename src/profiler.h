@@ -0,0 +1,44 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "Pi1MHz.h"
+
+/* Runtime poll-loop and FIQ profiler, on a production build.
+ *
+ * Switched on and off from the Beeb with its fx register (*FX147,202,<slot>
+ * then *FX147,203,1 or 0; the slot is the Profiler's place in the emulator
+ * table) or from the web UI at /profile.  While on it keeps, over rolling
+ * one-second windows:
+ *
+ *    - per poller: calls, average, worst case and a log2 histogram of the
+ *      cycles each call took;
+ *    - per pass: total cycles, so the loop's own overhead shows;
+ *    - per FIQ callback slot: accesses and the cycles spent in the callback.
+ *
+ * Off, the poll loop pays one load and branch per pass and the FIQ path is
+ * untouched. */
+
+/* Read by poll_sched.c on every pass. */
+extern bool profiler_on;
+
+void profiler_set(bool on);
+
+/* Start the current window again. */
+void profiler_reset(void);
+
+/* From the poll loop: one poller call, and one whole pass.  cycles are
+   read_cycle_counter() counts (rpi/performance.h). */
+void profiler_poll_record(unsigned int idx, func_ptr fn, uint32_t cycles);
+void profiler_pass_record(uint32_t cycles);
+
+/* Plain-text report of the last complete window, for /profile. */
+void profiler_status_text(char *buf, size_t size);
+
+/* Emulator-table entry.  Registers nothing on the bus. */
+void profiler_init(uint8_t instance, uint8_t address);
+
+#endif
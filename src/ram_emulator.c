@@ -27,6 +27,7 @@ Millipede PRISMA-3 (Not support)
 
 */
 
+#include <inttypes.h>
 #include <string.h>
 #include "Pi1MHz.h"
 
@@ -35,23 +36,121 @@ Millipede PRISMA-3 (Not support)
 #include "rpi/info.h"
 #include "BeebSCSI/filesystem.h"
 #include "helpers.h"
+#include "vpu_stream.h"
+#include "snapshot.h"
+#include "jim_pages.h"
+#include "jim_disc.h"
+#include "jim_init.h"
+#include "jim_tier.h"
+#include "services.h"
+#include "config.h"
 
 static uint8_t rambyte_address;
+static uint8_t rampage_address;
+static bool rambyte_on, rampage_on;
+
+/* Page mode reaches page_sets of 16MB: JIM RAM, and above it the compressed
+   overflow tier if there is one (jim_tier.h).  page_ram is the 256 bytes
+   behind the JIM window - in JIM RAM, or the tier's copy of the page. */
+static uint8_t tier_sets;
+static unsigned int page_sets;
+static uint8_t *page_ram;
+
+static uint8_t *ram_emulator_page_ram(size_t addr)
+{
+   return (addr < jim_tier_base) ? &Pi1MHz->JIM_ram[addr] : jim_tier_page(addr);
+}
+
+/* Byte RAM mode register at +4, after Sprow's four.  With RAMBYTE_AUTO_INC
+   set every access to the data register at +3 moves the address on one,
+   within the byte RAM's 16MB, and +3 then holds the next byte already:
+   sequential RAMFS transfers no longer rewrite the address for each byte,
+   which was most of their bus cycles.  With it clear - as after a BBC RST -
+   the registers are Sprow's exactly, and reading +3 costs no FIQ. */
+#define RAMBYTE_MODE      4u
+#define RAMBYTE_AUTO_INC  0x01u
+
+static uint8_t rambyte_mode;
+
+static bool ram_emulator_byte_inc(void)
+{
+   return (rambyte_mode & RAMBYTE_AUTO_INC) != 0u;
+}
+
+/* addr moved on n bytes, wrapping within its 16MB */
+static size_t ram_emulator_byte_step(size_t addr, uint32_t n)
+{
+   return (addr & ~(size_t)0xFFFFFF) | ((addr + n) & 0xFFFFFF);
+}
+
+/* The data register at +3 is streamed by the VPU (vpu_stream.h).  Without
+   a step it stores the Beeb's writes to the addressed byte itself, so only
+   the address registers, and one write in 256, reach ram_emulator_byte_write;
+   with auto-increment it steps through the rest of the 256-byte window and
+   keeps the low address read-back register in step.
+   Not while JIM_Init.bin has still to arrive there (jim_init.h): the
+   writes must come through here to be kept. */
+static void ram_emulator_byte_stream_arm(void)
+{
+   if (!jim_init_ready(Pi1MHz->byte_ram_addr))
+      return;
+   if (ram_emulator_byte_inc())
+      (void)vpu_stream_arm((uint8_t)(rambyte_address + 3u), Pi1MHz->byte_ram_addr,
+                           (Pi1MHz->byte_ram_addr | 0xFFFFFF) + 1u,
+                           1u, (rambyte_address & 1u) ? -1 : (int)rambyte_address);
+   else
+      (void)vpu_stream_arm((uint8_t)(rambyte_address + 3u), Pi1MHz->byte_ram_addr,
+                           (size_t)Pi1MHz->JIM_ram_size << 24, 0u, -1);
+}
+
+/* Take the data register back from the VPU, moving the address on past
+   what it served when auto-incrementing.  A window never runs past the
+   end of the 16MB, so this never needs the wrap. */
+static void ram_emulator_byte_take(void)
+{
+   uint32_t n = vpu_stream_take((uint8_t)(rambyte_address + 3u));
+
+   if (n == 0u)
+      return;
+   // the VPU may have stored the Beeb's writes at the old address
+   jim_disc_mark(Pi1MHz->byte_ram_addr);
+   if (ram_emulator_byte_inc())
+      Pi1MHz->byte_ram_addr += n;
+}
+
+/* Auto-increment: the address read-back registers and the next byte. */
+static void ram_emulator_byte_show(void)
+{
+   size_t a = Pi1MHz->byte_ram_addr;
+
+   Pi1MHz_MemoryWrite((uint32_t)(rambyte_address + 0u), (uint8_t)a);
+   Pi1MHz_MemoryWrite((uint32_t)(rambyte_address + 1u), (uint8_t)(a >> 8));
+   Pi1MHz_MemoryWrite((uint32_t)(rambyte_address + 2u), (uint8_t)(a >> 16));
+   Pi1MHz_MemoryWrite((uint32_t)(rambyte_address + 3u), Pi1MHz->JIM_ram[a]);
+}
 
 static void ram_emulator_byte_addr(unsigned int gpio)
 {
    uint8_t  data = GET_DATA(gpio);
    uint32_t addr = GET_ADDR(gpio);
 
+   ram_emulator_byte_take();
    switch (addr - rambyte_address)
    {
       case 0:  Pi1MHz->byte_ram_addr = ((Pi1MHz->byte_ram_addr & 0xFFFFFF00) | data); break;
       case 1:  Pi1MHz->byte_ram_addr = ((Pi1MHz->byte_ram_addr & 0xFFFF00FF) | ((size_t)data<<8)); break;
       default: Pi1MHz->byte_ram_addr = ((Pi1MHz->byte_ram_addr & 0xFF00FFFF) | ((size_t)data<<16)); break;
    }
+   jim_init_need(Pi1MHz->byte_ram_addr);
 
-   Pi1MHz_MemoryWrite((uint32_t)(rambyte_address + 3) , Pi1MHz->JIM_ram[Pi1MHz->byte_ram_addr]); // setup new data now the address has changed;
-   Pi1MHz_MemoryWrite(addr, data);               // enable the address register to be read back
+   if (ram_emulator_byte_inc())
+      ram_emulator_byte_show();                  // the VPU may have moved the other two on
+   else
+   {
+      Pi1MHz_MemoryWrite((uint32_t)(rambyte_address + 3) , Pi1MHz->JIM_ram[Pi1MHz->byte_ram_addr]); // setup new data now the address has changed;
+      Pi1MHz_MemoryWrite(addr, data);               // enable the address register to be read back
+   }
+   ram_emulator_byte_stream_arm();
 }
 
 static void ram_emulator_byte_write(unsigned int gpio)
@@ -59,17 +158,57 @@ static void ram_emulator_byte_write(unsigned int gpio)
    uint8_t data = GET_DATA(gpio);
    uint32_t addr = GET_ADDR(gpio);
 
+   ram_emulator_byte_take();
+   jim_init_write(Pi1MHz->byte_ram_addr);
    Pi1MHz->JIM_ram[Pi1MHz->byte_ram_addr] =  data;
-   Pi1MHz_MemoryWrite(addr,  data);
+   jim_disc_mark(Pi1MHz->byte_ram_addr);
+   if (ram_emulator_byte_inc())
+   {
+      Pi1MHz->byte_ram_addr = ram_emulator_byte_step(Pi1MHz->byte_ram_addr, 1u);
+      jim_init_need(Pi1MHz->byte_ram_addr);
+      ram_emulator_byte_show();
+   }
+   else
+      Pi1MHz_MemoryWrite(addr,  data);
+   ram_emulator_byte_stream_arm();
+}
+
+/* Registered only while auto-incrementing. */
+static void ram_emulator_byte_read(unsigned int gpio)
+{
+   (void)gpio;
+   ram_emulator_byte_take();
+   Pi1MHz->byte_ram_addr = ram_emulator_byte_step(Pi1MHz->byte_ram_addr, 1u);
+   jim_init_need(Pi1MHz->byte_ram_addr);
+   ram_emulator_byte_show();
+   ram_emulator_byte_stream_arm();
+}
+
+static void ram_emulator_byte_set_mode(uint8_t mode)
+{
+   rambyte_mode = mode & RAMBYTE_AUTO_INC;
+   Pi1MHz_Register_Memory(READ_FRED, (rambyte_address + 3u),
+                          ram_emulator_byte_inc() ? ram_emulator_byte_read : NULL);
+   Pi1MHz_MemoryWrite((uint32_t)(rambyte_address + RAMBYTE_MODE), rambyte_mode);
+   Pi1MHz_MemoryWrite((uint32_t)(rambyte_address + 3u), Pi1MHz->JIM_ram[Pi1MHz->byte_ram_addr]);
+}
+
+static void ram_emulator_byte_mode(unsigned int gpio)
+{
+   ram_emulator_byte_take();
+   ram_emulator_byte_set_mode(GET_DATA(gpio));
+   ram_emulator_byte_stream_arm();
 }
 
 static void ram_emulator_page_addr_high(unsigned int gpio)
 {
    uint8_t  data = GET_DATA(gpio);
    uint32_t addr = GET_ADDR(gpio);
-   if (data >= (Pi1MHz->JIM_ram_size)) data = (uint8_t)(Pi1MHz->JIM_ram_size - 1);
+   if (data >= page_sets) data = (uint8_t)(page_sets - 1);
                Pi1MHz->page_ram_addr = ((Pi1MHz->page_ram_addr & 0x00FFFFFF) | ((size_t)data<<24));
-   Pi1MHz_MemoryWritePage(Pi1MHz_MEM_PAGE, &Pi1MHz->JIM_ram[Pi1MHz->page_ram_addr]);
+   jim_init_need(Pi1MHz->page_ram_addr);
+   page_ram = ram_emulator_page_ram(Pi1MHz->page_ram_addr);
+   Pi1MHz_MemoryWritePage(Pi1MHz_MEM_PAGE, page_ram);
    Pi1MHz_MemoryWrite(addr,data); // enable the address register to be read back
 }
 
@@ -78,7 +217,9 @@ static void ram_emulator_page_addr_mid(unsigned int gpio)
    uint8_t  data = GET_DATA(gpio);
    uint32_t addr = GET_ADDR(gpio);
    Pi1MHz->page_ram_addr = ((Pi1MHz->page_ram_addr & 0xFF00FFFF) | ((size_t)data<<16));
-   Pi1MHz_MemoryWritePage(Pi1MHz_MEM_PAGE, &Pi1MHz->JIM_ram[Pi1MHz->page_ram_addr]);
+   jim_init_need(Pi1MHz->page_ram_addr);
+   page_ram = ram_emulator_page_ram(Pi1MHz->page_ram_addr);
+   Pi1MHz_MemoryWritePage(Pi1MHz_MEM_PAGE, page_ram);
    Pi1MHz_MemoryWrite(addr,data); // enable the address register to be read back
 }
 
@@ -87,22 +228,43 @@ static void ram_emulator_page_addr_low(unsigned int gpio)
    uint8_t  data = GET_DATA(gpio);
    uint32_t addr = GET_ADDR(gpio);
    Pi1MHz->page_ram_addr = ((Pi1MHz->page_ram_addr & 0xFFFF00FF) | ((size_t)data<<8));
+   jim_init_need(Pi1MHz->page_ram_addr);
+   page_ram = ram_emulator_page_ram(Pi1MHz->page_ram_addr);
    // RPI_SetGpioHi(TEST_PIN);
-   Pi1MHz_MemoryWritePage(Pi1MHz_MEM_PAGE, &Pi1MHz->JIM_ram[Pi1MHz->page_ram_addr]);
+   Pi1MHz_MemoryWritePage(Pi1MHz_MEM_PAGE, page_ram);
    // RPI_SetGpioLo(TEST_PIN);
    Pi1MHz_MemoryWrite(addr,data); // enable the address register to be read back
 }
 
 void ram_emulator_page_restore(void)
 {
-   Pi1MHz_MemoryWritePage(Pi1MHz_MEM_PAGE, &Pi1MHz->JIM_ram[Pi1MHz->page_ram_addr]);
+   Pi1MHz_MemoryWritePage(Pi1MHz_MEM_PAGE, page_ram);
+}
+
+void ram_emulator_refresh(size_t addr, size_t len)
+{
+   if (rampage_on && Pi1MHz->page_ram_addr - addr < len)
+   {
+      page_ram = ram_emulator_page_ram(Pi1MHz->page_ram_addr);
+      Pi1MHz_MemoryWritePage(Pi1MHz_MEM_PAGE, page_ram);
+   }
+   if (rambyte_on && Pi1MHz->byte_ram_addr - addr < len)
+   {
+      Pi1MHz_MemoryWrite((uint32_t)(rambyte_address + 3), Pi1MHz->JIM_ram[Pi1MHz->byte_ram_addr]);
+      ram_emulator_byte_stream_arm();
+   }
 }
 
 static void ram_emulator_page_write(unsigned int gpio)
 {
    uint8_t  data = GET_DATA(gpio);
    uint32_t addr = GET_ADDR(gpio);
-   Pi1MHz->JIM_ram[Pi1MHz->page_ram_addr + addr] = data;
+   vpu_stream_release();      // this page may be the one being streamed
+   jim_init_write(Pi1MHz->page_ram_addr + addr);
+   page_ram[addr] = data;
+   jim_disc_mark(Pi1MHz->page_ram_addr + addr);
+   if (Pi1MHz->page_ram_addr >= jim_tier_base)
+      jim_tier_write();
    Pi1MHz_MemoryWrite(Pi1MHz_MEM_PAGE + addr, data);
 }
 
@@ -127,9 +289,31 @@ static char* putstring(char *ram, char term, const char *string)
 
 extern char _end;
 
+/* A write to JIM RAM that found no memory to page in went nowhere
+   (jim_pages.h).  Nothing can be said from the abort handler itself, so the
+   first one is reported from here. */
+#define RAM_PAGES_CHECK_US 1000000u
+
+static void ram_emulator_pages_poll(void)
+{
+   static bool reported;
+   jim_pages_stats_t st;
+
+   if (reported)
+      return;
+   jim_pages_stats(&st);
+   if (st.sink_faults != 0u) {
+      reported = true;
+      LOG_INFO("JIM RAM: out of memory paging in, writes lost (%"PRIu32" of %"PRIu32" pages in use)\r\n",
+               st.backed, st.pages);
+   }
+}
+
 void rampage_emulator_init( uint8_t instance , uint8_t address)
 {
    static uint8_t init = 0 ;
+   static bool resume_tried, from_snapshot, disc_tried;
+   rampage_address = address;
    // Page access register write fcfd fcfe fcff
    Pi1MHz_Register_Memory(WRITE_FRED, (address + 0u), ram_emulator_page_addr_high ); // high byte
    Pi1MHz_Register_Memory(WRITE_FRED, (address + 1u), ram_emulator_page_addr_mid ); // Mid byte
@@ -150,12 +334,24 @@ void rampage_emulator_init( uint8_t instance , uint8_t address)
    Pi1MHz->byte_ram_addr = ((size_t)Pi1MHz->JIM_ram_size - 1)<<24; // 16Mbyte boundary
    Pi1MHz->page_ram_addr = 0;
 
-   fx_register[instance] = Pi1MHz->JIM_ram_size;  // fx addr 0 returns ram size
    if (init == 0)
    {
       init = 1;
-      Pi1MHz->JIM_ram = (uint8_t *) malloc(((size_t)Pi1MHz->JIM_ram_size<<24)); // malloc up to 480Mbytes
+      // Reserve it in the MMU and page it in as it is written (jim_pages.h),
+      // unless jim_lazy=0 or that cannot be set up: then malloc the lot.
+      const char *lazy = config_get("jim_lazy");
+      if (Pi1MHz->JIM_ram_size != 0u && (lazy == NULL || config_get_bool("jim_lazy"))
+          && jim_pages_init((size_t)Pi1MHz->JIM_ram_size << 24))
+         Pi1MHz->JIM_ram = (uint8_t *) JIM_VA_BASE;
+      else
+         Pi1MHz->JIM_ram = (uint8_t *) malloc(((size_t)Pi1MHz->JIM_ram_size<<24)); // malloc up to 480Mbytes
+      // page mode can go on above it compressed, up to 255 sets in all
+      if (Pi1MHz->JIM_ram != NULL && Pi1MHz->JIM_ram_size != 0u)
+         tier_sets = (uint8_t)jim_tier_init((size_t)Pi1MHz->JIM_ram_size << 24,
+                                            255u - Pi1MHz->JIM_ram_size);
    }
+   page_sets = (unsigned int)Pi1MHz->JIM_ram_size + tier_sets;
+   fx_register[instance] = (uint8_t)page_sets;  // fx addr 0 returns ram size
 
    /* Tested on every call, not just the first: a BBC RST re-runs this and
       re-advertises a nonzero JIM_ram_size above, but the one-time malloc is
@@ -166,12 +362,43 @@ void rampage_emulator_init( uint8_t instance , uint8_t address)
    {
       LOG_INFO("No RAM - disabling RAM page emulator\r\n");
       Pi1MHz->JIM_ram_size = 0;
+      page_sets = 0;
       fx_register[instance] = 0;
       return;
    }
 
-   // see if JIM_Init existing on the SDCARD if so load it to JIM and copy first page across Pi1MHz memory
-   if (!filesystemReadFile("JIM_Init.bin",&Pi1MHz->JIM_ram,((size_t)Pi1MHz->JIM_ram_size<<24)))
+   rampage_on = true;
+   page_ram = Pi1MHz->JIM_ram;
+   jim_tier_start();
+   if (jim_pages_active())
+      Pi1MHz_Register_Poll_Sched(ram_emulator_pages_poll, POLL_BACKGROUND, RAM_PAGES_CHECK_US, 0u);
+
+   // At power-on a snapshot, if there is one, stands in for JIM_Init.bin
+   // (snapshot.c).  Having been resumed it is the RAM's starting point for
+   // the session, so a BBC RST leaves the RAM alone rather than reloading
+   // JIM_Init.bin over it.
+   if (!resume_tried)
+   {
+      resume_tried = true;
+      from_snapshot = snapshot_resume_jim();
+   }
+
+   // At power-on the disc comes back over the snapshot.  It is opened before
+   // JIM_Init.bin is, so that JIM_Init.bin stops short of it then as on a BBC
+   // RST: streamed in behind the Beeb, JIM_Init.bin would otherwise arrive
+   // over the disc a region at a time, and go back to the card with the
+   // Beeb's next write there.
+   if (!disc_tried)
+   {
+      disc_tried = true;
+      jim_disc_open();
+   }
+
+   // see if JIM_Init existing on the SDCARD if so load it to JIM and copy first page across Pi1MHz memory.
+   // Only the start of it is read now, the rest follows in the background (jim_init.h).
+   // A RAM disc kept on the card (jim_disc.h) is never loaded over.
+   size_t init_size = jim_disc_init_limit((size_t)Pi1MHz->JIM_ram_size<<24);
+   if (!from_snapshot && init_size != 0u && !jim_init_load(init_size))
    {
        // put info in fred so beeb user can do P.$&FD00 if JIM_Init doesn't exist
       char * ram = (char *)Pi1MHz->JIM_ram;
@@ -181,12 +408,18 @@ void rampage_emulator_init( uint8_t instance , uint8_t address)
       putstring(ram,'\r', hex);
    }
 
-   Pi1MHz_MemoryWritePage(Pi1MHz_MEM_PAGE, &Pi1MHz->JIM_ram[0]);
+   jim_disc_start();
+
+   // moves and fills on the Pi side, for the Beeb through the services port
+   jim_service_init();
+
+   Pi1MHz_MemoryWritePage(Pi1MHz_MEM_PAGE, page_ram);
 }
 
 void rambyte_emulator_init( uint8_t instance , uint8_t address)
 {
    rambyte_address = address;
+   rambyte_on = true;
 
    // register call backs
    // byte memory address write fc00 01 02
@@ -195,4 +428,54 @@ void rambyte_emulator_init( uint8_t instance , uint8_t address)
    Pi1MHz_Register_Memory(WRITE_FRED, (rambyte_address+2u), ram_emulator_byte_addr );
    // fc03 write data byte
    Pi1MHz_Register_Memory(WRITE_FRED, (rambyte_address+3u), ram_emulator_byte_write );
-}
\ No newline at end of file
+   // fc04 mode: Sprow's registers until the Beeb asks for auto-increment
+   Pi1MHz_Register_Memory(WRITE_FRED, (rambyte_address+RAMBYTE_MODE), ram_emulator_byte_mode );
+   ram_emulator_byte_set_mode(0u);
+}
+/* Snapshot section (snapshot.c): the page and byte pointers and the byte
+   RAM mode.  Restoring puts up what the Beeb would read - the JIM window,
+   the address read-back registers and the byte at the byte pointer - as the
+   register writes that set them did.  A section without the mode, from
+   before there was one, restores Sprow's registers. */
+size_t ram_emulator_snapshot_save(uint8_t *buf, size_t size)
+{
+   uint32_t ptr[3] = { (uint32_t)Pi1MHz->page_ram_addr, (uint32_t)Pi1MHz->byte_ram_addr,
+                       rambyte_mode };
+
+   if (!rampage_on || size < sizeof ptr)
+      return 0;
+   memcpy(buf, ptr, sizeof ptr);
+   return sizeof ptr;
+}
+
+bool ram_emulator_snapshot_restore(const uint8_t *buf, size_t len)
+{
+   uint32_t ptr[3] = { 0u, 0u, 0u };
+   size_t ram = (size_t)Pi1MHz->JIM_ram_size << 24;
+   size_t pages = (size_t)page_sets << 24;
+
+   if (!rampage_on || (len != sizeof ptr && len != 2u * sizeof ptr[0]))
+      return false;
+   memcpy(ptr, buf, len);
+   if (ptr[0] > pages - PAGE_SIZE || (ptr[0] & (PAGE_SIZE - 1)) != 0 || ptr[1] >= ram)
+      return false;
+
+   Pi1MHz->page_ram_addr = ptr[0];
+   page_ram = ram_emulator_page_ram(Pi1MHz->page_ram_addr);
+   Pi1MHz_MemoryWritePage(Pi1MHz_MEM_PAGE, page_ram);
+   Pi1MHz_MemoryWrite(rampage_address + 0u, (uint8_t)(ptr[0] >> 24));
+   Pi1MHz_MemoryWrite(rampage_address + 1u, (uint8_t)(ptr[0] >> 16));
+   Pi1MHz_MemoryWrite(rampage_address + 2u, (uint8_t)(ptr[0] >> 8));
+
+   if (rambyte_on)
+   {
+      (void)vpu_stream_take((uint8_t)(rambyte_address + 3u));
+      Pi1MHz->byte_ram_addr = ptr[1];
+      Pi1MHz_MemoryWrite(rambyte_address + 0u, (uint8_t)ptr[1]);
+      Pi1MHz_MemoryWrite(rambyte_address + 1u, (uint8_t)(ptr[1] >> 8));
+      Pi1MHz_MemoryWrite(rambyte_address + 2u, (uint8_t)(ptr[1] >> 16));
+      ram_emulator_byte_set_mode((uint8_t)ptr[2]);
+      ram_emulator_byte_stream_arm();
+   }
+   return true;
+}
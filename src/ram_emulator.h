@@ -1,5 +1,18 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
 
 void rampage_emulator_init( uint8_t instance , uint8_t address);
 void rambyte_emulator_init( uint8_t instance , uint8_t address);
 
-void ram_emulator_page_restore(void);
\ No newline at end of file
+void ram_emulator_page_restore(void);
+
+/* JIM RAM from addr for len bytes has been loaded behind the Beeb's back
+   (jim_init.h): put the JIM window and the byte data register right if they
+   show any of it.  With FIQs masked. */
+void ram_emulator_refresh(size_t addr, size_t len);
+
+/* Snapshot section (snapshot.c): the page and byte RAM pointers. */
+size_t ram_emulator_snapshot_save(uint8_t *buf, size_t size);
+bool ram_emulator_snapshot_restore(const uint8_t *buf, size_t len);
\ No newline at end of file
@@ -53,6 +53,8 @@
  interfaces. You must include errno.h, then disable the macro, like this:
  */
 #include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <string.h>
 #undef errno
 extern int errno;
@@ -65,6 +67,8 @@ extern int errno;
 
 /* Prototype for the UART write function */
 #include "auxuart.h"
+#include "asm-helpers.h"
+#include "armc-cstubs.h"
 
 /* A pointer to a list of environment variables and their values. For a minimal
  environment, this empty list is adequate: */
@@ -157,22 +161,51 @@ void arm_setup_heap_limit(void *limit)
   }
 }
 
+/* Take whole 4K pages off the top of the heap for good, for JIM RAM paged
+ in on a write (jim_pages.c).  Called from the data abort handler, possibly
+ over a FIQ that interrupted the main loop, so it must not touch malloc - it
+ only lowers heap_limit - and _sbrk() below runs with interrupts masked so
+ the two cannot interleave.  HEAP_TOP_RESERVE is left between heap_end and
+ the new limit for everything else that still has to malloc.  NULL if that
+ would not be left, or the limit has not been set up yet. */
+#define HEAP_TOP_RESERVE (4u * 1024u * 1024u)
+
+void *arm_heap_take_top(size_t bytes)
+{
+  unsigned int cpsr = _disable_interrupts_cspr();
+  void *taken = NULL;
+  uintptr_t top = (uintptr_t) heap_limit & ~(uintptr_t) 0xFFF;
+
+  bytes = (bytes + 0xFFFu) & ~(size_t) 0xFFF;
+  if (heap_limit != NULL && bytes != 0u && top > (uintptr_t) heap_end
+      && top - (uintptr_t) heap_end >= (uintptr_t) bytes + HEAP_TOP_RESERVE) {
+    heap_limit = (char *) (top - bytes);
+    taken = heap_limit;
+  }
+  _restore_cpsr(cpsr);
+  return taken;
+}
+
 // cppcheck-suppress unusedFunction
 caddr_t _sbrk(int incr)
 {
+  unsigned int cpsr = _disable_interrupts_cspr();
   char * prev = heap_end;
   char * next = heap_end + incr;
   if ( next < &_end) {
+    _restore_cpsr(cpsr);
     errno = EINVAL;
     return (caddr_t) -1;
   }
 
   if ( next > ( heap_limit ? heap_limit : (&_end + EARLY_HEAP_SIZE) ) ) {
+    _restore_cpsr(cpsr);
     errno = ENOMEM;
     return (caddr_t) -1;
   }
 
   heap_end = next;
+  _restore_cpsr(cpsr);
   return (caddr_t) prev;
 }
 
@@ -3,6 +3,7 @@
 
 #include <sys/stat.h>
 #include <sys/times.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #ifdef __cplusplus
@@ -10,6 +11,7 @@ extern "C" {
 #endif
 
 void arm_setup_heap_limit(void *limit);
+void *arm_heap_take_top(size_t bytes);
 
 #ifdef __cplusplus
 }
@@ -1,3 +1,4 @@
+#include <stdbool.h>
 #include <stdio.h>
 #include <string.h>
 #include <inttypes.h>
@@ -229,12 +230,12 @@ static void _invalidate_dtlb()
 // 2      B     - bufferable    - TEX, C, B used together, see below
 // 1      1
 // 0      1
-#ifdef NUM_4K_PAGES
 static void _invalidate_dtlb_mva(const void *address)
 {
    __asm volatile ("mcr p15, 0, %0, c8, c6, 1" : : "r" (address));
 }
 
+#ifdef NUM_4K_PAGES
 void map_4k_page(unsigned int logical, unsigned int physical) {
   // Setup the 4K page table entry
   // Second level descriptors use extended small page format
@@ -264,6 +265,61 @@ void map_4k_page(unsigned int logical, unsigned int physical) {
   _invalidate_dtlb_mva((void *)(logical << 12));
 }
 #endif
+
+/* Hang second-level tables off count 1MB L1 entries from logical_mb, at run
+   time, for a region mapped a page at a time (jim_pages.c).  Each table is
+   256 words, 1KB aligned, and must already hold its descriptors - zero for a
+   translation fault.  Only entries that enable_MMU_and_IDCaches() left empty
+   can be taken: false, with nothing changed, if any of them is in use.
+
+   As in map_4k_page() the walker cannot see the L1 data cache on the Pi 0/1,
+   so the tables and the L1 entries are cleaned out to memory before the TLB
+   is invalidated. */
+bool map_l2_tables(unsigned int logical_mb, unsigned int count, const unsigned int *tables)
+{
+  if (count == 0u || logical_mb >= 4096u || count > 4096u - logical_mb)
+     return false;
+  for (unsigned int i = 0; i < count; i++)
+     if (PageTable[logical_mb + i] != 0u)
+        return false;
+
+  _clean_cache_area(tables, count * 256u * sizeof(unsigned int));
+  for (unsigned int i = 0; i < count; i++) {
+     PageTable[logical_mb + i] = ((unsigned int) &tables[i * 256u]) | 1u;   // coarse page table, domain 0
+     __asm volatile ("mcr p15, 0, %0, c7, c10, 1" : : "r" (&PageTable[logical_mb + i]) : "memory"); // clean D$ line by MVA
+  }
+  __asm volatile ("mcr p15, 0, %0, c7, c10, 4" : : "r" (0) : "memory");   // DSB / drain write buffer
+  __asm volatile ("mcr p15, 0, %0, c8, c7,  0" : : "r" (0) : "memory");   // invalidate unified TLB
+  return true;
+}
+
+/* Point the 4K page at logical (a page number, as for map_4k_page) to
+   physical, in a table hung by map_l2_tables(), with the same cacheable
+   attributes as map_4k_page().  writable false gives a page that reads and
+   faults on a write:
+     Pi 2/3 - APX=1 AP=01, privileged read-only
+     Pi 0/1 - AP=00, which with SCTLR.S set (enable_MMU_and_IDCaches) is also
+              privileged read-only in the ARMv4/5 format */
+void map_small_page(unsigned int logical, unsigned int physical, bool writable)
+{
+  volatile unsigned int *table = (volatile unsigned int *) (PageTable[logical >> 8] & ~0x3FFu);
+  volatile unsigned int *pte = &table[logical & 0xFFu];
+#if (__ARM_ARCH >= 7 )
+  unsigned int desc = (physical<<12) | 0x132u | (1 << 6) | (1<<3) | (1 << 2);
+  if (!writable)
+     desc = (desc & ~0x30u) | (1u << 9) | (1u << 4);
+#else
+  unsigned int desc = (physical<<12) | 0x133u | (1 << 6) | (1<<3) | (1 << 2);
+  if (!writable)
+     desc &= ~0x30u;
+#endif
+  *pte = desc;
+  // same ordering as map_4k_page: write PTE -> clean line -> drain -> invalidate TLB
+  __asm volatile ("mcr p15, 0, %0, c7, c10, 1" : : "r" (pte) : "memory"); // clean D$ line by MVA
+  __asm volatile ("mcr p15, 0, %0, c7, c10, 4" : : "r" (0) : "memory");   // DSB / drain write buffer
+  _invalidate_dtlb_mva((void *)(logical << 12));
+}
+
 void enable_MMU_and_IDCaches(unsigned int num_4k_pages)
 {
 
@@ -448,6 +504,11 @@ void enable_MMU_and_IDCaches(unsigned int num_4k_pages)
   // The L1 data cache will one be enabled if the MMU is enabled
   sctrl |= 0x00001805;
   sctrl |= 1<<22; // U (v6 unaligned access model)
+#if (__ARM_ARCH < 7 )
+  // S: AP=00 pages are privileged read-only (map_small_page); the sections
+  // above all use AP=11 and are not affected
+  sctrl |= 1<<8;
+#endif
   __asm volatile ("mcr p15,0,%0,c1,c0,0" :: "r" (sctrl) : "memory");
   // synchronize the SCTLR change before executing further instructions
 #if (__ARM_ARCH >= 7 )
@@ -3,12 +3,18 @@
 #ifndef CACHE_H
 #define CACHE_H
 
+#include <stdbool.h>
+
 void _clean_cache_area(const void *start, unsigned int length);
 
 void _invalidate_cache_area(const void * start, unsigned int length);
 
 void map_4k_page(unsigned int logical, unsigned int physical);
 
+bool map_l2_tables(unsigned int logical_mb, unsigned int count, const unsigned int *tables);
+
+void map_small_page(unsigned int logical, unsigned int physical, bool writable);
+
 void enable_MMU_and_IDCaches(unsigned int num_4k_pages);
 
 #endif
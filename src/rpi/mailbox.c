@@ -130,6 +130,7 @@ void RPI_MailboxInit( void )
 #define boot_stage_magic    (((volatile uint32_t *)BOOT_STAGE_BASE)[0])
 #define boot_stage_current  (((volatile uint32_t *)BOOT_STAGE_BASE)[1])
 #define boot_stage_previous (((volatile uint32_t *)BOOT_STAGE_BASE)[2])
+#define boot_stage_since    (((volatile uint32_t *)BOOT_STAGE_BASE)[3])
 #define BOOT_STAGE_MAGIC 0x8007ADE5u
 
 void RPI_BootStage( boot_stage_t stage )
@@ -143,6 +144,7 @@ void RPI_BootStage( boot_stage_t stage )
       boot_stage_previous = boot_stage_current;
    }
    boot_stage_current = (uint32_t)stage;
+   boot_stage_since = RPI_GetSystemTime();
 }
 
 boot_stage_t RPI_BootStagePrevious( void )
@@ -150,6 +152,11 @@ boot_stage_t RPI_BootStagePrevious( void )
    return (boot_stage_t)boot_stage_previous;
 }
 
+uint32_t RPI_BootStageElapsed( void )
+{
+   return RPI_GetSystemTime() - boot_stage_since;
+}
+
 static void RPI_Mailbox0Drain( void )
 {
     uint32_t start_us = RPI_GetSystemTime();
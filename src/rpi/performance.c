@@ -200,6 +200,29 @@ void reset_performance_counters(perf_counters_t *pct) {
 #endif
 }
 
+void start_cycle_counter(void) {
+#if (__ARM_ARCH >= 7 )
+   unsigned int pmcr;
+   /* PMCR: E (bit 0) on, D (bit 3, count every 64th cycle) off, no resets */
+   __asm volatile ("mrc p15,0,%0,c9,c12,0" : "=r" (pmcr));
+   pmcr = (pmcr | 1u) & ~0x0Eu;
+   __asm volatile ("mcr p15,0,%0,c9,c12,0" :: "r" (pmcr) : "memory");
+   /* PMCCFILTR: count at PL1 and PL0, and at HYP (NSH, bit 27) in case the
+      firmware's stub left us there */
+   __asm volatile ("mcr p15,0,%0,c14,c15,7" :: "r" (1u << 27) : "memory");
+   /* PMCNTENSET: the cycle counter is bit 31 */
+   __asm volatile ("mcr p15,0,%0,c9,c12,1" :: "r" (1u << 31) : "memory");
+#else
+   unsigned int ctrl;
+   /* Enable (bit 0) with the /64 divider (bit 3), as poll_ticks_start() in
+      poll_sched.c left it.  Bits 1 and 2 would reset the counters and bits
+      8-10 are write-one-to-clear overflow flags, so clear all of those. */
+   __asm volatile ("mrc p15,0,%0,c15,c12,0" : "=r" (ctrl));
+   ctrl = (ctrl | 0x9u) & ~0x706u;
+   __asm volatile ("mcr p15,0,%0,c15,c12,0" :: "r" (ctrl) : "memory");
+#endif
+}
+
 // cppcheck-suppress constParameterPointer
 void read_performance_counters(perf_counters_t *pct) {
 #if (__ARM_ARCH >= 7 )
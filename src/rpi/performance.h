@@ -87,4 +87,30 @@ extern void read_performance_counters(perf_counters_t *pct);
 
 extern void print_performance_counters(const perf_counters_t *pct);
 
+/* The free-running cycle counter on its own, for the profiler (profiler.c).
+   reset_performance_counters() zeroes it, which would upset the poll loop's
+   slow-poll timing on the ARM1176, so start_cycle_counter() only makes sure
+   it is running and leaves its value and the event counters alone. */
+#if (__ARM_ARCH >= 7 )
+/* Cortex-A53: PMCCNTR, every cycle */
+#define CYCLE_COUNTER_SCALE 1u
+static inline unsigned int read_cycle_counter(void)
+{
+   unsigned int v;
+   __asm volatile ("mrc p15,0,%0,c9,c13,0" : "=r" (v));
+   return v;
+}
+#else
+/* ARM1176: CCNT, which the poll loop runs with the /64 divider */
+#define CYCLE_COUNTER_SCALE 64u
+static inline unsigned int read_cycle_counter(void)
+{
+   unsigned int v;
+   __asm volatile ("mrc p15,0,%0,c15,c12,1" : "=r" (v));
+   return v;
+}
+#endif
+
+extern void start_cycle_counter(void);
+
 #endif
@@ -3,6 +3,7 @@
 
 #ifndef __ASSEMBLER__
 #include <stdio.h>
+#include <stdint.h>
 
 #ifdef DEBUG
 #define LOG_DEBUG(...) printf(__VA_ARGS__)
@@ -32,12 +33,18 @@ typedef enum {
    BOOT_STAGE_HEAP,           /* heap sized                                 */
    BOOT_STAGE_INFO,           /* dump_useful_info done (DEBUG builds)       */
    BOOT_STAGE_CONFIG,         /* Pi1MHz.cfg parsed                          */
-   BOOT_STAGE_EMULATORS,      /* every emulator init returned               */
-   BOOT_STAGE_RUNNING         /* main poll loop entered                     */
+   BOOT_STAGE_EMULATORS,      /* bus-critical emulator inits returned       */
+   BOOT_STAGE_RUNNING,        /* poll loop running, deferred inits returned */
+   BOOT_STAGE_INIT = 0x100    /* + emulator-table index: inside its init    */
 } boot_stage_t;
 
+#define BOOT_STAGE_INIT_OF(i) ((boot_stage_t)(BOOT_STAGE_INIT + (unsigned int)(i)))
+
 void RPI_BootStage( boot_stage_t stage );
 boot_stage_t RPI_BootStagePrevious( void );
+/* Microseconds since the current stage was stamped: what an init stage
+   cost, read just before the next one is stamped. */
+uint32_t RPI_BootStageElapsed( void );
 #endif
 
 
@@ -22,7 +22,9 @@
 #define SERVICE_CMD_AUN_LAST    44u
 #define SERVICE_CMD_NET_FIRST   45u   /* IP sockets / N: device - net_service.c */
 #define SERVICE_CMD_NET_LAST    79u   /* sockets 45-56, IRQ 57, N: dev 60-65   */
-/* 80..255 unallocated */
+#define SERVICE_CMD_JIM_FIRST   80u   /* JIM RAM move/fill/compare/search - jim_service.c */
+#define SERVICE_CMD_JIM_LAST    89u
+/* 90..255 unallocated */
 
 /* Handler for one service's command range.  FIQ context: called from the
    FRED write callback, so anything slow must be queued for the main loop
@@ -71,4 +73,8 @@ void fat_service_init(void);
    filesystemHostPathBusy() for the SCSI LUN images. */
 bool fat_service_file_in_use(const char *host_path);
 
+/* The JIM memory service (commands 80-83; the range reserves up to 89),
+   registered by rampage_emulator_init() once there is JIM RAM to work on. */
+void jim_service_init(void);
+
 #endif
@@ -2,7 +2,9 @@
   The services port: a command mailbox at &FCA6 (formerly "Discaccess").
 
   +0/+1/+2  24-bit address into the JIM buffer (low/mid/high)
-  +3        data port, auto-incrementing through the buffer
+  +3        data port, auto-incrementing through the buffer.  The VPU
+            serves it itself for a 256-byte window at a time, so a
+            callback here is one byte in 256 (vpu_stream.h)
   +4        command pointer: writing &F0-&FF dispatches the command block
             at the top of the buffer (&F0 -> 0xFFF000, ... &FF -> 0xFFFF00)
   +5        IRQ status (used by services that raise nIRQ, e.g. AUN)
@@ -16,6 +18,7 @@
 
 #include "ram_emulator.h"
 #include "services.h"
+#include "vpu_stream.h"
 
 static size_t disc_ram_addr;
 static size_t disc_ram_max;
@@ -94,11 +97,25 @@ static void services_emulator_update_address(void)
    }
 }
 
+// What the VPU streamed since the data port was last armed.  A window never
+// runs past disc_ram_max, so this never needs the wrap.
+static void services_emulator_stream_take(void)
+{
+   disc_ram_addr += vpu_stream_take((uint8_t)(ram_address + 3u));
+}
+
+static void services_emulator_stream_arm(void)
+{
+   (void)vpu_stream_arm((uint8_t)(ram_address + 3u), disc_ram_addr, disc_ram_max, 1u,
+                        ram_address);
+}
+
 static void services_emulator_byte_addr(unsigned int gpio)
 {
    uint8_t  data = GET_DATA(gpio);
    uint32_t addr = GET_ADDR(gpio);
 
+   services_emulator_stream_take();
    switch (addr - ram_address)
    {
       case 0:  disc_ram_addr = (size_t) ((disc_ram_addr & 0xFFFFFF00) | data); break;
@@ -108,24 +125,29 @@ static void services_emulator_byte_addr(unsigned int gpio)
 
    Pi1MHz_MemoryWrite((uint32_t)(ram_address + 3) , Pi1MHz->JIM_ram[disc_ram_addr]); // setup new data now the address has changed;
    services_emulator_update_address();              // enable the address register to be read back
+   services_emulator_stream_arm();
 }
 
 static void services_emulator_byte_write_inc(unsigned int gpio)
 {
    uint8_t data = GET_DATA(gpio);
+   services_emulator_stream_take();
    Pi1MHz->JIM_ram[disc_ram_addr] =  data;
    disc_ram_addr++;
    if (disc_ram_addr >= disc_ram_max) disc_ram_addr = DISC_RAM_BASE;
    Pi1MHz_MemoryWrite((uint32_t)(ram_address + 3) , Pi1MHz->JIM_ram[disc_ram_addr]); // setup new data now the address has changed;
    services_emulator_update_address();
+   services_emulator_stream_arm();
 }
 
 static void services_emulator_byte_read_inc(unsigned int gpio)
 {
+   services_emulator_stream_take();
    disc_ram_addr++;
    if (disc_ram_addr >= disc_ram_max) disc_ram_addr = DISC_RAM_BASE;
    Pi1MHz_MemoryWrite((uint32_t)(ram_address + 3) , Pi1MHz->JIM_ram[disc_ram_addr]); // setup new data now the address has changed;
    services_emulator_update_address();
+   services_emulator_stream_arm();
 }
 
 static void services_emulator_command(unsigned int gpio)
@@ -133,6 +155,9 @@ static void services_emulator_command(unsigned int gpio)
    uint8_t  data = GET_DATA(gpio);
    uint32_t addr = GET_ADDR(gpio);
 
+   // The handler may write the buffer: the next data access arms a fresh
+   // window, rather than the VPU serving what it saw before.
+   services_emulator_stream_take();
    Pi1MHz_MemoryWrite(addr, data); // return existing command
 
    // command pointer is always page aligned
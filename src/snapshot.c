@@ -0,0 +1,679 @@
+/* Emulator state snapshot and warm resume - see snapshot.h for the file.
+ *
+ * Cold, the slow part of getting to a working Beeb is JIM RAM: reading a
+ * JIM_Init.bin the size of the RAM, hundreds of megabytes of it mostly
+ * zeros.  A snapshot only stores the 4 KB blocks that are not all zeros,
+ * PackBits-packed when that is shorter, so it reads back in a fraction of
+ * the time, and brings everything else the Beeb had set up with it.
+ *
+ * Resuming is in two halves because the emulators initialise in table
+ * order.  rampage_emulator_init() calls snapshot_resume_jim() where it
+ * would load JIM_Init.bin, which fills the RAM and keeps the state
+ * sections; snapshot_init(), near the end of the table, hands each section
+ * back to its owner once every owner has initialised.  Both happen at
+ * power-on only: a BBC RST initialises the emulators as it always did,
+ * and leaves JIM RAM alone.
+ *
+ * Saving walks the whole of JIM RAM in the poll loop, so nothing else runs
+ * until it is written.  That is the price of a snapshot that is consistent
+ * with itself; the Beeb keeps running, and anything it writes to JIM RAM
+ * while the blocks go out lands in the snapshot or not depending on how far
+ * the walk has got.  The file is written under another name and renamed
+ * over the old one at the end, so a save that fails, or a power cut part
+ * way through, leaves the previous snapshot as it was.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Pi1MHz.h"
+#include "config.h"
+#include "rpi/systimer.h"
+#include "BeebSCSI/fatfs/ff.h"
+#include "watchdog.h"
+#include "vpu_stream.h"
+#include "ram_emulator.h"
+#include "harddisc_emulator.h"
+#include "teletext_emulator.h"
+#include "BeebSID/BeebSid.h"
+#include "snapshot.h"
+#include "jim_pages.h"
+#include "jim_init.h"
+#include "jim_tier.h"
+
+#define SNAPSHOT_DEFAULT_FILE "/Pi1MHz/snapshot.bin"
+#define SNAPSHOT_IO_CHUNK     65536u       /* bytes per f_read / f_write */
+#define SNAPSHOT_STATE_MAX    16384u       /* every section, with room to spare */
+#define SNAPSHOT_CHECK_US     100000u      /* how often the fx register is looked at */
+
+typedef struct {
+   uint32_t tag;
+   const char *name;
+   size_t (*save)(uint8_t *buf, size_t size);       /* 0: nothing to save */
+   bool   (*restore)(const uint8_t *buf, size_t len);
+} snapshot_section_t;
+
+static size_t snapshot_core_save(uint8_t *buf, size_t size);
+static bool snapshot_core_restore(const uint8_t *buf, size_t len);
+
+/* Restored in this order: the fx registers first, as the emulators' own
+   state was set up alongside them. */
+static const snapshot_section_t snapshot_sections[] = {
+   { SNAPSHOT_TAG('C','O','R','E'), "core",     snapshot_core_save,          snapshot_core_restore },
+   { SNAPSHOT_TAG('R','A','M',' '), "RAM",      ram_emulator_snapshot_save,  ram_emulator_snapshot_restore },
+   { SNAPSHOT_TAG('T','T','X',' '), "teletext", teletext_snapshot_save,      teletext_snapshot_restore },
+   { SNAPSHOT_TAG('S','I','D',' '), "BeebSID",  BeebSID_snapshot_save,       BeebSID_snapshot_restore },
+   { SNAPSHOT_TAG('S','C','S','I'), "SCSI",     harddisc_snapshot_save,      harddisc_snapshot_restore },
+};
+
+#define NUM_SECTIONS (sizeof(snapshot_sections) / sizeof(snapshot_sections[0]))
+
+typedef struct {
+   FIL      file;
+   uint8_t *buf;               /* SNAPSHOT_IO_CHUNK */
+   size_t   used;              /* bytes staged (writing) or held (reading) */
+   size_t   at;                /* next byte to hand out (reading) */
+   bool     ok;
+   void   (*kick)(void);       /* the watchdog: this can take seconds */
+} snapshot_io_t;
+
+static uint8_t  snap_fx;
+static uint8_t  snap_request;
+static uint8_t *snap_stash;               /* state sections awaiting snapshot_init() */
+static size_t   snap_stash_len;
+static bool     snap_resumed;
+static uint32_t snap_resumed_blocks;
+static uint32_t snap_resumed_ms;
+static unsigned int snap_restored, snap_skipped;
+
+static bool     snap_saved;               /* a save has been tried this session */
+static bool     snap_save_ok;
+static uint32_t snap_save_blocks;
+static uint32_t snap_save_bytes;
+static uint32_t snap_save_ms;
+
+static const char *snapshot_file(void)
+{
+   const char *file = config_get("snapshot_file");
+   return (file != NULL && file[0] != '\0') ? file : SNAPSHOT_DEFAULT_FILE;
+}
+
+static void put_le16(uint8_t *p, uint32_t v)
+{
+   p[0] = (uint8_t)v;
+   p[1] = (uint8_t)(v >> 8);
+}
+
+static void put_le32(uint8_t *p, uint32_t v)
+{
+   put_le16(p, v);
+   put_le16(p + 2, v >> 16);
+}
+
+static uint32_t get_le16(const uint8_t *p)
+{
+   return (uint32_t)p[0] | ((uint32_t)p[1] << 8);
+}
+
+static uint32_t get_le32(const uint8_t *p)
+{
+   return get_le16(p) | (get_le16(p + 2) << 16);
+}
+
+static size_t snapshot_pad(size_t n)
+{
+   return (4u - (n & 3u)) & 3u;
+}
+
+/* ---- PackBits ------------------------------------------------------------ */
+
+/* A control byte c < 128 is followed by c + 1 literal bytes; c > 128 by one
+   byte to repeat 257 - c times; 128 is skipped.  Runs shorter than three
+   are left in the literals: a run of two costs as much as it saves and
+   breaks the literal up. */
+size_t snapshot_pack(const uint8_t *src, size_t len, uint8_t *dst, size_t room)
+{
+   size_t i = 0u, o = 0u;
+
+   while (i < len) {
+      size_t run = 1u;
+      while (i + run < len && run < 128u && src[i + run] == src[i])
+         run++;
+      if (run >= 3u) {
+         if (o + 2u > room)
+            return 0u;
+         dst[o++] = (uint8_t)(257u - run);
+         dst[o++] = src[i];
+         i += run;
+         continue;
+      }
+
+      size_t lit = 0u;
+      while (i + lit < len && lit < 128u) {
+         if (i + lit + 2u < len && src[i + lit] == src[i + lit + 1u]
+             && src[i + lit] == src[i + lit + 2u])
+            break;
+         lit++;
+      }
+      if (o + 1u + lit > room)
+         return 0u;
+      dst[o++] = (uint8_t)(lit - 1u);
+      memcpy(dst + o, src + i, lit);
+      o += lit;
+      i += lit;
+   }
+   return o;
+}
+
+bool snapshot_unpack(const uint8_t *src, size_t len, uint8_t *dst, size_t out)
+{
+   size_t i = 0u, o = 0u;
+
+   while (i < len) {
+      uint8_t c = src[i++];
+      if (c < 128u) {
+         size_t n = (size_t)c + 1u;
+         if (n > len - i || n > out - o)
+            return false;
+         memcpy(dst + o, src + i, n);
+         i += n;
+         o += n;
+      } else if (c > 128u) {
+         size_t n = 257u - (size_t)c;
+         if (i == len || n > out - o)
+            return false;
+         memset(dst + o, src[i++], n);
+         o += n;
+      }
+   }
+   return o == out;
+}
+
+/* ---- buffered file access ------------------------------------------------ */
+
+static void snapshot_flush(snapshot_io_t *io)
+{
+   UINT written;
+
+   if (io->ok && io->used != 0u
+       && (f_write(&io->file, io->buf, (UINT)io->used, &written) != FR_OK
+           || written != io->used))
+      io->ok = false;
+   io->used = 0u;
+   io->kick();
+}
+
+static void snapshot_put(snapshot_io_t *io, const void *data, size_t n)
+{
+   const uint8_t *p = data;
+
+   while (n != 0u) {
+      size_t k = SNAPSHOT_IO_CHUNK - io->used;
+      if (k > n)
+         k = n;
+      memcpy(io->buf + io->used, p, k);
+      io->used += k;
+      p += k;
+      n -= k;
+      if (io->used == SNAPSHOT_IO_CHUNK)
+         snapshot_flush(io);
+   }
+}
+
+static void snapshot_put32(snapshot_io_t *io, uint32_t v)
+{
+   uint8_t b[4];
+
+   put_le32(b, v);
+   snapshot_put(io, b, sizeof b);
+}
+
+static bool snapshot_get(snapshot_io_t *io, void *data, size_t n)
+{
+   uint8_t *p = data;
+
+   while (n != 0u) {
+      if (io->at == io->used) {
+         UINT got;
+         io->kick();
+         if (!io->ok || f_read(&io->file, io->buf, SNAPSHOT_IO_CHUNK, &got) != FR_OK
+             || got == 0u) {
+            io->ok = false;
+            return false;
+         }
+         io->used = got;
+         io->at = 0u;
+      }
+      size_t k = io->used - io->at;
+      if (k > n)
+         k = n;
+      if (p != NULL) {
+         memcpy(p, io->buf + io->at, k);
+         p += k;
+      }
+      io->at += k;
+      n -= k;
+   }
+   return true;
+}
+
+static bool snapshot_get32(snapshot_io_t *io, uint32_t *v)
+{
+   uint8_t b[4];
+
+   if (!snapshot_get(io, b, sizeof b))
+      return false;
+   *v = get_le32(b);
+   return true;
+}
+
+/* ---- the core section ---------------------------------------------------- */
+
+/* The fx registers, and the FRED page as the Beeb reads it.  Only the
+   registers that do nothing but echo the Beeb's writes go back: the rest
+   are rebuilt by their emulators from their own state. */
+static size_t snapshot_core_save(uint8_t *buf, size_t size)
+{
+   if (size < 2u * PAGE_SIZE)
+      return 0u;
+   memcpy(buf, fx_register, PAGE_SIZE);
+   for (uint32_t addr = 0; addr < PAGE_SIZE; addr++)
+      buf[PAGE_SIZE + addr] = Pi1MHz_MemoryRead(addr);
+   return 2u * PAGE_SIZE;
+}
+
+static bool snapshot_core_restore(const uint8_t *buf, size_t len)
+{
+   if (len != 2u * PAGE_SIZE)
+      return false;
+   for (unsigned int i = 0; i < PAGE_SIZE; i++)
+      if (i != snap_fx)
+         fx_register[i] = buf[i];
+   Pi1MHz_MemoryRestoreEcho(buf + PAGE_SIZE);
+   return true;
+}
+
+/* ---- resume -------------------------------------------------------------- */
+
+static bool snapshot_block_zero(const uint8_t *p)
+{
+   const uint32_t *w = __builtin_assume_aligned((const void *)p, 4);
+   uint32_t any = 0u;
+
+   for (size_t i = 0; i < SNAPSHOT_BLOCK / 4u; i++)
+      any |= w[i];
+   return any == 0u;
+}
+
+/* Blocks that were zeros when saved.  Paged JIM RAM (jim_pages.h) puts
+   them back to the zero page rather than writing - and so paging in - every
+   one of them. */
+static void snapshot_zero_blocks(uint32_t from, uint32_t to)
+{
+   size_t off = (size_t)from << SNAPSHOT_BLOCK_SHIFT;
+   size_t len = (size_t)(to - from) << SNAPSHOT_BLOCK_SHIFT;
+
+   if (!jim_pages_zero(off, len))
+      memset(Pi1MHz->JIM_ram + off, 0, len);
+}
+
+static bool snapshot_read_blocks(snapshot_io_t *io, uint32_t stored, uint8_t *packed)
+{
+   uint32_t total = ((uint32_t)Pi1MHz->JIM_ram_size << 24) >> SNAPSHOT_BLOCK_SHIFT;
+   uint32_t next = 0u, count = 0u;
+
+   for (;;) {
+      uint32_t block, len;
+
+      if (!snapshot_get32(io, &block))
+         return false;
+      if (block == SNAPSHOT_END)
+         break;
+      if (!snapshot_get32(io, &len) || block < next || block >= total
+          || len == 0u || len > SNAPSHOT_BLOCK)
+         return false;
+
+      // the blocks in between were zeros when it was saved
+      snapshot_zero_blocks(next, block);
+
+      uint8_t *dst = Pi1MHz->JIM_ram + ((size_t)block << SNAPSHOT_BLOCK_SHIFT);
+      if (len == SNAPSHOT_BLOCK) {
+         if (!snapshot_get(io, dst, len))
+            return false;
+      } else if (!snapshot_get(io, packed, len)
+                 || !snapshot_unpack(packed, len, dst, SNAPSHOT_BLOCK)) {
+         return false;
+      }
+      if (!snapshot_get(io, NULL, snapshot_pad(len)))
+         return false;
+      next = block + 1u;
+      count++;
+   }
+
+   uint32_t check;
+   if (!snapshot_get32(io, &check) || check != count || count != stored)
+      return false;
+   io->kick();
+   snapshot_zero_blocks(next, total);
+   snap_resumed_blocks = count;
+   return true;
+}
+
+bool snapshot_resume_jim(void)
+{
+   const char *file = snapshot_file();
+   const char *resume = config_get("snapshot_resume");
+   uint8_t hdr[SNAPSHOT_HEADER];
+   snapshot_io_t io = { .kick = watchdog_boot_kick, .ok = true };
+   uint8_t *packed = NULL;
+   uint32_t start = RPI_GetSystemTime();
+   bool ok = false;
+
+   if ((resume != NULL && !config_get_bool("snapshot_resume")) || Pi1MHz->JIM_ram == NULL)
+      return false;
+   if (f_open(&io.file, file, FA_READ) != FR_OK)
+      return false;
+
+   io.buf = malloc(SNAPSHOT_IO_CHUNK);
+   packed = malloc(SNAPSHOT_BLOCK);
+   if (io.buf == NULL || packed == NULL || !snapshot_get(&io, hdr, sizeof hdr))
+      goto out;
+
+   uint32_t hdr_len = get_le16(hdr + 6);
+   uint32_t state_len = get_le32(hdr + 12);
+   if (memcmp(hdr, SNAPSHOT_MAGIC, 4) != 0 || get_le16(hdr + 4) != SNAPSHOT_VERSION
+       || hdr_len < SNAPSHOT_HEADER || hdr[9] != SNAPSHOT_BLOCK_SHIFT
+       || state_len > SNAPSHOT_STATE_MAX) {
+      LOG_WARN("Snapshot: %s is not a snapshot this firmware can read\r\n", file);
+      goto out;
+   }
+   if (hdr[8] != Pi1MHz->JIM_ram_size) {
+      LOG_WARN("Snapshot: %s is of %u MB of JIM RAM, this Pi has %u MB\r\n", file,
+               16u * hdr[8], 16u * Pi1MHz->JIM_ram_size);
+      goto out;
+   }
+   if (!snapshot_get(&io, NULL, hdr_len - SNAPSHOT_HEADER))
+      goto out;
+
+   snap_stash = malloc(state_len + 1u);
+   if (snap_stash == NULL || !snapshot_get(&io, snap_stash, state_len))
+      goto out;
+   snap_stash_len = state_len;
+
+   LOG_INFO("Snapshot: resuming from %s\r\n", file);
+   ok = snapshot_read_blocks(&io, get_le32(hdr + 16), packed);
+   if (!ok)
+      LOG_WARN("Snapshot: %s is damaged or cut short - starting cold\r\n", file);
+
+out:
+   f_close(&io.file);
+   free(io.buf);
+   free(packed);
+   if (!ok) {
+      free(snap_stash);
+      snap_stash = NULL;
+      snap_stash_len = 0u;
+      return false;
+   }
+   snap_resumed = true;
+   snap_resumed_ms = (RPI_GetSystemTime() - start) / 1000u;
+   LOG_INFO("Snapshot: %lu blocks in %lu ms\r\n", (unsigned long)snap_resumed_blocks,
+            (unsigned long)snap_resumed_ms);
+   return true;
+}
+
+static void snapshot_restore_state(const uint8_t *p, size_t len)
+{
+   size_t at = 0u;
+
+   while (len - at >= 8u) {
+      uint32_t tag = get_le32(p + at);
+      uint32_t n = get_le32(p + at + 4u);
+      const snapshot_section_t *s = NULL;
+
+      at += 8u;
+      if (n > len - at)
+         break;
+      for (unsigned int i = 0; i < NUM_SECTIONS; i++)
+         if (snapshot_sections[i].tag == tag)
+            s = &snapshot_sections[i];
+      if (s != NULL && s->restore(p + at, n)) {
+         snap_restored++;
+      } else {
+         LOG_WARN("Snapshot: %s state not restored\r\n", (s != NULL) ? s->name : "unknown");
+         snap_skipped++;
+      }
+      if (n + snapshot_pad(n) >= len - at)
+         break;
+      at += n + snapshot_pad(n);
+   }
+}
+
+/* ---- save ---------------------------------------------------------------- */
+
+/* The sections, laid out as they go in the file; the length in bytes. */
+static size_t snapshot_build_state(uint8_t *buf)
+{
+   size_t at = 0u;
+
+   for (unsigned int i = 0; i < NUM_SECTIONS; i++) {
+      size_t n = snapshot_sections[i].save(buf + at + 8u, SNAPSHOT_STATE_MAX - at - 8u);
+      if (n == 0u)
+         continue;
+      put_le32(buf + at, snapshot_sections[i].tag);
+      put_le32(buf + at + 4u, (uint32_t)n);
+      at += 8u + n;
+      while ((at & 3u) != 0u)
+         buf[at++] = 0u;
+      if (SNAPSHOT_STATE_MAX - at < 8u + 4u)
+         break;
+   }
+   return at;
+}
+
+static uint32_t snapshot_write_blocks(snapshot_io_t *io, bool pack, uint8_t *packed)
+{
+   uint32_t total = ((uint32_t)Pi1MHz->JIM_ram_size << 24) >> SNAPSHOT_BLOCK_SHIFT;
+   uint32_t count = 0u;
+   static const uint8_t zero[3];
+
+   for (uint32_t block = 0u; block < total && io->ok; block++) {
+      const uint8_t *src = Pi1MHz->JIM_ram + ((size_t)block << SNAPSHOT_BLOCK_SHIFT);
+      size_t len = 0u;
+
+      // a page never written is zeros without looking (jim_pages.h)
+      if (!jim_pages_backed((size_t)block << SNAPSHOT_BLOCK_SHIFT) || snapshot_block_zero(src))
+         continue;
+      if (pack)
+         len = snapshot_pack(src, SNAPSHOT_BLOCK, packed, SNAPSHOT_BLOCK - 1u);
+      snapshot_put32(io, block);
+      if (len == 0u) {
+         snapshot_put32(io, SNAPSHOT_BLOCK);
+         snapshot_put(io, src, SNAPSHOT_BLOCK);
+      } else {
+         snapshot_put32(io, (uint32_t)len);
+         snapshot_put(io, packed, len);
+         snapshot_put(io, zero, snapshot_pad(len));
+      }
+      count++;
+   }
+   snapshot_put32(io, SNAPSHOT_END);
+   snapshot_put32(io, count);
+   return count;
+}
+
+bool snapshot_save(void)
+{
+   const char *file = snapshot_file();
+   const char *prop = config_get("snapshot_compress");
+   bool pack = (prop == NULL) || config_get_bool("snapshot_compress");
+   char tmp[128];
+   uint8_t hdr[SNAPSHOT_HEADER];
+   snapshot_io_t io = { .kick = watchdog_kick, .ok = true };
+   uint8_t *state = NULL, *packed = NULL;
+   uint32_t start = RPI_GetSystemTime();
+   uint32_t blocks = 0u;
+   size_t state_len = 0u;
+
+   snap_saved = true;
+   snap_save_ok = false;
+   if (Pi1MHz->JIM_ram == NULL || Pi1MHz->JIM_ram_size == 0u
+       || (size_t)snprintf(tmp, sizeof tmp, "%s.tmp", file) >= sizeof tmp)
+      return false;
+   if (jim_tier_holds_data()) {
+      // it would resume empty under a page register that points into it
+      LOG_WARN("Snapshot: not saved - the JIM overflow tier holds data, and is not part of a snapshot\r\n");
+      return false;
+   }
+
+   io.buf = malloc(SNAPSHOT_IO_CHUNK);
+   state = malloc(SNAPSHOT_STATE_MAX);
+   packed = malloc(SNAPSHOT_BLOCK);
+   if (io.buf == NULL || state == NULL || packed == NULL) {
+      LOG_WARN("Snapshot: no memory to save\r\n");
+      goto out;
+   }
+   if (f_open(&io.file, tmp, FA_CREATE_ALWAYS | FA_WRITE) != FR_OK) {
+      LOG_WARN("Snapshot: cannot create %s\r\n", tmp);
+      goto out;
+   }
+
+   // what the VPU has been storing for a streamed register is in the RAM,
+   // and JIM_Init.bin all of it, not just what has arrived (jim_init.h)
+   vpu_stream_release();
+   jim_init_finish();
+
+   state_len = snapshot_build_state(state);
+   memset(hdr, 0, sizeof hdr);
+   snapshot_put(&io, hdr, sizeof hdr);          // filled in at the end
+   snapshot_put(&io, state, state_len);
+   blocks = snapshot_write_blocks(&io, pack, packed);
+   snapshot_flush(&io);
+
+   memcpy(hdr, SNAPSHOT_MAGIC, 4);
+   put_le16(hdr + 4, SNAPSHOT_VERSION);
+   put_le16(hdr + 6, SNAPSHOT_HEADER);
+   hdr[8] = Pi1MHz->JIM_ram_size;
+   hdr[9] = SNAPSHOT_BLOCK_SHIFT;
+   hdr[10] = pack ? SNAPSHOT_FLAG_PACKED : 0u;
+   put_le32(hdr + 12, (uint32_t)state_len);
+   put_le32(hdr + 16, blocks);
+   snap_save_bytes = (uint32_t)f_size(&io.file);
+   if (io.ok && f_lseek(&io.file, 0u) == FR_OK)
+      snapshot_put(&io, hdr, sizeof hdr);
+   else
+      io.ok = false;
+   snapshot_flush(&io);
+   if (f_close(&io.file) != FR_OK)
+      io.ok = false;
+
+   if (!io.ok) {
+      LOG_WARN("Snapshot: writing %s failed\r\n", tmp);
+      (void)f_unlink(tmp);
+      goto out;
+   }
+   (void)f_unlink(file);
+   if (f_rename(tmp, file) != FR_OK) {
+      LOG_WARN("Snapshot: cannot rename %s to %s\r\n", tmp, file);
+      goto out;
+   }
+   snap_save_ok = true;
+
+out:
+   free(io.buf);
+   free(state);
+   free(packed);
+   snap_save_blocks = blocks;
+   snap_save_ms = (RPI_GetSystemTime() - start) / 1000u;
+   if (snap_save_ok)
+      LOG_INFO("Snapshot: saved %lu blocks, %lu bytes, to %s in %lu ms\r\n",
+               (unsigned long)blocks, (unsigned long)snap_save_bytes, file,
+               (unsigned long)snap_save_ms);
+   return snap_save_ok;
+}
+
+bool snapshot_discard(void)
+{
+   FRESULT r = f_unlink(snapshot_file());
+   return r == FR_OK || r == FR_NO_FILE;
+}
+
+void snapshot_request(uint8_t op)
+{
+   snap_request = op;
+}
+
+/* ---- status -------------------------------------------------------------- */
+
+void snapshot_status_text(char *buf, size_t size)
+{
+   size_t n = 0u;
+   #define APPEND(...) do { if (n < size) \
+      n += (size_t)snprintf(buf + n, size - n, __VA_ARGS__); } while (0)
+
+   if (size == 0u)
+      return;
+   buf[0] = '\0';
+   APPEND("file         %s  (fx slot %u: *FX147,202,%u : *FX147,203,1 saves)\n",
+          snapshot_file(), (unsigned int)snap_fx, (unsigned int)snap_fx);
+   if (snap_resumed)
+      APPEND("this boot    resumed: %lu blocks in %lu ms, %u sections restored, %u skipped\n",
+             (unsigned long)snap_resumed_blocks, (unsigned long)snap_resumed_ms,
+             snap_restored, snap_skipped);
+   else
+      APPEND("this boot    started cold\n");
+   if (!snap_saved)
+      APPEND("last save    none since boot\n");
+   else if (snap_save_ok)
+      APPEND("last save    %lu blocks of %u, %lu bytes, %lu ms\n",
+             (unsigned long)snap_save_blocks,
+             (unsigned int)(((uint32_t)Pi1MHz->JIM_ram_size << 24) >> SNAPSHOT_BLOCK_SHIFT),
+             (unsigned long)snap_save_bytes, (unsigned long)snap_save_ms);
+   else
+      APPEND("last save    FAILED\n");
+   #undef APPEND
+}
+
+/* ---- emulator-table entry ------------------------------------------------ */
+
+static void snapshot_poll(void)
+{
+   uint8_t op = snap_request;
+
+   if (op != 0u)
+      snap_request = 0u;
+   else
+      op = fx_register[snap_fx];
+
+   switch (op) {
+   case 0u:
+   case SNAPSHOT_FX_FAILED:
+      return;
+   case SNAPSHOT_FX_SAVE:
+      fx_register[snap_fx] = snapshot_save() ? 0u : SNAPSHOT_FX_FAILED;
+      break;
+   case SNAPSHOT_FX_DISCARD:
+      fx_register[snap_fx] = snapshot_discard() ? 0u : SNAPSHOT_FX_FAILED;
+      break;
+   default:
+      fx_register[snap_fx] = SNAPSHOT_FX_FAILED;
+      break;
+   }
+}
+
+// cppcheck-suppress unusedFunction
+void snapshot_init(uint8_t instance, uint8_t address)
+{
+   (void)address;
+   snap_fx = instance;
+   fx_register[snap_fx] = 0u;
+
+   if (snap_stash != NULL) {
+      snapshot_restore_state(snap_stash, snap_stash_len);
+      free(snap_stash);
+      snap_stash = NULL;
+      snap_stash_len = 0u;
+   }
+   Pi1MHz_Register_Poll_Sched(snapshot_poll, POLL_BACKGROUND, SNAPSHOT_CHECK_US, 0u);
+}
@@ -0,0 +1,90 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Emulator state snapshot, and resuming from it at power-on.
+ *
+ * A snapshot is one file on the SD card (snapshot_file, default
+ * /Pi1MHz/snapshot.bin) holding JIM RAM - and with it the Music 5000/3000
+ * wave RAM at JIM &3000/&5000 and the services disc buffer - plus the state
+ * the emulators keep outside it: the fx registers, the FRED registers that
+ * only echo what the Beeb wrote, the RAM emulator's page and byte pointers,
+ * the teletext adapter's latch and row store, the BeebSID chip and the SCSI
+ * LUN directories.  At power-on it replaces JIM_Init.bin: the RAM comes
+ * back as it was saved and the rest is put back once every emulator has
+ * initialised.  The JIM overflow tier above JIM RAM (jim_tier.h) is not
+ * saved: a save is refused once the Beeb has written to it.
+ *
+ * The file is little-endian:
+ *
+ *    header   32 bytes  "P1SN", u16 version (1), u16 header size (32),
+ *                       u8 JIM size (16 MB units), u8 block shift (12),
+ *                       u8 flags (bit 0: blocks may be packed), u8 0,
+ *                       u32 state bytes, u32 blocks stored, u32 0 x 3
+ *    state              sections: u32 tag, u32 length, the bytes, padded
+ *                       to 4.  A section is its owner's business; the
+ *                       owner checks the length it is handed back.
+ *    blocks             u32 block number, u32 stored length, the bytes,
+ *                       padded to 4.  Ascending; a block that is not there
+ *                       was all zeros.  A stored length of SNAPSHOT_BLOCK is
+ *                       the block as it is, anything shorter is PackBits.
+ *    end      8 bytes   u32 0xFFFFFFFF, u32 blocks stored again
+ *
+ * Most of a large JIM RAM is zeros or runs of a fill byte, so a snapshot is
+ * a fraction of the size of the RAM - and of a JIM_Init.bin covering the
+ * same data - and is quicker to read back.  Sections are the structures
+ * the firmware keeps in memory, so one written by another build may have
+ * sections that no longer fit; those are skipped and keep their
+ * initialised state.  JIM RAM always comes back. */
+
+#define SNAPSHOT_MAGIC       "P1SN"
+#define SNAPSHOT_VERSION     1u
+#define SNAPSHOT_HEADER      32u
+#define SNAPSHOT_BLOCK_SHIFT 12u
+#define SNAPSHOT_BLOCK       (1u << SNAPSHOT_BLOCK_SHIFT)
+#define SNAPSHOT_END         0xFFFFFFFFu
+#define SNAPSHOT_FLAG_PACKED 0x01u
+
+#define SNAPSHOT_TAG(a, b, c, d) \
+   ((uint32_t)(a) | ((uint32_t)(b) << 8) | ((uint32_t)(c) << 16) | ((uint32_t)(d) << 24))
+
+/* fx register values (*FX147,202,<slot> : *FX147,203,<value>).  The
+   register reads back 0 once the request is done, or SNAPSHOT_FX_FAILED. */
+#define SNAPSHOT_FX_SAVE     1u
+#define SNAPSHOT_FX_DISCARD  2u
+#define SNAPSHOT_FX_FAILED   0xFFu
+
+/* From rampage_emulator_init(), the first time only: load JIM RAM from the
+   snapshot and keep the rest for snapshot_init().  False if there is no
+   snapshot, snapshot_resume=0, or it does not fit this Pi's JIM RAM - the
+   caller then loads JIM_Init.bin as before. */
+bool snapshot_resume_jim(void);
+
+/* Write a snapshot now.  Blocks the poll loop while it does - seconds for
+   hundreds of megabytes - so it is only done when asked for. */
+bool snapshot_save(void);
+
+/* Delete the snapshot, so the next power-on starts from JIM_Init.bin. */
+bool snapshot_discard(void);
+
+/* Ask the poll loop to save or discard (SNAPSHOT_FX_*), for callers that
+   must not block - the web server. */
+void snapshot_request(uint8_t op);
+
+/* Plain-text status: the file, the last save, whether this boot resumed. */
+void snapshot_status_text(char *buf, size_t size);
+
+/* Emulator-table entry: puts the saved state back after a resume, and
+   watches its fx register for SNAPSHOT_FX_* requests. */
+void snapshot_init(uint8_t instance, uint8_t address);
+
+/* PackBits, one block at a time; exposed for host testing.  snapshot_pack
+   returns the packed length, or 0 if it would not fit in room.
+   snapshot_unpack is true only if src unpacks to exactly out bytes. */
+size_t snapshot_pack(const uint8_t *src, size_t len, uint8_t *dst, size_t room);
+bool snapshot_unpack(const uint8_t *src, size_t len, uint8_t *dst, size_t out);
+
+#endif
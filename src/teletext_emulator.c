@@ -112,6 +112,7 @@ static uint8_t     ttx_field_parity;
 
 static ttx_chan_t  ttx_chan[TTX_CHANNELS];
 static bool        ttx_configured;
+static bool        ttx_running;          /* the init has run: TTX_ADDR is ours */
 static bool        ttx_debug;
 static bool        ttx_net_waiting_logged;
 
@@ -518,12 +519,58 @@ void teletext_status_text(char *buf, size_t size)
    #undef TTX_APPEND
 }
 
+/* ---- snapshot ------------------------------------------------------------*/
+
+/* What the BBC set up: the control latch, the row/column pointers and the
+   row store.  Status and field phase are not saved - the next field
+   rebuilds them - nor the TCP side, which reconnects by itself. */
+typedef struct {
+   uint8_t control;
+   uint8_t row_ptr;
+   uint8_t col_ptr;
+   uint8_t row[TTX_ROWS][TTX_ROW_STRIDE];
+} ttx_snapshot_t;
+
+size_t teletext_snapshot_save(uint8_t *buf, size_t size)
+{
+   ttx_snapshot_t s;
+
+   if (!ttx_running || size < sizeof s)
+      return 0u;
+   s.control = (uint8_t)(ttx_channel | (ttx_enable ? TTX_CTL_ENABLE : 0u)
+                         | (ttx_ints_enabled ? TTX_CTL_INTEN : 0u));
+   s.row_ptr = ttx_row_ptr;
+   s.col_ptr = ttx_col_ptr;
+   memcpy(s.row, ttx_row, sizeof s.row);
+   memcpy(buf, &s, sizeof s);
+   return sizeof s;
+}
+
+bool teletext_snapshot_restore(const uint8_t *buf, size_t len)
+{
+   ttx_snapshot_t s;
+
+   if (!ttx_running || len != sizeof s)
+      return false;
+   memcpy(&s, buf, sizeof s);
+   ttx_ints_enabled = (s.control & TTX_CTL_INTEN) != 0u;
+   ttx_enable       = (s.control & TTX_CTL_ENABLE) != 0u;
+   ttx_channel      = (uint8_t)(s.control & TTX_CTL_CHAN);
+   ttx_row_ptr      = s.row_ptr;
+   ttx_col_ptr      = (uint8_t)(s.col_ptr & 0x3fu);
+   memcpy(ttx_row, s.row, sizeof ttx_row);
+   ttx_preload_data();
+   ttx_update_irq();
+   return true;
+}
+
 /* ---- init ----------------------------------------------------------------*/
 
 void teletext_emulator_init(uint8_t instance, uint8_t address)
 {
    TTX_ADDR = address;
    IRQ_NUM  = instance;
+   ttx_running = true;
 
    /* adapter register/field state resets on every BREAK; the TCP
     * connections and parsed config persist (re-connecting on each
@@ -17,6 +17,7 @@
 #ifndef TELETEXT_EMULATOR_H
 #define TELETEXT_EMULATOR_H
 
+#include <stdbool.h>
 #include <stdint.h>
 #include <stddef.h>
 
@@ -27,4 +28,8 @@ void teletext_emulator_init(uint8_t instance, uint8_t address);
 /* Plain-text status block for diagnostics (e.g. a web page). */
 void teletext_status_text(char *buf, size_t size);
 
+/* Snapshot section (snapshot.c): the control latch and the row store. */
+size_t teletext_snapshot_save(uint8_t *buf, size_t size);
+bool teletext_snapshot_restore(const uint8_t *buf, size_t len);
+
 #endif
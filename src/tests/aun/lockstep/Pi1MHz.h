@@ -10,6 +10,12 @@ extern Pi1MHz_t *const Pi1MHz;
 typedef void (*func_ptr)(void);
 void Pi1MHz_MemoryWrite(uint32_t addr, uint8_t data);
 void Pi1MHz_Register_Poll(func_ptr f);
+/* the harness drives the poll itself, so events and periods are moot */
+#define POLL_NORMAL 1u
+#define POLL_EVENT_AUN (1u << 2)
+#define Pi1MHz_Register_Poll_Event(f, prio, period, ev) Pi1MHz_Register_Poll(f)
+#define Pi1MHz_Poll_Wake(ev) ((void)(ev))
+#define Pi1MHz_Poll_Wake_FIQ(ev) ((void)(ev))
 #define CLEAR_IRQ 0
 #define ASSERT_IRQ 1
 void Pi1MHz_nIRQ_ASSERT(uint8_t src);
@@ -0,0 +1,600 @@
+/* Bus-replay benchmark for the FIQ callback table.
+ *
+ * Replays a recorded stream of FRED/JIM accesses through
+ * Pi1MHz->callback_table exactly as FIQ.s dispatches it, with the real
+ * ram, harddisc, services, M5000 and teletext emulators registered at
+ * their default addresses, and reports what each callback costs.
+ *
+ * The host is not an ARM1176, so a callback's cost is ESTIMATED:
+ *
+ *    est = host_ns * scale + vpu_stores * VPU_STORE_NS + FIQ_NS
+ *
+ * host_ns     the callback's own run time here, timer overhead removed
+ * scale       host-to-ARM1176 factor (-s); crude, calibrate against a
+ *             hardware measurement before trusting absolute figures
+ * vpu_stores  VPU-window words the callback wrote (MemoryWrite = 1,
+ *             MemoryWrite16 = 1, MemoryWrite32 = 2, MemoryWritePage = 128);
+ *             each is a Strongly-Ordered store, 17 ns measured on hardware
+ *             (the table in Pi1MHz_MemoryWrite)
+ * FIQ_NS      entry/exit: the doorbell ack and VPU-return loads are both
+ *             Strongly-Ordered, ~47 ns each like RPI_GetSystemTime() (-f)
+ *
+ * A callback is flagged when its estimate exceeds the bus budget (-b,
+ * ~500 ns: the half-cycle the VPU leaves before the next access can
+ * start), and separately as an OVERRUN when it exceeds the time to the
+ * next access in the trace - the point at which a real FIQ would still be
+ * running when the next doorbell rings, and a read would be served stale.
+ * Relative figures between builds are the point; a callback that grows
+ * between two runs of the same trace has regressed.
+ *
+ * Trace format, one access per line ('#' starts a comment):
+ *
+ *    <time_ns> <R|W> <FCxx|FDxx> <data|-->
+ *
+ * For a read, data is what the Beeb saw; it is checked against the byte
+ * the Pi would have driven and mismatches are counted ("--" skips it).
+ *
+ * A binary capture from the firmware's bus recorder (bus_trace.h, "P1MT")
+ * is recognised by its magic and replayed as it is; its reads carry no
+ * data worth checking, since the VPU samples the bus before driving it.
+ */
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "Pi1MHz.h"
+#include "ram_emulator.h"
+#include "harddisc_emulator.h"
+#include "M5000_emulator.h"
+#include "services.h"
+#include "teletext_emulator.h"
+#include "vpu_stream.h"
+#include "jim_pages.h"
+#include "jim_disc.h"
+#include "jim_init.h"
+#include "jim_tier.h"
+#include "lwip/tcp.h"
+#include "wifi/wifi_lwip.h"
+#include "BeebSCSI/fatfs/ff.h"
+
+#define VPU_STORE_NS   17.0
+#define FIQ_NS_DEFAULT 100.0
+#define BUDGET_DEFAULT 500.0
+#define SCALE_DEFAULT  6.0
+
+/* ---- the bus side of Pi1MHz.c, instrumented ---- */
+
+static Pi1MHz_t pi;
+Pi1MHz_t * const Pi1MHz = &pi;
+uint8_t fx_register[256];
+uint32_t Pi1MHz_now_us;
+
+static unsigned int vpu_stores;      /* VPU-window words written this call */
+static uint32_t irq_mask;
+static func_ptr polls[16];
+static unsigned int npolls;
+
+void Pi1MHz_MemoryWrite(uint32_t addr, uint8_t data)
+{
+   Pi1MHz->Memory[addr] = data;
+   vpu_stores++;
+}
+
+void Pi1MHz_MemoryWrite16(uint32_t addr, uint32_t data)
+{
+   Pi1MHz->Memory[addr] = (uint8_t)data;
+   Pi1MHz->Memory[addr + 1u] = (uint8_t)(data >> 8);
+   vpu_stores++;
+}
+
+void Pi1MHz_MemoryWrite32(uint32_t addr, uint32_t data)
+{
+   memcpy(&Pi1MHz->Memory[addr], &data, sizeof data);
+   vpu_stores += 2u;
+}
+
+uint8_t Pi1MHz_MemoryRead(uint32_t addr)
+{
+   return Pi1MHz->Memory[addr];
+}
+
+void Pi1MHz_MemoryWritePage(uint32_t addr, const void *data)
+{
+   memcpy(&Pi1MHz->Memory[addr], data, PAGE_SIZE);
+   vpu_stores += PAGE_SIZE / 2u;
+}
+
+void Pi1MHz_EmulatedMemoryByte(unsigned int gpio)
+{
+   Pi1MHz_MemoryWrite(GET_ADDR(gpio), GET_DATA(gpio));
+}
+
+void Pi1MHz_Register_Memory(unsigned int access, unsigned int addr, callback_func_ptr function_ptr)
+{
+   Pi1MHz->callback_table[access + addr] = function_ptr;
+}
+
+/* The replay has no VPU to stream the data registers, so it is always off,
+   as a bus capture leaves it: every byte is the callback it was recorded as. */
+bool vpu_stream_arm(uint8_t port, size_t addr, size_t limit, unsigned int step, int addr_reg)
+{
+   (void)port; (void)addr; (void)limit; (void)step; (void)addr_reg;
+   return false;
+}
+uint32_t vpu_stream_take(uint8_t port) { (void)port; return 0u; }
+void vpu_stream_release(void) { }
+
+void Pi1MHz_Register_Poll(func_ptr function_ptr)
+{
+   for (unsigned int i = 0; i < npolls; i++)
+      if (polls[i] == function_ptr)
+         return;
+   if (npolls < sizeof polls / sizeof polls[0])
+      polls[npolls++] = function_ptr;
+}
+
+/* the bench runs every poller between events; classes do not matter here */
+void Pi1MHz_Register_Poll_Sched(func_ptr function_ptr, uint8_t priority,
+                                uint32_t period_us, uint32_t deadline_us)
+{
+   (void)priority; (void)period_us; (void)deadline_us;
+   Pi1MHz_Register_Poll(function_ptr);
+}
+
+/* nor do events; the FIQ-side wake is an OR into ARM RAM, timed with the
+   callback that does it */
+volatile uint32_t Pi1MHz_poll_events;
+void Pi1MHz_Register_Poll_Event(func_ptr function_ptr, uint8_t priority,
+                                uint32_t period_us, uint32_t events)
+{
+   (void)priority; (void)period_us; (void)events;
+   Pi1MHz_Register_Poll(function_ptr);
+}
+void Pi1MHz_Poll_Wake(uint32_t events) { Pi1MHz_poll_events |= events; }
+
+void Pi1MHz_nIRQ_ASSERT(uint8_t src) { irq_mask |= 1u << src; }
+void Pi1MHz_nIRQ_CLEAR(uint8_t src)  { irq_mask &= ~(1u << src); }
+bool Pi1MHz_is_rst_active(void) { return false; }
+
+/* ---- the rest of the firmware the emulators link against ---- */
+
+/* Sized so rampage_emulator_init() lands on JIM_ram_size = 3: 48 MB covers
+   the services buffer (the top 32 MB) and the M5000 wave RAM. */
+extern char _end;
+char _end;
+uint32_t mem_info(int size)
+{
+   (void)size;
+   return (uint32_t)(uintptr_t)&_end + 4u * 1024u * 1024u + 3u * JIM_RAM_STEP;
+}
+char *get_cmdline_prop(const char *prop) { (void)prop; return NULL; }
+const char *config_get(const char *key) { (void)key; return NULL; }
+bool config_get_bool(const char *key) { (void)key; return false; }
+bool config_beeb_write_protected(void) { return true; }
+uint8_t helpers_get_address(void) { return 0x88; }
+uint32_t filesystemReadFile(const char *f, uint8_t **a, unsigned int m)
+{ (void)f; (void)a; (void)m; return 0; }
+/* no snapshot: the replay starts from JIM_Init.bin, which is not there */
+bool snapshot_resume_jim(void) { return false; }
+/* no MMU to page JIM RAM in with: it is malloc'd */
+bool jim_pages_init(size_t bytes) { (void)bytes; return false; }
+bool jim_pages_active(void) { return false; }
+void jim_pages_stats(jim_pages_stats_t *stats) { memset(stats, 0, sizeof *stats); }
+/* no RAM disc: jim_disc_mark() in the page and byte writes is timed as it
+   runs with none configured, a subtract and a compare */
+size_t jim_disc_base;
+size_t jim_disc_len;
+uint32_t *jim_disc_dirty;
+volatile bool jim_disc_pending;
+void jim_disc_open(void) { }
+size_t jim_disc_init_limit(size_t size) { return size; }
+void jim_disc_start(void) { }
+void jim_service_init(void) { }
+/* nor JIM_Init.bin: jim_init_need() and jim_init_write() are timed as they
+   run once it is all in, a compare */
+size_t jim_init_len;
+uint32_t *jim_init_loaded;
+void jim_init_fault(size_t addr) { (void)addr; }
+void jim_init_keep(size_t addr) { (void)addr; }
+bool jim_init_load(size_t size) { (void)size; return false; }
+/* nor an overflow tier: the page registers pay its one compare */
+size_t jim_tier_base = SIZE_MAX;
+bool *jim_tier_dirty;
+unsigned int jim_tier_init(size_t base, unsigned int max_sets) { (void)base; (void)max_sets; return 0u; }
+void jim_tier_start(void) { }
+uint8_t *jim_tier_page(size_t addr) { (void)addr; return NULL; }
+
+void filesystemInitialise(uint8_t scsijuke, uint8_t vfsjuke) { (void)scsijuke; (void)vfsjuke; }
+void filesystemReset(void) {}
+uint8_t filesystemGetLunDirectory(void) { return 0; }
+uint8_t filesystemGetLunDirectoryVFS(void) { return 0; }
+void filesystemSetLunDirectory(uint8_t scsiHostID, uint8_t lunDirectoryNumber)
+{ (void)scsiHostID; (void)lunDirectoryNumber; }
+bool filesystemReadLunStatus(uint8_t lunNumber) { (void)lunNumber; return false; }
+bool filesystemPrefetchNextLun(void) { return false; }
+void scsiInitialise(void) {}
+void scsiReset(uint8_t scsiid) { (void)scsiid; }
+bool scsiJukebox(uint8_t lun) { (void)lun; return true; }
+void scsiProcessEmulation(void) {}
+bool scsiWaitingForSelection(void) { return true; }
+void writeCacheIdle(uint32_t nowUs) { (void)nowUs; }
+
+void fat_service_init(void) {}
+
+static uint32_t audio_buf[2];
+size_t rpi_audio_buffer_free_space(void) { return 0; }
+uint32_t *rpi_audio_buffer_pointer(void) { return audio_buf; }
+void rpi_audio_samples_written(void) {}
+uint32_t rpi_audio_init(uint32_t samplerate) { (void)samplerate; return 1024; }
+bool rpi_audio_beeb_muted(void) { return false; }
+FRESULT f_open(FIL *fp, const char *path, uint8_t mode) { (void)fp; (void)path; (void)mode; return FR_DISK_ERR; }
+FRESULT f_close(FIL *fp) { (void)fp; return FR_OK; }
+FRESULT f_write(FIL *fp, const void *b, UINT n, UINT *w) { (void)fp; (void)b; *w = n; return FR_OK; }
+
+uint32_t RPI_GetSystemTime(void) { return Pi1MHz_now_us; }
+void wifi_debug_printf(const char *fmt, ...) { (void)fmt; }
+const wifi_lwip_context_t *wifi_lwip_get_context(void) { return NULL; }
+struct tcp_pcb *tcp_new(void) { return NULL; }
+void tcp_arg(struct tcp_pcb *p, void *a) { (void)p; (void)a; }
+void tcp_recv(struct tcp_pcb *p, tcp_recv_fn f) { (void)p; (void)f; }
+void tcp_err(struct tcp_pcb *p, tcp_err_fn f) { (void)p; (void)f; }
+err_t tcp_connect(struct tcp_pcb *p, const ip_addr_t *a, uint16_t port, tcp_connected_fn f)
+{ (void)p; (void)a; (void)port; (void)f; return ERR_OK; }
+void tcp_recved(struct tcp_pcb *p, uint16_t n) { (void)p; (void)n; }
+err_t tcp_close(struct tcp_pcb *p) { (void)p; return ERR_OK; }
+void tcp_abort(struct tcp_pcb *p) { (void)p; }
+uint8_t pbuf_free(struct pbuf *p) { (void)p; return 1; }
+
+/* newlib has it, glibc before 2.38 does not */
+size_t strlcpy(char *dst, const char *src, size_t size)
+{
+   size_t len = strlen(src);
+   if (size != 0u) {
+      size_t n = (len < size) ? len : size - 1u;
+      memcpy(dst, src, n);
+      dst[n] = '\0';
+   }
+   return len;
+}
+
+/* ---- trace ---- */
+
+typedef struct {
+   uint64_t t_ns;
+   uint16_t slot;        /* callback_table index: RnW<<9 | JIM<<8 | addr */
+   int16_t  data;        /* -1: read data not recorded */
+} bus_event_t;
+
+static bus_event_t *events;
+static size_t nevents, events_cap;
+
+static bool add_event(uint64_t t_ns, uint16_t slot, int16_t data)
+{
+   if (nevents == events_cap) {
+      events_cap = events_cap ? events_cap * 2u : 4096u;
+      events = realloc(events, events_cap * sizeof *events);
+      if (events == NULL)
+         return false;
+   }
+   events[nevents].t_ns = t_ns;
+   events[nevents].slot = slot;
+   events[nevents].data = data;
+   nevents++;
+   return true;
+}
+
+/* bus_trace.h format: 16-byte header, then {u32 gpio, u32 stamp} records */
+static bool load_capture(FILE *f, const char *path)
+{
+   uint8_t h[16];
+   uint32_t rec[2], ticks_per_ms, prev = 0;
+   uint64_t t_ns = 0;
+   bool first = true;
+
+   if (fread(h, 1, sizeof h, f) != sizeof h || h[4] != 1u || h[6] != 8u) {
+      fprintf(stderr, "%s: not a version 1 bus capture\n", path);
+      return false;
+   }
+   memcpy(&ticks_per_ms, &h[8], sizeof ticks_per_ms);
+   if (ticks_per_ms == 0u)
+      return false;
+   while (fread(rec, sizeof rec[0], 2, f) == 2) {
+      unsigned int gpio = rec[0];
+      if (rec[0] == 0xFFFFFFFFu) {
+         fprintf(stderr, "%s: %u accesses lost in capture at %.3f ms\n",
+                 path, rec[1], (double)t_ns / 1e6);
+         continue;
+      }
+      /* stamps wrap; only the step from the last one matters */
+      if (!first)
+         t_ns += (uint64_t)(uint32_t)(rec[1] - prev) * 1000000u / ticks_per_ms;
+      prev = rec[1];
+      first = false;
+      uint16_t slot = (uint16_t)(GET_ADDR(gpio)
+                      | (((gpio >> (NPCFC_PIN - DATABUS_SHIFT)) & 1u) << 8)
+                      | (((gpio >> (RNW_PIN - DATABUS_SHIFT)) & 1u) << 9));
+      if (!add_event(t_ns, slot, (slot & Pi1MHz_MEM_RNW) ? -1 : (int16_t)GET_DATA(gpio)))
+         return false;
+   }
+   return true;
+}
+
+static bool load_trace(const char *path)
+{
+   FILE *f = fopen(path, "rb");
+   char line[256];
+   unsigned int lineno = 0;
+
+   if (f == NULL) {
+      perror(path);
+      return false;
+   }
+   if (fread(line, 1, 4, f) == 4 && memcmp(line, "P1MT", 4) == 0) {
+      rewind(f);
+      bool ok = load_capture(f, path);
+      fclose(f);
+      return ok;
+   }
+   rewind(f);
+   while (fgets(line, sizeof line, f) != NULL) {
+      unsigned long long t;
+      char op, data[8];
+      unsigned int addr;
+      char *hash = strchr(line, '#');
+
+      lineno++;
+      if (hash != NULL)
+         *hash = '\0';
+      if (strspn(line, " \t\r\n") == strlen(line))
+         continue;
+      if (sscanf(line, "%llu %c %x %7s", &t, &op, &addr, data) != 4
+          || (op != 'R' && op != 'W') || addr < 0xFC00u || addr > 0xFDFFu) {
+         fprintf(stderr, "%s:%u: bad trace line\n", path, lineno);
+         fclose(f);
+         return false;
+      }
+      if (!add_event(t, (uint16_t)((addr - 0xFC00u) | ((op == 'R') ? Pi1MHz_MEM_RNW : 0)),
+                     (strcmp(data, "--") == 0) ? -1 : (int16_t)(strtoul(data, NULL, 16) & 0xFFu))) {
+         fclose(f);
+         return false;
+      }
+   }
+   fclose(f);
+   return true;
+}
+
+/* The word FIQ.s hands a callback: GPLEV0 as the VPU sampled it, shifted
+   down by DATABUS_SHIFT.  nPCFC is high (inactive) for a JIM access. */
+static unsigned int event_gpio(uint16_t slot, uint8_t data)
+{
+   uint32_t lev = ((uint32_t)data << DATABUS_SHIFT)
+                | ((uint32_t)(slot & 0xFFu) << ADDRBUS_SHIFT);
+   if (slot & Pi1MHz_MEM_RNW)
+      lev |= RNW_MASK;
+   lev |= (slot & Pi1MHz_MEM_PAGE) ? NPCFC_MASK : NPCFD_MASK;
+   return lev >> DATABUS_SHIFT;
+}
+
+/* ---- per-slot accounting ---- */
+
+typedef struct {
+   uint64_t calls;
+   double   est_sum;
+   double   est_max;
+   double   host_max;
+   uint64_t over_budget;
+   uint64_t overruns;
+   uint64_t stores;
+} slot_stats_t;
+
+static slot_stats_t stats[PAGE_SIZE * 2 * 2];
+
+static inline uint64_t now_ns(void)
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+   return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static void __attribute__((noinline)) empty_callback(unsigned int gpio) { (void)gpio; }
+
+/* Cost of the timing itself, so tiny callbacks are not swamped by it. */
+static double timer_overhead_ns(void)
+{
+   uint64_t best = UINT64_MAX;
+   callback_func_ptr volatile fn = empty_callback;
+   for (int i = 0; i < 20000; i++) {
+      uint64_t t0 = now_ns();
+      fn(0);
+      uint64_t dt = now_ns() - t0;
+      if (dt < best)
+         best = dt;
+   }
+   return (double)best;
+}
+
+/* ---- symbol names for the report (optional nm map, -m) ---- */
+
+typedef struct { uintptr_t addr; char name[128]; } sym_t;
+static sym_t *syms;
+static size_t nsyms;
+
+static void load_symbols(const char *path)
+{
+   FILE *f = fopen(path, "r");
+   char line[256];
+   size_t cap = 0;
+   if (f == NULL)
+      return;
+   while (fgets(line, sizeof line, f) != NULL) {
+      unsigned long long a;
+      char type, name[128];
+      if (sscanf(line, "%llx %c %127s", &a, &type, name) != 3 || (type != 't' && type != 'T'))
+         continue;
+      if (nsyms == cap) {
+         cap = cap ? cap * 2u : 1024u;
+         syms = realloc(syms, cap * sizeof *syms);
+         if (syms == NULL)
+            break;
+      }
+      syms[nsyms].addr = (uintptr_t)a;
+      snprintf(syms[nsyms].name, sizeof syms[nsyms].name, "%s", name);
+      nsyms++;
+   }
+   fclose(f);
+}
+
+static const char *callback_name(callback_func_ptr fn)
+{
+   static char buf[24];
+   for (size_t i = 0; i < nsyms; i++)
+      if (syms[i].addr == (uintptr_t)fn)
+         return syms[i].name;
+   snprintf(buf, sizeof buf, "%p", (void *)(uintptr_t)fn);
+   return buf;
+}
+
+/* ---- main ---- */
+
+static void init_emulators(void)
+{
+   /* instance/address pairs as the emulator[] table in Pi1MHz.c assigns
+      them, so nIRQ bits and fx_register slots land where they would */
+   rampage_emulator_init(1, 0xFD);
+   rambyte_emulator_init(2, 0x00);
+   harddisc_emulator_init(3, 0x40);
+   M5000_emulator_init(4, 0x00);
+   services_emulator_init(6, 0xA6);
+   teletext_emulator_init(14, 0x10);
+}
+
+static void usage(const char *argv0)
+{
+   fprintf(stderr,
+           "usage: %s [-s scale] [-b budget_ns] [-f fiq_ns] [-r repeat] [-m nm.txt] [-S] trace...\n"
+           "  -s  host-to-ARM1176 cost factor   (default %.1f)\n"
+           "  -b  per-access bus budget in ns    (default %.0f)\n"
+           "  -f  FIQ entry/exit cost in ns      (default %.0f)\n"
+           "  -r  replay the trace N times       (default 1)\n"
+           "  -m  nm output, to name callbacks\n"
+           "  -S  exit non-zero on any overrun\n",
+           argv0, SCALE_DEFAULT, BUDGET_DEFAULT, FIQ_NS_DEFAULT);
+}
+
+int main(int argc, char **argv)
+{
+   double scale = SCALE_DEFAULT, budget = BUDGET_DEFAULT, fiq_ns = FIQ_NS_DEFAULT;
+   unsigned int repeat = 1;
+   bool strict = false;
+   int opt;
+
+   while ((opt = getopt(argc, argv, "s:b:f:r:m:S")) != -1) {
+      switch (opt) {
+      case 's': scale = atof(optarg); break;
+      case 'b': budget = atof(optarg); break;
+      case 'f': fiq_ns = atof(optarg); break;
+      case 'r': repeat = (unsigned int)atoi(optarg); break;
+      case 'm': load_symbols(optarg); break;
+      case 'S': strict = true; break;
+      default: usage(argv[0]); return 2;
+      }
+   }
+   if (optind >= argc || repeat == 0u) {
+      usage(argv[0]);
+      return 2;
+   }
+   for (int i = optind; i < argc; i++)
+      if (!load_trace(argv[i]))
+         return 2;
+   if (nevents == 0u) {
+      fprintf(stderr, "empty trace\n");
+      return 2;
+   }
+
+   init_emulators();
+   if (pi.JIM_ram == NULL) {
+      fprintf(stderr, "no JIM RAM\n");
+      return 2;
+   }
+
+   const double overhead = timer_overhead_ns();
+   const uint64_t span = events[nevents - 1u].t_ns - events[0].t_ns + 1000u;
+   uint64_t unclaimed = 0, mismatches = 0, total_overruns = 0;
+
+   /* pass 0 is untimed: it faults in the JIM RAM pages and warms the
+      caches, which would otherwise land on the first callback of each */
+   for (unsigned int r = 0; r <= repeat; r++) {
+      for (size_t i = 0; i < nevents; i++) {
+         const bus_event_t *e = &events[i];
+         callback_func_ptr fn = Pi1MHz->callback_table[e->slot];
+         /* the VPU drives the shadow byte on a read; a write carries the
+            Beeb's data */
+         uint8_t data = (e->slot & Pi1MHz_MEM_RNW)
+                        ? Pi1MHz->Memory[e->slot & 0x1FFu] : (uint8_t)e->data;
+
+         Pi1MHz_now_us = (uint32_t)(((uint64_t)r * span + e->t_ns) / 1000u);
+         if (r != 0u && (e->slot & Pi1MHz_MEM_RNW) && e->data >= 0 && e->data != data)
+            mismatches++;
+         if (fn == NULL) {
+            unclaimed += (r != 0u);
+            continue;
+         }
+         if (r == 0u) {
+            fn(event_gpio(e->slot, data));
+            continue;
+         }
+
+         vpu_stores = 0;
+         uint64_t t0 = now_ns();
+         fn(event_gpio(e->slot, data));
+         double host = (double)(now_ns() - t0) - overhead;
+         if (host < 0.0)
+            host = 0.0;
+
+         double est = host * scale + vpu_stores * VPU_STORE_NS + fiq_ns;
+         slot_stats_t *s = &stats[e->slot];
+         s->calls++;
+         s->est_sum += est;
+         s->stores += vpu_stores;
+         if (est > s->est_max)
+            s->est_max = est;
+         if (host > s->host_max)
+            s->host_max = host;
+         if (est > budget)
+            s->over_budget++;
+         if (i + 1u < nevents && est > (double)(events[i + 1u].t_ns - e->t_ns)) {
+            s->overruns++;
+            total_overruns++;
+         }
+      }
+   }
+
+   printf("bus replay: %zu accesses x %u, scale %.1f, budget %.0f ns, FIQ %.0f ns, timer %.0f ns\n",
+          nevents, repeat, scale, budget, fiq_ns, overhead);
+   printf("%-7s %-34s %9s %8s %8s %8s %6s %8s %8s\n",
+          "access", "callback", "calls", "est avg", "est max", "host max",
+          "stores", ">budget", "overrun");
+   for (unsigned int slot = 0; slot < PAGE_SIZE * 2 * 2; slot++) {
+      const slot_stats_t *s = &stats[slot];
+      if (s->calls == 0u)
+         continue;
+      printf("%c %04X  %-34s %9llu %8.0f %8.0f %8.0f %6.1f %8llu %8llu%s\n",
+             (slot & Pi1MHz_MEM_RNW) ? 'R' : 'W', 0xFC00u + (slot & 0x1FFu),
+             callback_name(Pi1MHz->callback_table[slot]),
+             (unsigned long long)s->calls, s->est_sum / (double)s->calls,
+             s->est_max, s->host_max, (double)s->stores / (double)s->calls,
+             (unsigned long long)s->over_budget, (unsigned long long)s->overruns,
+             (s->overruns != 0u) ? "  OVERRUN" : (s->over_budget != 0u) ? "  SLOW" : "");
+   }
+   printf("unclaimed accesses (doorbell only): %llu\n", (unsigned long long)unclaimed);
+   printf("read data mismatches: %llu\n", (unsigned long long)mismatches);
+   printf("overruns: %llu\n", (unsigned long long)total_overruns);
+
+   free(pi.JIM_ram);
+   return (strict && total_overruns != 0u) ? 1 : 0;
+}
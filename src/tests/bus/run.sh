@@ -0,0 +1,73 @@
+#!/bin/sh -e
+# Host bus-replay benchmark. Builds the real ram, harddisc, services,
+# M5000 and teletext emulators against stub headers whose bus encoding is
+# the firmware's own, then replays recorded FRED/JIM accesses through
+# Pi1MHz->callback_table and reports the estimated ARM cost per callback.
+#
+#   sh run.sh                     replay traces/*.trace
+#   sh run.sh my.trace -s 5.2     replay a capture, with extra bench options
+#   BUS_BENCH_STRICT=1 sh run.sh  fail if any callback overruns its gap
+#
+# See bus_bench.c for the trace format and the cost model.
+HERE=$(cd "$(dirname "$0")" && pwd)
+SRC=${SRC_DIR:-$HERE/../..}
+B=$(mktemp -d)
+trap 'rm -rf "$B"' EXIT
+mkdir -p "$B/BeebSCSI"
+
+cp "$SRC"/ram_emulator.c "$SRC"/ram_emulator.h \
+   "$SRC"/harddisc_emulator.c "$SRC"/harddisc_emulator.h \
+   "$SRC"/services_emulator.c "$SRC"/services.h \
+   "$SRC"/M5000_emulator.c "$SRC"/M5000_emulator.h \
+   "$SRC"/teletext_emulator.c "$SRC"/teletext_emulator.h \
+   "$SRC"/bus_trace.c "$SRC"/bus_trace.h \
+   "$SRC"/vpu_stream.h "$SRC"/snapshot.h "$SRC"/jim_pages.h "$SRC"/jim_disc.h "$SRC"/jim_init.h "$SRC"/jim_tier.h \
+   "$SRC"/config.h "$SRC"/helpers.h "$B/"
+cp "$SRC"/BeebSCSI/debug.h "$SRC"/BeebSCSI/cpuspecific.h "$SRC"/BeebSCSI/filesystem.h \
+   "$SRC"/BeebSCSI/hostadapter.h "$SRC"/BeebSCSI/scsi.h "$SRC"/BeebSCSI/writecache.h "$B/BeebSCSI/"
+cp -r "$HERE"/stubs/. "$B/"
+cp "$HERE"/bus_bench.c "$HERE"/test_bus_trace.c "$B/"
+
+# The emulators are built as the firmware would build them, less the two
+# warnings that only a 64-bit host raises (the &_end arithmetic in
+# rampage_emulator_init, and parameters used only on the ARM side).
+CFLAGS="-std=gnu2x -Wall -Wextra -Wno-unused-parameter -Wno-pointer-to-int-cast -include $B/host_compat.h"
+EMU="$B/ram_emulator.c $B/harddisc_emulator.c $B/services_emulator.c $B/M5000_emulator.c $B/teletext_emulator.c"
+
+if [ $# -gt 0 ] && [ -f "$1" ]; then
+   TRACES=$1
+   shift
+else
+   TRACES="$HERE/traces/*.trace"
+fi
+
+echo "== bus trace recorder =="
+# __ARM_ARCH=7 selects the system-timer stamp, the one that runs on a host.
+gcc -std=gnu2x -Wall -Wextra -Wconversion -g -D__ARM_ARCH=7 \
+    -fsanitize=address,undefined -fno-sanitize-recover=all \
+    -I"$B" -o "$B/trace" "$B/test_bus_trace.c" "$B/bus_trace.c"
+"$B/trace" "$B/capture.bin"
+
+echo "== replay under ASan/UBSan =="
+# shellcheck disable=SC2086
+gcc $CFLAGS -g \
+    -fsanitize=address,undefined -fno-sanitize-recover=all \
+    -I"$B" -o "$B/bus_san" "$B/bus_bench.c" $EMU -lm
+# shellcheck disable=SC2086
+"$B/bus_san" -b 1000000 $TRACES > "$B/san.out"
+# every read the traces record, the byte-RAM auto-increment included, is
+# what the Pi drives
+grep -q "^read data mismatches: 0$" "$B/san.out" || { grep mismatches "$B/san.out"; exit 1; }
+"$B/bus_san" -b 1000000 "$B/capture.bin" | grep -q "^unclaimed accesses (doorbell only): 3000$"
+
+echo "== timing replay =="
+# shellcheck disable=SC2086
+gcc $CFLAGS -O2 -no-pie \
+    -I"$B" -o "$B/bus" "$B/bus_bench.c" $EMU -lm
+nm "$B/bus" > "$B/bus.nm"
+STRICT=
+[ -n "$BUS_BENCH_STRICT" ] && STRICT=-S
+# shellcheck disable=SC2086
+"$B/bus" -r 20 -m "$B/bus.nm" $STRICT "$@" $TRACES
+
+echo "BUS BENCH PASSED"
@@ -0,0 +1,13 @@
+#pragma once
+/* Host stub of FatFs ff.h - just what the M5000 recorder and the bus
+   trace SD sink use. */
+#include <stdint.h>
+typedef unsigned int UINT;
+typedef enum { FR_OK = 0, FR_DISK_ERR, FR_EXIST = 8 } FRESULT;
+#define FA_WRITE         0x02
+#define FA_CREATE_NEW    0x04
+#define FA_CREATE_ALWAYS 0x08
+typedef struct { uint32_t fsize; } FIL;
+FRESULT f_open(FIL *fp, const char *path, uint8_t mode);
+FRESULT f_close(FIL *fp);
+FRESULT f_write(FIL *fp, const void *b, UINT n, UINT *w);
@@ -0,0 +1,101 @@
+#pragma once
+/* Host stub of the firmware Pi1MHz.h for the bus-replay bench.  Unlike the
+   services stub, the gpio encoding is the REAL one - the word the FIQ
+   handler passes to a callback is the VPU's GPLEV0 sample shifted right by
+   DATABUS_SHIFT - so GET_ADDR/GET_DATA and the callback_table index are
+   exactly what the emulators see on hardware. */
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#define LOG_DEBUG(...) ((void)0)
+#define LOG_INFO(...)  ((void)0)
+#define LOG_WARN(...)  ((void)0)
+
+#define NOINIT_SECTION
+
+#define PAGE_SIZE    0x100
+
+#define NPCFD_PIN    (25)
+#define NPCFC_PIN    (24)
+#define A0_PIN       (16)
+#define RNW_PIN      (10)
+#define D0_PIN       (2)
+
+#define NPCFD_MASK   (1u << NPCFD_PIN)
+#define NPCFC_MASK   (1u << NPCFC_PIN)
+#define RNW_MASK     (1u << RNW_PIN)
+#define DATABUS_MASK (0xFFu << D0_PIN)
+#define ADDRBUS_MASK (0xFFu << A0_PIN)
+
+#define DATABUS_SHIFT D0_PIN
+#define ADDRBUS_SHIFT A0_PIN
+
+#define Pi1MHz_MEM_PAGE  (1<<8)
+#define Pi1MHz_MEM_RNW   (1<<9)
+
+#define WRITE_FRED   0
+#define WRITE_JIM                     Pi1MHz_MEM_PAGE
+#define READ_FRED    Pi1MHz_MEM_RNW
+#define READ_JIM    (Pi1MHz_MEM_RNW | Pi1MHz_MEM_PAGE)
+
+#define GET_DATA(gpio) ((gpio) & (DATABUS_MASK>>DATABUS_SHIFT))
+#define GET_ADDR(gpio) (((gpio) & (ADDRBUS_MASK>>DATABUS_SHIFT)) >> (ADDRBUS_SHIFT-DATABUS_SHIFT))
+
+extern uint8_t fx_register[256];
+
+typedef void (*func_ptr)(void);
+typedef void (*callback_func_ptr)( unsigned int);
+typedef void (*func_ptr_parameter)( uint8_t instance, uint8_t address);
+
+typedef struct
+{
+   uint8_t Memory[PAGE_SIZE*2];
+   uint8_t * JIM_ram;
+   size_t page_ram_addr;
+   size_t byte_ram_addr;
+   uint8_t JIM_ram_size;
+
+   _Alignas(PAGE_SIZE)callback_func_ptr callback_table[PAGE_SIZE*2*2];
+} Pi1MHz_t;
+
+extern Pi1MHz_t * const Pi1MHz;
+
+#define JIM_RAM_STEP ( 16u * 1024u * 1024u)
+#define DISC_RAM_SIZE (2u * JIM_RAM_STEP)
+#define DISC_RAM_BASE ((uint32_t)( ((size_t)Pi1MHz->JIM_ram_size) * JIM_RAM_STEP )- DISC_RAM_SIZE)
+
+void Pi1MHz_Register_Memory(unsigned int access, unsigned int addr, callback_func_ptr function_ptr );
+void Pi1MHz_Register_Poll( func_ptr function_ptr );
+
+#define POLL_URGENT      0u
+#define POLL_NORMAL      1u
+#define POLL_BACKGROUND  2u
+void Pi1MHz_Register_Poll_Sched( func_ptr function_ptr, uint8_t priority,
+                                 uint32_t period_us, uint32_t deadline_us );
+
+#define POLL_EVENT_SCSI  (1u << 0)
+#define POLL_EVENT_NET   (1u << 1)
+#define POLL_EVENT_AUN   (1u << 2)
+extern volatile uint32_t Pi1MHz_poll_events;
+void Pi1MHz_Register_Poll_Event( func_ptr function_ptr, uint8_t priority,
+                                 uint32_t period_us, uint32_t events );
+static inline void Pi1MHz_Poll_Wake_FIQ(uint32_t events) { Pi1MHz_poll_events |= events; }
+void Pi1MHz_Poll_Wake(uint32_t events);
+
+void Pi1MHz_nIRQ_ASSERT(uint8_t src);
+void Pi1MHz_nIRQ_CLEAR(uint8_t src);
+
+void Pi1MHz_MemoryWrite(uint32_t addr, uint8_t data);
+void Pi1MHz_MemoryWrite16(uint32_t addr, uint32_t data);
+void Pi1MHz_MemoryWrite32(uint32_t addr, uint32_t data);
+uint8_t Pi1MHz_MemoryRead(uint32_t addr);
+void Pi1MHz_MemoryWritePage(uint32_t addr, const void * data);
+void Pi1MHz_EmulatedMemoryByte(unsigned int gpio);
+bool Pi1MHz_MemorySync(uint32_t addr);
+void Pi1MHz_MemoryLocal(bool enable);
+
+bool Pi1MHz_is_rst_active(void);
+
+extern uint32_t Pi1MHz_now_us;
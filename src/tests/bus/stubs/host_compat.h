@@ -0,0 +1,5 @@
+#pragma once
+/* Forced into every unit (-include): newlib declares strlcpy in
+   <string.h>, glibc before 2.38 does not.  bus_bench.c defines it. */
+#include <stddef.h>
+size_t strlcpy(char *dst, const char *src, size_t size);
@@ -0,0 +1,4 @@
+#pragma once
+#include <stdint.h>
+typedef struct { uint32_t addr; } ip_addr_t;
+#define ip_addr_set_ip4_u32(ipaddr, val) ((ipaddr)->addr = (uint32_t)(val))
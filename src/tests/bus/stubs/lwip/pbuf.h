@@ -0,0 +1,4 @@
+#pragma once
+#include <stdint.h>
+struct pbuf { struct pbuf *next; void *payload; uint16_t len; uint16_t tot_len; };
+uint8_t pbuf_free(struct pbuf *p);
@@ -0,0 +1,18 @@
+#pragma once
+#include <stdint.h>
+#include "lwip/pbuf.h"
+#include "lwip/ip_addr.h"
+typedef int8_t err_t;
+#define ERR_OK 0
+struct tcp_pcb;
+typedef err_t (*tcp_recv_fn)(void*, struct tcp_pcb*, struct pbuf*, err_t);
+typedef err_t (*tcp_connected_fn)(void*, struct tcp_pcb*, err_t);
+typedef void  (*tcp_err_fn)(void*, err_t);
+struct tcp_pcb *tcp_new(void);
+void tcp_arg(struct tcp_pcb*, void*);
+void tcp_recv(struct tcp_pcb*, tcp_recv_fn);
+void tcp_err(struct tcp_pcb*, tcp_err_fn);
+err_t tcp_connect(struct tcp_pcb*, const ip_addr_t*, uint16_t, tcp_connected_fn);
+void tcp_recved(struct tcp_pcb*, uint16_t);
+err_t tcp_close(struct tcp_pcb*);
+void tcp_abort(struct tcp_pcb*);
@@ -0,0 +1,4 @@
+#pragma once
+/* The FIQ mask is a no-op on the host: replay is single threaded. */
+static inline unsigned int _disable_interrupts_cspr(void) { return 0u; }
+static inline void _restore_cpsr(unsigned int cpsr) { (void)cpsr; }
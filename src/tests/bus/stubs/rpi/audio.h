@@ -0,0 +1,9 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+size_t rpi_audio_buffer_free_space(void);
+uint32_t * rpi_audio_buffer_pointer(void);
+void rpi_audio_samples_written(void);
+uint32_t rpi_audio_init(uint32_t samplerate );
+bool rpi_audio_beeb_muted(void);
@@ -0,0 +1,2 @@
+#pragma once
+/* M5000_emulator.c includes this but drives no pins itself. */
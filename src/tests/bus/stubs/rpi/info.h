@@ -0,0 +1,4 @@
+#pragma once
+#include <stdint.h>
+uint32_t mem_info(int size);
+char *get_cmdline_prop(const char *prop);
@@ -0,0 +1,2 @@
+#pragma once
+void wifi_debug_printf(const char *fmt, ...);
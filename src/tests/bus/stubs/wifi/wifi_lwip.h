@@ -0,0 +1,4 @@
+#pragma once
+#include <stdbool.h>
+typedef struct { bool address_ready; } wifi_lwip_context_t;
+const wifi_lwip_context_t *wifi_lwip_get_context(void);
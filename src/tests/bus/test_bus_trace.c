@@ -0,0 +1,293 @@
+/* Host tests for the bus trace recorder (bus_trace.c): the callback-table
+ * swap, forwarding, the ring's drop accounting, the capture format and the
+ * SD sink, and the profiler's per-slot counts.  FIQs are simulated by calling through the live callback table
+ * with the word FIQ.s would pass, so the recorder's index arithmetic is
+ * checked against the same encoding the bench uses.
+ */
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Pi1MHz.h"
+#include "config.h"
+#include "bus_trace.h"
+#include "BeebSCSI/fatfs/ff.h"
+
+/* ---- Pi1MHz stubs ---- */
+static Pi1MHz_t pi;
+Pi1MHz_t *const Pi1MHz = &pi;
+uint32_t Pi1MHz_now_us;
+
+void Pi1MHz_Register_Memory(unsigned int access, unsigned int addr, callback_func_ptr fn)
+{
+   if (bus_trace_register(access + addr, fn))
+      return;
+   pi.callback_table[access + addr] = fn;
+}
+
+/* whether the VPU may keep echo writes to itself */
+static bool mem_local = true;
+void Pi1MHz_MemoryLocal(bool enable) { mem_local = enable; }
+
+static func_ptr polls[4];
+static unsigned int npolls;
+void Pi1MHz_Register_Poll(func_ptr fn) { polls[npolls++] = fn; }
+
+static uint32_t sys_time;
+uint32_t RPI_GetSystemTime(void) { return sys_time++; }
+
+static const char *cfg_file, *cfg_records;
+const char *config_get(const char *key)
+{
+   if (strcmp(key, "bus_trace") == 0) return cfg_file;
+   if (strcmp(key, "bus_trace_records") == 0) return cfg_records;
+   return NULL;
+}
+
+/* FatFs: one file, in memory */
+static uint8_t *sd_data;
+static size_t sd_len;
+static bool sd_open;
+FRESULT f_open(FIL *fp, const char *path, uint8_t mode)
+{
+   (void)fp; (void)path; assert(mode & FA_CREATE_ALWAYS);
+   sd_len = 0u;
+   sd_open = true;
+   return FR_OK;
+}
+FRESULT f_write(FIL *fp, const void *b, UINT n, UINT *w)
+{
+   (void)fp; assert(sd_open);
+   sd_data = realloc(sd_data, sd_len + n);
+   memcpy(sd_data + sd_len, b, n);
+   sd_len += n;
+   *w = n;
+   return FR_OK;
+}
+FRESULT f_close(FIL *fp) { (void)fp; sd_open = false; return FR_OK; }
+
+/* ---- helpers ---- */
+static unsigned int last_gpio[PAGE_SIZE * 2 * 2];
+static unsigned int calls;
+
+static void cb_a(unsigned int gpio) { last_gpio[0] = gpio; calls++; }
+static void cb_b(unsigned int gpio) { last_gpio[1] = gpio; calls++; }
+
+static unsigned int gpio_word(unsigned int slot, uint8_t data)
+{
+   uint32_t lev = ((uint32_t)data << DATABUS_SHIFT) | ((slot & 0xFFu) << ADDRBUS_SHIFT);
+   if (slot & Pi1MHz_MEM_RNW)
+      lev |= RNW_MASK;
+   lev |= (slot & Pi1MHz_MEM_PAGE) ? NPCFC_MASK : NPCFD_MASK;
+   return lev >> DATABUS_SHIFT;
+}
+
+/* what FIQ.s does: index by address/JIM/RnW, call if non-NULL */
+static void fiq(unsigned int slot, uint8_t data)
+{
+   callback_func_ptr fn = pi.callback_table[slot];
+   if (fn != NULL)
+      fn(gpio_word(slot, data));
+}
+
+static uint8_t buf[1u << 20];
+
+static void test_hook_and_forward(void)
+{
+   memset(pi.callback_table, 0, sizeof pi.callback_table);
+   Pi1MHz_Register_Memory(WRITE_FRED, 0x40, cb_a);
+   Pi1MHz_Register_Memory(READ_JIM, 0x12, cb_b);
+
+   assert(bus_trace_start(4));
+   assert(bus_trace_running());
+   assert(!mem_local);                       /* every write must reach the FIQ */
+   for (unsigned int i = 0; i < PAGE_SIZE * 2 * 2; i++)
+      assert(pi.callback_table[i] != NULL);
+
+   calls = 0;
+   fiq(WRITE_FRED + 0x40, 0x5A);
+   fiq(READ_JIM + 0x12, 0x00);
+   fiq(WRITE_JIM + 0x12, 0x33);              /* unclaimed: recorded, not forwarded */
+   assert(calls == 2);
+   assert(last_gpio[0] == gpio_word(WRITE_FRED + 0x40, 0x5A));
+   assert(GET_ADDR(last_gpio[1]) == 0x12);
+
+   /* a registration while hooked lands behind the recorder */
+   Pi1MHz_Register_Memory(WRITE_JIM, 0x12, cb_a);
+   fiq(WRITE_JIM + 0x12, 0x44);
+   assert(calls == 3 && GET_DATA(last_gpio[0]) == 0x44);
+
+   size_t n = bus_trace_read(buf, sizeof buf);
+   assert(n == BUS_TRACE_HEADER + 4u * BUS_TRACE_RECORD);
+   assert(memcmp(buf, BUS_TRACE_MAGIC, 4) == 0 && buf[4] == 1 && buf[6] == 8);
+   uint32_t g;
+   memcpy(&g, buf + BUS_TRACE_HEADER, 4);
+   assert(g == gpio_word(WRITE_FRED + 0x40, 0x5A));
+   memcpy(&g, buf + BUS_TRACE_HEADER + 16u, 4);
+   assert(g == gpio_word(WRITE_JIM + 0x12, 0x33));
+
+   /* the capture stopped itself and put the real table back */
+   assert(!bus_trace_running() && mem_local);
+   assert(pi.callback_table[WRITE_FRED + 0x40] == cb_a);
+   assert(pi.callback_table[WRITE_JIM + 0x12] == cb_a);
+   assert(pi.callback_table[WRITE_FRED + 0x41] == NULL);
+   assert(bus_trace_read(buf, sizeof buf) == 0u);
+   printf("hook/forward/restore ok\n");
+}
+
+static void test_overflow_marker(void)
+{
+   memset(pi.callback_table, 0, sizeof pi.callback_table);
+   assert(bus_trace_start(200000));
+   /* nobody draining: the ring fills, then accesses are dropped */
+   for (unsigned int i = 0; i < 70000u; i++)
+      fiq(WRITE_FRED + (i & 0xFFu), (uint8_t)i);
+
+   size_t n = bus_trace_read(buf, sizeof buf);
+   uint32_t recs = (uint32_t)((n - BUS_TRACE_HEADER) / BUS_TRACE_RECORD);
+   assert(recs == 65535u);                   /* ring size less the gap */
+   for (uint32_t i = 0; i < recs; i++) {
+      uint32_t g;
+      memcpy(&g, buf + BUS_TRACE_HEADER + i * BUS_TRACE_RECORD, 4);
+      assert(g != BUS_TRACE_DROPPED);
+   }
+
+   /* the next access after room appears is preceded by the loss count */
+   fiq(WRITE_FRED + 0x01, 0x99);
+   n = bus_trace_read(buf, sizeof buf);
+   assert(n == 2u * BUS_TRACE_RECORD);
+   uint32_t g, s;
+   memcpy(&g, buf, 4);
+   memcpy(&s, buf + 4, 4);
+   assert(g == BUS_TRACE_DROPPED && s == 70000u - 65535u);
+   memcpy(&g, buf + 8, 4);
+   assert(GET_DATA(g) == 0x99);
+
+   bus_trace_stop();
+   assert(!bus_trace_running());
+   assert(pi.callback_table[0] == NULL);
+   printf("overflow marker ok\n");
+}
+
+static void test_reset_rehook(void)
+{
+   memset(pi.callback_table, 0, sizeof pi.callback_table);
+   assert(bus_trace_start(1000));
+
+   /* init_emulator(): unhook, clear, re-register, then our init re-hooks */
+   bus_trace_unhook();
+   memset(pi.callback_table, 0, sizeof pi.callback_table);
+   Pi1MHz_Register_Memory(WRITE_FRED, 0x40, cb_b);
+   assert(pi.callback_table[WRITE_FRED + 0x40] == cb_b);
+   cfg_file = NULL;
+   mem_local = true;                         /* init_emulator() resets it */
+   bus_trace_init(16, 0);
+   assert(pi.callback_table[WRITE_FRED + 0x40] != cb_b);
+   assert(!mem_local);
+
+   calls = 0;
+   fiq(WRITE_FRED + 0x40, 0x01);
+   assert(calls == 1);
+   bus_trace_stop();
+   assert(pi.callback_table[WRITE_FRED + 0x40] == cb_b);
+   printf("reset re-hook ok\n");
+}
+
+/* The profiler counting through the same hook, with and without a capture. */
+static void test_counts(void)
+{
+   static bus_trace_counts_t counts;
+
+   memset(&counts, 0, sizeof counts);
+   memset(pi.callback_table, 0, sizeof pi.callback_table);
+   Pi1MHz_Register_Memory(WRITE_FRED, 0x40, cb_a);
+
+   bus_trace_count(&counts);
+   assert(!bus_trace_running() && mem_local); /* counts what really reaches the FIQ */
+   assert(pi.callback_table[WRITE_FRED + 0x40] != cb_a);
+   calls = 0;
+   fiq(WRITE_FRED + 0x40, 0x01);
+   fiq(WRITE_FRED + 0x40, 0x02);
+   fiq(READ_JIM + 0x07, 0x00);               /* unclaimed: counted all the same */
+   assert(calls == 2);
+   assert(counts.calls[WRITE_FRED + 0x40] == 2u && counts.calls[READ_JIM + 0x07] == 1u);
+   assert(bus_trace_read(buf, sizeof buf) == 0u);   /* counting records nothing */
+
+   /* a capture on top: ending it leaves the counting hook in place */
+   assert(bus_trace_start(1000));
+   fiq(WRITE_FRED + 0x40, 0x03);
+   assert(counts.calls[WRITE_FRED + 0x40] == 3u);
+   bus_trace_stop();
+   assert(pi.callback_table[WRITE_FRED + 0x40] != cb_a);
+
+   /* a BBC RST re-hooks for the counts alone */
+   bus_trace_unhook();
+   memset(pi.callback_table, 0, sizeof pi.callback_table);
+   Pi1MHz_Register_Memory(WRITE_FRED, 0x40, cb_b);
+   cfg_file = NULL;
+   bus_trace_init(16, 0);
+   fiq(WRITE_FRED + 0x40, 0x04);
+   assert(counts.calls[WRITE_FRED + 0x40] == 4u && calls == 4);
+
+   /* and with neither, the real table goes back */
+   bus_trace_count(NULL);
+   assert(pi.callback_table[WRITE_FRED + 0x40] == cb_b);
+   assert(pi.callback_table[READ_JIM + 0x07] == NULL);
+   printf("profiler counts ok\n");
+}
+
+static void test_sd_sink(const char *keep)
+{
+   memset(pi.callback_table, 0, sizeof pi.callback_table);
+   npolls = 0;
+   cfg_file = "trace.bin";
+   cfg_records = "3000";
+   bus_trace_init(16, 0);
+   assert(bus_trace_running() && npolls == 1 && sd_open);
+
+   /* a second init (BBC RST) must not restart it */
+   bus_trace_init(16, 0);
+   assert(npolls == 2 && polls[1] == polls[0]);
+
+   for (unsigned int i = 0; i < 3000u; i++) {
+      fiq(READ_FRED + 0x03, 0);
+      if ((i % 500u) == 0u)
+         polls[0]();
+   }
+   while (sd_open)
+      polls[0]();
+   assert(!bus_trace_running());
+   assert(sd_len == BUS_TRACE_HEADER + 3000u * BUS_TRACE_RECORD);
+
+   /* stamps are the system timer on this build, one tick per access */
+   uint32_t s0, s1;
+   memcpy(&s0, sd_data + BUS_TRACE_HEADER + 4u, 4);
+   memcpy(&s1, sd_data + BUS_TRACE_HEADER + 12u, 4);
+   assert(s1 - s0 == 1u);
+
+   /* and once per power-on only */
+   npolls = 0;
+   bus_trace_init(16, 0);
+   assert(!bus_trace_running() && npolls == 0);
+
+   /* run.sh replays it through the bench, to check the reader agrees */
+   if (keep != NULL) {
+      FILE *f = fopen(keep, "wb");
+      assert(f != NULL && fwrite(sd_data, 1, sd_len, f) == sd_len);
+      fclose(f);
+   }
+   free(sd_data);
+   printf("SD sink ok\n");
+}
+
+int main(int argc, char **argv)
+{
+   test_hook_and_forward();
+   test_overflow_marker();
+   test_reset_rehook();
+   test_counts();
+   test_sd_sink((argc > 1) ? argv[1] : NULL);
+   printf("BUS TRACE TESTS PASSED\n");
+   return 0;
+}
@@ -0,0 +1,74 @@
+#!/bin/sh -e
+# Host tests of JIM RAM under ASan/UBSan: the page tracking behind demand
+# paging (jim_pages.c) against a C model of the MMU and the heap top, and
+# the RAM disc image (jim_disc.c) and JIM_Init.bin streaming (jim_init.c)
+# over an in-memory FatFs, the two of them together at power-on, and the
+# compressed overflow tier (jim_tier.c) with its LZ4 blocks (lz4_block.c),
+# checked against the lz4 tool if it is installed.
+HERE=$(cd "$(dirname "$0")" && pwd)
+SRC=${SRC_DIR:-$HERE/../..}
+B=$(mktemp -d)
+trap 'rm -rf "$B"' EXIT
+
+mkdir -p "$B/rpi" "$B/BeebSCSI"
+cp "$SRC"/jim_pages.c "$SRC"/jim_pages.h "$SRC"/jim_disc.c "$SRC"/jim_disc.h \
+   "$SRC"/jim_init.c "$SRC"/jim_init.h "$SRC"/jim_tier.c "$SRC"/jim_tier.h \
+   "$SRC"/lz4_block.c "$SRC"/lz4_block.h "$SRC"/ram_emulator.h "$SRC"/config.h "$SRC"/watchdog.h "$SRC"/vpu_stream.h "$B/"
+cp "$SRC"/rpi/cache.h "$SRC"/rpi/armc-cstubs.h "$SRC"/rpi/asm-helpers.h "$B/rpi/"
+cp "$SRC"/BeebSCSI/filesystem.h "$B/BeebSCSI/"
+cp -r "$HERE"/stubs/. "$B/"
+cp "$HERE"/test_jim_pages.c "$HERE"/test_jim_disc.c "$HERE"/test_jim_init.c \
+   "$HERE"/test_jim_power_on.c "$HERE"/test_lz4_block.c "$HERE"/test_jim_tier.c "$B/"
+
+echo "== JIM RAM paging =="
+gcc -std=gnu2x -Wall -Wextra -Wconversion -g \
+    -fsanitize=address,undefined -fno-sanitize-recover=all \
+    -I"$B" -o "$B/t" "$B/test_jim_pages.c" "$B/jim_pages.c"
+"$B/t"
+
+echo "== JIM RAM disc =="
+gcc -std=gnu2x -Wall -Wextra -Wconversion -g \
+    -fsanitize=address,undefined -fno-sanitize-recover=all \
+    -I"$B" -o "$B/d" "$B/test_jim_disc.c" "$B/jim_disc.c"
+for s in new existing ro; do
+   "$B/d" $s
+done
+
+echo "== JIM_Init.bin streaming =="
+gcc -std=gnu2x -Wall -Wextra -Wconversion -g \
+    -fsanitize=address,undefined -fno-sanitize-recover=all \
+    -I"$B" -o "$B/i" "$B/test_jim_init.c" "$B/jim_init.c"
+"$B/i"
+
+echo "== JIM_Init.bin and the RAM disc at power-on =="
+gcc -std=gnu2x -Wall -Wextra -Wconversion -g \
+    -fsanitize=address,undefined -fno-sanitize-recover=all \
+    -I"$B" -o "$B/p" "$B/test_jim_power_on.c" "$B/jim_init.c" "$B/jim_disc.c"
+"$B/p"
+
+echo "== LZ4 blocks =="
+gcc -std=gnu2x -Wall -Wextra -Wconversion -g \
+    -fsanitize=address,undefined -fno-sanitize-recover=all \
+    -I"$B" -o "$B/l" "$B/test_lz4_block.c" "$B/lz4_block.c"
+"$B/l"
+if command -v lz4 >/dev/null 2>&1; then
+   cat "$B"/*.c | head -c 40000 > "$B/sample"
+   "$B/l" pack < "$B/sample" | lz4 -dc > "$B/sample.out"
+   cmp "$B/sample" "$B/sample.out"
+   lz4 -lc -12 < "$B/sample" | "$B/l" unpack 40000 > "$B/sample.out"
+   cmp "$B/sample" "$B/sample.out"
+   echo "lz4 tool agrees"
+fi
+
+echo "== JIM overflow tier =="
+gcc -std=gnu2x -Wall -Wextra -Wconversion -g \
+    -fsanitize=address,undefined -fno-sanitize-recover=all \
+    -I"$B" -o "$B/o" "$B/test_jim_tier.c" "$B/jim_tier.c" "$B/lz4_block.c"
+"$B/o"
+
+echo "== JIM overflow tier benchmark =="
+gcc -std=gnu2x -Wall -Wextra -O2 \
+    -I"$B" -o "$B/ob" "$B/test_jim_tier.c" "$B/jim_tier.c" "$B/lz4_block.c"
+"$B/ob" bench
+
+echo "JIM TESTS PASSED"
@@ -0,0 +1,29 @@
+#pragma once
+/* Host stub of FatFs ff.h - the calls jim_disc.c makes, on one file the
+   test keeps in memory. */
+#include <stdint.h>
+
+typedef unsigned int  UINT;
+typedef uint8_t       BYTE;
+typedef uint32_t      FSIZE_t;
+
+typedef enum {
+   FR_OK = 0, FR_DISK_ERR, FR_INT_ERR, FR_NOT_READY, FR_NO_FILE,
+   FR_NO_PATH, FR_INVALID_NAME, FR_DENIED, FR_EXIST
+} FRESULT;
+
+#define FA_READ          0x01
+#define FA_WRITE         0x02
+#define FA_CREATE_ALWAYS 0x08
+#define FA_OPEN_ALWAYS   0x10
+
+typedef struct { uint32_t pos; FSIZE_t fsize; BYTE mode; } FIL;
+
+FRESULT f_open(FIL *fp, const char *path, BYTE mode);
+FRESULT f_close(FIL *fp);
+FRESULT f_read(FIL *fp, void *buff, UINT btr, UINT *br);
+FRESULT f_write(FIL *fp, const void *buff, UINT btw, UINT *bw);
+FRESULT f_lseek(FIL *fp, FSIZE_t ofs);
+FRESULT f_sync(FIL *fp);
+
+#define f_size(fp) ((fp)->fsize)
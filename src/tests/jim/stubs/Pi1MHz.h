@@ -0,0 +1,46 @@
+#pragma once
+/* Just what jim_disc.c, jim_init.c and jim_tier.c need from the firmware's
+   Pi1MHz.h.
+   JIM RAM is a malloc'd buffer the tests size themselves. */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+void test_log(const char *fmt, ...);
+#define LOG_INFO(...) test_log(__VA_ARGS__)
+#define LOG_WARN(...) test_log(__VA_ARGS__)
+
+typedef struct {
+   uint8_t *JIM_ram;
+   uint8_t JIM_ram_size;
+} Pi1MHz_t;
+extern Pi1MHz_t *const Pi1MHz;
+
+#define PAGE_SIZE     0x100
+#define JIM_RAM_STEP  (16u * 1024u * 1024u)
+#define DISC_RAM_SIZE (2u * JIM_RAM_STEP)
+
+typedef void (*func_ptr)(void);
+
+#define POLL_URGENT      0u
+#define POLL_NORMAL      1u
+#define POLL_BACKGROUND  2u
+
+void Pi1MHz_Register_Poll_Sched( func_ptr function_ptr, uint8_t priority,
+                                 uint32_t period_us, uint32_t deadline_us );
+void Pi1MHz_Unregister_Poll( func_ptr function_ptr );
+
+#define POLL_EVENT_JIM   (1u << 3)
+#define POLL_EVENT_JIMTIER (1u << 5)
+
+extern volatile uint32_t Pi1MHz_poll_events;
+
+void Pi1MHz_Register_Poll_Event( func_ptr function_ptr, uint8_t priority,
+                                 uint32_t period_us, uint32_t events );
+
+static inline void Pi1MHz_Poll_Wake_FIQ(uint32_t events)
+{
+   Pi1MHz_poll_events |= events;
+}
+
+void Pi1MHz_Poll_Wake(uint32_t events);
@@ -0,0 +1,324 @@
+/* Host test of jim_disc.c: the JIM RAM disc image, loaded at power-on and
+   written back region by region by its poller, over a FatFs stub holding
+   one file in memory.  A power-on can only happen once per process, so the
+   scenario is picked on the command line:
+      new        no image yet: created, then written out a burst at a time
+      existing   an image cut short: loaded, and the rest written after it
+      ro         Beeb_write_protect: loaded, never written */
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Pi1MHz.h"
+#include "config.h"
+#include "BeebSCSI/fatfs/ff.h"
+#include "rpi/asm-helpers.h"
+#include "watchdog.h"
+#include "vpu_stream.h"
+#include "jim_pages.h"
+#include "jim_disc.h"
+
+static int failures, checks;
+#define CHECK(c) do { checks++; if (!(c)) { failures++; \
+   printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #c); } } while (0)
+
+#define JIM_BYTES (16u * 1024u * 1024u)
+#define IMG       "/jim.img"
+#define BASE      0x10000u
+#define REGIONS   64u
+#define LEN       (REGIONS * JIM_DISC_REGION)
+
+/* ---- firmware stand-ins -------------------------------------------------- */
+
+static Pi1MHz_t pi;
+Pi1MHz_t *const Pi1MHz = &pi;
+
+static func_ptr poll_fn;
+static unsigned int masked, logs, boot_kicks;
+
+void test_log(const char *fmt, ...) { (void)fmt; logs++; }
+void watchdog_boot_kick(void) { boot_kicks++; }
+void vpu_stream_release(void) { }
+unsigned int _disable_interrupts_cspr(void) { return ++masked; }
+void _restore_cpsr(unsigned int cpsr) { CHECK(cpsr == masked); masked--; }
+bool jim_pages_zero(size_t offset, size_t len) { (void)offset; (void)len; return false; }
+
+void Pi1MHz_Register_Poll_Sched(func_ptr fn, uint8_t priority, uint32_t period_us,
+                                uint32_t deadline_us)
+{
+   CHECK(priority == POLL_BACKGROUND);
+   (void)period_us; (void)deadline_us;
+   poll_fn = fn;
+}
+
+static const char *cfg_disc, *cfg_addr, *cfg_size;
+static bool cfg_protect;
+
+const char *config_get(const char *key)
+{
+   if (strcmp(key, "jim_disc") == 0) return cfg_disc;
+   if (strcmp(key, "jim_disc_addr") == 0) return cfg_addr;
+   if (strcmp(key, "jim_disc_size") == 0) return cfg_size;
+   return NULL;
+}
+bool config_beeb_write_protected(void) { return cfg_protect; }
+
+/* ---- the image ----------------------------------------------------------- */
+
+static uint8_t *img;
+static uint32_t img_size, img_cap;
+static bool img_exists, fail_writes;
+static unsigned int writes, syncs;
+static uint32_t last_write_at, last_write_len;
+
+FRESULT f_open(FIL *fp, const char *path, BYTE mode)
+{
+   if (strcmp(path, IMG) != 0)
+      return FR_NO_FILE;
+   if (!img_exists) {
+      if ((mode & FA_OPEN_ALWAYS) == 0)
+         return FR_NO_FILE;
+      img_exists = true;
+      img_size = 0u;
+   }
+   fp->pos = 0u;
+   fp->fsize = img_size;
+   fp->mode = mode;
+   return FR_OK;
+}
+FRESULT f_close(FIL *fp) { fp->mode = 0; return FR_OK; }
+FRESULT f_read(FIL *fp, void *buff, UINT btr, UINT *br)
+{
+   uint32_t left = img_size - fp->pos;
+   UINT n = (btr < left) ? btr : (UINT)left;
+   memcpy(buff, img + fp->pos, n);
+   fp->pos += n;
+   *br = n;
+   return FR_OK;
+}
+FRESULT f_write(FIL *fp, const void *buff, UINT btw, UINT *bw)
+{
+   CHECK(fp->mode & FA_WRITE);
+   CHECK(fp->pos <= img_size);                  // never a hole
+   if (fail_writes) { *bw = 0u; return FR_DISK_ERR; }
+   if (fp->pos + btw > img_cap) {
+      img_cap = fp->pos + btw;
+      img = realloc(img, img_cap);
+   }
+   memcpy(img + fp->pos, buff, btw);
+   last_write_at = fp->pos;
+   last_write_len = btw;
+   writes++;
+   fp->pos += btw;
+   if (fp->pos > img_size) img_size = fp->pos;
+   fp->fsize = img_size;
+   *bw = btw;
+   return FR_OK;
+}
+FRESULT f_lseek(FIL *fp, FSIZE_t ofs) { fp->pos = ofs; return FR_OK; }
+FRESULT f_sync(FIL *fp) { (void)fp; syncs++; return FR_OK; }
+
+/* ---- helpers ------------------------------------------------------------- */
+
+static void fill_ram(uint8_t seed)
+{
+   for (size_t i = 0; i < JIM_BYTES; i++)
+      pi.JIM_ram[i] = (uint8_t)(i * 7u + seed);
+}
+
+/* The Beeb writes a byte through a register. */
+static void beeb_write(size_t addr, uint8_t v)
+{
+   pi.JIM_ram[addr] = v;
+   jim_disc_mark(addr);
+}
+
+static bool image_matches_ram(void)
+{
+   return img_size == LEN && memcmp(img, pi.JIM_ram + BASE, LEN) == 0;
+}
+
+static unsigned int drain(void)
+{
+   unsigned int polls = 0u;
+
+   while (jim_disc_pending && polls < 1000u) {
+      poll_fn();
+      polls++;
+   }
+   return polls;
+}
+
+/* Bits set and the poller's write-back, once the image is complete. */
+static void test_write_back(void)
+{
+   // one byte: one region
+   writes = 0u;
+   beeb_write(BASE + 5000u, 0x42u);
+   CHECK(jim_disc_pending);
+   poll_fn();
+   CHECK(writes == 1u && last_write_at == 4096u && last_write_len == 4096u);
+   CHECK(img[5000] == 0x42u);
+
+   // neighbours go out together, a run that is not next to them after
+   writes = 0u;
+   beeb_write(BASE + 3u * 4096u, 1u);
+   beeb_write(BASE + 4u * 4096u + 100u, 2u);
+   beeb_write(BASE + 5u * 4096u + 4095u, 3u);
+   beeb_write(BASE + 9u * 4096u, 4u);
+   poll_fn();
+   CHECK(writes == 1u && last_write_at == 3u * 4096u && last_write_len == 3u * 4096u);
+   poll_fn();
+   CHECK(writes == 2u && last_write_at == 9u * 4096u && last_write_len == 4096u);
+   drain();
+   CHECK(writes == 2u);
+   CHECK(image_matches_ram());
+
+   // behind the cursor: found when the search wraps
+   beeb_write(BASE, 9u);
+   drain();
+   CHECK(img[0] == 9u);
+
+   // a long run is split into bursts
+   writes = 0u;
+   for (unsigned int r = 10u; r < 40u; r++)
+      beeb_write(BASE + r * 4096u, (uint8_t)r);
+   poll_fn();
+   CHECK(writes == 1u && last_write_at == 10u * 4096u && last_write_len == 16u * 4096u);
+   drain();
+   CHECK(writes == 2u && last_write_len == 14u * 4096u);
+   CHECK(image_matches_ram());
+
+   // outside the range is not the disc's
+   writes = 0u;
+   beeb_write(BASE - 1u, 1u);
+   beeb_write(BASE + LEN, 1u);
+   drain();
+   CHECK(writes == 0u);
+
+   // a write while its region is going out marks it again
+   beeb_write(BASE + 20u * 4096u, 5u);
+   poll_fn();
+   beeb_write(BASE + 20u * 4096u, 6u);
+   CHECK(jim_disc_pending);
+   drain();
+   CHECK(img[20u * 4096u] == 6u);
+   CHECK(masked == 0u);
+
+   // a failing card stops write-back, and nothing else
+   fail_writes = true;
+   beeb_write(BASE + 30u * 4096u, 7u);
+   poll_fn();
+   fail_writes = false;
+   unsigned int before = logs;
+   writes = 0u;
+   beeb_write(BASE + 31u * 4096u, 8u);
+   poll_fn();
+   poll_fn();
+   CHECK(writes == 0u && logs == before);
+}
+
+static void scenario_new(void)
+{
+   // a range that does not fit is refused, and leaves no disc
+   cfg_disc = IMG;
+   cfg_addr = "0xFFF000";
+   cfg_size = "64K";
+   jim_disc_open();
+   CHECK(jim_disc_len == 0u && !img_exists);
+   CHECK(jim_disc_init_limit(JIM_BYTES) == JIM_BYTES);
+
+   cfg_addr = "64K";
+   cfg_size = "256k";
+   fill_ram(1u);
+   jim_disc_open();
+   CHECK(img_exists && jim_disc_len == LEN && jim_disc_base == BASE);
+   CHECK(jim_disc_init_limit(JIM_BYTES) == BASE);
+   CHECK(jim_disc_init_limit(BASE / 2u) == BASE / 2u);
+   jim_disc_start();
+   CHECK(poll_fn != NULL);
+
+   // the new image is written out from the RAM, a burst at a time
+   CHECK(jim_disc_pending);
+   poll_fn();
+   CHECK(img_size == 16u * 4096u && syncs == 1u);
+   CHECK(drain() == 4u);
+   CHECK(image_matches_ram());
+   CHECK(writes == 4u);
+
+   test_write_back();
+}
+
+static void scenario_existing(void)
+{
+   // an image of 100 KB: 25 regions, the third all zeros
+   img_exists = true;
+   img_size = img_cap = 100u * 1024u;
+   img = malloc(img_cap);
+   for (uint32_t i = 0; i < img_size; i++)
+      img[i] = (uint8_t)(i ^ 0x5Au);
+   memset(img + 2u * 4096u, 0, 4096u);
+
+   cfg_disc = IMG;
+   cfg_addr = "0x10000";
+   cfg_size = "0x40000";
+   fill_ram(2u);
+   jim_disc_open();
+   CHECK(jim_disc_len == LEN);
+   CHECK(memcmp(pi.JIM_ram + BASE, img, 100u * 1024u) == 0);
+   CHECK(pi.JIM_ram[BASE - 1u] == (uint8_t)((BASE - 1u) * 7u + 2u));   // around it untouched
+   CHECK(boot_kicks > 0u);
+
+   // the rest is written after it, from the RAM, with no hole
+   jim_disc_start();
+   poll_fn();
+   CHECK(last_write_at == 100u * 1024u);
+   drain();
+   CHECK(image_matches_ram());
+
+   test_write_back();
+}
+
+static void scenario_ro(void)
+{
+   cfg_disc = IMG;
+   cfg_protect = true;
+   jim_disc_open();                          // nothing to load, none made
+   CHECK(jim_disc_len == 0u && !img_exists);
+
+   img_exists = true;
+   img_size = img_cap = 8192u;
+   img = calloc(1u, img_cap);
+   img[0] = 0x11u;
+   cfg_size = "16K";
+   fill_ram(3u);
+   jim_disc_open();
+   CHECK(jim_disc_len == 16384u && jim_disc_base == 0u);
+   CHECK(pi.JIM_ram[0] == 0x11u && pi.JIM_ram[1] == 0u);
+
+   poll_fn = NULL;
+   jim_disc_start();
+   CHECK(poll_fn == NULL);                   // nothing to write back
+   CHECK(img_size == 8192u);
+}
+
+int main(int argc, char **argv)
+{
+   pi.JIM_ram_size = 1u;
+   pi.JIM_ram = malloc(JIM_BYTES);
+
+   if (argc > 1 && strcmp(argv[1], "new") == 0)
+      scenario_new();
+   else if (argc > 1 && strcmp(argv[1], "existing") == 0)
+      scenario_existing();
+   else if (argc > 1 && strcmp(argv[1], "ro") == 0)
+      scenario_ro();
+   else
+      CHECK(!"scenario: new, existing or ro");
+
+   free(img);
+   free(pi.JIM_ram);
+   printf("%s: %d checks, %d failures\n", argc > 1 ? argv[1] : "?", checks, failures);
+   return failures != 0;
+}
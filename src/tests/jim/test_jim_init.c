@@ -0,0 +1,380 @@
+/* Host test of jim_init.c: JIM_Init.bin read in behind the Beeb - the head
+   at once, regions on demand and in the background, the Beeb's early
+   writes kept - over an in-memory FatFs holding the one file. */
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Pi1MHz.h"
+#include "config.h"
+#include "BeebSCSI/filesystem.h"
+#include "BeebSCSI/fatfs/ff.h"
+#include "rpi/asm-helpers.h"
+#include "rpi/systimer.h"
+#include "watchdog.h"
+#include "jim_pages.h"
+#include "ram_emulator.h"
+#include "jim_init.h"
+
+static int failures, checks;
+#define CHECK(c) do { checks++; if (!(c)) { failures++; \
+   printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #c); } } while (0)
+
+#define RAM_SETS  3u                            // 48 MB: the top 32 MB is shared
+#define RAM_BYTES (RAM_SETS * JIM_RAM_STEP)
+#define SHARED    (RAM_BYTES - DISC_RAM_SIZE)
+#define R(n)      ((size_t)(n) << JIM_INIT_REGION_SHIFT)
+#define OLD       0xEEu                         // what the RAM held before
+
+/* ---- firmware stand-ins -------------------------------------------------- */
+
+static Pi1MHz_t pi;
+Pi1MHz_t *const Pi1MHz = &pi;
+volatile uint32_t Pi1MHz_poll_events;
+
+static func_ptr urgent_fn, background_fn;
+static unsigned int masked, kicks, zeroed, refreshed, logs;
+static size_t last_refresh;
+static bool pages_on;
+
+void test_log(const char *fmt, ...) { (void)fmt; logs++; }
+void watchdog_kick(void) { kicks++; }
+uint32_t RPI_GetSystemTime(void) { return 0u; }
+unsigned int _disable_interrupts_cspr(void) { return ++masked; }
+void _restore_cpsr(unsigned int cpsr) { CHECK(cpsr == masked); masked--; }
+
+bool jim_pages_zero(size_t offset, size_t len)
+{
+   CHECK(masked != 0u);
+   if (!pages_on)
+      return false;
+   zeroed++;
+   memset(pi.JIM_ram + offset, 0, len);
+   return true;
+}
+
+void ram_emulator_refresh(size_t addr, size_t len)
+{
+   CHECK(masked != 0u);                          // with the region's bit
+   CHECK(len == JIM_INIT_REGION && jim_init_ready(addr));
+   refreshed++;
+   last_refresh = addr;
+}
+
+void Pi1MHz_Register_Poll_Sched(func_ptr fn, uint8_t priority, uint32_t period_us,
+                                uint32_t deadline_us)
+{
+   CHECK(priority == POLL_BACKGROUND);
+   (void)period_us; (void)deadline_us;
+   background_fn = fn;
+}
+void Pi1MHz_Register_Poll_Event(func_ptr fn, uint8_t priority, uint32_t period_us,
+                                uint32_t events)
+{
+   CHECK(priority == POLL_URGENT && events == POLL_EVENT_JIM);
+   (void)period_us;
+   urgent_fn = fn;
+}
+void Pi1MHz_Unregister_Poll(func_ptr fn)
+{
+   if (fn == urgent_fn) urgent_fn = NULL;
+   if (fn == background_fn) background_fn = NULL;
+}
+
+static const char *cfg_stream;
+const char *config_get(const char *key)
+{
+   return strcmp(key, "jim_init_stream") == 0 ? cfg_stream : NULL;
+}
+bool config_get_bool(const char *key)
+{
+   const char *v = config_get(key);
+   return v != NULL && v[0] == '1';
+}
+
+/* ---- the file ------------------------------------------------------------ */
+
+static uint8_t *img;
+static uint32_t img_size;
+static bool fail_reads;
+static unsigned int reads;
+static uint32_t last_read_at, last_read_len;
+
+uint32_t filesystemReadFile(const char *filename, uint8_t **address, unsigned int max_size)
+{
+   uint32_t n = (max_size < img_size) ? max_size : img_size;
+
+   if (img == NULL || strcmp(filename, "JIM_Init.bin") != 0)
+      return 0u;
+   memcpy(*address, img, n);
+   return n;
+}
+
+FRESULT f_open(FIL *fp, const char *path, BYTE mode)
+{
+   if (img == NULL || strcmp(path, "JIM_Init.bin") != 0)
+      return FR_NO_FILE;
+   CHECK(mode == FA_READ);
+   fp->pos = 0u;
+   fp->fsize = img_size;
+   fp->mode = mode;
+   return FR_OK;
+}
+FRESULT f_close(FIL *fp) { CHECK(fp->mode != 0u); fp->mode = 0; return FR_OK; }
+FRESULT f_read(FIL *fp, void *buff, UINT btr, UINT *br)
+{
+   uint32_t left = img_size - fp->pos;
+   UINT n = (btr < left) ? btr : (UINT)left;
+
+   CHECK(fp->mode != 0u);
+   if (fail_reads) { *br = 0u; return FR_DISK_ERR; }
+   memcpy(buff, img + fp->pos, n);
+   last_read_at = fp->pos;
+   last_read_len = n;
+   reads++;
+   fp->pos += n;
+   *br = n;
+   return FR_OK;
+}
+FRESULT f_lseek(FIL *fp, FSIZE_t ofs) { fp->pos = ofs; return FR_OK; }
+FRESULT f_write(FIL *fp, const void *buff, UINT btw, UINT *bw)
+{ (void)fp; (void)buff; (void)btw; *bw = 0u; CHECK(!"write"); return FR_DENIED; }
+FRESULT f_sync(FIL *fp) { (void)fp; return FR_OK; }
+
+/* ---- helpers ------------------------------------------------------------- */
+
+static void make_image(uint32_t size)
+{
+   free(img);
+   img_size = size;
+   img = malloc(size);
+   for (uint32_t i = 0; i < size; i++)
+      img[i] = (uint8_t)((i * 13u) ^ (i >> 9));
+   for (uint32_t i = 0; i < size; i++)
+      if (img[i] == OLD)
+         img[i] = 0x11u;                        // so OLD means not loaded
+}
+
+static void reset_ram(void)
+{
+   memset(pi.JIM_ram, OLD, RAM_BYTES);
+}
+
+static bool ram_is(size_t from, size_t to, bool image)
+{
+   for (size_t i = from; i < to; i++)
+      if (pi.JIM_ram[i] != (image ? img[i] : OLD))
+         return false;
+   return true;
+}
+
+/* The Beeb sets an address, then the main loop gets round to its pollers. */
+static void beeb_select(size_t addr)
+{
+   jim_init_need(addr);
+}
+static void beeb_write(size_t addr, uint8_t v)
+{
+   jim_init_write(addr);
+   pi.JIM_ram[addr] = v;
+}
+static void urgent(void)
+{
+   if ((Pi1MHz_poll_events & POLL_EVENT_JIM) != 0u && urgent_fn != NULL) {
+      Pi1MHz_poll_events &= ~POLL_EVENT_JIM;
+      urgent_fn();
+   }
+}
+static unsigned int drain(void)
+{
+   unsigned int polls = 0u;
+
+   while (background_fn != NULL && polls < 100000u) {
+      urgent();
+      background_fn();
+      polls++;
+   }
+   return polls;
+}
+
+/* ---- tests --------------------------------------------------------------- */
+
+static void test_absent(void)
+{
+   free(img);
+   img = NULL;
+   CHECK(!jim_init_load(RAM_BYTES));
+   CHECK(urgent_fn == NULL && background_fn == NULL && jim_init_len == 0u);
+}
+
+static void test_whole(void)
+{
+   cfg_stream = "0";
+   make_image(300000u);
+   reset_ram();
+   CHECK(jim_init_load(RAM_BYTES));
+   CHECK(ram_is(0, img_size, true) && ram_is(img_size, img_size + 4096u, false));
+   CHECK(urgent_fn == NULL && background_fn == NULL && jim_init_len == 0u);
+
+   // and so it is with jim_init_stream not set: streaming is opt-in
+   cfg_stream = NULL;
+   reset_ram();
+   CHECK(jim_init_load(RAM_BYTES));
+   CHECK(ram_is(0, img_size, true) && ram_is(img_size, img_size + 4096u, false));
+   CHECK(urgent_fn == NULL && background_fn == NULL && jim_init_len == 0u);
+   cfg_stream = "1";
+
+   // a file no longer than the head is all read at once
+   make_image(JIM_INIT_HEAD - 5u);
+   reset_ram();
+   CHECK(jim_init_load(RAM_BYTES));
+   CHECK(ram_is(0, img_size, true) && pi.JIM_ram[img_size] == OLD);
+   CHECK(background_fn == NULL && jim_init_len == 0u);
+}
+
+static void test_stream(void)
+{
+   // 1 MB and a bit: 64 regions and a partial one; region 60 all zeros
+   make_image((uint32_t)R(64) + 100u);
+   memset(img + R(60), 0, JIM_INIT_REGION);
+   reset_ram();
+   pages_on = true;
+   reads = 0u;
+
+   CHECK(jim_init_load(RAM_BYTES));
+   CHECK(urgent_fn != NULL && background_fn != NULL);
+   CHECK(jim_init_len == img_size);
+   CHECK(ram_is(0, JIM_INIT_HEAD, true) && ram_is(JIM_INIT_HEAD, img_size, false));
+   CHECK(jim_init_ready(0) && jim_init_ready(JIM_INIT_HEAD - 1u));
+   CHECK(!jim_init_ready(JIM_INIT_HEAD) && !jim_init_ready(img_size - 1u));
+   CHECK(jim_init_ready(img_size) && jim_init_ready(RAM_BYTES - 1u));
+   CHECK(reads == 0u);
+
+   // selecting a page ahead of the load reads its region next, and only it
+   refreshed = 0u;
+   beeb_select(R(40) + 0x1200u);
+   beeb_select(R(40) + 0x1200u);
+   beeb_select(R(40) + 0x1300u);
+   CHECK(Pi1MHz_poll_events & POLL_EVENT_JIM);
+   urgent();
+   CHECK(reads == 1u && last_read_at == R(40) && last_read_len == JIM_INIT_REGION);
+   CHECK(ram_is(R(40), R(41), true) && ram_is(R(39), R(40), false));
+   CHECK(refreshed == 1u && last_refresh == R(40) && jim_init_ready(R(40)));
+
+   // an address already in gets nothing
+   beeb_select(R(40));
+   beeb_select(100u);
+   urgent();
+   CHECK(reads == 1u);
+
+   // more asked for than the ring holds: the latest eight are read
+   reads = 0u;
+   for (unsigned int i = 0; i < 10u; i++)
+      beeb_select(R(20 + i));
+   urgent();
+   CHECK(reads == 8u && !jim_init_ready(R(20)) && !jim_init_ready(R(21)));
+   CHECK(jim_init_ready(R(22)) && jim_init_ready(R(29)));
+
+   // the Beeb's writes ahead of the load are kept, the rest merged round them
+   beeb_write(R(50) + 7u, 0xA5u);
+   beeb_write(R(50) + 300u, 0x5Au);
+   beeb_write(R(51), 1u);
+   beeb_write(R(52), 2u);
+   beeb_write(R(53), 3u);
+   CHECK(!jim_init_ready(R(53)));
+   beeb_write(R(54) + 9u, 4u);                 // no mask left: the Beeb's now
+   CHECK(jim_init_ready(R(54)));
+   beeb_select(R(50));
+   urgent();
+   CHECK(pi.JIM_ram[R(50) + 7u] == 0xA5u && pi.JIM_ram[R(50) + 300u] == 0x5Au);
+   CHECK(ram_is(R(50), R(50) + 7u, true) && ram_is(R(50) + 8u, R(50) + 300u, true));
+   CHECK(ram_is(R(50) + 301u, R(51), true));
+
+   // a mask is free again once its region is in
+   beeb_write(R(55), 5u);
+   CHECK(!jim_init_ready(R(55)));
+
+   // the rest in the background, in bursts, around what is in already
+   unsigned int before = reads;
+   zeroed = 0u;
+   drain();
+   CHECK(urgent_fn == NULL && background_fn == NULL && jim_init_len == 0u);
+   CHECK(last_read_len <= 4u * JIM_INIT_REGION);
+   CHECK(reads - before < 20u);
+   CHECK(zeroed == 1u && ram_is(R(60), R(61), true));
+   CHECK(ram_is(JIM_INIT_HEAD, R(50), true));
+   CHECK(pi.JIM_ram[R(51)] == 1u && ram_is(R(51) + 1u, R(52), true));
+   CHECK(pi.JIM_ram[R(53)] == 3u && ram_is(R(53) + 1u, R(54), true));
+   CHECK(pi.JIM_ram[R(54) + 9u] == 4u && ram_is(R(54), R(54) + 9u, false));
+   CHECK(ram_is(R(54) + 10u, R(55), false));     // given up on
+   CHECK(pi.JIM_ram[R(55)] == 5u && ram_is(R(55) + 1u, img_size, true));
+   CHECK(pi.JIM_ram[img_size] == OLD);
+   CHECK(masked == 0u);
+   CHECK(jim_init_ready(R(30)));
+   pages_on = false;
+}
+
+static void test_shared_top(void)
+{
+   // reaching into the shared top: that part is read at once
+   make_image((uint32_t)SHARED + 4096u);
+   reset_ram();
+   CHECK(jim_init_load(RAM_BYTES));
+   CHECK(ram_is(SHARED, img_size, true) && ram_is(JIM_INIT_HEAD, SHARED, false));
+   CHECK(jim_init_len == SHARED);
+
+   // a snapshot save has the lot first
+   kicks = 0u;
+   jim_init_finish();
+   CHECK(kicks > 0u && ram_is(0, img_size, true));
+   CHECK(background_fn == NULL && jim_init_len == 0u);
+
+   // clipped by the caller (jim_disc_init_limit())
+   reset_ram();
+   CHECK(jim_init_load(R(10)));
+   CHECK(jim_init_len == R(10));
+   drain();
+   CHECK(ram_is(0, R(10), true) && ram_is(R(10), R(11), false));
+}
+
+static void test_restart_and_failure(void)
+{
+   make_image((uint32_t)R(200));
+   reset_ram();
+   CHECK(jim_init_load(RAM_BYTES));
+   background_fn();
+
+   // a BBC RST part-way through starts again
+   reset_ram();
+   CHECK(jim_init_load(RAM_BYTES));
+   CHECK(ram_is(0, JIM_INIT_HEAD, true) && ram_is(JIM_INIT_HEAD, R(5), false));
+   CHECK(background_fn != NULL && jim_init_len == R(200));
+
+   // a card error gives up on the rest and lets the Beeb have it as it is
+   background_fn();
+   fail_reads = true;
+   unsigned int before = logs;
+   background_fn();
+   fail_reads = false;
+   CHECK(logs > before);
+   CHECK(urgent_fn == NULL && background_fn == NULL && jim_init_len == 0u);
+   CHECK(jim_init_ready(R(199)));
+}
+
+int main(void)
+{
+   pi.JIM_ram_size = RAM_SETS;
+   pi.JIM_ram = malloc(RAM_BYTES);
+
+   test_absent();
+   test_whole();
+   test_stream();
+   test_shared_top();
+   test_restart_and_failure();
+
+   free(img);
+   free(pi.JIM_ram);
+   printf("%d checks, %d failures\n", checks, failures);
+   return failures != 0;
+}
@@ -0,0 +1,301 @@
+/* Host test of jim_pages.c: the page tracking behind demand-paged JIM RAM.
+   The MMU is a C model - a descriptor per page, filled in by the
+   map_small_page() stub - and a read or write through it that the model
+   says would fault is handed to jim_pages_abort() and retried, as the data
+   abort handler does.  The heap top is an arena with a page cap. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rpi/armc-cstubs.h"
+#include "rpi/asm-helpers.h"
+#include "rpi/cache.h"
+#include "jim_pages.h"
+
+static int failures, checks;
+#define CHECK(c) do { checks++; if (!(c)) { failures++; \
+   printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #c); } } while (0)
+
+#define WINDOW_MB    4u
+#define WINDOW_PAGES (WINDOW_MB << 8)
+#define ARENA_PAGES  64u
+
+#define DFSR_READ_TRANSLATION   0x007u
+#define DFSR_WRITE_TRANSLATION  0x807u
+#define DFSR_WRITE_PERMISSION   0x80Fu
+#define DFSR_WRITE_ALIGNMENT    0x801u
+
+/* ---- firmware stand-ins -------------------------------------------------- */
+
+static uint8_t *arena;
+static size_t arena_top;             // pages below this are still the heap's
+static size_t arena_floor;           // and this many are never given up
+static unsigned int masked;
+
+void *arm_heap_take_top(size_t bytes)
+{
+   size_t pages = (bytes + JIM_PAGE_SIZE - 1u) / JIM_PAGE_SIZE;
+
+   if (pages == 0u || arena_top < arena_floor + pages)
+      return NULL;
+   arena_top -= pages;
+   memset(arena + arena_top * JIM_PAGE_SIZE, 0xA5, pages * JIM_PAGE_SIZE);   // not zeroed, as on the Pi
+   return arena + arena_top * JIM_PAGE_SIZE;
+}
+
+unsigned int _disable_interrupts_cspr(void) { masked++; return masked; }
+void _restore_cpsr(unsigned int cpsr) { CHECK(cpsr == masked); masked--; }
+
+/* The MMU model: bit 0 present, bit 1 writable, the page frame above. */
+static uint32_t pte[WINDOW_PAGES];
+static bool tables_hung, refuse_tables;
+static unsigned int maps;
+
+bool map_l2_tables(unsigned int logical_mb, unsigned int count, const unsigned int *tables)
+{
+   CHECK(logical_mb == JIM_VA_BASE >> 20);
+   CHECK(count == WINDOW_MB);
+   CHECK(((uintptr_t)tables & 0x3FFu) == 0u);
+   for (unsigned int i = 0; i < count * 256u; i++)
+      if (tables[i] != 0u) {
+         CHECK(!"tables not cleared");
+         break;
+      }
+   if (refuse_tables)
+      return false;
+   tables_hung = true;
+   return true;
+}
+
+void map_small_page(unsigned int logical, unsigned int physical, bool writable)
+{
+   unsigned int page = logical - (JIM_VA_BASE >> JIM_PAGE_SHIFT);
+
+   CHECK(tables_hung);
+   CHECK(page < WINDOW_PAGES);
+   if (page < WINDOW_PAGES)
+      pte[page] = (physical << JIM_PAGE_SHIFT) | (writable ? 2u : 0u) | 1u;
+   maps++;
+}
+
+/* A physical address back to the host pointer: every page the module maps
+   is in the arena, which is far smaller than 4 GB, so the low 32 bits are
+   enough. */
+static uint8_t *phys_ptr(uint32_t phys)
+{
+   return arena + (uint32_t)(phys - (uint32_t)(uintptr_t)arena);
+}
+
+static unsigned int faults;
+
+static uint8_t *translate(size_t off, bool write)
+{
+   uint32_t page = (uint32_t)(off >> JIM_PAGE_SHIFT);
+   uint32_t va = JIM_VA_BASE + (uint32_t)off;
+
+   for (int tries = 0; tries < 3; tries++) {
+      uint32_t d = pte[page];
+      uint32_t dfsr;
+
+      if ((d & 1u) == 0u)
+         dfsr = write ? DFSR_WRITE_TRANSLATION : DFSR_READ_TRANSLATION;
+      else if (write && (d & 2u) == 0u)
+         dfsr = DFSR_WRITE_PERMISSION;
+      else
+         return phys_ptr(d & ~0xFFFu) + (off & (JIM_PAGE_SIZE - 1u));
+      faults++;
+      if (jim_pages_abort(va, dfsr) != 1)
+         break;
+   }
+   CHECK(!"access not resolved");
+   abort();
+}
+
+static uint8_t rd(size_t off) { return *translate(off, false); }
+static void wr(size_t off, uint8_t v) { *translate(off, true) = v; }
+
+static jim_pages_stats_t stats(void)
+{
+   jim_pages_stats_t st;
+
+   jim_pages_stats(&st);
+   return st;
+}
+
+/* ---- tests --------------------------------------------------------------- */
+
+static void test_inactive(void)
+{
+   CHECK(!jim_pages_active());
+   CHECK(jim_pages_backed(0u));              // plain malloc'd RAM is all real
+   CHECK(jim_pages_back(0u));
+   CHECK(!jim_pages_zero(0u, JIM_PAGE_SIZE));
+   CHECK(jim_pages_abort(JIM_VA_BASE, DFSR_WRITE_TRANSLATION) == 0);
+
+   CHECK(!jim_pages_init(0u));
+   CHECK(!jim_pages_init(((size_t)WINDOW_MB << 20) + 4096u));
+   CHECK(!jim_pages_init((size_t)1025u << 20));    // beyond 4 GB
+   refuse_tables = true;
+   CHECK(!jim_pages_init((size_t)WINDOW_MB << 20));
+   CHECK(!jim_pages_active());
+   refuse_tables = false;
+}
+
+static void test_reads(void)
+{
+   size_t top = arena_top;
+
+   CHECK(jim_pages_init((size_t)WINDOW_MB << 20));
+   CHECK(jim_pages_active());
+   CHECK(jim_pages_init((size_t)WINDOW_MB << 20));
+   CHECK(top - arena_top == 1u + 2u);    // 4 KB of tables, zero and scratch pages
+   CHECK(stats().pages == WINDOW_PAGES);
+
+   // every page reads zero; the first read maps the zero page, once
+   faults = 0u;
+   CHECK(rd(0u) == 0u);
+   CHECK(rd(4095u) == 0u);
+   CHECK(rd(((size_t)WINDOW_PAGES << JIM_PAGE_SHIFT) - 1u) == 0u);
+   CHECK(faults == 2u);
+   CHECK((pte[0] & 2u) == 0u);
+   CHECK(jim_pages_phys(5u) == jim_pages_phys(7u * JIM_PAGE_SIZE + 5u));
+   CHECK(!jim_pages_backed(0u));
+   CHECK(stats().backed == 0u && stats().taken == 0u);
+}
+
+static void test_writes(void)
+{
+   uint32_t zero = jim_pages_phys(0u);
+
+   // a write to the zero page: a permission fault gives it a page
+   faults = 0u;
+   wr(10u, 0x42u);
+   CHECK(faults == 1u);
+   CHECK(rd(10u) == 0x42u);
+   CHECK(rd(11u) == 0u);                     // the new page was zeroed
+   CHECK(jim_pages_backed(0u));
+   CHECK(jim_pages_phys(10u) != zero + 10u);
+   CHECK(*phys_ptr(jim_pages_phys(10u)) == 0x42u);
+   CHECK(*phys_ptr(zero + 10u) == 0u);       // the zero page was not written
+
+   // a write to a page never touched: a translation fault, the same
+   faults = 0u;
+   wr(3u * JIM_PAGE_SIZE + 1u, 0x99u);
+   CHECK(faults == 1u);
+   CHECK(rd(3u * JIM_PAGE_SIZE + 1u) == 0x99u);
+   CHECK(!jim_pages_backed(2u * JIM_PAGE_SIZE));
+   CHECK(stats().backed == 2u && stats().taken == 2u);
+
+   // no more faults once a page is writable
+   faults = 0u;
+   for (size_t i = 0; i < JIM_PAGE_SIZE; i++)
+      wr(3u * JIM_PAGE_SIZE + i, (uint8_t)i);
+   CHECK(faults == 0u);
+
+   // faults that are not the window's, or not a page fault, are refused
+   CHECK(jim_pages_abort(JIM_VA_BASE - 1u, DFSR_WRITE_TRANSLATION) == 0);
+   CHECK(jim_pages_abort(JIM_VA_BASE + (WINDOW_MB << 20), DFSR_WRITE_TRANSLATION) == 0);
+   CHECK(jim_pages_abort(JIM_VA_BASE + 5u * JIM_PAGE_SIZE, DFSR_WRITE_ALIGNMENT) == 0);
+   CHECK(jim_pages_abort(JIM_VA_BASE + 3u * JIM_PAGE_SIZE, DFSR_WRITE_PERMISSION) == 0);
+
+   // backing ahead of a write, as the VPU stream does
+   CHECK(jim_pages_back(6u * JIM_PAGE_SIZE + 100u));
+   CHECK(jim_pages_backed(6u * JIM_PAGE_SIZE));
+   CHECK((pte[6] & 2u) != 0u);
+   CHECK(!jim_pages_back((size_t)WINDOW_PAGES << JIM_PAGE_SHIFT));
+   CHECK(masked == 0u);
+}
+
+static void test_zero(void)
+{
+   jim_pages_stats_t before = stats();
+   uint32_t frame = jim_pages_phys(3u * JIM_PAGE_SIZE) & ~0xFFFu;
+
+   // part of a page is cleared in place
+   CHECK(jim_pages_zero(3u * JIM_PAGE_SIZE + 16u, 32u));
+   CHECK(rd(3u * JIM_PAGE_SIZE + 15u) == 15u);
+   CHECK(rd(3u * JIM_PAGE_SIZE + 16u) == 0u);
+   CHECK(rd(3u * JIM_PAGE_SIZE + 47u) == 0u);
+   CHECK(rd(3u * JIM_PAGE_SIZE + 48u) == 48u);
+   CHECK(jim_pages_backed(3u * JIM_PAGE_SIZE));
+
+   // a range covering pages 2-3 whole and 4 in part: 3 is released
+   CHECK(jim_pages_zero(2u * JIM_PAGE_SIZE, 2u * JIM_PAGE_SIZE + 8u));
+   CHECK(!jim_pages_backed(3u * JIM_PAGE_SIZE));
+   CHECK(rd(3u * JIM_PAGE_SIZE + 15u) == 0u);
+   CHECK((pte[3] & 2u) == 0u);
+   CHECK(stats().backed == before.backed - 1u);
+   CHECK(stats().free == 1u);
+
+   // the next page needed is the released one, not a new one from the heap
+   wr(9u * JIM_PAGE_SIZE, 1u);
+   CHECK((jim_pages_phys(9u * JIM_PAGE_SIZE) & ~0xFFFu) == frame);
+   CHECK(rd(9u * JIM_PAGE_SIZE + 1u) == 0u);   // its link word was cleared
+   CHECK(stats().free == 0u);
+   CHECK(stats().taken == before.taken);
+
+   // past the end is clipped
+   CHECK(jim_pages_zero(((size_t)WINDOW_PAGES - 1u) << JIM_PAGE_SHIFT, 3u * JIM_PAGE_SIZE));
+   CHECK(masked == 0u);
+}
+
+static void test_exhaustion(void)
+{
+   size_t page = 16u;
+
+   // write page after page until the heap has nothing left
+   while (stats().sink_faults == 0u && page < WINDOW_PAGES)
+      wr(page++ << JIM_PAGE_SHIFT, 0x77u);
+   CHECK(stats().sink_faults == 1u);
+   CHECK(arena_top == arena_floor);
+   size_t sunk = page - 1u;
+   CHECK(!jim_pages_backed(sunk << JIM_PAGE_SHIFT));
+
+   // the write went somewhere harmless: no further faults for that page,
+   // nothing else changed, and the zero page still reads zero
+   faults = 0u;
+   wr((sunk << JIM_PAGE_SHIFT) + 1u, 0x55u);
+   CHECK(faults == 0u);
+   CHECK(rd((page - 2u) << JIM_PAGE_SHIFT) == 0x77u);
+   CHECK(rd(1000u * JIM_PAGE_SIZE) == 0u);
+   CHECK(!jim_pages_back(sunk << JIM_PAGE_SHIFT));
+   CHECK(stats().sink_faults == 2u);
+
+   // more pages land on the scratch page too
+   wr(page << JIM_PAGE_SHIFT, 1u);
+   CHECK(stats().sink_faults == 3u);
+
+   // once a page is released, a scratch page can have it
+   CHECK(jim_pages_zero(16u << JIM_PAGE_SHIFT, JIM_PAGE_SIZE));
+   CHECK(jim_pages_back(sunk << JIM_PAGE_SHIFT));
+   CHECK(jim_pages_backed(sunk << JIM_PAGE_SHIFT));
+   CHECK(rd((sunk << JIM_PAGE_SHIFT) + 1u) == 0u);   // the lost write stays lost
+
+   // releasing part of a scratch page puts it back to the zero page
+   CHECK(jim_pages_zero((page << JIM_PAGE_SHIFT) + 5u, 1u));
+   CHECK(rd(page << JIM_PAGE_SHIFT) == 0u);
+   CHECK((pte[page] & 2u) == 0u);
+
+   jim_pages_stats_t st = stats();
+   CHECK(st.backed + st.free == st.taken);
+   CHECK(masked == 0u);
+}
+
+int main(void)
+{
+   arena = aligned_alloc(JIM_PAGE_SIZE, (size_t)ARENA_PAGES * JIM_PAGE_SIZE);
+   if (arena == NULL)
+      return 1;
+   arena_top = ARENA_PAGES;
+   arena_floor = 8u;
+
+   test_inactive();
+   test_reads();
+   test_writes();
+   test_zero();
+   test_exhaustion();
+
+   printf("%u page maps, %d checks, %d failures\n", maps, checks, failures);
+   free(arena);
+   return failures != 0;
+}
@@ -0,0 +1,231 @@
+/* Host test of JIM_Init.bin and the JIM RAM disc together at power-on, in
+   the order rampage_emulator_init() takes them: the disc is opened first,
+   so JIM_Init.bin - streamed in behind the Beeb - stops short of it and
+   never lands on the disc, in RAM or, through the disc's write-back, on the
+   card.  Links jim_init.c and jim_disc.c over an in-memory FatFs holding
+   both files. */
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Pi1MHz.h"
+#include "config.h"
+#include "BeebSCSI/filesystem.h"
+#include "BeebSCSI/fatfs/ff.h"
+#include "rpi/asm-helpers.h"
+#include "rpi/systimer.h"
+#include "watchdog.h"
+#include "vpu_stream.h"
+#include "jim_pages.h"
+#include "ram_emulator.h"
+#include "jim_init.h"
+#include "jim_disc.h"
+
+static int failures, checks;
+#define CHECK(c) do { checks++; if (!(c)) { failures++; \
+   printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #c); } } while (0)
+
+#define RAM_SETS  3u
+#define RAM_BYTES (RAM_SETS * JIM_RAM_STEP)
+#define INIT_FILE "JIM_Init.bin"
+#define DISC_FILE "/jim.img"
+#define INIT_LEN  (4u * 1024u * 1024u)          // runs on past the disc
+#define BASE      (1024u * 1024u)
+#define LEN       (1024u * 1024u)
+
+/* ---- firmware stand-ins -------------------------------------------------- */
+
+static Pi1MHz_t pi;
+Pi1MHz_t *const Pi1MHz = &pi;
+volatile uint32_t Pi1MHz_poll_events;
+
+static func_ptr urgent_fn, background_fn[2];
+static unsigned int masked;
+
+void test_log(const char *fmt, ...) { (void)fmt; }
+void watchdog_kick(void) { }
+void watchdog_boot_kick(void) { }
+void vpu_stream_release(void) { }
+uint32_t RPI_GetSystemTime(void) { return 0u; }
+unsigned int _disable_interrupts_cspr(void) { return ++masked; }
+void _restore_cpsr(unsigned int cpsr) { CHECK(cpsr == masked); masked--; }
+bool jim_pages_zero(size_t offset, size_t len) { (void)offset; (void)len; return false; }
+void ram_emulator_refresh(size_t addr, size_t len) { (void)addr; (void)len; }
+
+void Pi1MHz_Register_Poll_Sched(func_ptr fn, uint8_t priority, uint32_t period_us,
+                                uint32_t deadline_us)
+{
+   CHECK(priority == POLL_BACKGROUND);
+   (void)period_us; (void)deadline_us;
+   for (unsigned int i = 0; i < 2u; i++)
+      if (background_fn[i] == NULL || background_fn[i] == fn) {
+         background_fn[i] = fn;
+         return;
+      }
+   CHECK(!"too many pollers");
+}
+void Pi1MHz_Register_Poll_Event(func_ptr fn, uint8_t priority, uint32_t period_us,
+                                uint32_t events)
+{
+   CHECK(priority == POLL_URGENT && events == POLL_EVENT_JIM);
+   (void)period_us;
+   urgent_fn = fn;
+}
+void Pi1MHz_Unregister_Poll(func_ptr fn)
+{
+   if (fn == urgent_fn) urgent_fn = NULL;
+   for (unsigned int i = 0; i < 2u; i++)
+      if (fn == background_fn[i]) background_fn[i] = NULL;
+}
+
+const char *config_get(const char *key)
+{
+   if (strcmp(key, "jim_init_stream") == 0) return "1";
+   if (strcmp(key, "jim_disc") == 0) return DISC_FILE;
+   if (strcmp(key, "jim_disc_addr") == 0) return "1M";
+   if (strcmp(key, "jim_disc_size") == 0) return "1M";
+   return NULL;
+}
+bool config_get_bool(const char *key)
+{
+   const char *v = config_get(key);
+   return v != NULL && v[0] == '1';
+}
+bool config_beeb_write_protected(void) { return false; }
+
+/* ---- the two files ------------------------------------------------------- */
+
+static uint8_t *init_img, *disc_img, *disc_was;
+
+uint32_t filesystemReadFile(const char *filename, uint8_t **address, unsigned int max_size)
+{
+   uint32_t n = (max_size < INIT_LEN) ? max_size : INIT_LEN;
+
+   CHECK(strcmp(filename, INIT_FILE) == 0);
+   memcpy(*address, init_img, n);
+   return n;
+}
+
+static uint8_t *file_of(const FIL *fp)
+{
+   return (fp->mode & FA_WRITE) != 0u ? disc_img : init_img;
+}
+
+FRESULT f_open(FIL *fp, const char *path, BYTE mode)
+{
+   if (strcmp(path, INIT_FILE) == 0) {
+      CHECK(mode == FA_READ);
+      fp->fsize = INIT_LEN;
+   } else if (strcmp(path, DISC_FILE) == 0) {
+      CHECK((mode & FA_WRITE) != 0u);
+      fp->fsize = LEN;
+   } else {
+      return FR_NO_FILE;
+   }
+   fp->pos = 0u;
+   fp->mode = mode;
+   return FR_OK;
+}
+FRESULT f_close(FIL *fp) { fp->mode = 0; return FR_OK; }
+FRESULT f_read(FIL *fp, void *buff, UINT btr, UINT *br)
+{
+   uint32_t left = fp->fsize - fp->pos;
+   UINT n = (btr < left) ? btr : (UINT)left;
+
+   memcpy(buff, file_of(fp) + fp->pos, n);
+   fp->pos += n;
+   *br = n;
+   return FR_OK;
+}
+FRESULT f_write(FIL *fp, const void *buff, UINT btw, UINT *bw)
+{
+   CHECK((fp->mode & FA_WRITE) != 0u && fp->pos + btw <= LEN);
+   memcpy(disc_img + fp->pos, buff, btw);
+   fp->pos += btw;
+   *bw = btw;
+   return FR_OK;
+}
+FRESULT f_lseek(FIL *fp, FSIZE_t ofs) { fp->pos = ofs; return FR_OK; }
+FRESULT f_sync(FIL *fp) { (void)fp; return FR_OK; }
+
+/* ---- helpers ------------------------------------------------------------- */
+
+/* The Beeb writes a byte through a register, as ram_emulator_page_write()
+   does. */
+static void beeb_write(size_t addr, uint8_t v)
+{
+   jim_init_need(addr);
+   jim_init_write(addr);
+   pi.JIM_ram[addr] = v;
+   jim_disc_mark(addr);
+}
+
+static void drain(void)
+{
+   for (unsigned int polls = 0u; polls < 100000u; polls++) {
+      bool busy = false;
+
+      if ((Pi1MHz_poll_events & POLL_EVENT_JIM) != 0u && urgent_fn != NULL) {
+         Pi1MHz_poll_events &= ~POLL_EVENT_JIM;
+         urgent_fn();
+      }
+      for (unsigned int i = 0; i < 2u; i++)
+         if (background_fn[i] != NULL) {
+            background_fn[i]();
+            busy = true;
+         }
+      if (!busy || (jim_init_len == 0u && !jim_disc_pending))
+         return;
+   }
+   CHECK(!"pollers never finished");
+}
+
+int main(void)
+{
+   pi.JIM_ram_size = RAM_SETS;
+   pi.JIM_ram = malloc(RAM_BYTES);
+   memset(pi.JIM_ram, 0, RAM_BYTES);
+   init_img = malloc(INIT_LEN);
+   disc_img = malloc(LEN);
+   disc_was = malloc(LEN);
+   for (uint32_t i = 0; i < INIT_LEN; i++)
+      init_img[i] = (uint8_t)(i * 13u + 1u);
+   for (uint32_t i = 0; i < LEN; i++)
+      disc_img[i] = (uint8_t)((i * 7u) ^ 0x5Au);
+   memcpy(disc_was, disc_img, LEN);
+
+   // rampage_emulator_init() at power-on
+   jim_disc_open();
+   CHECK(jim_disc_len == LEN && jim_disc_base == BASE);
+   CHECK(jim_disc_init_limit(RAM_BYTES) == BASE);
+   CHECK(jim_init_load(jim_disc_init_limit(RAM_BYTES)));
+   CHECK(jim_init_len == BASE);                 // streamed, and short of the disc
+   jim_disc_start();
+
+   CHECK(memcmp(pi.JIM_ram + BASE, disc_was, LEN) == 0);
+
+   // the Beeb gets going before the rest of JIM_Init.bin is in
+   beeb_write(BASE + 0x1234u, 0xA5u);
+   disc_was[0x1234u] = 0xA5u;
+   beeb_write(BASE - 1u, 0x3Cu);
+   drain();
+
+   CHECK(jim_init_len == 0u && !jim_disc_pending);
+   CHECK(memcmp(pi.JIM_ram, init_img, BASE - 1u) == 0);
+   CHECK(pi.JIM_ram[BASE - 1u] == 0x3Cu);
+   CHECK(memcmp(pi.JIM_ram + BASE, disc_was, LEN) == 0);
+   CHECK(memcmp(disc_img, disc_was, LEN) == 0);
+   for (size_t i = BASE + LEN; i < INIT_LEN; i++)
+      if (pi.JIM_ram[i] != 0u) {
+         CHECK(!"JIM_Init.bin loaded past the disc");
+         break;
+      }
+
+   free(init_img);
+   free(disc_img);
+   free(disc_was);
+   free(pi.JIM_ram);
+   printf("%d checks, %d failures\n", checks, failures);
+   return failures != 0;
+}
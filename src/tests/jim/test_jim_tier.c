@@ -0,0 +1,415 @@
+/* Host test of jim_tier.c: JIM RAM above the Pi's memory, compressed - the
+   FIQ's staged pages, the urgent poller folding them back and making
+   regions hot and pushing the least recently shown ones back out, and the
+   Beeb's writes surviving all of it - against a plain copy of what the Beeb wrote.  With "bench" it
+   times the FIQ's cold page and the poller's region swaps instead. */
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "Pi1MHz.h"
+#include "config.h"
+#include "rpi/asm-helpers.h"
+#include "ram_emulator.h"
+#include "jim_tier.h"
+
+static int failures, checks;
+#define CHECK(c) do { checks++; if (!(c)) { failures++; \
+   printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #c); } } while (0)
+
+#define RAM_SETS   2u                     // JIM RAM proper below the tier
+#define BASE       ((size_t)RAM_SETS * JIM_RAM_STEP)
+#define TIER_SETS  4u
+#define TIER_BYTES ((size_t)TIER_SETS * JIM_RAM_STEP)
+#define REG(n)     (BASE + ((size_t)(n) << JIM_TIER_REGION_SHIFT))
+#define SLOTS      32u
+#define STAGE      32u
+
+/* ---- firmware stand-ins -------------------------------------------------- */
+
+static Pi1MHz_t pi;
+Pi1MHz_t *const Pi1MHz = &pi;
+volatile uint32_t Pi1MHz_poll_events;
+
+static func_ptr urgent_fn;
+static unsigned int masked, logs;
+
+void test_log(const char *fmt, ...) { (void)fmt; logs++; }
+unsigned int _disable_interrupts_cspr(void) { return ++masked; }
+void _restore_cpsr(unsigned int cpsr) { CHECK(cpsr == masked); masked--; }
+
+void Pi1MHz_Register_Poll_Sched(func_ptr fn, uint8_t priority, uint32_t period_us,
+                                uint32_t deadline_us)
+{
+   (void)fn; (void)priority; (void)period_us; (void)deadline_us;
+   CHECK(0);
+}
+void Pi1MHz_Register_Poll_Event(func_ptr fn, uint8_t priority, uint32_t period_us,
+                                uint32_t events)
+{
+   CHECK(priority == POLL_URGENT && events == POLL_EVENT_JIMTIER);
+   (void)period_us;
+   urgent_fn = fn;
+   Pi1MHz_poll_events |= events;
+}
+void Pi1MHz_Unregister_Poll(func_ptr fn) { (void)fn; }
+void Pi1MHz_Poll_Wake(uint32_t events) { Pi1MHz_poll_events |= events; }
+
+const char *config_get(const char *key)
+{
+   return strcmp(key, "jim_overflow") == 0 ? "64M" : NULL;
+}
+bool config_get_bool(const char *key) { (void)key; return false; }
+
+/* ---- the Beeb's side, as ram_emulator.c does it -------------------------- */
+
+static size_t page_addr;                  // the page register
+static uint8_t *page;                     // what the JIM window shows
+static uint8_t *model;                    // what the Beeb has written, all of it
+
+void ram_emulator_refresh(size_t addr, size_t len)
+{
+   CHECK(masked != 0u);
+   if (page_addr - addr < len)
+      page = jim_tier_page(page_addr);
+}
+
+static void select_page(size_t addr)
+{
+   page_addr = addr;
+   page = jim_tier_page(addr);
+}
+
+static void beeb_write(unsigned int off, uint8_t v)
+{
+   page[off] = v;
+   jim_tier_write();
+   model[page_addr - BASE + off] = v;
+}
+
+static bool beeb_page_right(void)
+{
+   return memcmp(page, model + (page_addr - BASE), PAGE_SIZE) == 0;
+}
+
+/* The main loop: the urgent poller until it has nothing left. */
+static unsigned int poll_all(void)
+{
+   unsigned int runs = 0;
+
+   while ((Pi1MHz_poll_events & POLL_EVENT_JIMTIER) && runs < 1000u) {
+      Pi1MHz_poll_events &= ~POLL_EVENT_JIMTIER;
+      urgent_fn();
+      runs++;
+   }
+   CHECK(masked == 0u);
+   return runs;
+}
+
+static uint32_t seed = 4321u;
+
+static uint32_t rnd(void)
+{
+   seed = seed * 1103515245u + 12345u;
+   return seed >> 8;
+}
+
+/* Fill the shown page as a RAM disc would: text, runs and now and then
+   something that will not compress. */
+static void beeb_fill(unsigned int kind)
+{
+   for (unsigned int i = 0; i < PAGE_SIZE; i++)
+      beeb_write(i, kind == 0u ? (uint8_t)("10 PRINT \"HELLO\"\r"[i % 17u])
+                  : kind == 1u ? (uint8_t)(i / 64u)
+                  : (uint8_t)rnd());
+}
+
+/* ---- tests --------------------------------------------------------------- */
+
+static void test_init(void)
+{
+   jim_tier_stats_t st;
+
+   CHECK(jim_tier_base == SIZE_MAX);
+   CHECK(jim_tier_init(BASE, 255u - RAM_SETS) == TIER_SETS);
+   CHECK(jim_tier_base == BASE);
+   CHECK(jim_tier_init(BASE, 255u - RAM_SETS) == 0u);     // once only
+   jim_tier_start();
+   CHECK(urgent_fn != NULL);
+   jim_tier_stats(&st);
+   CHECK(st.regions == TIER_BYTES >> JIM_TIER_REGION_SHIFT);
+   CHECK(st.stored == 0u && st.hot == 0u);
+   poll_all();                             // the first pass finds nothing
+   CHECK(!jim_tier_holds_data());
+}
+
+static void test_cold_and_hot(void)
+{
+   jim_tier_stats_t st;
+   uint8_t *staged;
+
+   // never written: zeros, from a staging page, with the region asked for
+   select_page(REG(5) + 0x300u);
+   CHECK(beeb_page_right());
+   staged = page;
+   CHECK(Pi1MHz_poll_events & POLL_EVENT_JIMTIER);
+
+   // the Beeb writes before the poller gets to it
+   CHECK(!jim_tier_holds_data());          // looked at is not written
+   beeb_write(0, 0x11u);
+   beeb_write(255, 0x22u);
+   CHECK(page == staged);
+   CHECK(jim_tier_holds_data());           // staged: no snapshot now
+
+   poll_all();
+   jim_tier_stats(&st);
+   CHECK(st.loads == 1u && st.hot == 1u);
+   CHECK(page != staged);                  // the window has moved to the slot
+   CHECK(beeb_page_right());
+
+   // the rest of the region is hot now: no staging, no poll
+   select_page(REG(5) + 0xFF00u);
+   CHECK(!(Pi1MHz_poll_events & POLL_EVENT_JIMTIER));
+   beeb_fill(0);
+   select_page(REG(5) + 0x300u);
+   CHECK(beeb_page_right());
+}
+
+static void test_evict(void)
+{
+   jim_tier_stats_t st;
+
+   // more regions than slots, each written on a few pages
+   for (unsigned int r = 10; r < 10u + 3u * SLOTS; r++) {
+      for (unsigned int p = 0; p < 4u; p++) {
+         select_page(REG(r) + p * 0x1100u);
+         beeb_fill((r + p) % 3u);
+      }
+      poll_all();
+   }
+   jim_tier_stats(&st);
+   CHECK(st.hot == SLOTS);
+   CHECK(st.evictions >= 2u * SLOTS);
+   CHECK(st.stored >= 2u * SLOTS);
+   CHECK(st.bytes < (size_t)st.stored * JIM_TIER_REGION / 4u);
+   CHECK(st.refused == 0u);
+
+   // all of it back, cold regions through staging first
+   for (unsigned int r = 0; r < 10u + 3u * SLOTS + 4u; r++)
+      for (size_t p = 0; p < JIM_TIER_REGION; p += 0x1100u) {
+         select_page(REG(r) + p);
+         CHECK(beeb_page_right());
+         if (p % 0x4400u == 0u)
+            poll_all();
+      }
+   poll_all();
+}
+
+static void test_zeroed(void)
+{
+   jim_tier_stats_t st, was;
+
+   select_page(REG(500));
+   beeb_fill(2);
+   poll_all();
+   // pushed out with data in it
+   for (unsigned int r = 520; r < 520u + SLOTS; r++) {
+      select_page(REG(r));
+      poll_all();
+   }
+   jim_tier_stats(&was);
+
+   // cleared again: pushed out, it needs no blob at all
+   select_page(REG(500));
+   poll_all();
+   for (unsigned int i = 0; i < PAGE_SIZE; i++)
+      beeb_write(i, 0u);
+   for (unsigned int r = 560; r < 560u + SLOTS; r++) {
+      select_page(REG(r));
+      poll_all();
+   }
+   jim_tier_stats(&st);
+   CHECK(st.stored == was.stored - 1u);
+   CHECK(st.bytes < was.bytes);
+   select_page(REG(500));
+   CHECK(beeb_page_right());
+   poll_all();
+}
+
+static void test_staging_full(void)
+{
+   jim_tier_stats_t st, was;
+   unsigned int refused_logs;
+
+   // one more cold page written than there are staging pages, no poll
+   // between: the last is shown from the spare, and kept once they are folded
+   jim_tier_stats(&was);
+   for (unsigned int i = 0; i < STAGE + 1u; i++) {
+      select_page(REG(600u + i));
+      beeb_write(7, (uint8_t)(0x40u + i));
+   }
+   CHECK(beeb_page_right());
+   poll_all();
+   jim_tier_stats(&st);
+   CHECK(st.refused == 0u);
+   CHECK(st.folds >= was.folds + STAGE);
+   CHECK(st.loads == was.loads + 1u);      // only the one the Beeb is in
+   CHECK(beeb_page_right());               // the window moved off the spare
+   beeb_write(8, 0x5Au);
+   poll_all();
+
+   // two more: the oldest writes are all kept, the spare's first is not
+   for (unsigned int i = 0; i < STAGE + 2u; i++) {
+      select_page(REG(640u + i));
+      beeb_write(7, (uint8_t)(0x80u + i));
+   }
+   jim_tier_stats(&st);
+   CHECK(st.refused == 1u);
+   refused_logs = logs;
+   poll_all();
+   CHECK(logs > refused_logs);             // said so
+   model[REG(640u + STAGE) - BASE + 7u] = 0u;
+
+   for (unsigned int i = 0; i < STAGE + 1u; i++) {
+      select_page(REG(600u + i));
+      CHECK(beeb_page_right());
+      select_page(REG(640u + i));
+      CHECK(beeb_page_right());
+      poll_all();
+   }
+   select_page(REG(640u + STAGE + 1u));
+   CHECK(beeb_page_right());
+   poll_all();
+
+   // re-selecting a staged page finds the same copy
+   select_page(REG(700u) + 0x500u);
+   beeb_write(1, 0x99u);
+   select_page(REG(701u));
+   select_page(REG(700u) + 0x500u);
+   CHECK(beeb_page_right());
+   poll_all();
+   CHECK(beeb_page_right());
+}
+
+static void test_shown_kept(void)
+{
+   jim_tier_stats_t st, was;
+   size_t keep = REG(800u) + 0x200u;
+
+   // the Beeb stays on one page while the poller churns through regions
+   // staged by another FIQ-side look: the shown slot is never evicted
+   select_page(keep);
+   poll_all();
+   beeb_write(3, 0x77u);
+   jim_tier_stats(&was);
+   for (unsigned int r = 0; r < 2u * SLOTS; r++) {
+      size_t back = page_addr;
+      (void)jim_tier_page(REG(850u + r));       // asked for, not shown
+      page = jim_tier_page(back);
+      poll_all();
+      beeb_write(4, (uint8_t)r);
+   }
+   jim_tier_stats(&st);
+   CHECK(st.loads > was.loads);
+   CHECK(page_addr == keep && beeb_page_right());
+}
+
+static void test_random(void)
+{
+   // a RAM disc in use: random pages over 4 MB of the tier, polled now and then
+   for (unsigned int n = 0; n < 20000u; n++) {
+      size_t addr = REG(rnd() % 64u) + (rnd() % 256u) * PAGE_SIZE;
+      select_page(addr);
+      CHECK(beeb_page_right());
+      if (rnd() % 3u == 0u)
+         beeb_write(rnd() % PAGE_SIZE, (uint8_t)rnd());
+      if (rnd() % 4u == 0u)
+         poll_all();
+   }
+   poll_all();
+   for (unsigned int r = 0; r < 64u; r++)
+      for (size_t p = 0; p < JIM_TIER_REGION; p += PAGE_SIZE) {
+         select_page(REG(r) + p);
+         CHECK(beeb_page_right());
+         if (p == 0u)
+            poll_all();
+      }
+}
+
+static double now_us(void)
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (double)ts.tv_sec * 1e6 + (double)ts.tv_nsec / 1e3;
+}
+
+static void bench(void)
+{
+   jim_tier_stats_t st;
+   double t0, t1;
+   unsigned int n = 0;
+
+   // 16 MB of RAM disc, then cold pages selected the way the FIQ sees them
+   for (unsigned int r = 0; r < 256u; r++) {
+      for (size_t p = 0; p < JIM_TIER_REGION; p += PAGE_SIZE) {
+         select_page(REG(r) + p);
+         beeb_fill((unsigned int)(p / PAGE_SIZE) % 3u);
+         if (p == 0u)
+            poll_all();                    // hot from here on
+      }
+      poll_all();
+   }
+   jim_tier_stats(&st);
+   CHECK(st.refused == 0u);
+   for (unsigned int r = 300; r < 300u + SLOTS; r++) {
+      select_page(REG(r));
+      poll_all();
+   }
+   jim_tier_stats(&st);
+   printf("16 MB held in %zu KB\n", st.bytes >> 10);
+
+   t0 = now_us();
+   for (unsigned int r = 0; r < 256u; r += 8u)
+      for (size_t p = 0; p < JIM_TIER_REGION; p += 0x1100u, n++) {
+         page_addr = REG(r) + p;
+         page = jim_tier_page(page_addr);
+      }
+   t1 = now_us();
+   printf("cold page in the FIQ: %.2f us\n", (t1 - t0) / n);
+   Pi1MHz_poll_events = 0u;
+
+   // each region in and a written one out
+   t0 = now_us();
+   for (unsigned int r = 0; r < 256u; r++) {
+      select_page(REG(r));
+      beeb_write(0, 1u);
+      poll_all();
+   }
+   t1 = now_us();
+   printf("region swap in the poller: %.1f us\n", (t1 - t0) / 256.0);
+}
+
+int main(int argc, char **argv)
+{
+   pi.JIM_ram_size = RAM_SETS;
+   model = calloc(1, TIER_BYTES);
+
+   test_init();
+   if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+      bench();
+      free(model);
+      return 0;
+   }
+   test_cold_and_hot();
+   test_evict();
+   test_zeroed();
+   test_staging_full();
+   test_shown_kept();
+   test_random();
+
+   free(model);
+   printf("%d checks, %d failures\n", checks, failures);
+   return failures != 0;
+}
@@ -0,0 +1,214 @@
+/* Host test of lz4_block.c: blocks of every kind round trip, the end rules
+   other decoders rely on are kept, and a damaged block is refused without
+   writing past its output.  With "pack" or "unpack" it instead converts
+   stdin to stdout as an LZ4 legacy frame, for run.sh to check the blocks
+   against the lz4 tool when there is one. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lz4_block.h"
+
+static int failures, checks;
+#define CHECK(c) do { checks++; if (!(c)) { failures++; \
+   printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #c); } } while (0)
+
+#define LEGACY_MAGIC 0x184C2102u
+#define GUARD        64u
+
+static uint32_t seed = 12345u;
+
+static uint8_t rnd(void)
+{
+   seed = seed * 1103515245u + 12345u;
+   return (uint8_t)(seed >> 16);
+}
+
+/* Round trip src through a block and back, into a buffer with guard bytes
+   after it.  The compressed size, 0 if it did not fit. */
+static size_t round_trip(const uint8_t *src, size_t len)
+{
+   static uint8_t comp[LZ4_BLOCK_BOUND(LZ4_BLOCK_MAX)];
+   static uint8_t out[LZ4_BLOCK_MAX + GUARD];
+   size_t n = lz4_compress_block(src, len, comp, sizeof comp);
+
+   CHECK(n != 0u && n <= LZ4_BLOCK_BOUND(len));
+   if (n == 0u)
+      return 0u;
+   memset(out, 0xA5, sizeof out);
+   CHECK(lz4_decompress_block(comp, n, out, len));
+   CHECK(memcmp(out, src, len) == 0);
+   for (size_t i = len; i < len + GUARD; i++)
+      CHECK(out[i] == 0xA5u);
+
+   // the format's end rules: the last five bytes literals, and so the
+   // last sequence a token and at least five of them
+   if (len >= 13u)
+      CHECK(memcmp(comp + n - 5u, src + len - 5u, 5u) == 0);
+   return n;
+}
+
+static void test_kinds(void)
+{
+   static uint8_t buf[LZ4_BLOCK_MAX];
+   size_t n;
+
+   // every short length, where there is no room for a match at all
+   for (size_t len = 0; len <= 40u; len++) {
+      memset(buf, 'x', len);
+      n = round_trip(buf, len);
+      if (len <= 12u)
+         CHECK(n == 1u + len);              // one token and the literals
+   }
+
+   // zeros: a 256-byte page goes to a handful of bytes
+   memset(buf, 0, sizeof buf);
+   CHECK(round_trip(buf, 256u) < 16u);
+   CHECK(round_trip(buf, LZ4_BLOCK_MAX) < 300u);
+
+   // noise does not compress, and stays under the bound
+   for (size_t i = 0; i < sizeof buf; i++)
+      buf[i] = rnd();
+   CHECK(round_trip(buf, 256u) > 256u);
+   CHECK(round_trip(buf, LZ4_BLOCK_MAX) > LZ4_BLOCK_MAX);
+
+   // text, runs and a repeat far back
+   for (size_t i = 0; i < sizeof buf; i++)
+      buf[i] = (uint8_t)("The quick brown fox jumps over the lazy dog. "[i % 45u]);
+   CHECK(round_trip(buf, 256u) < 128u);
+   CHECK(round_trip(buf, LZ4_BLOCK_MAX) < 1024u);
+   for (size_t i = 0; i < sizeof buf; i++)
+      buf[i] = (uint8_t)((i / 300u) & 3u);
+   round_trip(buf, LZ4_BLOCK_MAX);
+   for (size_t i = 0; i < 1000u; i++)
+      buf[i] = rnd();
+   memcpy(buf + 64000u, buf, 1000u);
+   round_trip(buf, LZ4_BLOCK_MAX);
+
+   // literals and matches both long enough to need extra length bytes
+   for (size_t i = 0; i < 600u; i++)
+      buf[i] = rnd();
+   memset(buf + 600u, 7, 1000u);
+   round_trip(buf, 1600u);
+
+   // mixed: pages of a RAM disc
+   for (int k = 0; k < 200; k++) {
+      size_t len = 1u + (size_t)rnd() * 256u % LZ4_BLOCK_MAX;
+      for (size_t i = 0; i < len; i++)
+         buf[i] = (rnd() & 1u) ? buf[i / 2u] : rnd() & 15u;
+      round_trip(buf, len);
+   }
+
+   CHECK(lz4_compress_block(buf, LZ4_BLOCK_MAX + 1u, buf, 10u) == 0u);
+}
+
+static void test_tight(void)
+{
+   uint8_t src[256], comp[300];
+   size_t full, n;
+
+   for (size_t i = 0; i < sizeof src; i++)
+      src[i] = rnd();
+   full = lz4_compress_block(src, sizeof src, comp, sizeof comp);
+   CHECK(full > sizeof src);
+   // too little room is 0, never an overrun
+   for (size_t cap = 0; cap < full; cap++) {
+      memset(comp, 0xA5, sizeof comp);
+      CHECK(lz4_compress_block(src, sizeof src, comp, cap) == 0u);
+      for (size_t i = cap; i < sizeof comp; i++)
+         CHECK(comp[i] == 0xA5u);
+   }
+   n = lz4_compress_block(src, sizeof src, comp, full);
+   CHECK(n == full);
+}
+
+static void test_damaged(void)
+{
+   uint8_t src[1024], comp[LZ4_BLOCK_BOUND(1024u)], out[1024 + GUARD];
+   size_t n;
+
+   for (size_t i = 0; i < sizeof src; i++)
+      src[i] = (uint8_t)((i % 37u) ^ (i / 200u));
+   n = lz4_compress_block(src, sizeof src, comp, sizeof comp);
+   CHECK(n != 0u);
+
+   memset(out, 0xA5, sizeof out);
+   CHECK(!lz4_decompress_block(comp, n, out, sizeof src - 1u));    // too short a size
+   CHECK(!lz4_decompress_block(comp, n, out, sizeof src + 1u));    // too long a size
+   for (size_t cut = 0; cut < n; cut++)
+      CHECK(!lz4_decompress_block(comp, cut, out, sizeof src));    // truncated
+   for (size_t i = sizeof src + 1u; i < sizeof out; i++)
+      CHECK(out[i] == 0xA5u);
+
+   // an offset before the start, and an offset of 0
+   static const uint8_t back[] = { 0x14, 'a', 0x05, 0x00, 0x50, 'a', 'b', 'c', 'd', 'e' };
+   static const uint8_t zero[] = { 0x14, 'a', 0x00, 0x00, 0x50, 'a', 'b', 'c', 'd', 'e' };
+   static const uint8_t good[] = { 0x14, 'a', 0x01, 0x00, 0x50, 'a', 'b', 'c', 'd', 'e' };
+   CHECK(!lz4_decompress_block(back, sizeof back, out, 14u));
+   CHECK(!lz4_decompress_block(zero, sizeof zero, out, 14u));
+   CHECK(lz4_decompress_block(good, sizeof good, out, 14u));
+   CHECK(memcmp(out, "aaaaaaaaaabcde", 14u) == 0);
+
+   // every one-byte corruption is decoded safely or refused
+   for (size_t i = 0; i < n; i++) {
+      uint8_t keep = comp[i];
+      comp[i] ^= (uint8_t)(1u << (i & 7u));
+      memset(out, 0xA5, sizeof out);
+      (void)lz4_decompress_block(comp, n, out, sizeof src);
+      for (size_t j = sizeof src; j < sizeof out; j++)
+         CHECK(out[j] == 0xA5u);
+      comp[i] = keep;
+   }
+}
+
+static void put32(uint32_t v)
+{
+   uint8_t b[4] = { (uint8_t)v, (uint8_t)(v >> 8), (uint8_t)(v >> 16), (uint8_t)(v >> 24) };
+   fwrite(b, 1, 4, stdout);
+}
+
+static int pack(void)
+{
+   static uint8_t src[LZ4_BLOCK_MAX], comp[LZ4_BLOCK_BOUND(LZ4_BLOCK_MAX)];
+   size_t len = fread(src, 1, sizeof src, stdin);
+   size_t n = lz4_compress_block(src, len, comp, sizeof comp);
+
+   if (n == 0u)
+      return 1;
+   put32(LEGACY_MAGIC);
+   put32((uint32_t)n);
+   fwrite(comp, 1, n, stdout);
+   return 0;
+}
+
+/* One block of a legacy frame, which lz4 -l makes for input of up to 8 MB;
+   the size it comes to is given, as the tier knows its own. */
+static int unpack(size_t out_len)
+{
+   static uint8_t comp[LZ4_BLOCK_BOUND(LZ4_BLOCK_MAX) + 8u], out[LZ4_BLOCK_MAX];
+   size_t len = fread(comp, 1, sizeof comp, stdin);
+   uint32_t n;
+
+   if (len < 8u || out_len > sizeof out)
+      return 1;
+   n = (uint32_t)comp[4] | (uint32_t)comp[5] << 8 | (uint32_t)comp[6] << 16 | (uint32_t)comp[7] << 24;
+   if (n != len - 8u || !lz4_decompress_block(comp + 8, n, out, out_len))
+      return 1;
+   fwrite(out, 1, out_len, stdout);
+   return 0;
+}
+
+int main(int argc, char **argv)
+{
+   if (argc > 1 && strcmp(argv[1], "pack") == 0)
+      return pack();
+   if (argc > 2 && strcmp(argv[1], "unpack") == 0)
+      return unpack((size_t)strtoul(argv[2], NULL, 0));
+
+   test_kinds();
+   test_tight();
+   test_damaged();
+
+   printf("%d checks, %d failures\n", checks, failures);
+   return failures != 0;
+}
@@ -16,6 +16,12 @@ extern Pi1MHz_t *Pi1MHz;
 
 void Pi1MHz_MemoryWrite(uint32_t addr, uint8_t data);
 void Pi1MHz_Register_Poll(func_ptr function_ptr);
+/* the tests drive the poll themselves, so events are moot */
+#define POLL_NORMAL 1u
+#define POLL_EVENT_NET (1u << 1)
+#define Pi1MHz_Register_Poll_Event(f, prio, period, ev) Pi1MHz_Register_Poll(f)
+#define Pi1MHz_Poll_Wake(ev) ((void)(ev))
+#define Pi1MHz_Poll_Wake_FIQ(ev) ((void)(ev))
 void Pi1MHz_nIRQ_ASSERT(uint8_t src);
 void Pi1MHz_nIRQ_CLEAR(uint8_t src);
 #endif
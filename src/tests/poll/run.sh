@@ -0,0 +1,20 @@
+#!/bin/sh -e
+# Host test of the idle-loop poll scheduler (poll_sched.c) and the profiler
+# that hooks into it (profiler.c). From tests/poll/.
+HERE=$(cd "$(dirname "$0")" && pwd)
+SRC=${SRC:-$HERE/../..}
+B=$(mktemp -d)
+trap 'rm -rf "$B"' EXIT
+
+cp "$SRC/poll_sched.c" "$SRC/poll_sched.h" \
+   "$SRC/profiler.c" "$SRC/profiler.h" "$SRC/bus_trace.h" "$B/"
+cp -r "$HERE"/stubs/. "$B/"
+cp "$HERE/test_poll_sched.c" "$B/"
+
+# __ARM_ARCH=7 selects the system-timer tick source, which the test drives.
+gcc -std=gnu2x -Wall -Wextra -Wconversion -g -D__ARM_ARCH=7 \
+    -fsanitize=address,undefined -fno-sanitize-recover=all \
+    -I"$B" -o "$B/t" "$B/test_poll_sched.c" "$B/poll_sched.c" "$B/profiler.c"
+"$B/t"
+
+echo "POLL SCHED TESTS PASSED"
@@ -0,0 +1,37 @@
+/* Just what poll_sched.c and profiler.c need from the firmware's Pi1MHz.h. */
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+#define NOINIT_SECTION
+
+typedef void (*func_ptr)(void);
+
+void poll_test_log(const char *fmt, ...);
+#define LOG_INFO(...) poll_test_log(__VA_ARGS__)
+#define LOG_WARN(...) poll_test_log(__VA_ARGS__)
+
+#define PAGE_SIZE        0x100
+#define Pi1MHz_MEM_PAGE  (1<<8)
+#define Pi1MHz_MEM_RNW   (1<<9)
+
+extern uint8_t fx_register[256];
+extern uint32_t Pi1MHz_now_us;
+
+#define POLL_URGENT      0u
+#define POLL_NORMAL      1u
+#define POLL_BACKGROUND  2u
+
+void Pi1MHz_Register_Poll( func_ptr function_ptr );
+void Pi1MHz_Register_Poll_Sched( func_ptr function_ptr, uint8_t priority,
+                                 uint32_t period_us, uint32_t deadline_us );
+void Pi1MHz_Unregister_Poll( func_ptr function_ptr );
+
+#define POLL_EVENT_SCSI  (1u << 0)
+#define POLL_EVENT_NET   (1u << 1)
+#define POLL_EVENT_AUN   (1u << 2)
+extern volatile uint32_t Pi1MHz_poll_events;
+void Pi1MHz_Register_Poll_Event( func_ptr function_ptr, uint8_t priority,
+                                 uint32_t period_us, uint32_t events );
+static inline void Pi1MHz_Poll_Wake_FIQ(uint32_t events) { Pi1MHz_poll_events |= events; }
+void Pi1MHz_Poll_Wake(uint32_t events);
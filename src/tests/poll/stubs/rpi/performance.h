@@ -0,0 +1,7 @@
+#pragma once
+/* The cycle counter on the host is the test's: it runs at the simulated
+   clock, 1000 cycles a microsecond. */
+#define CYCLE_COUNTER_SCALE 1u
+unsigned int poll_test_cycles(void);
+static inline unsigned int read_cycle_counter(void) { return poll_test_cycles(); }
+static inline void start_cycle_counter(void) { }
@@ -0,0 +1,4 @@
+#pragma once
+#include <stdint.h>
+/* the test's simulated clock; see test_poll_sched.c */
+uint32_t RPI_GetSystemTime(void);
@@ -0,0 +1,423 @@
+/* Host tests for the idle-loop poll scheduler (poll_sched.c) and the
+ * profiler hooked into it (profiler.c).  The clock is simulated: each poller
+ * advances it by what it would cost on the Pi, so the gaps an audio refill
+ * sees behind slow network pollers can be measured exactly and compared with
+ * the flat every-poller-in-turn loop it replaced, and the profiler's cycle
+ * counts are known in advance.
+ */
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "Pi1MHz.h"
+#include "bus_trace.h"
+#include "poll_sched.h"
+#include "profiler.h"
+
+static unsigned int poll_test_logs;
+unsigned int poll_test_masks;
+void poll_test_log(const char *fmt, ...) { (void)fmt; poll_test_logs++; }
+
+static uint32_t sim_us;
+uint32_t RPI_GetSystemTime(void) { return sim_us; }
+unsigned int poll_test_cycles(void) { return sim_us * 1000u; }   /* 1 GHz */
+
+uint8_t fx_register[256];
+uint32_t Pi1MHz_now_us;
+
+/* what the profiler hands the FIQ side */
+static bus_trace_counts_t *fiq_counts;
+static unsigned int fiq_count_calls;
+void bus_trace_count(bus_trace_counts_t *counts)
+{
+   fiq_counts = counts;
+   fiq_count_calls++;
+}
+
+/* ---- pollers ---- */
+static char order[64];
+static unsigned int norder;
+
+static uint32_t audio_last, audio_max_gap;
+static unsigned int audio_calls, house_calls;
+
+static void note(char c)
+{
+   if (norder + 1u < sizeof order)
+      order[norder++] = c;
+   order[norder] = '\0';
+}
+
+static void audio(void)
+{
+   if (audio_calls++ != 0u && sim_us - audio_last > audio_max_gap)
+      audio_max_gap = sim_us - audio_last;
+   audio_last = sim_us;
+   note('a');
+   sim_us += 20u;
+}
+static void lwip(void)      { note('l'); sim_us += 3000u; }     /* a burst of frames */
+static void usb(void)       { note('u'); sim_us += 500u; }
+static void webserver(void) { note('w'); sim_us += 2500u; }     /* a FAT walk */
+static void house(void)     { note('h'); house_calls++; sim_us += 5u; }
+static void spin(void)      { sim_us += 3u; }                   /* an idle poller */
+
+/* an event-driven poller: counts runs, optionally leaves work behind */
+static unsigned int scsi_calls, scsi_rearm;
+static void scsi(void)
+{
+   note('s');
+   scsi_calls++;
+   if (scsi_rearm != 0u) {
+      scsi_rearm--;
+      Pi1MHz_Poll_Wake(POLL_EVENT_SCSI);
+   }
+   sim_us += 2u;
+}
+static unsigned int aun_calls;
+static void aun(void) { aun_calls++; sim_us += 2u; }
+
+static void passes(uint32_t until_us)
+{
+   norder = 0u;
+   order[0] = '\0';
+   while (sim_us < until_us) {
+      Pi1MHz_now_us = sim_us;
+      poll_sched_pass();
+   }
+}
+
+static void test_order(void)
+{
+   poll_sched_reset();
+   Pi1MHz_Register_Poll(lwip);
+   Pi1MHz_Register_Poll_Sched(house, POLL_BACKGROUND, 0u, 0u);
+   Pi1MHz_Register_Poll_Sched(audio, POLL_URGENT, 0u, 0u);
+   Pi1MHz_Register_Poll(usb);
+   assert(poll_sched_count() == 4u);
+   poll_sched_start();
+
+   norder = 0u;
+   poll_sched_pass();
+   assert(strcmp(order, "aluh") == 0);      /* class first, then registration order */
+   printf("priority order ok\n");
+}
+
+static void test_reregister(void)
+{
+   poll_sched_reset();
+   Pi1MHz_Register_Poll_Sched(audio, POLL_URGENT, 0u, 0u);
+   Pi1MHz_Register_Poll(lwip);
+   Pi1MHz_Register_Poll(lwip);
+   Pi1MHz_Register_Poll(audio);             /* plain registration keeps the class */
+   Pi1MHz_Register_Poll(NULL);
+   assert(poll_sched_count() == 2u);
+   poll_sched_start();
+   norder = 0u;
+   poll_sched_pass();
+   assert(strcmp(order, "al") == 0);
+
+   /* an explicit one replaces it */
+   Pi1MHz_Register_Poll_Sched(audio, POLL_BACKGROUND, 0u, 0u);
+   assert(poll_sched_count() == 2u);
+   norder = 0u;
+   poll_sched_pass();
+   assert(strcmp(order, "la") == 0);
+
+   /* and a reset forgets everything */
+   poll_sched_reset();
+   assert(poll_sched_count() == 0u);
+   norder = 0u;
+   poll_sched_pass();
+   assert(norder == 0u);
+   printf("re-registration ok\n");
+}
+
+#define N_FILL 26
+static unsigned int fill_calls[N_FILL];
+#define FILL(n) static void fill##n(void) { fill_calls[n]++; }
+FILL(0) FILL(1) FILL(2) FILL(3) FILL(4) FILL(5) FILL(6) FILL(7) FILL(8)
+FILL(9) FILL(10) FILL(11) FILL(12) FILL(13) FILL(14) FILL(15) FILL(16)
+FILL(17) FILL(18) FILL(19) FILL(20) FILL(21) FILL(22) FILL(23) FILL(24)
+FILL(25)
+static const func_ptr fills[N_FILL] = {
+   fill0, fill1, fill2, fill3, fill4, fill5, fill6, fill7, fill8, fill9,
+   fill10, fill11, fill12, fill13, fill14, fill15, fill16, fill17, fill18,
+   fill19, fill20, fill21, fill22, fill23, fill24, fill25,
+};
+
+static void test_table_full(void)
+{
+   poll_sched_reset();
+   poll_test_logs = 0u;
+   for (unsigned int i = 0; i < N_FILL; i++)
+      Pi1MHz_Register_Poll(fills[i]);
+   unsigned int n = poll_sched_count();
+   assert(n < N_FILL && poll_test_logs == N_FILL - n);
+
+   /* re-registering one already in a full table is not a new entry */
+   Pi1MHz_Register_Poll_Sched(fills[0], POLL_URGENT, 0u, 0u);
+   assert(poll_sched_count() == n && poll_test_logs == N_FILL - n);
+
+   poll_sched_start();
+   poll_sched_pass();
+   for (unsigned int i = 0; i < N_FILL; i++)
+      assert(fill_calls[i] == (i < n ? 1u : 0u));
+   printf("table full ok (%u entries)\n", n);
+}
+
+static void test_period(void)
+{
+   poll_sched_reset();
+   Pi1MHz_Register_Poll(usb);
+   Pi1MHz_Register_Poll_Sched(house, POLL_BACKGROUND, 250000u, 0u);
+   poll_sched_start();
+
+   /* due on the first pass, then at most once per 250 ms */
+   house_calls = 0u;
+   uint32_t t0 = sim_us;
+   poll_sched_pass();
+   assert(house_calls == 1u);
+   passes(t0 + 1000000u);
+   assert(house_calls == 4u);               /* t0, then ~250, ~500, ~750 ms */
+   printf("period rate-limit ok\n");
+}
+
+/* The same slow pass, scheduled flat (everything POLL_NORMAL, the old loop)
+   and with the audio refill urgent with a 2 ms deadline.  Returns the
+   longest gap between refills over a simulated second. */
+static uint32_t audio_gap(bool urgent)
+{
+   poll_sched_reset();
+   if (urgent)
+      Pi1MHz_Register_Poll_Sched(audio, POLL_URGENT, 0u, 2000u);
+   else
+      Pi1MHz_Register_Poll(audio);
+   Pi1MHz_Register_Poll(lwip);
+   Pi1MHz_Register_Poll(usb);
+   Pi1MHz_Register_Poll(webserver);
+   Pi1MHz_Register_Poll_Sched(house, POLL_BACKGROUND, 250000u, 0u);
+   poll_sched_start();
+
+   audio_calls = 0u;
+   audio_max_gap = 0u;
+   passes(sim_us + 1000000u);
+   return audio_max_gap;
+}
+
+static void test_deadline(void)
+{
+   uint32_t flat = audio_gap(false);
+   uint32_t sched = audio_gap(true);
+
+   printf("audio refill gap: flat %u us, scheduled %u us (half-buffer 4800 us)\n",
+          (unsigned int)flat, (unsigned int)sched);
+
+   /* flat, audio waits for the whole pass: 20 + 3000 + 500 + 2500 */
+   assert(flat >= 6000u);
+   /* scheduled, never longer than the deadline plus the slowest poller it
+      can be stuck behind, and inside the DMA half-buffer */
+   assert(sched <= 2000u + 3000u + 20u);
+   assert(sched < 4800u);
+   printf("deadline interleave ok\n");
+}
+
+static void test_events(void)
+{
+   poll_sched_reset();
+   Pi1MHz_poll_events = 0u;
+   Pi1MHz_Register_Poll(spin);
+   Pi1MHz_Register_Poll_Event(scsi, POLL_NORMAL, 0u, POLL_EVENT_SCSI);
+   Pi1MHz_Register_Poll_Event(aun, POLL_NORMAL, 1000u, POLL_EVENT_AUN);
+   poll_sched_start();
+
+   /* registration raises the event: each runs once, then sleeps */
+   scsi_calls = aun_calls = 0u;
+   poll_sched_pass();
+   assert(scsi_calls == 1u && aun_calls == 1u && Pi1MHz_poll_events == 0u);
+
+   /* idle passes cost neither a call nor an interrupt mask */
+   unsigned int masks = poll_test_masks;
+   for (unsigned int i = 0; i < 100u; i++)
+      poll_sched_pass();
+   assert(scsi_calls == 1u && aun_calls == 1u && poll_test_masks == masks);
+
+   /* a FIQ raise runs it on the next pass, once */
+   Pi1MHz_Poll_Wake_FIQ(POLL_EVENT_SCSI);
+   poll_sched_pass();
+   poll_sched_pass();
+   assert(scsi_calls == 2u && aun_calls == 1u);
+
+   /* a poller that leaves work raises its own event and comes back */
+   scsi_rearm = 3u;
+   Pi1MHz_Poll_Wake(POLL_EVENT_SCSI);
+   for (unsigned int i = 0; i < 10u; i++)
+      poll_sched_pass();
+   assert(scsi_calls == 2u + 4u && Pi1MHz_poll_events == 0u);
+
+   /* the period is a timeout: ~once a millisecond with no event at all */
+   aun_calls = 0u;
+   passes(sim_us + 100000u);
+   assert(aun_calls >= 95u && aun_calls <= 101u);
+   assert(scsi_calls == 6u);
+
+   /* a BBC RST forgets the pollers, not the events raised for them */
+   Pi1MHz_Poll_Wake_FIQ(POLL_EVENT_SCSI);
+   poll_sched_reset();
+   assert(Pi1MHz_poll_events == POLL_EVENT_SCSI);
+   Pi1MHz_Register_Poll_Event(scsi, POLL_NORMAL, 0u, POLL_EVENT_SCSI);
+   poll_sched_pass();
+   assert(scsi_calls == 7u && Pi1MHz_poll_events == 0u);
+   printf("event wake ok\n");
+}
+
+/* A deferred-init runner: each call starts one more poller, and once they
+   are all up it takes itself out - registering and unregistering from
+   inside a pass, which shifts the table under it. */
+static const func_ptr staged[] = { usb, lwip, house };
+static unsigned int staged_next, starter_calls;
+static void starter(void)
+{
+   starter_calls++;
+   if (staged_next < sizeof staged / sizeof staged[0]) {
+      Pi1MHz_Register_Poll_Sched(staged[staged_next],
+                                 (uint8_t)(staged[staged_next] == house ? POLL_URGENT : POLL_NORMAL),
+                                 0u, 0u);
+      staged_next++;
+   }
+   if (staged_next == sizeof staged / sizeof staged[0])
+      Pi1MHz_Unregister_Poll(starter);
+}
+
+static void test_staged(void)
+{
+   poll_sched_reset();
+   Pi1MHz_Register_Poll_Sched(audio, POLL_URGENT, 0u, 0u);
+   Pi1MHz_Register_Poll_Sched(starter, POLL_BACKGROUND, 0u, 0u);
+   Pi1MHz_Register_Poll(spin);
+   poll_sched_start();
+
+   /* each pass stops where the table changed; nothing runs twice */
+   norder = 0u;
+   poll_sched_pass();
+   assert(strcmp(order, "a") == 0 && starter_calls == 1u);
+   poll_sched_pass();
+   assert(strcmp(order, "aau") == 0 && starter_calls == 2u);
+   poll_sched_pass();
+   assert(strcmp(order, "aauaul") == 0 && starter_calls == 3u);
+   /* house went in ahead of audio's pass position and the starter is gone */
+   assert(poll_sched_count() == 5u);
+   norder = 0u;
+   poll_sched_pass();
+   poll_sched_pass();
+   assert(strcmp(order, "ahulahul") == 0 && starter_calls == 3u);
+
+   /* taking out one that is not there changes nothing */
+   Pi1MHz_Unregister_Poll(starter);
+   Pi1MHz_Unregister_Poll(usb);
+   assert(poll_sched_count() == 4u);
+   norder = 0u;
+   poll_sched_pass();
+   assert(strcmp(order, "ahl") == 0);
+   printf("staged registration ok\n");
+}
+
+#define PROF_FX 15u
+#define READ_FRED_SLOT (Pi1MHz_MEM_RNW | 0x40u)      /* reads of &FC40 on */
+
+/* Whether the report line starting with `start` contains `want`. */
+static bool line_has(const char *text, const char *start, const char *want)
+{
+   const char *l = strstr(text, start);
+   if (l == NULL)
+      return false;
+   const char *end = strchr(l + 1, '\n');
+   const char *w = strstr(l, want);
+   return w != NULL && (end == NULL || w < end);
+}
+
+static void test_profiler(void)
+{
+   static char text[8192];
+
+   poll_sched_reset();
+   Pi1MHz_poll_events = 0u;
+   Pi1MHz_Register_Poll_Sched(audio, POLL_URGENT, 0u, 0u);
+   Pi1MHz_Register_Poll(lwip);
+   memset(fx_register, 0xA5, sizeof fx_register);     /* NOINIT at power-on */
+   profiler_init(PROF_FX, 0u);
+   poll_sched_start();
+
+   /* off until asked, whatever the fx register held */
+   assert(fx_register[PROF_FX] == 0u);
+   passes(sim_us + 200000u);
+   assert(!profiler_on && fiq_count_calls == 0u);
+   profiler_status_text(text, sizeof text);
+   assert(strstr(text, "profiler     off") != NULL);
+   assert(strstr(text, "no readings yet") != NULL);
+
+   /* *FX147,202,15 : *FX147,203,1 - on within the profiler's period */
+   fx_register[PROF_FX] = 1u;
+   passes(sim_us + 101000u);
+   assert(profiler_on && fiq_counts != NULL);
+
+   /* the FIQ side: twenty slots, each busier than the last */
+   for (unsigned int s = 0; s < 20u; s++) {
+      fiq_counts->calls[READ_FRED_SLOT + s] = 100u + s;
+      fiq_counts->cycles[READ_FRED_SLOT + s] = (100u + s) * 80u;
+   }
+   bus_trace_counts_t *filled = fiq_counts;
+
+   /* a whole window later it is the reading, and the FIQ has a fresh one */
+   passes(sim_us + 1000000u);
+   assert(fiq_counts != filled);
+   assert(fiq_counts->calls[READ_FRED_SLOT + 19u] == 0u);
+   profiler_status_text(text, sizeof text);
+   printf("%s", text);
+   assert(strstr(text, "profiler     on") != NULL);
+   assert(strstr(text, "3020000 in pollers, 0 loop overhead") != NULL);  /* every cycle accounted for */
+   /* audio is 20 us (20000 cycles), lwip 3 ms */
+   assert(line_has(text, "\n  0 ", "    20000    20000  16384+:"));
+   assert(line_has(text, "\n  1 ", "  3000000  3000000  2097152+:"));
+   /* busiest first, top sixteen only */
+   const char *top = strstr(text, "busiest slots:\n");
+   assert(top != NULL);
+   assert(strstr(top, "R &FC53       119  avg 80 cycles") != NULL);
+   assert(strstr(top, "&FC53") < strstr(top, "&FC52"));
+   assert(strstr(top, "&FC44") != NULL && strstr(top, "&FC43") == NULL);
+
+   /* the web switch moves the fx register with it, and off hands the FIQ
+      side nothing to count into */
+   profiler_set(false);
+   assert(!profiler_on && fiq_counts == NULL && fx_register[PROF_FX] == 0u);
+   profiler_status_text(text, sizeof text);
+   assert(strstr(text, "profiler     off") != NULL && strstr(text, "window") != NULL);
+   profiler_set(true);
+   assert(profiler_on && fiq_counts != NULL && fx_register[PROF_FX] == 1u);
+
+   /* a BBC RST keeps it running */
+   poll_sched_reset();
+   Pi1MHz_Register_Poll(lwip);
+   profiler_init(PROF_FX, 0u);
+   assert(profiler_on && fx_register[PROF_FX] == 1u);
+
+   /* and *FX147,203,0 switches it off */
+   fx_register[PROF_FX] = 0u;
+   poll_sched_start();
+   passes(sim_us + 101000u);
+   assert(!profiler_on && fiq_counts == NULL);
+   printf("profiler ok\n");
+}
+
+int main(void)
+{
+   test_order();
+   test_reregister();
+   test_table_full();
+   test_period();
+   test_deadline();
+   test_events();
+   test_staged();
+   test_profiler();
+   return 0;
+}
@@ -0,0 +1,80 @@
+#!/bin/sh -e
+# Host tests of the BeebSCSI sector cache (sectorcache.c) over LUN images in
+# memory, of the write-back cache (writecache.c) against a model of the
+# card, of sparse LUN images and overlays (sparselun.c) and
+# tools/sparse_lun.py, and of packed LUN images (packedlun.c) and
+# tools/pack_lun.py, under ASan/UBSan.
+HERE=$(cd "$(dirname "$0")" && pwd)
+SRC=${SRC_DIR:-$HERE/../..}
+TOOLS=${TOOLS_DIR:-$SRC/../tools}
+B=$(mktemp -d)
+trap 'rm -rf "$B"' EXIT
+
+mkdir -p "$B/BeebSCSI"
+cp "$SRC"/config.h "$B/"
+cp "$SRC"/BeebSCSI/sectorcache.c "$SRC"/BeebSCSI/sectorcache.h "$SRC"/BeebSCSI/writecache.c "$SRC"/BeebSCSI/writecache.h \
+   "$SRC"/BeebSCSI/sparselun.c "$SRC"/BeebSCSI/sparselun.h "$SRC"/BeebSCSI/packedlun.c "$SRC"/BeebSCSI/packedlun.h \
+   "$SRC"/BeebSCSI/filesystem.h "$B/BeebSCSI/"
+cp "$SRC"/lz4_block.c "$SRC"/lz4_block.h "$B/"
+cp "$HERE"/test_sector_cache.c "$HERE"/test_write_cache.c "$HERE"/test_sparse_lun.c "$HERE"/test_packed_lun.c "$B/"
+
+echo "== sector cache =="
+gcc -std=gnu2x -Wall -Wextra -Wconversion -g \
+    -fsanitize=address,undefined -fno-sanitize-recover=all \
+    -I"$B" -o "$B/t" "$B/test_sector_cache.c" "$B/BeebSCSI/sectorcache.c"
+"$B/t"
+"$B/t" off
+
+echo "== write-back cache =="
+gcc -std=gnu2x -Wall -Wextra -Wconversion -g \
+    -fsanitize=address,undefined -fno-sanitize-recover=all \
+    -I"$B" -o "$B/w" "$B/test_write_cache.c" "$B/BeebSCSI/writecache.c"
+"$B/w"
+"$B/w" off
+
+echo "== sparse LUN images =="
+gcc -std=gnu2x -Wall -Wextra -Wconversion -g \
+    -fsanitize=address,undefined -fno-sanitize-recover=all \
+    -I"$B" -o "$B/s" "$B/test_sparse_lun.c" "$B/BeebSCSI/sparselun.c"
+"$B/s"
+if command -v python3 >/dev/null; then
+   # a disc that is mostly empty, with a short last block: flat -> sparse
+   # -> flat must give it back, and sparselun.c must read it the same
+   head -c 200000 /dev/urandom > "$B/flat.dat"
+   head -c 400000 /dev/zero >> "$B/flat.dat"
+   head -c 168000 /dev/urandom >> "$B/flat.dat"
+   python3 "$TOOLS"/sparse_lun.py "$B/flat.dat" "$B/sparse.dat"
+   python3 "$TOOLS"/sparse_lun.py --flat "$B/sparse.dat" "$B/back.dat"
+   cmp "$B/flat.dat" "$B/back.dat"
+   test "$(wc -c < "$B/sparse.dat")" -lt "$(wc -c < "$B/flat.dat")"
+   "$B/s" "$B/sparse.dat" "$B/flat.dat"
+fi
+
+echo "== packed LUN images =="
+gcc -std=gnu2x -Wall -Wextra -Wconversion -g \
+    -fsanitize=address,undefined -fno-sanitize-recover=all \
+    -I"$B" -o "$B/p" "$B/test_packed_lun.c" "$B/BeebSCSI/packedlun.c" "$B/lz4_block.c"
+"$B/p"
+if command -v python3 >/dev/null; then
+   # text, a run of zeros and noise, with a short last chunk: flat ->
+   # packed -> flat must give it back, and packedlun.c must read it the same
+   python3 -c 'import random, sys; random.seed(5); w = "the survey of the village map".split()
+sys.stdout.write(" ".join(random.choice(w) for _ in range(80000))[:307200])' > "$B/flat.dat"
+   head -c 102400 /dev/zero >> "$B/flat.dat"
+   head -c 70400 /dev/urandom >> "$B/flat.dat"
+   head -c 79872 "$B/flat.dat" >> "$B/flat.dat"
+   python3 "$TOOLS"/pack_lun.py "$B/flat.dat" "$B/packed.dat"
+   python3 "$TOOLS"/pack_lun.py --verify "$B/packed.dat" "$B/flat.dat"
+   python3 "$TOOLS"/pack_lun.py --flat "$B/packed.dat" "$B/back.dat"
+   cmp "$B/flat.dat" "$B/back.dat"
+   test "$(wc -c < "$B/packed.dat")" -lt "$(wc -c < "$B/flat.dat")"
+   "$B/p" "$B/packed.dat" "$B/flat.dat"
+   python3 "$TOOLS"/pack_lun.py --chunk 16 "$B/flat.dat" "$B/packed16.dat"
+   python3 "$TOOLS"/pack_lun.py --verify "$B/packed16.dat" "$B/flat.dat"
+   "$B/p" "$B/packed16.dat" "$B/flat.dat"
+   # a damaged chunk is found
+   printf 'XXXXXXXX' | dd of="$B/packed.dat" bs=1 seek=2000 conv=notrunc 2>/dev/null
+   if python3 "$TOOLS"/pack_lun.py --verify "$B/packed.dat" "$B/flat.dat" 2>/dev/null; then exit 1; fi
+fi
+
+echo "SCSI TESTS PASSED"
@@ -0,0 +1,335 @@
+/* Host test of BeebSCSI packed LUN images (packedlun.c) on image files held
+   in memory, packed here with lz4_block.c: every sector reads back as the
+   disc, the short last chunk and one held as it is too, reads past the
+   end of the disc are zeros, a chunk read through a sector at a time is
+   read off the card once, chunks of every size read the same, and a
+   damaged image or chunk is refused.  Given
+   a packed image and the flat image it was made from, it checks the two
+   read the same - which is how run.sh checks the images
+   tools/pack_lun.py makes. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "BeebSCSI/packedlun.h"
+#include "lz4_block.h"
+
+static int failures, checks;
+#define CHECK(c) do { checks++; if (!(c)) { failures++; \
+   printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #c); } } while (0)
+
+#define DISC_SECTORS 1300u               // 6 chunks, the last one short
+#define FILE_MAX     (2u * 1024u * 1024u)
+#define LUNS         2u
+
+static uint8_t *file[LUNS];
+static uint32_t file_size[LUNS];
+static unsigned int reads;
+static uint8_t disc[LUNS][DISC_SECTORS * 256u];
+
+static bool file_read(uint8_t lun, uint32_t offset, uint8_t *buffer, uint32_t length)
+{
+   uint32_t n = length;
+
+   CHECK(lun < LUNS);
+   reads++;
+   if (offset + n > file_size[lun])
+      n = offset < file_size[lun] ? file_size[lun] - offset : 0u;
+   memcpy(buffer, file[lun] + offset, n);
+   memset(buffer + n, 0, length - n);
+   return true;
+}
+
+static void put32(uint8_t *p, uint32_t v)
+{
+   p[0] = (uint8_t)v;
+   p[1] = (uint8_t)(v >> 8);
+   p[2] = (uint8_t)(v >> 16);
+   p[3] = (uint8_t)(v >> 24);
+}
+
+static uint32_t get32(const uint8_t *p)
+{
+   return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+// Pack a LUN's disc as tools/pack_lun.py does, in chunks of chunkSectors;
+// a chunk that does not get smaller is held as it is
+static void pack(uint8_t lun, uint32_t sectors, uint32_t chunkSectors)
+{
+   static uint8_t comp[LZ4_BLOCK_BOUND(PACKED_LUN_CHUNK_SIZE)];
+   uint32_t chunks = (sectors + chunkSectors - 1u) / chunkSectors;
+   uint32_t offset = (PACKED_LUN_HEADER_SIZE + chunks * 8u + 511u) / 512u * 512u;
+   uint8_t *f = file[lun];
+
+   memset(f, 0, FILE_MAX);
+   memcpy(f, "BSCSILZ4", 8);
+   put32(f + 8, 1u);
+   put32(f + 12, chunkSectors);
+   put32(f + 16, sectors);
+   for (uint32_t c = 0; c < chunks; c++) {
+      const uint8_t *chunk = disc[lun] + c * chunkSectors * 256u;
+      uint32_t bytes = (sectors - c * chunkSectors) * 256u;
+      size_t n;
+
+      if (bytes > chunkSectors * 256u)
+         bytes = chunkSectors * 256u;
+      n = lz4_compress_block(chunk, bytes, comp, bytes - 1u);
+      if (n == 0u) {
+         memcpy(f + offset, chunk, bytes);
+         n = bytes;
+      } else
+         memcpy(f + offset, comp, n);
+      put32(f + PACKED_LUN_HEADER_SIZE + c * 8u, offset);
+      put32(f + PACKED_LUN_HEADER_SIZE + c * 8u + 4u, (uint32_t)n);
+      offset += ((uint32_t)n + 511u) / 512u * 512u;
+   }
+   file_size[lun] = offset;
+}
+
+// Text, runs of one byte, and a chunk of noise that will not compress
+static void make_disc(uint8_t lun)
+{
+   static const char *const words[] = { "the ", "Domesday ", "survey ", "of ", "village ", "map ", "school " };
+   uint32_t seed = 77u + lun;
+   uint32_t i = 0;
+
+   while (i < sizeof disc[lun]) {
+      const char *w;
+
+      seed = seed * 1103515245u + 12345u;
+      w = words[(seed >> 16) % 7u];
+      for (; *w != '\0' && i < sizeof disc[lun]; w++)
+         disc[lun][i++] = (uint8_t)*w;
+   }
+   memset(disc[lun] + 300u * 256u, 0, 100u * 256u);
+   for (i = 2u * PACKED_LUN_CHUNK_SIZE; i < 3u * PACKED_LUN_CHUNK_SIZE; i++) {
+      seed = seed * 1103515245u + 12345u;
+      disc[lun][i] = (uint8_t)(seed >> 16);
+   }
+}
+
+static bool reads_as_disc(uint8_t lun, uint32_t first, uint32_t sectors)
+{
+   static uint8_t buffer[DISC_SECTORS * 256u];
+
+   return packedLunRead(lun, first, buffer, sectors)
+          && memcmp(buffer, disc[lun] + first * 256u, sectors * 256u) == 0;
+}
+
+static uint32_t chunk_length(uint8_t lun, uint32_t chunk)
+{
+   return get32(file[lun] + PACKED_LUN_HEADER_SIZE + chunk * 8u + 4u);
+}
+
+static void test_read(void)
+{
+   struct packedLunStats stats;
+
+   make_disc(0);
+   pack(0, DISC_SECTORS, PACKED_LUN_CHUNK_SECTORS);
+   CHECK(file_size[0] < sizeof disc[0] / 2u);
+   CHECK(chunk_length(0, 2u) == PACKED_LUN_CHUNK_SIZE);     // the noise
+   CHECK(chunk_length(0, 1u) < PACKED_LUN_CHUNK_SIZE / 4u); // the text
+   CHECK(packedLunOpen(0, file_size[0]));
+   CHECK(packedLunIsPacked(0));
+   CHECK(packedLunSectors(0) == DISC_SECTORS);
+
+   // all of it in one go, then every sector on its own
+   CHECK(reads_as_disc(0, 0u, DISC_SECTORS));
+   for (uint32_t s = 0; s < DISC_SECTORS; s++)
+      CHECK(reads_as_disc(0, s, 1u));
+   // across a chunk boundary, and the short last chunk
+   CHECK(reads_as_disc(0, 250u, 20u));
+   CHECK(reads_as_disc(0, DISC_SECTORS - 30u, 30u));
+
+   // past the end of the disc is zeros, as a short flat image reads
+   {
+      uint8_t buffer[4u * 256u];
+
+      memset(buffer, 0xAA, sizeof buffer);
+      CHECK(packedLunRead(0, DISC_SECTORS - 2u, buffer, 4u));
+      CHECK(memcmp(buffer, disc[0] + (DISC_SECTORS - 2u) * 256u, 512u) == 0);
+      for (uint32_t i = 512u; i < sizeof buffer; i++)
+         CHECK(buffer[i] == 0u);
+   }
+
+   // a chunk read through a sector at a time is one read of the card
+   packedLunClose(0);
+   CHECK(packedLunOpen(0, file_size[0]));
+   reads = 0;
+   for (uint32_t s = 512u; s < 768u; s++)
+      CHECK(reads_as_disc(0, s, 1u));
+   CHECK(reads == 1u);
+   packedLunGetStats(0, &stats);
+   CHECK(stats.chunks == 6u && stats.reads == 1u && stats.hits == 255u);
+}
+
+static void test_slots(void)
+{
+   // the slots are shared: two LUNs read turn about keep theirs, and a
+   // fifth chunk pushes out the one used longest ago
+   make_disc(1);
+   pack(1, DISC_SECTORS, PACKED_LUN_CHUNK_SECTORS);
+   CHECK(packedLunOpen(1, file_size[1]));
+   CHECK(reads_as_disc(0, 0u, 1u) && reads_as_disc(1, 0u, 1u));
+   reads = 0;
+   for (int i = 0; i < 10; i++)
+      CHECK(reads_as_disc(0, 10u, 1u) && reads_as_disc(1, 10u, 1u));
+   CHECK(reads == 0u);
+   CHECK(reads_as_disc(0, 256u, 1u) && reads_as_disc(0, 512u, 1u) && reads_as_disc(0, 768u, 1u));
+   reads = 0;
+   CHECK(reads_as_disc(1, 0u, 1u));
+   CHECK(reads == 0u);
+   CHECK(reads_as_disc(0, 0u, 1u));
+   CHECK(reads == 1u);
+
+   // a LUN closed leaves nothing behind for the image opened next: the
+   // same chunk of a new disc is read from the card
+   packedLunClose(1);
+   memset(disc[1], 0x42, sizeof disc[1]);
+   pack(1, DISC_SECTORS, PACKED_LUN_CHUNK_SECTORS);
+   CHECK(packedLunOpen(1, file_size[1]));
+   CHECK(reads_as_disc(1, 0u, DISC_SECTORS));
+   packedLunClose(1);
+   CHECK(!packedLunIsPacked(1));
+   CHECK(packedLunIsPacked(0));
+}
+
+static void test_bad_images(void)
+{
+   static uint8_t saved[FILE_MAX];
+   uint32_t size = file_size[0];
+   uint32_t offset;
+
+   packedLunClose(0);
+   memcpy(saved, file[0], FILE_MAX);
+
+   // a flat image is left alone
+   memcpy(file[0], "BSCSIFLT", 8);
+   CHECK(packedLunOpen(0, size));
+   CHECK(!packedLunIsPacked(0));
+   CHECK(packedLunOpen(0, 100u));
+   CHECK(!packedLunIsPacked(0));
+   memcpy(file[0], saved, FILE_MAX);
+
+   // an unknown version or chunk size, no sectors, too many
+   file[0][8] = 2u;
+   CHECK(!packedLunOpen(0, size));
+   memcpy(file[0], saved, FILE_MAX);
+   file[0][12] = 128u;
+   CHECK(!packedLunOpen(0, size));
+   memcpy(file[0], saved, FILE_MAX);
+   put32(file[0] + 16, 0u);
+   CHECK(!packedLunOpen(0, size));
+   put32(file[0] + 16, (1u << 21) + 1u);
+   CHECK(!packedLunOpen(0, size));
+   memcpy(file[0], saved, FILE_MAX);
+
+   // the index cut short, a chunk past the end of the file or over the
+   // index, one longer than a chunk, one of no length
+   CHECK(!packedLunOpen(0, PACKED_LUN_HEADER_SIZE + 8u));
+   CHECK(!packedLunOpen(0, get32(file[0] + PACKED_LUN_HEADER_SIZE + 40u) + chunk_length(0, 5u) - 1u));
+   put32(file[0] + PACKED_LUN_HEADER_SIZE, 0u);
+   CHECK(!packedLunOpen(0, size));
+   memcpy(file[0], saved, FILE_MAX);
+   put32(file[0] + PACKED_LUN_HEADER_SIZE + 4u, PACKED_LUN_CHUNK_SIZE + 1u);
+   CHECK(!packedLunOpen(0, size));
+   put32(file[0] + PACKED_LUN_HEADER_SIZE + 4u, 0u);
+   CHECK(!packedLunOpen(0, size));
+   CHECK(!packedLunIsPacked(0));
+   memcpy(file[0], saved, FILE_MAX);
+
+   // a chunk that does not unpack to its size opens, but will not read;
+   // the chunks around it still do
+   offset = get32(file[0] + PACKED_LUN_HEADER_SIZE + 8u);
+   file[0][offset + chunk_length(0, 1u) - 1u] ^= 0xFFu;
+   put32(file[0] + PACKED_LUN_HEADER_SIZE + 12u, chunk_length(0, 1u) - 6u);
+   CHECK(packedLunOpen(0, size));
+   CHECK(!reads_as_disc(0, 256u, 1u));
+   CHECK(!reads_as_disc(0, 256u, 1u));
+   CHECK(reads_as_disc(0, 0u, 256u));
+   CHECK(reads_as_disc(0, 512u, 256u));
+   memcpy(file[0], saved, FILE_MAX);
+   CHECK(packedLunOpen(0, size));
+   CHECK(reads_as_disc(0, 0u, DISC_SECTORS));
+}
+
+static void test_chunk_sizes(void)
+{
+   // smaller chunks: a sector on its own costs less of the card
+   packedLunClose(0);
+   pack(0, DISC_SECTORS, PACKED_LUN_CHUNK_SECTORS_MIN);
+   CHECK(packedLunOpen(0, file_size[0]));
+   CHECK(reads_as_disc(0, 0u, DISC_SECTORS));
+   for (uint32_t s = 0; s + 9u <= DISC_SECTORS; s += 7u)
+      CHECK(reads_as_disc(0, s, 9u));
+   CHECK(reads_as_disc(0, DISC_SECTORS - 3u, 3u));
+   packedLunClose(0);
+   pack(0, DISC_SECTORS, 128u);
+   CHECK(packedLunOpen(0, file_size[0]));
+   CHECK(reads_as_disc(0, 0u, DISC_SECTORS));
+
+   // but not too small, too big, or not a power of two
+   packedLunClose(0);
+   put32(file[0] + 12, PACKED_LUN_CHUNK_SECTORS_MIN / 2u);
+   CHECK(!packedLunOpen(0, file_size[0]));
+   put32(file[0] + 12, PACKED_LUN_CHUNK_SECTORS * 2u);
+   CHECK(!packedLunOpen(0, file_size[0]));
+   put32(file[0] + 12, 100u);
+   CHECK(!packedLunOpen(0, file_size[0]));
+   CHECK(!packedLunIsPacked(0));
+}
+
+// A packed image made elsewhere against the flat image it came from
+static int compare_files(const char *packed_name, const char *flat_name)
+{
+   FILE *f = fopen(packed_name, "rb"), *g = fopen(flat_name, "rb");
+   static uint8_t flat[FILE_MAX];
+   size_t flat_size;
+
+   CHECK(f != NULL && g != NULL);
+   if (f == NULL || g == NULL)
+      return 1;
+   file_size[0] = (uint32_t)fread(file[0], 1, FILE_MAX, f);
+   flat_size = fread(flat, 1, sizeof flat, g);
+   fclose(f);
+   fclose(g);
+
+   CHECK(packedLunOpen(0, file_size[0]));
+   CHECK(packedLunIsPacked(0));
+   CHECK(packedLunSectors(0) * 256u == flat_size);
+   if (packedLunSectors(0) * 256u == flat_size) {
+      static uint8_t buffer[FILE_MAX];
+
+      CHECK(packedLunRead(0, 0u, buffer, packedLunSectors(0)));
+      CHECK(memcmp(buffer, flat, flat_size) == 0);
+   }
+   printf("%d checks, %d failures\n", checks, failures);
+   return failures != 0;
+}
+
+int main(int argc, char **argv)
+{
+   int r;
+
+   for (uint32_t l = 0; l < LUNS; l++)
+      file[l] = calloc(FILE_MAX, 1);
+   packedLunInitialise(file_read);
+   if (argc > 2)
+      r = compare_files(argv[1], argv[2]);
+   else {
+      test_read();
+      test_slots();
+      test_bad_images();
+      test_chunk_sizes();
+      printf("%d checks, %d failures\n", checks, failures);
+      r = failures != 0;
+   }
+
+   for (uint8_t l = 0; l < LUNS; l++) {
+      packedLunClose(l);
+      free(file[l]);
+   }
+   return r;
+}
@@ -0,0 +1,250 @@
+/* Host test of the BeebSCSI sector cache (sectorcache.c) over LUN images
+   held in memory, read as filesystem.c reads them: what comes back is always the image, hits and misses are
+   counted as they happen, a sequential stream is read ahead of and then
+   let go, and writes, invalidation and the end of the image are honoured.
+   With "off" it checks that scsi_cache 0 turns the cache off. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "BeebSCSI/sectorcache.h"
+#include "config.h"
+
+static int failures, checks;
+#define CHECK(c) do { checks++; if (!(c)) { failures++; \
+   printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #c); } } while (0)
+
+#define IMAGE_SECTORS 8192u            // 2 MB
+
+static const char *cache_size = "128K";  // 32 blocks
+static unsigned int reads;
+static bool read_fails;
+
+struct image
+{
+   uint8_t *data;
+   uint32_t size;                      // bytes; past it reads as zeros
+};
+
+const char *config_get(const char *key)
+{
+   return strcmp(key, "scsi_cache") == 0 ? cache_size : NULL;
+}
+
+static struct image lun[2];
+
+static bool image_read(uint8_t l, uint32_t first, uint8_t *buffer, uint32_t sectors)
+{
+   uint32_t pos = first * 256u, n = sectors * 256u;
+
+   CHECK(pos < lun[l].size);           // the cache never asks past the end
+   reads++;
+   if (read_fails)
+      return false;
+   if (pos + n > lun[l].size)
+      n = pos < lun[l].size ? lun[l].size - pos : 0u;
+   memcpy(buffer, lun[l].data + pos, n);
+   memset(buffer + n, 0, sectors * 256u - n);
+   return true;
+}
+
+static uint32_t image_sectors(uint8_t l)
+{
+   return (lun[l].size + 255u) / 256u;
+}
+static uint8_t bounce[16384];          // filesystem.c lends its sector buffer
+
+static void make_image(uint8_t l, uint32_t sectors)
+{
+   lun[l].data = malloc((size_t)IMAGE_SECTORS * 256u);
+   for (uint32_t s = 0; s < IMAGE_SECTORS; s++)
+      for (uint32_t i = 0; i < 256u; i++)
+         lun[l].data[s * 256u + i] = (uint8_t)(s * 7u + i + l * 101u);
+   lun[l].size = sectors * 256u;
+}
+
+/* Read sectors from start as scsi.c does, checking them against the image
+   (zeros past its end).  The number of f_reads it took. */
+static unsigned int read_run(uint8_t l, uint32_t start, uint32_t sectors)
+{
+   unsigned int before = reads;
+
+   sectorCacheOpenRead(l, image_sectors(l), start, sectors);
+   for (uint32_t s = start; s < start + sectors; s++) {
+      uint8_t *p = NULL, zero[256] = { 0 };
+
+      CHECK(sectorCacheReadNext(l, &p));
+      if (p == NULL)
+         return reads - before;
+      if (s * 256u < lun[l].size)
+         CHECK(memcmp(p, lun[l].data + s * 256u, 256u) == 0);
+      else
+         CHECK(memcmp(p, zero, 256u) == 0);
+   }
+   return reads - before;
+}
+
+static struct sectorCacheStats stats(uint8_t l)
+{
+   struct sectorCacheStats s;
+
+   sectorCacheGetStats(l, &s);
+   return s;
+}
+
+static void test_hits(void)
+{
+   struct sectorCacheStats s0 = stats(0), s;
+
+   // one block goes straight into the cache, not through the bounce buffer
+   memset(bounce, 0xA5, sizeof bounce);
+   CHECK(read_run(0, 100u, 1u) == 1u);
+   CHECK(bounce[0] == 0xA5u && bounce[sizeof bounce - 1u] == 0xA5u);
+   s = stats(0);
+   CHECK(s.misses == s0.misses + 1u && s.hits == s0.hits);
+   CHECK(read_run(0, 100u, 1u) == 0u);
+   CHECK(read_run(0, 96u, 16u) == 0u);    // the rest of the block came too
+   s = stats(0);
+   CHECK(s.hits == s0.hits + 17u);
+
+   // a request over several blocks is one f_read, not one per block
+   CHECK(read_run(0, 2010u, 40u) == 1u);
+   CHECK(memcmp(bounce, lun[0].data + 2000u * 256u, sizeof bounce) == 0);
+   CHECK(read_run(0, 2000u, 64u) == 0u);
+
+   // the same sector of another LUN is another block
+   CHECK(read_run(1, 100u, 1u) == 1u);
+   CHECK(read_run(0, 100u, 1u) == 0u);
+}
+
+static void test_stream(void)
+{
+   struct sectorCacheStats s0 = stats(0), s;
+   unsigned int n = 0;
+
+   // a *LOAD-sized stream 16 sectors at a time: read ahead after the first
+   // couple, so most commands find their sectors already there, and the
+   // card is read a bounce buffer at a time
+   for (uint32_t i = 0; i < 64u; i++)
+      n += read_run(0, 4096u + i * 16u, 16u);
+   s = stats(0);
+   CHECK(n <= 64u / (sizeof bounce / SECTOR_CACHE_BLOCK_SIZE) + 2u);
+   CHECK(s.readAhead > s0.readAhead);
+   CHECK(s.readAheadUsed > s0.readAheadUsed);
+   CHECK(s.hits - s0.hits >= 2u * (s.misses - s0.misses));
+
+   // a jump elsewhere is not read ahead of
+   s0 = stats(0);
+   CHECK(read_run(0, 7000u, 16u) == 1u);
+   CHECK(stats(0).readAhead == s0.readAhead);
+}
+
+static void test_scan(void)
+{
+   // the catalogue, read now and then; a stream four times the size of the
+   // cache must not push it out
+   read_run(0, 0u, 8u);
+   read_run(0, 0u, 8u);
+   for (uint32_t i = 0; i < 128u; i++)
+      read_run(0, 1024u + i * 16u, 16u);
+   CHECK(read_run(0, 0u, 8u) == 0u);
+}
+
+static void test_lru(void)
+{
+   sectorCacheInvalidateLun(0);
+   // 40 scattered blocks through a 32-block cache: the oldest are gone,
+   // the newest still there
+   for (uint32_t b = 0; b < 40u; b++)
+      CHECK(read_run(0, b * 160u, 1u) == 1u);
+   CHECK(read_run(0, 39u * 160u, 1u) == 0u);
+   CHECK(read_run(0, 30u * 160u, 1u) == 0u);
+   CHECK(read_run(0, 0u, 1u) == 1u);
+}
+
+static void test_write(void)
+{
+   uint8_t sectors[3 * 256];
+
+   read_run(0, 300u, 16u);
+   // the host writes three sectors over a block boundary, one of them
+   // cached: the image changes and the cache is told
+   memset(sectors, 0x5A, sizeof sectors);
+   memcpy(lun[0].data + 303u * 256u, sectors, sizeof sectors);
+   sectorCacheWrite(0, 303u, sectors, 3u);
+   CHECK(read_run(0, 300u, 16u) == 0u);
+   CHECK(read_run(0, 303u, 3u) == 0u);
+
+   // changed behind its back, it is only right once it has been dropped
+   lun[0].data[300u * 256u] ^= 0xFFu;
+   sectorCacheInvalidateLun(0);
+   CHECK(read_run(0, 300u, 1u) == 1u);
+}
+
+static void test_end(void)
+{
+   uint32_t size = 1000u;               // a growing image, 1000 sectors so far
+   struct sectorCacheStats s0;
+
+   lun[1].size = size * 256u;
+   sectorCacheInvalidateLun(1);
+
+   // over the end: the sectors past it are zeros
+   read_run(1, 990u, 20u);
+   CHECK(read_run(1, 1500u, 16u) == 0u);  // all past it: no card at all
+
+   // a stream up to the end is not read ahead of past it
+   for (uint32_t i = 0; i < 6u; i++)
+      read_run(1, 880u + i * 16u, 16u);
+   s0 = stats(1);
+   read_run(1, 976u, 16u);
+   read_run(1, 992u, 8u);
+   CHECK(stats(1).readAhead == s0.readAhead);
+
+   // once the image has grown to cover them, they are read for real
+   lun[1].size = IMAGE_SECTORS * 256u;
+   sectorCacheInvalidateLun(1);
+   read_run(1, 990u, 20u);
+}
+
+static void test_error(void)
+{
+   uint8_t *p;
+
+   sectorCacheInvalidateLun(0);
+   read_fails = true;
+   sectorCacheOpenRead(0, image_sectors(0), 50u, 1u);
+   CHECK(!sectorCacheReadNext(0, &p));
+   read_fails = false;
+   CHECK(read_run(0, 50u, 1u) == 1u);
+}
+
+int main(int argc, char **argv)
+{
+   if (argc > 1 && strcmp(argv[1], "off") == 0) {
+      cache_size = "0";
+      CHECK(!sectorCacheInitialise(image_read, bounce, sizeof bounce));
+      CHECK(!sectorCacheEnabled());
+      CHECK(!sectorCacheInitialise(image_read, bounce, sizeof bounce));
+      printf("%d checks, %d failures\n", checks, failures);
+      return failures != 0;
+   }
+
+   make_image(0, IMAGE_SECTORS);
+   make_image(1, IMAGE_SECTORS);
+   CHECK(sectorCacheInitialise(image_read, bounce, sizeof bounce));
+   CHECK(sectorCacheEnabled());
+
+   test_hits();
+   test_stream();
+   test_scan();
+   test_lru();
+   test_write();
+   test_end();
+   test_error();
+
+   free(lun[0].data);
+   free(lun[1].data);
+   printf("%d checks, %d failures\n", checks, failures);
+   return failures != 0;
+}
@@ -0,0 +1,325 @@
+/* Host test of BeebSCSI sparse LUN images (sparselun.c) on an image file
+   held in memory: FORMAT writes only the header and map, blocks never
+   written read as the pattern, a first write adds a block and then its map
+   entry, and what was written reads back the same once the image is
+   opened again.  An overlay reads what it has not been written from the
+   image under it, and is emptied by emptying its file.  Given a sparse image and the flat image it was made from,
+   it checks the two read the same - which is how run.sh checks the images
+   tools/sparse_lun.py makes. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "BeebSCSI/sparselun.h"
+
+static int failures, checks;
+#define CHECK(c) do { checks++; if (!(c)) { failures++; \
+   printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #c); } } while (0)
+
+#define DISC_SECTORS 4000u                // 63 blocks, the last one short
+#define FILE_MAX     (2u * 1024u * 1024u)
+
+static uint8_t *file;
+static uint32_t file_size;
+static unsigned int reads, writes;
+static unsigned int fail_write;          // the nth write from now fails
+static uint8_t disc[DISC_SECTORS * 256u]; // what the Beeb should read back
+static uint8_t base[DISC_SECTORS * 256u]; // the image under an overlay
+static unsigned int base_reads;
+
+static bool file_read(uint8_t lun, uint32_t offset, uint8_t *buffer, uint32_t length)
+{
+   uint32_t n = length;
+
+   CHECK(lun == 0u);
+   reads++;
+   if (offset + n > file_size)
+      n = offset < file_size ? file_size - offset : 0u;
+   memcpy(buffer, file + offset, n);
+   memset(buffer + n, 0, length - n);
+   return true;
+}
+
+static bool file_write(uint8_t lun, uint32_t offset, const uint8_t *data, uint32_t length)
+{
+   CHECK(lun == 0u && offset + length <= FILE_MAX);
+   writes++;
+   if (fail_write != 0u && --fail_write == 0u)
+      return false;
+   memcpy(file + offset, data, length);
+   if (offset + length > file_size)
+      file_size = offset + length;
+   return true;
+}
+
+static bool base_read(uint8_t lun, uint32_t first, uint8_t *buffer, uint32_t sectors)
+{
+   CHECK(lun == 0u && first + sectors <= DISC_SECTORS);
+   base_reads++;
+   memcpy(buffer, base + first * 256u, sectors * 256u);
+   return true;
+}
+
+static bool reads_as_disc(uint32_t first, uint32_t sectors)
+{
+   static uint8_t buffer[DISC_SECTORS * 256u];
+
+   return sparseLunRead(0, first, buffer, sectors)
+          && memcmp(buffer, disc + first * 256u, sectors * 256u) == 0;
+}
+
+static void write_disc(uint32_t first, uint32_t sectors, uint8_t v)
+{
+   for (uint32_t i = 0; i < sectors * 256u; i++)
+      disc[first * 256u + i] = (uint8_t)(v + i * 3u);
+   CHECK(sparseLunWrite(0, first, disc + first * 256u, sectors));
+}
+
+static uint32_t allocated(void)
+{
+   struct sparseLunStats s;
+
+   sparseLunGetStats(0, &s);
+   return s.allocated;
+}
+
+static void test_format(void)
+{
+   file_size = 0;
+   CHECK(sparseLunFormat(0, DISC_SECTORS, 0xE5u));
+   // the header and a 252 byte map fit in the first block
+   CHECK(file_size == SPARSE_LUN_BLOCK_SIZE);
+   CHECK(memcmp(file, "BSCSISPR", 8) == 0);
+   CHECK(!sparseLunIsSparse(0));
+
+   CHECK(sparseLunOpen(0, file_size));
+   CHECK(sparseLunIsSparse(0));
+   CHECK(sparseLunSectors(0) == DISC_SECTORS);
+   memset(disc, 0xE5, sizeof disc);
+   CHECK(reads_as_disc(0u, DISC_SECTORS));
+   CHECK(allocated() == 0u);
+}
+
+static void test_write(void)
+{
+   uint32_t size;
+
+   // a sector in the middle of a block: the block is added, the pattern
+   // around it, then its map entry
+   writes = 0;
+   write_disc(100u, 1u, 1u);
+   CHECK(writes == 2u && allocated() == 1u);
+   CHECK(file_size == 2u * SPARSE_LUN_BLOCK_SIZE);
+   CHECK(reads_as_disc(64u, 64u));
+
+   // written again: in place, no new block
+   writes = 0;
+   write_disc(101u, 3u, 2u);
+   CHECK(writes == 1u && allocated() == 1u);
+
+   // over a block boundary into two new blocks, then the short last block
+   write_disc(250u, 20u, 3u);
+   CHECK(allocated() == 3u);
+   write_disc(DISC_SECTORS - 2u, 2u, 4u);
+   CHECK(allocated() == 4u);
+   CHECK(reads_as_disc(0u, DISC_SECTORS));
+
+   // nothing but the pattern needs no block
+   size = file_size;
+   CHECK(sparseLunWrite(0, 1000u, disc + 1000u * 256u, 64u));
+   CHECK(file_size == size && allocated() == 4u);
+
+   // past the end of the disc
+   CHECK(!sparseLunWrite(0, DISC_SECTORS, disc, 1u));
+}
+
+static void test_contiguous(void)
+{
+   // two blocks written one after the other are one read of the card
+   write_disc(1280u, 128u, 5u);
+   reads = 0;
+   CHECK(reads_as_disc(1290u, 100u));
+   CHECK(reads == 1u);
+
+   // written the other way round they are two
+   write_disc(576u, 1u, 8u);
+   write_disc(575u, 1u, 9u);
+   reads = 0;
+   CHECK(reads_as_disc(575u, 2u));
+   CHECK(reads == 2u);
+}
+
+static void test_reopen(void)
+{
+   uint32_t size = file_size;
+
+   sparseLunClose(0);
+   CHECK(!sparseLunIsSparse(0));
+   CHECK(sparseLunOpen(0, file_size));
+   CHECK(allocated() == 8u);
+   CHECK(reads_as_disc(0u, DISC_SECTORS));
+
+   // the next block goes after the last, not over it
+   write_disc(2000u, 1u, 6u);
+   CHECK(file_size == size + SPARSE_LUN_BLOCK_SIZE);
+   CHECK(reads_as_disc(0u, DISC_SECTORS));
+}
+
+static void test_power_cut(void)
+{
+   uint32_t size;
+   uint8_t sector[256];
+
+   // the block gets to the card, its map entry does not: the write fails,
+   // and the image opens again as it was, the block's sectors unwritten
+   memset(sector, 0x42, sizeof sector);
+   fail_write = 2u;
+   CHECK(!sparseLunWrite(0, 3000u, sector, 1u));
+   fail_write = 0u;
+   size = file_size;
+   sparseLunClose(0);
+   CHECK(sparseLunOpen(0, file_size));
+   CHECK(reads_as_disc(0u, DISC_SECTORS));
+
+   // ... and the next block written goes over the lost one
+   write_disc(3000u, 1u, 7u);
+   CHECK(file_size == size);
+   CHECK(reads_as_disc(0u, DISC_SECTORS));
+}
+
+static void test_bad_images(void)
+{
+   uint8_t saved[SPARSE_LUN_HEADER_SIZE + 4];
+
+   sparseLunClose(0);
+   memcpy(saved, file, sizeof saved);
+
+   // a flat image is left alone
+   memcpy(file, "BSCSIFLT", 8);
+   CHECK(sparseLunOpen(0, file_size));
+   CHECK(!sparseLunIsSparse(0));
+   CHECK(sparseLunOpen(0, 100u));
+   CHECK(!sparseLunIsSparse(0));
+   memcpy(file, saved, sizeof saved);
+
+   // an unknown version, a map past the end, a block past the end
+   file[8] = 2u;
+   CHECK(!sparseLunOpen(0, file_size));
+   memcpy(file, saved, sizeof saved);
+   CHECK(!sparseLunOpen(0, SPARSE_LUN_BLOCK_SIZE - 1u));
+   file[SPARSE_LUN_HEADER_SIZE] = 200u;
+   CHECK(!sparseLunOpen(0, file_size));
+   CHECK(!sparseLunIsSparse(0));
+   memcpy(file, saved, sizeof saved);
+   CHECK(sparseLunOpen(0, file_size));
+}
+
+static void test_overlay(void)
+{
+   uint32_t size;
+
+   for (uint32_t i = 0; i < sizeof base; i++)
+      base[i] = (uint8_t)(i * 13u + i / 256u);
+   memcpy(disc, base, sizeof disc);
+
+   // an empty file is an overlay with nothing in it: everything is the
+   // image, read in one go
+   sparseLunClose(0);
+   memset(file, 0, FILE_MAX);
+   file_size = 0;
+   CHECK(sparseLunOpenOverlay(0, 0u, DISC_SECTORS));
+   CHECK(sparseLunIsSparse(0) && sparseLunIsOverlay(0));
+   CHECK(file_size == SPARSE_LUN_BLOCK_SIZE);
+   base_reads = 0;
+   CHECK(reads_as_disc(0u, DISC_SECTORS));
+   CHECK(base_reads == 1u);
+
+   // a write takes its block from the image, then changes it; the image
+   // is never written
+   write_disc(130u, 2u, 1u);
+   CHECK(allocated() == 1u);
+   CHECK(reads_as_disc(0u, DISC_SECTORS));
+   CHECK(memcmp(base + 130u * 256u, disc + 130u * 256u, 256u) != 0);
+
+   // a write of zeros is a write, not a block left to the image
+   memset(disc + 1000u * 256u, 0, 256u);
+   CHECK(sparseLunWrite(0, 1000u, disc + 1000u * 256u, 1u));
+   CHECK(allocated() == 2u);
+
+   // opened again it is still over the image
+   sparseLunClose(0);
+   CHECK(sparseLunOpenOverlay(0, file_size, DISC_SECTORS));
+   CHECK(reads_as_disc(0u, DISC_SECTORS));
+
+   // it will not do as an image, nor over one of another size, nor will an
+   // image do as an overlay
+   size = file_size;
+   sparseLunClose(0);
+   CHECK(!sparseLunOpen(0, size));
+   CHECK(!sparseLunOpenOverlay(0, size, DISC_SECTORS + 1u));
+   CHECK(file_size == size);
+   CHECK(sparseLunFormat(0, DISC_SECTORS, 0u));
+   CHECK(!sparseLunOpenOverlay(0, file_size, DISC_SECTORS));
+   CHECK(!sparseLunIsSparse(0));
+
+   // emptied, it is the image again
+   file_size = 0;
+   CHECK(sparseLunOpenOverlay(0, 0u, DISC_SECTORS));
+   memcpy(disc, base, sizeof disc);
+   CHECK(reads_as_disc(0u, DISC_SECTORS));
+   CHECK(allocated() == 0u);
+}
+
+// A sparse image made elsewhere against the flat image it came from
+static int compare_files(const char *sparse_name, const char *flat_name)
+{
+   FILE *f = fopen(sparse_name, "rb"), *g = fopen(flat_name, "rb");
+   static uint8_t flat[FILE_MAX];
+   size_t flat_size;
+
+   CHECK(f != NULL && g != NULL);
+   if (f == NULL || g == NULL)
+      return 1;
+   file_size = (uint32_t)fread(file, 1, FILE_MAX, f);
+   flat_size = fread(flat, 1, sizeof flat, g);
+   fclose(f);
+   fclose(g);
+
+   CHECK(sparseLunOpen(0, file_size));
+   CHECK(sparseLunIsSparse(0));
+   CHECK(sparseLunSectors(0) * 256u == flat_size);
+   if (sparseLunSectors(0) * 256u == flat_size) {
+      static uint8_t buffer[FILE_MAX];
+
+      CHECK(sparseLunRead(0, 0u, buffer, sparseLunSectors(0)));
+      CHECK(memcmp(buffer, flat, flat_size) == 0);
+   }
+   printf("%d checks, %d failures\n", checks, failures);
+   return failures != 0;
+}
+
+int main(int argc, char **argv)
+{
+   file = calloc(FILE_MAX, 1);
+   sparseLunInitialise(file_read, file_write, base_read);
+   if (argc > 2) {
+      int r = compare_files(argv[1], argv[2]);
+
+      sparseLunClose(0);
+      free(file);
+      return r;
+   }
+
+   test_format();
+   test_write();
+   test_contiguous();
+   test_reopen();
+   test_power_cut();
+   test_bad_images();
+   test_overlay();
+
+   sparseLunClose(0);
+   free(file);
+   printf("%d checks, %d failures\n", checks, failures);
+   return failures != 0;
+}
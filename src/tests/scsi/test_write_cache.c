@@ -0,0 +1,222 @@
+/* Host test of the BeebSCSI write-back cache (writecache.c) against a model
+   of the card: writes that carry on from each other go out as one, nothing
+   a read wants is left behind, the f_sync waits for the LUNs to go quiet
+   or be stopped, and the counts add up.  With "off" it checks that no
+   scsi_writeback leaves every LUN writing through. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "BeebSCSI/writecache.h"
+#include "config.h"
+
+static int failures, checks;
+#define CHECK(c) do { checks++; if (!(c)) { failures++; \
+   printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #c); } } while (0)
+
+#define IMAGE_SECTORS 1024u
+
+static const char *luns = "0,2-3";
+static uint8_t card[4][IMAGE_SECTORS * 256u];
+static unsigned int writes, syncs;
+static uint16_t synced;
+static bool write_fails;
+
+const char *config_get(const char *key)
+{
+   if (strcmp(key, "scsi_writeback") == 0)
+      return luns;
+   if (strcmp(key, "scsi_writeback_ms") == 0)
+      return "500";
+   return NULL;
+}
+
+static bool card_write(uint8_t lun, uint32_t first, const uint8_t *data, uint32_t sectors)
+{
+   CHECK(lun < 4u && first + sectors <= IMAGE_SECTORS);
+   writes++;
+   if (write_fails)
+      return false;
+   memcpy(card[lun] + first * 256u, data, sectors * 256u);
+   return true;
+}
+
+static bool card_sync(uint8_t lun)
+{
+   syncs++;
+   synced |= (uint16_t)(1u << lun);
+   return true;
+}
+
+static void fill(uint8_t *p, uint32_t sectors, uint8_t v)
+{
+   for (uint32_t i = 0; i < sectors * 256u; i++)
+      p[i] = (uint8_t)(v + i);
+}
+
+static struct writeCacheStats stats(uint8_t lun)
+{
+   struct writeCacheStats s;
+
+   writeCacheGetStats(lun, &s);
+   return s;
+}
+
+static void test_config(void)
+{
+   CHECK(writeCacheEnabled(0));
+   CHECK(!writeCacheEnabled(1));
+   CHECK(writeCacheEnabled(2) && writeCacheEnabled(3));
+   CHECK(!writeCacheEnabled(4) && !writeCacheEnabled(8));
+}
+
+static void test_coalesce(void)
+{
+   uint8_t a[256], b[3 * 256], c[256];
+
+   // the free space map, then a directory straight after it, then the map
+   // again: all one run, nothing on the card yet
+   fill(a, 1u, 1u);
+   fill(b, 3u, 2u);
+   fill(c, 1u, 3u);
+   writes = 0;
+   CHECK(writeCacheWrite(0, 0u, a, 1u));
+   CHECK(writeCacheWrite(0, 1u, b, 3u));
+   CHECK(writeCacheWrite(0, 0u, c, 1u));
+   CHECK(writes == 0u);
+   CHECK(stats(0).dirty == 4u && stats(0).sectors == 5u);
+
+   // a read elsewhere leaves it; a read of it sends it, once
+   CHECK(writeCacheFlushRange(0, 100u, 10u));
+   CHECK(writeCacheFlushRange(1, 0u, 10u));
+   CHECK(writes == 0u);
+   CHECK(writeCacheFlushRange(0, 2u, 1u));
+   CHECK(writes == 1u);
+   CHECK(memcmp(card[0], c, 256u) == 0);
+   CHECK(memcmp(card[0] + 256u, b, sizeof b) == 0);
+   CHECK(stats(0).dirty == 0u && stats(0).flushes == 1u);
+   CHECK(writeCacheFlushRange(0, 0u, 4u));
+   CHECK(writes == 1u);
+}
+
+// filesystem.c flushes whatever it reads from the card, and the sector
+// cache reads a whole block and more around what the host asked for: a
+// read of sector 104 fills 96-111, which must take the held 105 with it
+static void test_neighbour(void)
+{
+   uint8_t a[256];
+
+   fill(a, 1u, 60u);
+   writes = 0;
+   CHECK(writeCacheWrite(0, 105u, a, 1u));
+   CHECK(writeCacheFlushRange(0, 96u, 9u));   // 96-104 alone would miss it
+   CHECK(writes == 0u);
+   CHECK(writeCacheFlushRange(0, 106u, 6u));
+   CHECK(writes == 0u);
+   CHECK(writeCacheFlushRange(0, 96u, 16u));
+   CHECK(writes == 1u && card[0][105u * 256u] == 60u);
+   CHECK(stats(0).dirty == 0u);
+}
+
+static void test_boundaries(void)
+{
+   static uint8_t big[WRITE_CACHE_SECTORS * 256u + 256u];
+
+   // a gap, another LUN, or the 16K filling up each start a new run
+   fill(big, 2u, 10u);
+   writes = 0;
+   CHECK(writeCacheWrite(2, 10u, big, 1u));
+   CHECK(writeCacheWrite(2, 12u, big, 1u));
+   CHECK(writes == 1u && card[2][10u * 256u] == 10u);
+   CHECK(writeCacheWrite(3, 12u, big, 1u));
+   CHECK(writes == 2u && card[2][12u * 256u] == 10u);
+
+   fill(big, WRITE_CACHE_SECTORS + 1u, 20u);
+   CHECK(writeCacheWrite(3, 13u, big, WRITE_CACHE_SECTORS - 1u));
+   CHECK(writes == 2u);                       // just fits
+   CHECK(writeCacheWrite(3, 12u + WRITE_CACHE_SECTORS, big, 1u));
+   CHECK(writes == 3u);
+   CHECK(memcmp(card[3] + 13u * 256u, big, (WRITE_CACHE_SECTORS - 1u) * 256u) == 0);
+
+   // more than it holds goes straight through, after what was held
+   CHECK(writeCacheWrite(3, 200u, big, WRITE_CACHE_SECTORS + 1u));
+   CHECK(writes == 5u);
+   CHECK(memcmp(card[3] + 200u * 256u, big, sizeof big) == 0);
+   CHECK(card[3][(12u + WRITE_CACHE_SECTORS) * 256u] == 20u);
+   CHECK(stats(3).dirty == 0u);
+}
+
+static void test_sync(void)
+{
+   uint8_t a[256];
+
+   fill(a, 1u, 40u);
+   syncs = 0;
+   synced = 0;
+   CHECK(writeCacheWrite(0, 50u, a, 1u));
+
+   // 500ms of quiet first: a write inside it starts the wait again
+   writeCacheIdle(1000000u);
+   writeCacheIdle(1400000u);
+   CHECK(syncs == 0u);
+   CHECK(writeCacheWrite(0, 51u, a, 1u));
+   writeCacheIdle(1600000u);
+   writeCacheIdle(2000000u);
+   CHECK(syncs == 0u);
+   writeCacheIdle(2100000u);
+   CHECK(card[0][51u * 256u] == 40u);
+   CHECK(synced == ((1u << 0) | (1u << 2) | (1u << 3)));
+   writeCacheIdle(9000000u);
+   CHECK(syncs == 3u);                        // nothing more to do
+
+   // stopping a LUN syncs it there and then, and only it
+   syncs = 0;
+   synced = 0;
+   CHECK(writeCacheWrite(2, 60u, a, 1u));
+   CHECK(writeCacheSync(0));
+   CHECK(syncs == 0u);
+   CHECK(writeCacheSync(2));
+   CHECK(synced == (1u << 2) && card[2][60u * 256u] == 40u);
+   CHECK(stats(2).syncs == 2u);
+}
+
+static void test_failure(void)
+{
+   uint8_t a[256];
+
+   fill(a, 1u, 50u);
+   CHECK(writeCacheWrite(0, 70u, a, 1u));
+   write_fails = true;
+   // the write that needed the room is told; the run is not kept
+   CHECK(!writeCacheWrite(0, 90u, a, 1u));
+   CHECK(!writeCacheSync(0));
+   write_fails = false;
+   CHECK(stats(0).dirty == 0u);
+   CHECK(writeCacheSync(0));
+}
+
+int main(int argc, char **argv)
+{
+   if (argc > 1 && strcmp(argv[1], "off") == 0) {
+      luns = NULL;
+      writeCacheInitialise(card_write, card_sync);
+      for (uint8_t lun = 0; lun < 16u; lun++)
+         CHECK(!writeCacheEnabled(lun));
+      CHECK(writeCacheSync(0));
+      writeCacheIdle(10000000u);
+      CHECK(writes == 0u && syncs == 0u);
+      printf("%d checks, %d failures\n", checks, failures);
+      return failures != 0;
+   }
+
+   writeCacheInitialise(card_write, card_sync);
+   test_config();
+   test_coalesce();
+   test_neighbour();
+   test_boundaries();
+   test_sync();
+   test_failure();
+
+   printf("%d checks, %d failures\n", checks, failures);
+   return failures != 0;
+}
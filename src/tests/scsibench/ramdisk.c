@@ -0,0 +1,98 @@
+/* FatFs disk I/O layer (diskio.h) over a RAM disk, for the SCSI bench.
+ *
+ * Stands in for fatfs/diskio.c and the SD card driver under it.  The data
+ * is in memory, so the card's time is a model: every disk_read() and
+ * disk_write() is charged a cost per command and a cost per 512 byte
+ * sector, added up in ramdisk_card_ns rather than waited for.  The
+ * defaults are a rough figure for a class 10 card on the Pi's SDHOST - set
+ * them from a measurement before trusting absolute numbers; for comparing
+ * two builds they only need to be the same.
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "BeebSCSI/fatfs/ff.h"
+#include "BeebSCSI/fatfs/diskio.h"
+#include "ramdisk.h"
+
+static uint8_t *disk;
+static uint32_t disk_sectors;
+
+uint32_t ramdisk_command_ns = 200000u;
+uint32_t ramdisk_sector_ns = 25000u;
+uint64_t ramdisk_card_ns;
+unsigned long ramdisk_reads, ramdisk_writes;
+unsigned long ramdisk_sectors_read, ramdisk_sectors_written;
+
+bool ramdisk_create(uint32_t sectors)
+{
+   disk = calloc(sectors, RAMDISK_SECTOR_SIZE);
+   disk_sectors = sectors;
+   return disk != NULL;
+}
+
+void ramdisk_free(void)
+{
+   free(disk);
+   disk = NULL;
+}
+
+void ramdisk_reset_counts(void)
+{
+   ramdisk_card_ns = 0;
+   ramdisk_reads = ramdisk_writes = 0;
+   ramdisk_sectors_read = ramdisk_sectors_written = 0;
+}
+
+DSTATUS disk_status(BYTE pdrv)
+{
+   return (pdrv == 0 && disk != NULL) ? 0 : STA_NOINIT;
+}
+
+DSTATUS disk_initialize(BYTE pdrv)
+{
+   return disk_status(pdrv);
+}
+
+DRESULT disk_read(BYTE pdrv, BYTE *buff, LBA_t sector, UINT count)
+{
+   if (pdrv != 0 || sector >= disk_sectors || count > disk_sectors - sector)
+      return RES_PARERR;
+   memcpy(buff, disk + (size_t)sector * RAMDISK_SECTOR_SIZE, (size_t)count * RAMDISK_SECTOR_SIZE);
+   ramdisk_reads++;
+   ramdisk_sectors_read += count;
+   ramdisk_card_ns += ramdisk_command_ns + (uint64_t)count * ramdisk_sector_ns;
+   return RES_OK;
+}
+
+DRESULT disk_write(BYTE pdrv, const BYTE *buff, LBA_t sector, UINT count)
+{
+   if (pdrv != 0 || sector >= disk_sectors || count > disk_sectors - sector)
+      return RES_PARERR;
+   memcpy(disk + (size_t)sector * RAMDISK_SECTOR_SIZE, buff, (size_t)count * RAMDISK_SECTOR_SIZE);
+   ramdisk_writes++;
+   ramdisk_sectors_written += count;
+   ramdisk_card_ns += ramdisk_command_ns + (uint64_t)count * ramdisk_sector_ns;
+   return RES_OK;
+}
+
+DRESULT disk_ioctl(BYTE pdrv, BYTE cmd, void *buff)
+{
+   if (pdrv != 0)
+      return RES_PARERR;
+   switch (cmd) {
+      case CTRL_SYNC:
+         return RES_OK;
+      case GET_SECTOR_COUNT:
+         *(LBA_t *)buff = disk_sectors;
+         return RES_OK;
+      case GET_SECTOR_SIZE:
+         *(WORD *)buff = RAMDISK_SECTOR_SIZE;
+         return RES_OK;
+      case GET_BLOCK_SIZE:
+         *(DWORD *)buff = 1;
+         return RES_OK;
+   }
+   return RES_PARERR;
+}
@@ -0,0 +1,17 @@
+#pragma once
+/* RAM disk under FatFs for the SCSI bench, with a model of the card's
+   time; see ramdisk.c. */
+#include <stdbool.h>
+#include <stdint.h>
+
+#define RAMDISK_SECTOR_SIZE 512u
+
+extern uint32_t ramdisk_command_ns;    // charged per disk_read()/disk_write()
+extern uint32_t ramdisk_sector_ns;     // ... and per sector of it
+extern uint64_t ramdisk_card_ns;       // what the card has been charged
+extern unsigned long ramdisk_reads, ramdisk_writes;
+extern unsigned long ramdisk_sectors_read, ramdisk_sectors_written;
+
+bool ramdisk_create(uint32_t sectors);
+void ramdisk_free(void);
+void ramdisk_reset_counts(void);
@@ -0,0 +1,73 @@
+#!/bin/sh -e
+# Host benchmark of the BeebSCSI command path. Builds the real scsi.c and
+# filesystem.c, the caches, sparse and packed layers under them, FatFs and the
+# config and .cfg parsers, over a RAM disk and a fake host adapter, then
+# replays ADFS command mixes and reports commands/s and sectors/s.
+#
+#   sh run.sh                        check under ASan, then time the caches
+#   sh run.sh -a 12000 load save     time with extra bench options/mixes
+#
+# See scsi_bench.c for the mixes and the time model.
+HERE=$(cd "$(dirname "$0")" && pwd)
+SRC=${SRC_DIR:-$HERE/../..}
+B=$(mktemp -d)
+trap 'rm -rf "$B"' EXIT
+mkdir -p "$B/BeebSCSI/fatfs" "$B/rpi"
+
+cp "$SRC"/config.c "$SRC"/config.h "$B/"
+cp "$SRC"/rpi/fileparser.c "$SRC"/rpi/fileparser.h "$B/rpi/"
+cp "$SRC"/BeebSCSI/*.c "$SRC"/BeebSCSI/*.h "$B/BeebSCSI/"
+rm "$B/BeebSCSI/fcode.c"
+cp "$SRC"/BeebSCSI/fatfs/ff.c "$SRC"/BeebSCSI/fatfs/ff.h "$SRC"/BeebSCSI/fatfs/ffconf.h \
+   "$SRC"/BeebSCSI/fatfs/ffunicode.c "$SRC"/BeebSCSI/fatfs/diskio.h "$B/BeebSCSI/fatfs/"
+cp -r "$HERE"/stubs/. "$B/"
+cp "$SRC"/lz4_block.c "$SRC"/lz4_block.h "$B/"
+cp "$HERE"/scsi_bench.c "$HERE"/ramdisk.c "$HERE"/ramdisk.h "$B/"
+
+# The bench formats its RAM disk, which the firmware never does
+sed -i 's/^#define FF_USE_MKFS[[:space:]]*0/#define FF_USE_MKFS\t1/' "$B/BeebSCSI/fatfs/ffconf.h"
+
+# BeebSCSI and FatFs are built as the firmware builds them, less the
+# warnings FatFs raises on a 64-bit host
+CFLAGS="-std=gnu2x -Wall -Wextra -Wno-unused-parameter -include $B/host_compat.h -I$B"
+SOURCES="$B/scsi_bench.c $B/ramdisk.c $B/config.c $B/rpi/fileparser.c
+   $B/BeebSCSI/scsi.c $B/BeebSCSI/filesystem.c $B/BeebSCSI/sectorcache.c
+   $B/BeebSCSI/writecache.c $B/BeebSCSI/sparselun.c $B/BeebSCSI/packedlun.c
+   $B/BeebSCSI/debug.c $B/lz4_block.c $B/BeebSCSI/fatfs/ff.c $B/BeebSCSI/fatfs/ffunicode.c"
+
+echo "== mixes under ASan/UBSan =="
+# shellcheck disable=SC2086
+gcc $CFLAGS -g -fsanitize=address,undefined -fno-sanitize-recover=all \
+    -o "$B/bench_san" $SOURCES
+# every mix with no caches, the default sector cache, and write-back with
+# the idle sync running between commands, then the reads of a packed image;
+# data and status checked
+"$B/bench_san" -c scsi_cache=0 > "$B/san.out" || { cat "$B/san.out"; exit 1; }
+"$B/bench_san" >> "$B/san.out" || { cat "$B/san.out"; exit 1; }
+"$B/bench_san" -c scsi_writeback=all -g 400000 >> "$B/san.out" || { cat "$B/san.out"; exit 1; }
+"$B/bench_san" -z 16 -c scsi_cache=0 >> "$B/san.out" || { cat "$B/san.out"; exit 1; }
+# and write-back with nothing synced between commands, so that a written
+# sector is still held when the sector cache reads the block around it
+"$B/bench_san" -c scsi_writeback=all neighbour >> "$B/san.out" || { cat "$B/san.out"; exit 1; }
+test "$(grep -c '^sector mismatches: 0$' "$B/san.out")" -eq 5
+
+echo "== timing =="
+# shellcheck disable=SC2086
+gcc $CFLAGS -O2 -o "$B/bench" $SOURCES
+if [ $# -gt 0 ]; then
+   "$B/bench" "$@"
+else
+   echo "-- no caches, immediate ACK --"
+   "$B/bench" -a 0 -c scsi_cache=0
+   echo "-- sector cache, immediate ACK --"
+   "$B/bench" -a 0
+   echo "-- sector cache and write-back, immediate ACK --"
+   "$B/bench" -a 0 -c scsi_writeback=all
+   echo "-- sector cache, ADFS byte loop --"
+   "$B/bench" -a 12000
+   echo "-- sector cache, immediate ACK, packed image --"
+   "$B/bench" -a 0 -z 64
+   "$B/bench" -a 0 -z 16
+fi
+
+echo "SCSI BENCH PASSED"
@@ -0,0 +1,968 @@
+/* Host benchmark of the BeebSCSI command path.
+ *
+ * Builds the real scsi.c and filesystem.c, with the sector, write-back
+ * and sparse layers under them, over FatFs on a RAM disk (ramdisk.c), and
+ * drives them through a fake host adapter the way ADFS drives the real
+ * one: select, the CDB, the data, then status and message, one REQ/ACK
+ * handshake a byte.  A mix is a stream of such commands modelled on what
+ * ADFS sends; for each the bench reports commands and sectors a second
+ * and how long a command takes.
+ *
+ * A command's time is made of three parts, reported apart:
+ *
+ *    pi    what the emulation spends, measured here.  The host is not an
+ *          ARM1176, so only relative figures between two builds mean
+ *          anything.
+ *    beeb  the host's ACK delay, -a ns a handshake: 0 is a host that ACKs
+ *          at once, which leaves nothing but the emulation's own cost;
+ *          ~12000 is ADFS's polled byte loop, about 24 cycles of a 2MHz
+ *          6502, two of them 1MHz bus accesses.
+ *    card  the modelled SD card under FatFs, -s command_us:sector_us (see
+ *          ramdisk.c).
+ *
+ * "max us" is the longest command; "pass us" is the longest single call of
+ * scsiProcessEmulation(), which is how long the firmware's other pollers
+ * can be kept waiting.  A FORMAT or VERIFY runs over many passes, so it is
+ * long as a command but not as a pass.
+ *
+ * The Beeb's and the card's time are modelled, not waited for, so a run
+ * takes as long as the emulation does.  -g adds the Beeb's time between
+ * commands to the clock the write-back cache sees, without which it only
+ * syncs at the end of a mix; the sync is part of the mix's time.
+ *
+ * Every sector read is checked against a copy of what the disc should
+ * hold, and every command against the status and byte counts a host
+ * expects; either going wrong fails the run.
+ *
+ *    scsi_bench [-a ns] [-s us:us] [-g us] [-n scale] [-z K] [-c key=value]... [mix...]
+ *
+ * -c passes a Pi1MHz.cfg line through, e.g. -c scsi_cache=0 to turn the
+ * sector cache off, or -c scsi_writeback=all.  -z puts the disc on the card
+ * as a packed image (packedlun.h) of K chunks, which is read-only, so only
+ * the mixes that do not write are run.
+ */
+#define _GNU_SOURCE
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "BeebSCSI/fatfs/ff.h"
+#include "BeebSCSI/filesystem.h"
+#include "BeebSCSI/hostadapter.h"
+#include "BeebSCSI/packedlun.h"
+#include "BeebSCSI/scsi.h"
+#include "BeebSCSI/writecache.h"
+#include "lz4_block.h"
+#include "ramdisk.h"
+
+#define VOLUME_SECTORS  (64u * 1024u)     // 32MB FAT volume of 512 byte sectors
+#define DISC_SECTORS    40960u            // a 10MB ADFS disc of 256 byte sectors
+#define LUN             0u
+
+/* ---- what the firmware links in that the bench has no use for ---- */
+
+void Pi1MHz_LED(int led) { (void)led; }
+
+// The LaserVision F-code buffer: LV-DOS only, never sent by ADFS
+uint8_t scsiFcodeBuffer[256], scsiFcodeBufferRX[256];
+void fcodeWriteBuffer(uint8_t lunNumber) { (void)lunNumber; }
+void fcodeReadBuffer(void) {}
+void fcodeClearBuffer(void) {}
+
+size_t strlcpy(char *dst, const char *src, size_t size)
+{
+   size_t n = strlen(src);
+
+   if (size != 0) {
+      size_t c = n < size - 1 ? n : size - 1;
+      memcpy(dst, src, c);
+      dst[c] = '\0';
+   }
+   return n;
+}
+
+/* ---- the fake host adapter ---- */
+
+enum busPhase { PHASE_DATAOUT, PHASE_DATAIN, PHASE_COMMAND, PHASE_STATUS, PHASE_MESSAGEOUT, PHASE_MESSAGEIN };
+
+// The host's side of the command in progress
+static struct {
+   bool selected;
+   enum busPhase phase;
+   const uint8_t *cdb;
+   uint32_t cdbLength, cdbDone;
+   const uint8_t *out;           // data out
+   uint32_t outLength, outDone;
+   uint8_t *in;                  // data in
+   uint32_t inLength, inDone;
+   int status, message;
+   bool dataPhase;               // the target went to data in or out after the CDB
+   unsigned long unexpected;     // bytes the target moved that the host had no place for
+} host;
+
+static uint32_t ackNs;           // -a
+static uint64_t beebNs;          // ACK time so far
+static unsigned long handshakes;
+
+static void hostHandshake(uint32_t bytes)
+{
+   handshakes += bytes;
+   beebNs += (uint64_t)ackNs * bytes;
+}
+
+void hostadapterInitialise(void) {}
+void hostadapterReset(void) {}
+void hostadapterWritedatabus(uint8_t databusValue) { (void)databusValue; }
+void hostadapterDatabusInput(void) {}
+void hostadapterDatabusOutput(void) {}
+
+// The host ID the host put on the bus to select: ADFS's, 1 << 0
+uint8_t hostadapterReadDatabus(void)
+{
+   return 1u;
+}
+
+uint8_t hostadapterReadByte(void)
+{
+   hostHandshake(1);
+   if (host.phase == PHASE_COMMAND && host.cdbDone < host.cdbLength)
+      return host.cdb[host.cdbDone++];
+   if (host.phase == PHASE_DATAOUT && host.outDone < host.outLength)
+      return host.out[host.outDone++];
+   host.unexpected++;
+   return 0;
+}
+
+void hostadapterWriteByte(uint8_t databusValue)
+{
+   hostHandshake(1);
+   if (host.phase == PHASE_DATAIN && host.inDone < host.inLength)
+      host.in[host.inDone++] = databusValue;
+   else if (host.phase == PHASE_STATUS)
+      host.status = databusValue;
+   else if (host.phase == PHASE_MESSAGEIN)
+      host.message = databusValue;
+   else
+      host.unexpected++;
+}
+
+uint32_t hostadapterPerformReadDMA(const uint8_t *dataBuffer)
+{
+   hostHandshake(256);
+   if (host.phase != PHASE_DATAIN || host.inLength - host.inDone < 256) {
+      host.unexpected += 256;
+      return 256;
+   }
+   memcpy(host.in + host.inDone, dataBuffer, 256);
+   host.inDone += 256;
+   return 256;
+}
+
+uint32_t hostadapterPerformWriteDMA(uint8_t *dataBuffer)
+{
+   hostHandshake(256);
+   if (host.phase != PHASE_DATAOUT || host.outLength - host.outDone < 256) {
+      host.unexpected += 256;
+      return 256;
+   }
+   memcpy(dataBuffer, host.out + host.outDone, 256);
+   host.outDone += 256;
+   return 256;
+}
+
+bool hostadapterConnectedToExternalBus(void) { return true; }
+void hostadapterWriteResetFlag(bool flagState) { (void)flagState; }
+bool hostadapterReadResetFlag(void) { return false; }
+
+void hostadapterWriteDataPhaseFlags(bool message, bool commandNotData, bool inputNotOutput)
+{
+   if (message)
+      host.phase = inputNotOutput ? PHASE_MESSAGEIN : PHASE_MESSAGEOUT;
+   else if (commandNotData)
+      host.phase = inputNotOutput ? PHASE_STATUS : PHASE_COMMAND;
+   else {
+      // Bus free puts the lines back to data out too, which is not a data
+      // phase of the command
+      host.phase = inputNotOutput ? PHASE_DATAIN : PHASE_DATAOUT;
+      if (host.cdbLength != 0 && host.cdbDone == host.cdbLength && host.status < 0)
+         host.dataPhase = true;
+   }
+}
+
+// Selection ends when the target takes the bus, as the real adapter has it
+void hostadapterWriteBusyFlag(bool flagState)
+{
+   if (flagState)
+      host.selected = false;
+}
+
+void hostadapterWriteRequestFlag(bool flagState) { (void)flagState; }
+bool hostadapterReadSelectFlag(void) { return host.selected; }
+
+/* ---- running commands ---- */
+
+struct mixStats {
+   unsigned long commands, sectors;
+   uint64_t piNs, beebNs, cardNs, worstNs, worstPassNs;
+};
+
+static struct mixStats stats;
+static uint64_t clockNs;          // the write-back cache's idea of the time
+static uint32_t gapNs;            // -g
+static unsigned long failures, mismatches;
+static uint8_t disc[DISC_SECTORS * 256u];   // what the disc should hold
+
+static uint64_t nowNs(void)
+{
+   struct timespec t;
+
+   clock_gettime(CLOCK_MONOTONIC, &t);
+   return (uint64_t)t.tv_sec * 1000000000u + (uint64_t)t.tv_nsec;
+}
+
+// Select the target and run the emulation until it is back in BUS FREE.
+// False if the target did not take all the host had, or gave it anything
+// other than what it asked for and a good status.
+static bool scsiTransaction(const uint8_t *cdb, uint32_t cdbLength,
+                            const uint8_t *out, uint32_t outLength,
+                            uint8_t *in, uint32_t inLength, bool exactIn)
+{
+   unsigned int steps = 0;
+   uint64_t beeb, card, start, took;
+
+   memset(&host, 0, sizeof host);
+   host.cdb = cdb;
+   host.cdbLength = cdbLength;
+   host.out = out;
+   host.outLength = outLength;
+   host.in = in;
+   host.inLength = inLength;
+   host.status = host.message = -1;
+   host.selected = true;
+
+   do {
+      beeb = beebNs;
+      card = ramdisk_card_ns;
+      start = nowNs();
+      scsiProcessEmulation();
+      took = nowNs() - start + beebNs - beeb + ramdisk_card_ns - card;
+      if (took > stats.worstPassNs)
+         stats.worstPassNs = took;
+      if (++steps > 100000u)
+         return false;
+   } while (!scsiWaitingForSelection());
+
+   return host.status == 0 && host.message == 0 && host.unexpected == 0
+          && host.cdbDone == cdbLength && host.outDone == outLength
+          && (!exactIn || host.inDone == inLength);
+}
+
+// One command of a mix, timed and added to its figures
+static bool command(const uint8_t *cdb, uint32_t cdbLength,
+                    const uint8_t *out, uint32_t outLength,
+                    uint8_t *in, uint32_t inLength, bool exactIn)
+{
+   uint64_t beeb = beebNs, card = ramdisk_card_ns, start = nowNs();
+   bool ok = scsiTransaction(cdb, cdbLength, out, outLength, in, inLength, exactIn);
+   uint64_t pi = nowNs() - start, took;
+
+   beeb = beebNs - beeb;
+   card = ramdisk_card_ns - card;
+   took = pi + beeb + card;
+   stats.commands++;
+   stats.piNs += pi;
+   stats.beebNs += beeb;
+   stats.cardNs += card;
+   if (took > stats.worstNs)
+      stats.worstNs = took;
+   if (!ok) {
+      failures++;
+      if (failures <= 10u)
+         printf("FAIL: command %02X status %d message %d\n", cdb[0], host.status, host.message);
+   }
+
+   // What the write-back poll in harddisc_emulator.c would see next
+   clockNs += took + gapNs;
+   writeCacheIdle((uint32_t)(clockNs / 1000u));
+   return ok;
+}
+
+static void group0(uint8_t cdb[6], uint8_t opCode, uint32_t lba, uint8_t length)
+{
+   cdb[0] = opCode;
+   cdb[1] = (uint8_t)((LUN << 5) | ((lba >> 16) & 0x1Fu));
+   cdb[2] = (uint8_t)(lba >> 8);
+   cdb[3] = (uint8_t)lba;
+   cdb[4] = length;
+   cdb[5] = 0;
+}
+
+static bool relearning;           // read6() takes what it reads as the disc
+
+static void read6(uint32_t lba, uint32_t sectors)
+{
+   static uint8_t data[256u * 256u];
+   uint8_t cdb[6];
+
+   group0(cdb, 0x08, lba, (uint8_t)sectors);
+   if (command(cdb, 6, NULL, 0, data, sectors * 256u, true)) {
+      stats.sectors += sectors;
+      if (relearning)
+         memcpy(disc + lba * 256u, data, sectors * 256u);
+      else if (memcmp(data, disc + lba * 256u, sectors * 256u) != 0) {
+         mismatches++;
+         if (mismatches <= 10u)
+            printf("FAIL: READ6 of %u sectors at %u read the wrong data\n", sectors, lba);
+      }
+   }
+}
+
+static void write6(uint32_t lba, uint32_t sectors, uint32_t generation)
+{
+   static uint8_t data[256u * 256u];
+   uint8_t cdb[6];
+
+   for (uint32_t i = 0; i < sectors * 256u; i++)
+      data[i] = (uint8_t)(generation * 29u + i * 7u + (i >> 8));
+   group0(cdb, 0x0A, lba, (uint8_t)sectors);
+   if (command(cdb, 6, data, sectors * 256u, NULL, 0, true)) {
+      stats.sectors += sectors;
+      memcpy(disc + lba * 256u, data, sectors * 256u);
+   }
+}
+
+static void testUnitReady(void)
+{
+   uint8_t cdb[6];
+
+   group0(cdb, 0x00, 0, 0);
+   (void)command(cdb, 6, NULL, 0, NULL, 0, true);
+}
+
+// What ADFS asks for: the header, a block descriptor and the geometry page
+static void modeSense(void)
+{
+   uint8_t cdb[6], data[36];
+
+   group0(cdb, 0x1A, 0, sizeof data);
+   (void)command(cdb, 6, NULL, 0, data, sizeof data, false);
+}
+
+// VERIFY(10) of `blocks` from `lba`
+static void verify10(uint32_t lba, uint16_t blocks)
+{
+   const uint8_t cdb[10] = { 0x2F, LUN << 5, (uint8_t)(lba >> 24), (uint8_t)(lba >> 16),
+                             (uint8_t)(lba >> 8), (uint8_t)lba, 0,
+                             (uint8_t)(blocks >> 8), (uint8_t)blocks, 0 };
+
+   if (command(cdb, sizeof cdb, NULL, 0, NULL, 0, true))
+      stats.sectors += blocks;
+}
+
+static void group1(uint8_t cdb[10], uint8_t opCode, uint32_t lba, uint16_t blocks)
+{
+   cdb[0] = opCode;
+   cdb[1] = LUN << 5;
+   cdb[2] = (uint8_t)(lba >> 24);
+   cdb[3] = (uint8_t)(lba >> 16);
+   cdb[4] = (uint8_t)(lba >> 8);
+   cdb[5] = (uint8_t)lba;
+   cdb[6] = 0;
+   cdb[7] = (uint8_t)(blocks >> 8);
+   cdb[8] = (uint8_t)blocks;
+   cdb[9] = 0;
+}
+
+#define GROUP1_MAX_BLOCKS 1024u
+
+// A group 1 command of 0 blocks has no data phase at all
+static void noDataPhase(uint8_t opCode)
+{
+   failures++;
+   if (failures <= 10u)
+      printf("FAIL: command %02X of 0 blocks went to a data phase\n", opCode);
+}
+
+// READ(10) of `blocks` from `lba`
+static void read10(uint32_t lba, uint16_t blocks)
+{
+   static uint8_t data[GROUP1_MAX_BLOCKS * 256u];
+   uint8_t cdb[10];
+
+   group1(cdb, 0x28, lba, blocks);
+   if (command(cdb, sizeof cdb, NULL, 0, data, blocks * 256u, true)) {
+      if (blocks == 0 && host.dataPhase)
+         noDataPhase(cdb[0]);
+      stats.sectors += blocks;
+      if (memcmp(data, disc + lba * 256u, blocks * 256u) != 0) {
+         mismatches++;
+         if (mismatches <= 10u)
+            printf("FAIL: READ10 of %u sectors at %u read the wrong data\n", blocks, lba);
+      }
+   }
+}
+
+// WRITE(10) of `blocks` to `lba`
+static void write10(uint32_t lba, uint16_t blocks, uint32_t generation)
+{
+   static uint8_t data[GROUP1_MAX_BLOCKS * 256u];
+   uint8_t cdb[10];
+
+   for (uint32_t i = 0; i < blocks * 256u; i++)
+      data[i] = (uint8_t)(generation * 31u + i * 5u + (i >> 8));
+   group1(cdb, 0x2A, lba, blocks);
+   if (command(cdb, sizeof cdb, data, blocks * 256u, NULL, 0, true)) {
+      if (blocks == 0 && host.dataPhase)
+         noDataPhase(cdb[0]);
+      stats.sectors += blocks;
+      memcpy(disc + lba * 256u, data, blocks * 256u);
+   }
+}
+
+// A command the target must refuse with CHECK CONDITION and no data phase,
+// then the REQUEST SENSE that says why
+static void refused(const uint8_t *cdb, uint32_t cdbLength, uint32_t sense)
+{
+   uint8_t senseCdb[6], data[4];
+   const uint8_t expect[4] = { (uint8_t)(sense >> 24), (uint8_t)(sense >> 16),
+                               (uint8_t)(sense >> 8), (uint8_t)sense };
+
+   stats.commands++;
+   (void)scsiTransaction(cdb, cdbLength, NULL, 0, NULL, 0, true);
+   if (host.status != 2 || host.message != 0 || host.unexpected != 0 || host.dataPhase) {
+      failures++;
+      if (failures <= 10u)
+         printf("FAIL: command %02X not refused: status %d message %d\n", cdb[0], host.status, host.message);
+      return;
+   }
+
+   group0(senseCdb, 0x03, 0, sizeof data);
+   if (command(senseCdb, 6, NULL, 0, data, sizeof data, true) && memcmp(data, expect, sizeof data) != 0) {
+      failures++;
+      if (failures <= 10u)
+         printf("FAIL: command %02X refused with sense %02X %02X %02X %02X\n",
+                cdb[0], data[0], data[1], data[2], data[3]);
+   }
+}
+
+// FORMAT UNIT with no defect list.  What the disc then holds depends on the
+// image (a flat one keeps what the card held), so it is read back to learn it.
+static void format(void)
+{
+   uint8_t cdb[6];
+
+   group0(cdb, 0x04, 0, 0);
+   cdb[2] = 0xE5;                 // the data pattern
+   (void)command(cdb, 6, NULL, 0, NULL, 0, true);
+
+   relearning = true;
+   for (uint32_t lba = 0, sectors = filesystemGetLunTotalSectors(LUN); lba < sectors; lba += 128u)
+      read6(lba, sectors - lba < 128u ? sectors - lba : 128u);
+   relearning = false;
+}
+
+/* ---- the mixes ---- */
+
+// An old-map ADFS disc: the free space map in sectors 0 and 1, the root
+// directory in 2 to 6, and directories of five sectors, each followed by
+// its files
+#define DIRECTORIES      48u
+#define FILES_PER_DIR    8u
+#define DIR_SECTORS      5u
+
+static struct { uint32_t lba, sectors; } directory[DIRECTORIES], file[DIRECTORIES * FILES_PER_DIR];
+static uint32_t rng;
+static unsigned int scale = 1;    // -n
+
+static uint32_t random32(void)
+{
+   rng = rng * 1664525u + 1013904223u;
+   return rng >> 8;
+}
+
+static bool layDisc(void)
+{
+   uint32_t next = 7;
+
+   rng = 1;
+   for (uint32_t d = 0; d < DIRECTORIES; d++) {
+      directory[d].lba = next;
+      directory[d].sectors = DIR_SECTORS;
+      next += DIR_SECTORS;
+      for (uint32_t f = 0; f < FILES_PER_DIR; f++) {
+         // mostly small files, a few up to 32K
+         uint32_t sectors = random32() % 4u == 0u ? 16u + random32() % 113u : 1u + random32() % 16u;
+
+         file[d * FILES_PER_DIR + f].lba = next;
+         file[d * FILES_PER_DIR + f].sectors = sectors;
+         next += sectors + random32() % 32u;
+      }
+   }
+   return next <= DISC_SECTORS;
+}
+
+// A file picked the way a Beeb uses its disc: most often one of a few
+static uint32_t pickFile(void)
+{
+   uint32_t files = DIRECTORIES * FILES_PER_DIR;
+
+   if (random32() % 10u < 7u)
+      return random32() % 16u;
+   return random32() % files;
+}
+
+// *MOUNT: is the drive there, what shape is it, then the map and root
+static void mixMount(void)
+{
+   for (unsigned int i = 0; i < 200u * scale; i++) {
+      testUnitReady();
+      modeSense();
+      read6(0, 2);
+      read6(2, DIR_SECTORS);
+   }
+}
+
+static void mixModeSense(void)
+{
+   for (unsigned int i = 0; i < 1000u * scale; i++)
+      modeSense();
+}
+
+// *LOAD and *RUN: the directory, then the whole file in one READ6
+static void mixLoad(void)
+{
+   for (unsigned int i = 0; i < 400u * scale; i++) {
+      uint32_t f = pickFile();
+
+      read6(directory[f / FILES_PER_DIR].lba, DIR_SECTORS);
+      read6(file[f].lba, file[f].sectors);
+   }
+}
+
+// *SAVE of a few sectors over an existing file: read the map and the
+// directory, write the data, then the map and the directory back
+static void mixSave(void)
+{
+   for (unsigned int i = 0; i < 300u * scale; i++) {
+      uint32_t f = pickFile(), d = directory[f / FILES_PER_DIR].lba;
+      uint32_t sectors = file[f].sectors < 4u ? file[f].sectors : 1u + random32() % 4u;
+
+      read6(0, 2);
+      read6(d, DIR_SECTORS);
+      write6(file[f].lba, sectors, random32());
+      write6(0, 2, random32());
+      write6(d, DIR_SECTORS, random32());
+   }
+}
+
+// *EX down the tree, the way a disc browser or a *COPY walks it
+static void mixDirWalk(void)
+{
+   for (unsigned int i = 0; i < 8u * scale; i++) {
+      read6(2, DIR_SECTORS);
+      for (uint32_t d = 0; d < DIRECTORIES; d++)
+         read6(directory[d].lba, DIR_SECTORS);
+   }
+}
+
+static void mixMixed(void)
+{
+   for (unsigned int i = 0; i < 400u * scale; i++) {
+      uint32_t pick = random32() % 20u;
+      uint32_t d = random32() % DIRECTORIES;
+
+      if (pick < 12u) {
+         uint32_t f = pickFile();
+
+         read6(directory[f / FILES_PER_DIR].lba, DIR_SECTORS);
+         read6(file[f].lba, file[f].sectors);
+      } else if (pick < 17u) {
+         read6(directory[d].lba, DIR_SECTORS);
+      } else {
+         read6(0, 2);
+         read6(directory[d].lba, DIR_SECTORS);
+         write6(file[d * FILES_PER_DIR].lba, 1u, random32());
+         write6(0, 2, random32());
+         write6(directory[d].lba, DIR_SECTORS, random32());
+      }
+   }
+}
+
+// A sector written, then the one before it read and the written one read
+// back, as ADFS updating a directory and then looking at the map does.
+// With write-back the written sector is still held when the one before it
+// is read, and the sector cache reads the block around that from the card.
+static void mixNeighbour(void)
+{
+   for (unsigned int i = 0; i < 300u * scale; i++) {
+      uint32_t lba = 1u + random32() % (DISC_SECTORS - 2u);
+
+      write6(lba, 1u, random32());
+      read6(lba - 1u, 1u);
+      read6(lba, 1u);
+      read6(lba + 1u, 1u);
+   }
+}
+
+// The group 1 READ and WRITE, which ADFS never sends but a SCSI-2 host
+// does: transfers longer than READ6's 256 blocks, which a write-back LUN
+// sends straight through, counts of 0, which move nothing, and addresses
+// past the 24-bit block limit, which are refused with ILLEGAL ADDRESS
+static void mixGroup1(void)
+{
+   uint8_t cdb[10];
+
+   for (unsigned int i = 0; i < 20u * scale; i++) {
+      uint16_t blocks = (uint16_t)(257u + random32() % (GROUP1_MAX_BLOCKS - 257u));
+      uint32_t lba = random32() % (DISC_SECTORS - GROUP1_MAX_BLOCKS);
+
+      write10(lba, blocks, random32());
+      read10(lba, blocks);
+      read10(lba + blocks - 1u, 1u);
+      read6(lba > 0u ? lba - 1u : 0u, 2u);
+      write10(lba, 0, random32());
+      read10(lba, 0);
+   }
+
+   group1(cdb, 0x28, 0x01000000u, 1);
+   refused(cdb, sizeof cdb, 0xA1000000u);
+   group1(cdb, 0x2A, 0x01000000u, 1);
+   refused(cdb, sizeof cdb, 0xA1000000u);
+   // in range itself, but the blocks after it are not
+   group1(cdb, 0x28, 0x00FFFFFFu, 2);
+   refused(cdb, sizeof cdb, 0xA11FFFFFu);
+   group1(cdb, 0x2A, 0x00FFFF00u, 0x200);
+   refused(cdb, sizeof cdb, 0xA11FFF00u);
+   read10(0, 4);
+}
+
+// A search through the whole disc, as a Domesday text or map lookup does,
+// in 32K READ6s
+static void mixScan(void)
+{
+   for (unsigned int i = 0; i < scale; i++)
+      for (uint32_t lba = 0; lba < DISC_SECTORS; lba += 128u)
+         read6(lba, DISC_SECTORS - lba < 128u ? DISC_SECTORS - lba : 128u);
+}
+
+// The image replaced while the LUN is stopped, as a host copying a disc
+// onto the card does: new data in new places on the card, so reading it
+// through the link map saved for the old one would read the wrong sectors
+static bool replaceImage(void)
+{
+   FIL f;
+   UINT written;
+   bool ok;
+
+   for (uint32_t i = 0; i < sizeof disc; i++)
+      disc[i] ^= 0x5Au;
+   ok = f_unlink("/BeebSCSI0/scsi0.dat") == FR_OK
+        && f_open(&f, "/BeebSCSI0/scsi0.dat", FA_WRITE | FA_CREATE_ALWAYS) == FR_OK;
+   if (!ok)
+      return false;
+   ok = f_write(&f, disc, sizeof disc, &written) == FR_OK && written == sizeof disc;
+   return f_close(&f) == FR_OK && ok;
+}
+
+// The host replacing the image over MTP or WebDAV after the idle poll has
+// opened it: streamed into a .part file beside it, so into clusters the old
+// one does not own, then renamed over it.  Not busy, as the Beeb has not
+// started it, but let go of before the rename.
+static bool hostReplaceImage(void)
+{
+   FIL f;
+   UINT written;
+   bool ok;
+
+   for (uint32_t i = 0; i < sizeof disc; i++)
+      disc[i] ^= 0x5Au;
+   if (f_open(&f, "/BeebSCSI0/scsi0.dat.part", FA_WRITE | FA_CREATE_ALWAYS) != FR_OK)
+      return false;
+   ok = f_write(&f, disc, sizeof disc, &written) == FR_OK && written == sizeof disc;
+   if (f_close(&f) != FR_OK || !ok || filesystemHostPathBusy("/BeebSCSI0/scsi0.dat"))
+      return false;
+   filesystemReleasePreparedLun("/BeebSCSI0/scsi0.dat");
+   return f_unlink("/BeebSCSI0/scsi0.dat") == FR_OK
+          && f_rename("/BeebSCSI0/scsi0.dat.part", "/BeebSCSI0/scsi0.dat") == FR_OK;
+}
+
+// A BREAK: the card remounted and the LUNs stopped, as
+// harddisc_emulator_init() does, then ADFS's first look at the disc.  Unless
+// scsi_prefetch=0 the idle poll has opened the image by then; that is the
+// Pi's time between commands, so it is not counted.  The first time round
+// the image is replaced, the second time by the host once it is open; the
+// last directory is far enough into it to be found through the link map.
+static void mixBoot(void)
+{
+   for (unsigned int i = 0; i < 20u * scale; i++) {
+      scsiReset(0);
+      filesystemReset();
+      if (i == 0 && !replaceImage())
+         failures++;
+      while (filesystemPrefetchNextLun())
+         ;
+      if (i == 1 && !hostReplaceImage())
+         failures++;
+      read6(0, 2);
+      read6(2, DIR_SECTORS);
+      read6(directory[DIRECTORIES - 1u].lba, DIR_SECTORS);
+      // started now: the image and the directory holding it are the Beeb's
+      if (!filesystemHostPathBusy("/BeebSCSI0/scsi0.dat") || !filesystemHostPathBusy("/BeebSCSI0/"))
+         failures++;
+   }
+}
+
+// *VERIFY, then a reformat: the long commands, run a piece a pass.  The
+// LUN's size is what its geometry makes it, a little short of the image.
+static void mixFormat(void)
+{
+   uint32_t sectors = filesystemGetLunTotalSectors(LUN);
+
+   for (unsigned int i = 0; i < scale; i++) {
+      for (uint32_t lba = 0; lba < sectors; lba += 0x8000u)
+         verify10(lba, (uint16_t)(sectors - lba < 0x8000u ? sectors - lba : 0x8000u));
+      format();
+      testUnitReady();
+      modeSense();
+   }
+}
+
+static const struct {
+   const char *name;
+   void (*run)(void);
+   bool writes;                  // the disc, so not a packed image
+} mixes[] = {
+   { "mount",     mixMount,     false },
+   { "modesense", mixModeSense, false },
+   { "load",      mixLoad,      false },
+   { "save",      mixSave,      true },
+   { "dirwalk",   mixDirWalk,   false },
+   { "mixed",     mixMixed,     true },
+   { "format",    mixFormat,    true },
+   { "boot",      mixBoot,      true },
+   { "scan",      mixScan,      false },
+   { "neighbour", mixNeighbour, true },
+   { "group1",    mixGroup1,    true },
+};
+
+#define MIXES (sizeof mixes / sizeof mixes[0])
+
+static void runMix(unsigned int m)
+{
+   double seconds;
+   uint64_t start;
+
+   memset(&stats, 0, sizeof stats);
+   rng = 12345u + m;
+   mixes[m].run();
+
+   // The mix is done when its writes are on the card
+   start = nowNs();
+   uint64_t card = ramdisk_card_ns;
+   if (!writeCacheSync(LUN))
+      failures++;
+   stats.piNs += nowNs() - start;
+   stats.cardNs += ramdisk_card_ns - card;
+
+   seconds = (double)(stats.piNs + stats.beebNs + stats.cardNs) / 1e9;
+   printf("%-10s %6lu %8lu %9.2f %9.2f %9.2f %10.0f %10.0f %8.1f %8.1f %8.1f\n",
+          mixes[m].name, stats.commands, stats.sectors,
+          (double)stats.piNs / 1e6, (double)stats.beebNs / 1e6, (double)stats.cardNs / 1e6,
+          (double)stats.commands / seconds, (double)stats.sectors / seconds,
+          seconds * 1e6 / (double)stats.commands, (double)stats.worstNs / 1e3,
+          (double)stats.worstPassNs / 1e3);
+}
+
+/* ---- the disc ---- */
+
+static uint32_t packed;           // -z, sectors to a chunk
+
+// Words picked at random, so the disc packs about as well as text does and
+// no two sectors are alike
+static void fillDisc(void)
+{
+   static const char *const words[] = {
+      "the ", "of ", "and ", "village ", "school ", "survey ", "map ", "river ",
+      "church ", "farm ", "people ", "Domesday ", "in ", "1986 ", "grid ", "photo "
+   };
+   uint32_t seed = 1, i = 0;
+
+   while (i < sizeof disc) {
+      const char *w;
+
+      seed = seed * 1664525u + 1013904223u;
+      w = words[seed >> 28];
+      for (; *w != '\0' && i < sizeof disc; w++)
+         disc[i++] = (uint8_t)*w;
+   }
+}
+
+// The disc as a packed image, as tools/pack_lun.py makes it; NULL if there
+// is no memory for it
+static uint8_t *packDisc(uint32_t *size)
+{
+   const uint32_t chunks = DISC_SECTORS / packed;
+   uint32_t offset = (PACKED_LUN_HEADER_SIZE + chunks * 8u + 511u) / 512u * 512u;
+   uint8_t *image = calloc(1, offset + chunks * LZ4_BLOCK_BOUND(PACKED_LUN_CHUNK_SIZE) + 512u);
+
+   if (image == NULL)
+      return NULL;
+   // little endian, as the host is
+   memcpy(image, "BSCSILZ4", 8);
+   memcpy(image + 8, &(uint32_t){ 1 }, 4);
+   memcpy(image + 12, &packed, 4);
+   memcpy(image + 16, &(uint32_t){ DISC_SECTORS }, 4);
+   for (uint32_t c = 0; c < chunks; c++) {
+      const uint8_t *chunk = disc + c * packed * 256u;
+      uint32_t n = (uint32_t)lz4_compress_block(chunk, packed * 256u, image + offset, packed * 256u - 1u);
+
+      if (n == 0) {
+         memcpy(image + offset, chunk, packed * 256u);
+         n = packed * 256u;
+      }
+      memcpy(image + PACKED_LUN_HEADER_SIZE + c * 8u, &offset, 4);
+      memcpy(image + PACKED_LUN_HEADER_SIZE + c * 8u + 4u, &n, 4);
+      offset += (n + 511u) / 512u * 512u;
+   }
+   *size = offset;
+   return image;
+}
+
+// A FAT volume on the RAM disk with /BeebSCSI0/scsi0.dat on it, flat or
+// packed, and the LUN started.  The image is written in IMAGE_PIECES with another file
+// growing between them, then deleted, as an image copied onto a card that
+// has seen some use is in pieces.
+#define IMAGE_PIECES 16u
+
+static bool makeDisc(void)
+{
+   static FATFS fs;
+   static BYTE work[FF_MAX_SS];
+   static uint8_t filler[64u * 1024u];
+   const MKFS_PARM opt = { FM_FAT, 1, 0, 0, 0 };
+   uint32_t size = sizeof disc, piece;
+   uint8_t *image = disc;
+   FIL f, g;
+   UINT written;
+   bool ok = true;
+
+   fillDisc();
+   if (packed && (image = packDisc(&size)) == NULL)
+      return false;
+   piece = (size + IMAGE_PIECES - 1u) / IMAGE_PIECES;
+
+   if (!ramdisk_create(VOLUME_SECTORS) || f_mkfs("", &opt, work, sizeof work) != FR_OK
+       || f_mount(&fs, "", 1) != FR_OK || f_mkdir("/BeebSCSI0") != FR_OK
+       || f_open(&f, "/BeebSCSI0/scsi0.dat", FA_WRITE | FA_CREATE_ALWAYS) != FR_OK
+       || f_open(&g, "/filler", FA_WRITE | FA_CREATE_ALWAYS) != FR_OK)
+      return false;
+   for (uint32_t at = 0; at < size; at += piece) {
+      uint32_t n = size - at < piece ? size - at : piece;
+
+      ok = ok && f_write(&f, image + at, n, &written) == FR_OK && written == n;
+      ok = ok && f_write(&g, filler, sizeof filler, &written) == FR_OK && written == sizeof filler;
+   }
+   ok = f_close(&f) == FR_OK && f_close(&g) == FR_OK && f_unlink("/filler") == FR_OK && ok;
+   f_mount(NULL, "", 0);
+   if (packed) {
+      printf("packed image, %uK chunks: %u bytes, %.0f%% of the disc\n", packed / 4u, size,
+             100.0 * size / sizeof disc);
+      free(image);
+   }
+   if (!ok)
+      return false;
+
+   filesystemInitialise(0, 0);
+   scsiInitialise();
+   scsiReset(0);
+   filesystemReset();
+
+   // START UNIT, as ADFS's first READ would, but not counted
+   uint8_t cdb[6];
+   group0(cdb, 0x1B, 0, 1);
+   return scsiTransaction(cdb, 6, NULL, 0, NULL, 0, true);
+}
+
+static void usage(void)
+{
+   fprintf(stderr, "usage: scsi_bench [-a ns] [-s us:us] [-g us] [-n scale] [-z K] [-c key=value]... [mix...]\nmixes:");
+   for (unsigned int m = 0; m < MIXES; m++)
+      fprintf(stderr, " %s", mixes[m].name);
+   fprintf(stderr, "\n");
+   exit(2);
+}
+
+int main(int argc, char **argv)
+{
+   bool run[MIXES] = { false }, any = false;
+   int opt;
+
+   while ((opt = getopt(argc, argv, "a:s:g:n:z:c:")) != -1) {
+      switch (opt) {
+         case 'a':
+            ackNs = (uint32_t)strtoul(optarg, NULL, 0);
+            break;
+         case 's': {
+            char *end;
+            ramdisk_command_ns = (uint32_t)(strtod(optarg, &end) * 1000.0);
+            if (*end != ':')
+               usage();
+            ramdisk_sector_ns = (uint32_t)(strtod(end + 1, NULL) * 1000.0);
+            break;
+         }
+         case 'g':
+            gapNs = (uint32_t)strtoul(optarg, NULL, 0) * 1000u;
+            break;
+         case 'n':
+            scale = (unsigned int)strtoul(optarg, NULL, 0);
+            break;
+         case 'z':
+            packed = (uint32_t)strtoul(optarg, NULL, 0) * 4u;
+            if (packed < PACKED_LUN_CHUNK_SECTORS_MIN || packed > PACKED_LUN_CHUNK_SECTORS
+                || (packed & (packed - 1u)) != 0)
+               usage();
+            break;
+         case 'c':
+            // the config keeps pointers into the line, so it cannot be a copy
+            config_parse(optarg, strlen(optarg));
+            break;
+         default:
+            usage();
+      }
+   }
+   for (int i = optind; i < argc; i++) {
+      unsigned int m = 0;
+
+      while (m < MIXES && strcmp(argv[i], mixes[m].name) != 0)
+         m++;
+      if (m == MIXES || (packed && mixes[m].writes))
+         usage();
+      run[m] = any = true;
+   }
+
+   if (!layDisc() || !makeDisc()) {
+      printf("FAIL: could not make the disc\n");
+      return 1;
+   }
+   ramdisk_reset_counts();
+
+   printf("ACK %u ns/byte, card %.0f us/command + %.1f us/sector, gap %u us\n",
+          ackNs, ramdisk_command_ns / 1e3, ramdisk_sector_ns / 1e3, gapNs / 1000u);
+   printf("%-10s %6s %8s %9s %9s %9s %10s %10s %8s %8s %8s\n", "mix", "cmds", "sectors",
+          "pi ms", "beeb ms", "card ms", "cmds/s", "sectors/s", "mean us", "max us", "pass us");
+   for (unsigned int m = 0; m < MIXES; m++)
+      if (run[m] || (!any && !(packed && mixes[m].writes)))
+         runMix(m);
+
+   printf("card: %lu reads (%lu sectors), %lu writes (%lu sectors); %lu handshakes\n",
+          ramdisk_reads, ramdisk_sectors_read, ramdisk_writes, ramdisk_sectors_written, handshakes);
+   printf("failed commands: %lu\n", failures);
+   printf("sector mismatches: %lu\n", mismatches);
+   ramdisk_free();
+   return failures != 0 || mismatches != 0;
+}
@@ -0,0 +1,4 @@
+#pragma once
+/* Host stub of the firmware Pi1MHz.h for the SCSI bench: just the status
+   LED statusled.h drives. */
+void Pi1MHz_LED(int led);
@@ -0,0 +1,10 @@
+#pragma once
+/* Host stub of rpi/rpi.h for the SCSI bench. */
+#include <stdio.h>
+#include <stdint.h>
+
+#define LOG_DEBUG(...) ((void)0)
+#define LOG_INFO(...)  ((void)0)
+#define LOG_WARN(...)  ((void)0)
+
+#define NOINIT_SECTION
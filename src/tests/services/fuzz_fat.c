@@ -12,6 +12,7 @@
 
 #include "Pi1MHz.h"
 #include "services.h"
+#include "vpu_stream.h"
 #include "BeebSCSI/fatfs/ff.h"
 #include "BeebSCSI/fatfs/diskio.h"
 #include "BeebSCSI/filesystem.h"
@@ -27,6 +28,11 @@ void Pi1MHz_Register_Memory(unsigned int access, unsigned int addr, callback_fun
 void Pi1MHz_MemoryWrite(uint32_t addr, uint8_t data)  { pi.Memory[addr & 0x1ff] = data; }
 void Pi1MHz_nIRQ_ASSERT(uint8_t src) { (void)src; }
 void Pi1MHz_nIRQ_CLEAR(uint8_t src) { (void)src; }
+
+/* No VPU here: the data port is a callback per byte (tests/stream has the VPU). */
+bool vpu_stream_arm(uint8_t port, size_t addr, size_t limit, unsigned int step, int addr_reg)
+{ (void)port; (void)addr; (void)limit; (void)step; (void)addr_reg; return false; }
+uint32_t vpu_stream_take(uint8_t port) { (void)port; return 0u; }
 void Pi1MHz_MemoryWrite16(uint32_t addr, uint32_t data)
 { pi.Memory[addr & 0x1ff] = (uint8_t)data; pi.Memory[(addr + 1u) & 0x1ff] = (uint8_t)(data >> 8); }
 
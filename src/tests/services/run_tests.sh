@@ -1,17 +1,20 @@
 #!/bin/sh -e
-# Host tests for the services port and the FAT service interlock.
-# Mirrors the firmware layout in a temp tree (real services_emulator.c,
-# fat_service.c and services.h; stub Pi1MHz/FatFs headers) and runs the
-# suite under ASan/UBSan.
+# Host tests for the services port, the FAT service interlock and the JIM
+# memory commands.  Mirrors the firmware layout in a temp tree (real
+# services_emulator.c, fat_service.c, jim_service.c and services.h; stub
+# Pi1MHz/FatFs headers) and runs the suite under ASan/UBSan, then the JIM
+# commands' benchmark at -O2.
 HERE=$(cd "$(dirname "$0")" && pwd)
 SRC=${SRC_DIR:-$HERE/../..}
 B=$(mktemp -d)
 trap 'rm -rf "$B"' EXIT
 
-cp "$SRC"/services_emulator.c "$SRC"/fat_service.c "$SRC"/services.h "$B/"
+cp "$SRC"/services_emulator.c "$SRC"/fat_service.c "$SRC"/services.h "$SRC"/vpu_stream.h "$B/"
+cp "$SRC"/jim_service.c "$SRC"/jim_pages.h "$SRC"/jim_disc.h "$SRC"/jim_init.h "$B/"
 cp "$SRC"/config.c "$SRC"/config.h "$B/"
-cp "$HERE"/test_services.c "$HERE"/test_config.c "$HERE"/fuzz_fat.c "$B/"
+cp "$HERE"/test_services.c "$HERE"/test_config.c "$HERE"/fuzz_fat.c "$HERE"/test_jim_service.c "$B/"
 cp -r "$HERE"/stubs/. "$B/"
+cp "$SRC"/rpi/asm-helpers.h "$B/rpi/"
 
 echo "== services port + FAT interlock =="
 gcc -std=gnu2x -Wall -Wextra -Wconversion -g \
@@ -34,4 +37,17 @@ gcc -std=gnu2x -Wall -Wextra -Wconversion -g \
     "$B/fuzz_fat.c" "$B/services_emulator.c" "$B/fat_service.c" "$B/config.c"
 "$B/f"
 
+echo "== JIM memory commands =="
+gcc -std=gnu2x -Wall -Wextra -Wconversion -g \
+    -fsanitize=address,undefined -fno-sanitize-recover=all \
+    -I"$B" -o "$B/j" \
+    "$B/test_jim_service.c" "$B/services_emulator.c" "$B/jim_service.c"
+"$B/j"
+
+echo "== JIM memory commands: benchmark =="
+gcc -std=gnu2x -Wall -Wextra -Wconversion -O2 \
+    -I"$B" -o "$B/jb" \
+    "$B/test_jim_service.c" "$B/services_emulator.c" "$B/jim_service.c"
+"$B/jb" bench
+
 echo "SERVICES TESTS PASSED"
@@ -1,6 +1,6 @@
 #pragma once
 /* Host-test stub of the firmware Pi1MHz.h - just enough for
-   services_emulator.c and fat_service.c.  The gpio encoding is the
+   services_emulator.c, fat_service.c and jim_service.c.  The gpio encoding is the
    test's own (data in bits 0-7, FRED address in bits 8-23); the real
    bus shifts differ but both sides of the test use these macros. */
 #include <stdint.h>
@@ -14,6 +14,8 @@ extern Pi1MHz_t *const Pi1MHz;
 #define DISC_RAM_SIZE (2u*JIM_RAM_STEP)
 #define DISC_RAM_BASE ((uint32_t)(((size_t)Pi1MHz->JIM_ram_size)*JIM_RAM_STEP)-DISC_RAM_SIZE)
 
+#define PAGE_SIZE 0x100
+
 #define NOINIT_SECTION
 
 #define WRITE_FRED   0
@@ -31,3 +33,18 @@ void Pi1MHz_MemoryWrite(uint32_t addr, uint8_t data);
 void Pi1MHz_MemoryWrite16(uint32_t addr, uint32_t data);
 void Pi1MHz_nIRQ_ASSERT(uint8_t src);
 void Pi1MHz_nIRQ_CLEAR(uint8_t src);
+
+#define POLL_NORMAL      1u
+#define POLL_EVENT_JIM    (1u << 3)
+#define POLL_EVENT_JIMCMD (1u << 4)
+
+extern volatile uint32_t Pi1MHz_poll_events;
+
+void Pi1MHz_Register_Poll_Event(func_ptr function_ptr, uint8_t priority,
+                                uint32_t period_us, uint32_t events);
+void Pi1MHz_Poll_Wake(uint32_t events);
+
+static inline void Pi1MHz_Poll_Wake_FIQ(uint32_t events)
+{
+   Pi1MHz_poll_events |= events;
+}
@@ -1,2 +1,5 @@
 #pragma once
 /* Host-test stub: DISC_RAM_BASE/SIZE come from the stub Pi1MHz.h. */
+#include <stddef.h>
+
+void ram_emulator_refresh(size_t addr, size_t len);
@@ -0,0 +1,417 @@
+/* Host tests and benchmark for the JIM memory service (jim_service.c),
+ * driven through the real services port dispatch (services_emulator.c):
+ * the block is built in the top JIM pages, the page written to the
+ * command register, and the main loop's passes run until the register
+ * reads back a result below &80, as the Beeb sees it.
+ *
+ *   t          correctness, with a model of JIM RAM paging, the RAM disc
+ *              bitmap and JIM_Init.bin regions still to arrive
+ *   t bench    MB/s for each command over 16 MB, and the longest single
+ *              poll pass - the time the main loop is held up for
+ */
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "Pi1MHz.h"
+#include "services.h"
+#include "ram_emulator.h"
+#include "vpu_stream.h"
+#include "jim_pages.h"
+#include "jim_disc.h"
+#include "jim_init.h"
+#include "rpi/asm-helpers.h"
+
+#define MB       (1024u * 1024u)
+#define RAM_SETS 4u                 /* 64 MB: DISC_RAM_BASE is 32 MB */
+#define RAM_SIZE ((size_t)RAM_SETS * 16u * MB)
+
+/* ---- Pi1MHz stubs ---- */
+static Pi1MHz_t pi;
+Pi1MHz_t *const Pi1MHz = &pi;
+
+#define SVC_BASE 0xA6u
+static callback_func_ptr write_cb[256];
+
+void Pi1MHz_Register_Memory(unsigned int access, unsigned int addr, callback_func_ptr fn)
+{
+   if (access == WRITE_FRED)
+      write_cb[addr & 0xff] = fn;
+}
+void Pi1MHz_MemoryWrite(uint32_t addr, uint8_t data) { pi.Memory[addr & 0x1ff] = data; }
+void Pi1MHz_MemoryWrite16(uint32_t addr, uint32_t data)
+{ pi.Memory[addr & 0x1ff] = (uint8_t)data; pi.Memory[(addr + 1u) & 0x1ff] = (uint8_t)(data >> 8); }
+void Pi1MHz_nIRQ_ASSERT(uint8_t src) { (void)src; }
+void Pi1MHz_nIRQ_CLEAR(uint8_t src) { (void)src; }
+
+volatile uint32_t Pi1MHz_poll_events;
+static func_ptr poller;
+static uint32_t poller_events;
+
+void Pi1MHz_Register_Poll_Event(func_ptr fn, uint8_t priority, uint32_t period_us, uint32_t events)
+{ (void)priority; (void)period_us; poller = fn; poller_events = events; }
+void Pi1MHz_Poll_Wake(uint32_t events) { Pi1MHz_poll_events |= events; }
+
+static int masked;
+unsigned int _disable_interrupts_cspr(void) { masked++; return 0u; }
+void _restore_cpsr(unsigned int cpsr) { (void)cpsr; masked--; }
+
+/* The port's own FAT service is not under test here. */
+void fat_service_init(void) { }
+
+bool vpu_stream_arm(uint8_t port, size_t addr, size_t limit, unsigned int step, int addr_reg)
+{ (void)port; (void)addr; (void)limit; (void)step; (void)addr_reg; return false; }
+uint32_t vpu_stream_take(uint8_t port) { (void)port; return 0u; }
+static unsigned int releases;
+void vpu_stream_release(void) { releases++; }
+
+/* The JIM window shows page `window`: what the refreshes covered of it. */
+static size_t window = 0x123400u;
+static unsigned int window_refreshes, unmasked_refreshes;
+void ram_emulator_refresh(size_t addr, size_t len)
+{
+   if (masked == 0)
+      unmasked_refreshes++;
+   if (window - addr < len)
+      window_refreshes++;
+}
+
+/* ---- JIM RAM paging model: a bit per 4 KB page, off unless `paging` ---- */
+static bool paging;
+static uint8_t page_backed[RAM_SIZE >> JIM_PAGE_SHIFT];
+static unsigned int zero_calls;
+
+bool jim_pages_backed(size_t offset) { return !paging || page_backed[offset >> JIM_PAGE_SHIFT]; }
+bool jim_pages_zero(size_t offset, size_t len)
+{
+   if (!paging)
+      return false;
+   zero_calls++;
+   memset(pi.JIM_ram + offset, 0, len);
+   for (size_t a = offset; a < offset + len; a++)
+      if ((a & (JIM_PAGE_SIZE - 1u)) == 0u && offset + len - a >= JIM_PAGE_SIZE)
+         page_backed[a >> JIM_PAGE_SHIFT] = 0u;
+   return true;
+}
+
+/* ---- RAM disc bitmap ---- */
+size_t jim_disc_base;
+size_t jim_disc_len;
+uint32_t *jim_disc_dirty;
+volatile bool jim_disc_pending;
+
+static bool disc_dirty(size_t addr)
+{
+   size_t r = (addr - jim_disc_base) >> JIM_DISC_REGION_SHIFT;
+   return (jim_disc_dirty[r >> 5] >> (r & 31u)) & 1u;
+}
+
+/* ---- JIM_Init.bin regions: asked for, and arriving one a pass ---- */
+size_t jim_init_len;
+uint32_t *jim_init_loaded;
+static uint32_t asked[64];
+static unsigned int asked_count, unmasked_faults;
+
+void jim_init_fault(size_t addr)
+{
+   if (masked == 0)
+      unmasked_faults++;
+   asked[asked_count++ % 64u] = (uint32_t)(addr >> JIM_INIT_REGION_SHIFT);
+}
+void jim_init_keep(size_t addr) { (void)addr; }
+
+/* ---- driving it ---- */
+#define CMD_PAGE 0xF5u
+static uint32_t cp_of(uint8_t page) { return DISC_RAM_BASE | 0xFF0000u | ((uint32_t)page << 8); }
+
+static void put32(uint32_t off, uint32_t v) { memcpy(&pi.JIM_ram[off], &v, 4); }
+static uint32_t get32(uint32_t off) { uint32_t v; memcpy(&v, &pi.JIM_ram[off], 4); return v; }
+
+static unsigned int passes;
+static double longest_pass_us;
+
+static double now_us(void)
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (double)ts.tv_sec * 1e6 + (double)ts.tv_nsec / 1e3;
+}
+
+/* One main-loop pass: the poller if its event is up, and in the streaming
+   test one region the Beeb asked for arriving. */
+static void pass(void)
+{
+   if (jim_init_len != 0u && asked_count != 0u) {
+      uint32_t r = asked[--asked_count % 64u];
+      jim_init_loaded[r >> 5] |= 1u << (r & 31u);
+   }
+   if (Pi1MHz_poll_events & poller_events) {
+      double t = now_us();
+
+      Pi1MHz_poll_events &= ~poller_events;
+      poller();
+      t = now_us() - t;
+      if (t > longest_pass_us)
+         longest_pass_us = t;
+      passes++;
+   }
+}
+
+/* Send the block at CMD_PAGE and run the main loop until the result. */
+static uint8_t run(void)
+{
+   passes = 0u;
+   write_cb[SVC_BASE + 4](TEST_GPIO(SVC_BASE + 4, CMD_PAGE));
+   assert(pi.Memory[SVC_BASE + 4] == CMD_PAGE);    // busy: bit 7 set
+   for (unsigned int i = 0; i < 1000000u && (pi.Memory[SVC_BASE + 4] & 0x80u); i++)
+      pass();
+   return pi.Memory[SVC_BASE + 4];
+}
+
+static void block(uint8_t cmd, uint8_t b1, uint32_t src, uint32_t dst, uint32_t len)
+{
+   uint32_t cp = cp_of(CMD_PAGE);
+
+   memset(&pi.JIM_ram[cp], 0, 256);
+   pi.JIM_ram[cp] = cmd;
+   pi.JIM_ram[cp + 1u] = b1;
+   put32(cp + 4u, src);
+   put32(cp + 8u, dst);
+   put32(cp + 12u, len);
+}
+
+static uint8_t do_move(uint32_t src, uint32_t dst, uint32_t len)
+{ block(80, 0, src, dst, len); return run(); }
+static uint8_t do_fill(uint8_t v, uint32_t dst, uint32_t len)
+{ block(81, v, 0, dst, len); return run(); }
+static uint8_t do_compare(uint32_t a, uint32_t b, uint32_t len)
+{ block(82, 0, a, b, len); return run(); }
+static uint8_t do_search(const void *pat, uint8_t n, uint32_t start, uint32_t len)
+{
+   block(83, n, start, 0, len);
+   memcpy(&pi.JIM_ram[cp_of(CMD_PAGE) + 32u], pat, n);
+   return run();
+}
+static uint32_t returned(void) { return get32(cp_of(CMD_PAGE) + 16u); }
+
+static void scribble(size_t at, size_t len, uint32_t seed)
+{
+   for (size_t i = 0; i < len; i++) {
+      seed = seed * 1103515245u + 12345u;
+      pi.JIM_ram[at + i] = (uint8_t)(seed >> 16);
+   }
+}
+
+static int checks, fails;
+static void ok(int cond, const char *what)
+{
+   checks++;
+   if (!cond) { fails++; printf("  FAIL: %s\n", what); }
+   else         printf("  ok: %s\n", what);
+}
+
+static void test_move(void)
+{
+   static uint8_t ref[2u * MB];
+   const uint32_t len = MB + 123u;
+
+   scribble(0x100000u, len, 1u);
+   window = 0x501000u;
+   window_refreshes = 0u;
+   ok(do_move(0x100000u, 0x500007u, len) == 0u, "move: result 0");
+   ok(memcmp(pi.JIM_ram + 0x100000u, pi.JIM_ram + 0x500007u, len) == 0, "move: copied");
+   ok(passes == 5u, "move: 256 KB a pass");
+   ok(window_refreshes == 1u && unmasked_refreshes == 0u, "move: JIM window refreshed, FIQs masked");
+   ok(releases != 0u, "move: VPU window released before writing");
+
+   // overlapping, both ways, over more than a slice, against memmove()
+   scribble(0x200000u, 2u * MB, 2u);
+   memcpy(ref, pi.JIM_ram + 0x200000u, 2u * MB);
+   memmove(ref + 3u, ref, 600000u);
+   ok(do_move(0x200000u, 0x200003u, 600000u) == 0u
+      && memcmp(ref, pi.JIM_ram + 0x200000u, 2u * MB) == 0, "move: overlap upwards as memmove");
+   memmove(ref, ref + 1000u, 700000u);
+   ok(do_move(0x2003E8u, 0x200000u, 700000u) == 0u
+      && memcmp(ref, pi.JIM_ram + 0x200000u, 2u * MB) == 0, "move: overlap downwards as memmove");
+
+   ok(do_move(0u, 0u, 0u) == 0u, "move: nothing to move");
+   ok(do_move((uint32_t)RAM_SIZE - 10u, 0u, 11u) == 2u, "move: source past the end refused");
+   ok(do_move(0u, (uint32_t)RAM_SIZE - 10u, 11u) == 2u, "move: destination past the end refused");
+   ok(do_move(0xFFFFFFF0u, 0u, 0x20u) == 2u, "move: wrapping range refused");
+   ok(do_move(0u, 0u, (uint32_t)RAM_SIZE) == 0u, "move: the whole RAM onto itself");
+}
+
+static void test_fill(void)
+{
+   bool same = true;
+
+   pi.JIM_ram[0x300000u] = 0x11u;
+   pi.JIM_ram[0x300001u + 300000u] = 0x22u;
+   ok(do_fill(0xA5u, 0x300001u, 300000u) == 0u, "fill: result 0");
+   for (size_t i = 0; i < 300000u; i++)
+      if (pi.JIM_ram[0x300001u + i] != 0xA5u)
+         same = false;
+   ok(same, "fill: filled");
+   ok(pi.JIM_ram[0x300000u] == 0x11u && pi.JIM_ram[0x300001u + 300000u] == 0x22u,
+      "fill: nothing either side");
+   ok(do_fill(0u, (uint32_t)RAM_SIZE - 1u, 2u) == 2u, "fill: past the end refused");
+
+   // zeros give pages back when paging is on
+   paging = true;
+   memset(page_backed, 1, sizeof page_backed);
+   zero_calls = 0u;
+   ok(do_fill(0u, 0x300000u, 0x10000u) == 0u && zero_calls != 0u
+      && !page_backed[0x300000u >> JIM_PAGE_SHIFT]
+      && pi.JIM_ram[0x300001u] == 0u, "fill: zeros release pages");
+
+   // a move from pages never written zeroes the destination instead
+   page_backed[0x310000u >> JIM_PAGE_SHIFT] = 0u;
+   memset(pi.JIM_ram + 0x600000u, 0x77, JIM_PAGE_SIZE);
+   zero_calls = 0u;
+   ok(do_move(0x310000u, 0x600000u, JIM_PAGE_SIZE) == 0u && zero_calls == 1u
+      && !page_backed[0x600000u >> JIM_PAGE_SHIFT] && pi.JIM_ram[0x600FFFu] == 0u,
+      "move: a page never written zeroes rather than copies");
+   paging = false;
+}
+
+static void test_compare_search(void)
+{
+   static const char pat[40] = "Pi1MHz!";
+   uint32_t slice = 256u * 1024u;
+
+   scribble(0x400000u, MB, 3u);
+   memcpy(pi.JIM_ram + 0x800000u, pi.JIM_ram + 0x400000u, MB);
+   ok(do_compare(0x400000u, 0x800000u, MB) == 0u && returned() == MB, "compare: same, offset = length");
+   pi.JIM_ram[0x800000u + 300001u] ^= 1u;
+   ok(do_compare(0x400000u, 0x800000u, MB) == 1u && returned() == 300001u, "compare: first difference found");
+   pi.JIM_ram[0x800000u] ^= 1u;
+   ok(do_compare(0x400000u, 0x800000u, MB) == 1u && returned() == 0u, "compare: difference in the first byte");
+   ok(do_compare(0x400000u, 0x800000u, 0u) == 0u && returned() == 0u, "compare: nothing to compare");
+
+   memset(pi.JIM_ram + 0x400000u, 0, MB);
+   // straddling the end of the first slice
+   memcpy(pi.JIM_ram + 0x400000u + slice - 3u, pat, 7u);
+   ok(do_search(pat, 7u, 0x400000u, MB) == 0u && returned() == slice - 3u, "search: found across a slice");
+   ok(do_search(pat, 7u, 0x400000u, slice + 4u) == 0u && returned() == slice - 3u, "search: match ending at the end");
+   ok(do_search(pat, 7u, 0x400000u, slice + 3u) == 1u && returned() == slice + 3u, "search: match past the end not found");
+   ok(do_search("P", 1u, 0x400001u, MB) == 0u && returned() == slice - 4u, "search: one byte");
+   ok(do_search(pat, 7u, 0x400000u, 6u) == 1u && returned() == 6u, "search: range shorter than the pattern");
+   ok(do_search(pat, 0u, 0x400000u, MB) == 3u, "search: empty pattern refused");
+   ok(do_search(pat, 33u, 0x400000u, MB) == 3u, "search: long pattern refused");
+   ok(do_search(pat, 7u, (uint32_t)RAM_SIZE - 4u, 5u) == 2u, "search: past the end refused");
+
+   block(84, 0, 0, 0, 0);
+   ok(run() == 3u, "reserved command answered");
+}
+
+static void test_disc_and_init(void)
+{
+   static uint32_t dirty[(4u * MB >> JIM_DISC_REGION_SHIFT) / 32u];
+
+   // a RAM disc over 4-8 MB: writes mark the regions they touch, only those
+   jim_disc_base = 4u * MB;
+   jim_disc_len = 4u * MB;
+   jim_disc_dirty = dirty;
+   ok(do_fill(1u, 4u * MB + 0x1FFFu, 2u) == 0u && disc_dirty(4u * MB + 0x1000u)
+      && disc_dirty(4u * MB + 0x2000u) && !disc_dirty(4u * MB) && !disc_dirty(4u * MB + 0x3000u)
+      && jim_disc_pending, "disc: both regions of a write marked");
+   memset(dirty, 0, sizeof dirty);
+   ok(do_move(4u * MB, 0u, 0x8000u) == 0u && !disc_dirty(4u * MB), "disc: reading it marks nothing");
+   jim_disc_len = 0u;
+
+   // JIM_Init.bin still arriving over 0-1 MB: asked for and waited on
+   static uint32_t loaded[(MB >> JIM_INIT_REGION_SHIFT) / 32u];
+   jim_init_loaded = loaded;
+   jim_init_len = MB;
+   memset(loaded, 0, sizeof loaded);
+   asked_count = 0u;
+   ok(do_move(0x8000u, 0x40000u, 0x8000u) == 0u && passes > 2u && unmasked_faults == 0u,
+      "init: source and destination asked for and waited on");
+   ok(loaded[0] == ((3u << 2) | (3u << 16)), "init: exactly their regions");
+   ok(do_fill(0u, MB - 1u, 2u) == 0u, "init: a write over the end of the image");
+   jim_init_len = 0u;
+}
+
+static void test_abandon(void)
+{
+   // a command sent while one is running takes over
+   pi.JIM_ram[0x100000u + 4u * MB] = 0x22u;
+   block(81, 0x11u, 0, 0x100000u, 8u * MB);
+   write_cb[SVC_BASE + 4](TEST_GPIO(SVC_BASE + 4, CMD_PAGE));
+   pass();
+   ok(pi.Memory[SVC_BASE + 4] == CMD_PAGE, "abandon: busy after a pass");
+   ok(do_compare(0x100000u, 0x100000u, 16u) == 0u && pi.JIM_ram[0x100000u + 4u * MB] == 0x22u,
+      "abandon: the fill went no further");
+   ok(passes == 1u, "abandon: nothing left running");
+}
+
+static void bench_one(const char *what, uint8_t (*go)(void), size_t bytes)
+{
+   double t = now_us();
+   uint8_t r;
+
+   longest_pass_us = 0.0;
+   r = go();
+   t = now_us() - t;
+   printf("  %-22s %8.0f MB/s   %5u passes, longest %6.0f us%s\n", what,
+          (double)bytes / t, passes, longest_pass_us, r > 1u ? "  (failed)" : "");
+}
+
+static uint8_t b_move(void)    { return do_move(0u, 16u * MB, 16u * MB); }
+static uint8_t b_overlap(void) { return do_move(0u, 1u, 16u * MB); }
+static uint8_t b_fill(void)    { return do_fill(0x5Au, 0u, 16u * MB); }
+static uint8_t b_compare(void) { return do_compare(0u, 16u * MB, 16u * MB); }
+static uint8_t b_search(void)  { return do_search("\xDE\xAD\xBE\xEF", 4u, 0u, 16u * MB); }
+
+static uint8_t b_loop(void)
+{
+   // the same move a byte at a time, as the Pi would without the
+   // lib/armstring routines: a lower bound on a 6502 loop, which is slower
+   // again by the bus
+   volatile uint8_t *ram = pi.JIM_ram;
+   passes = 0u;
+   for (size_t i = 0; i < 16u * MB; i++)
+      ram[16u * MB + i] = ram[i];
+   return 0u;
+}
+
+static void bench(void)
+{
+   scribble(0u, 32u * MB, 4u);     // both halves in memory before timing
+   printf("JIM memory commands over 16 MB (host figures: relative only)\n");
+   bench_one("move", b_move, 16u * MB);
+   bench_one("move, overlapping", b_overlap, 16u * MB);
+   bench_one("fill", b_fill, 16u * MB);
+   scribble(0u, 16u * MB, 4u);
+   memcpy(pi.JIM_ram + 16u * MB, pi.JIM_ram, 16u * MB);
+   bench_one("compare", b_compare, 16u * MB);
+   bench_one("search, not found", b_search, 16u * MB);
+   bench_one("byte loop move", b_loop, 16u * MB);
+}
+
+int main(int argc, char **argv)
+{
+   pi.JIM_ram = calloc(1, RAM_SIZE);
+   pi.JIM_ram_size = RAM_SETS;
+   assert(pi.JIM_ram != NULL);
+
+   services_emulator_init(0, SVC_BASE);
+   jim_service_init();
+   assert(poller != NULL && poller_events == POLL_EVENT_JIMCMD);
+
+   if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+      bench();
+      return 0;
+   }
+
+   test_move();
+   test_fill();
+   test_compare_search();
+   test_disc_and_init();
+   test_abandon();
+
+   printf("\n%d checks, %d failures\n", checks, fails);
+   return fails ? 1 : 0;
+}
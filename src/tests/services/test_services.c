@@ -11,6 +11,7 @@
 
 #include "Pi1MHz.h"
 #include "services.h"
+#include "vpu_stream.h"
 #include "config.h"
 #include "BeebSCSI/fatfs/ff.h"
 #include "BeebSCSI/fatfs/diskio.h"
@@ -39,6 +40,11 @@ void Pi1MHz_MemoryWrite16(uint32_t addr, uint32_t data)
 void Pi1MHz_nIRQ_ASSERT(uint8_t src) { (void)src; }
 void Pi1MHz_nIRQ_CLEAR(uint8_t src) { (void)src; }
 
+/* No VPU here: the data port is a callback per byte (tests/stream has the VPU). */
+bool vpu_stream_arm(uint8_t port, size_t addr, size_t limit, unsigned int step, int addr_reg)
+{ (void)port; (void)addr; (void)limit; (void)step; (void)addr_reg; return false; }
+uint32_t vpu_stream_take(uint8_t port) { (void)port; return 0u; }
+
 /* ---- FatFs stubs: record calls, results settable per test ---- */
 static FRESULT open_result = FR_OK;
 static char    last_open_path[512];
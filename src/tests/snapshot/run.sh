@@ -0,0 +1,22 @@
+#!/bin/sh -e
+# Host test of the snapshot file (snapshot.c): the PackBits codec, and a
+# save and resume through an in-memory FatFs, under ASan/UBSan.
+HERE=$(cd "$(dirname "$0")" && pwd)
+SRC=${SRC_DIR:-$HERE/../..}
+B=$(mktemp -d)
+trap 'rm -rf "$B"' EXIT
+
+mkdir -p "$B/BeebSID"
+cp "$SRC"/snapshot.c "$SRC"/snapshot.h "$SRC"/watchdog.h "$SRC"/vpu_stream.h "$SRC"/jim_pages.h "$SRC"/jim_init.h "$SRC"/jim_tier.h \
+   "$SRC"/ram_emulator.h "$SRC"/harddisc_emulator.h "$SRC"/teletext_emulator.h "$B/"
+cp "$SRC"/BeebSID/BeebSid.h "$B/BeebSID/"
+cp -r "$HERE"/stubs/. "$B/"
+cp "$HERE"/test_snapshot.c "$B/"
+
+echo "== snapshot save/resume =="
+gcc -std=gnu2x -Wall -Wextra -Wconversion -g \
+    -fsanitize=address,undefined -fno-sanitize-recover=all \
+    -I"$B" -o "$B/t" "$B/test_snapshot.c" "$B/snapshot.c"
+"$B/t"
+
+echo "SNAPSHOT TESTS PASSED"
@@ -0,0 +1,28 @@
+#pragma once
+/* Host stub of FatFs ff.h - the calls snapshot.c makes, over files the
+   test keeps in memory. */
+#include <stdint.h>
+
+typedef unsigned int  UINT;
+typedef uint8_t       BYTE;
+
+typedef enum {
+   FR_OK = 0, FR_DISK_ERR, FR_INT_ERR, FR_NOT_READY, FR_NO_FILE,
+   FR_NO_PATH, FR_INVALID_NAME, FR_DENIED, FR_EXIST
+} FRESULT;
+
+#define FA_READ          0x01
+#define FA_WRITE         0x02
+#define FA_CREATE_ALWAYS 0x08
+
+typedef struct { int slot; uint32_t pos; uint32_t fsize; } FIL;
+
+FRESULT f_open(FIL *fp, const char *path, BYTE mode);
+FRESULT f_close(FIL *fp);
+FRESULT f_read(FIL *fp, void *buff, UINT btr, UINT *br);
+FRESULT f_write(FIL *fp, const void *buff, UINT btw, UINT *bw);
+FRESULT f_lseek(FIL *fp, uint32_t ofs);
+FRESULT f_rename(const char *path_old, const char *path_new);
+FRESULT f_unlink(const char *path);
+
+#define f_size(fp) ((fp)->fsize)
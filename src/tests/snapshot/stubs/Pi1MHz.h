@@ -0,0 +1,35 @@
+#pragma once
+/* Just what snapshot.c needs from the firmware's Pi1MHz.h.  JIM RAM is a
+   malloc'd buffer the test sizes itself. */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define NOINIT_SECTION
+#define PAGE_SIZE        0x100
+
+void snap_test_log(const char *fmt, ...);
+#define LOG_INFO(...) snap_test_log(__VA_ARGS__)
+#define LOG_WARN(...) snap_test_log(__VA_ARGS__)
+
+typedef struct {
+   uint8_t Memory[PAGE_SIZE * 2];
+   uint8_t *JIM_ram;
+   size_t page_ram_addr;
+   size_t byte_ram_addr;
+   uint8_t JIM_ram_size;
+} Pi1MHz_t;
+extern Pi1MHz_t *const Pi1MHz;
+
+extern uint8_t fx_register[256];
+
+typedef void (*func_ptr)(void);
+
+#define POLL_URGENT      0u
+#define POLL_NORMAL      1u
+#define POLL_BACKGROUND  2u
+
+void Pi1MHz_Register_Poll_Sched( func_ptr function_ptr, uint8_t priority,
+                                 uint32_t period_us, uint32_t deadline_us );
+uint8_t Pi1MHz_MemoryRead(uint32_t addr);
+void Pi1MHz_MemoryRestoreEcho(const uint8_t *fred);
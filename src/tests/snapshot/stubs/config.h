@@ -0,0 +1,4 @@
+#pragma once
+#include <stdbool.h>
+const char *config_get(const char *key);
+bool config_get_bool(const char *key);
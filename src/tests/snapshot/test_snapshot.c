@@ -0,0 +1,491 @@
+/* Host test of snapshot.c: the PackBits codec, and a save followed by a
+   resume through a FatFs stub that keeps its files in memory. */
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Pi1MHz.h"
+#include "config.h"
+#include "BeebSCSI/fatfs/ff.h"
+#include "rpi/systimer.h"
+#include "watchdog.h"
+#include "vpu_stream.h"
+#include "ram_emulator.h"
+#include "harddisc_emulator.h"
+#include "teletext_emulator.h"
+#include "BeebSID/BeebSid.h"
+#include "snapshot.h"
+#include "jim_pages.h"
+#include "jim_init.h"
+#include "jim_tier.h"
+
+static int failures, checks;
+#define CHECK(c) do { checks++; if (!(c)) { failures++; \
+   printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #c); } } while (0)
+
+/* ---- firmware stand-ins -------------------------------------------------- */
+
+static Pi1MHz_t pi;
+Pi1MHz_t *const Pi1MHz = &pi;
+uint8_t fx_register[256];
+
+static func_ptr poll_fn;
+static uint8_t fred_restored[PAGE_SIZE];
+static bool fred_restore_called;
+static unsigned int kicks, boot_kicks, releases;
+
+void snap_test_log(const char *fmt, ...) { (void)fmt; }
+uint32_t RPI_GetSystemTime(void) { return 0u; }
+void watchdog_kick(void) { kicks++; }
+void watchdog_boot_kick(void) { boot_kicks++; }
+void vpu_stream_release(void) { releases++; }
+
+void Pi1MHz_Register_Poll_Sched(func_ptr fn, uint8_t priority, uint32_t period_us,
+                                uint32_t deadline_us)
+{
+   (void)priority; (void)period_us; (void)deadline_us;
+   poll_fn = fn;
+}
+
+uint8_t Pi1MHz_MemoryRead(uint32_t addr) { return pi.Memory[addr]; }
+
+void Pi1MHz_MemoryRestoreEcho(const uint8_t *fred)
+{
+   memcpy(fred_restored, fred, PAGE_SIZE);
+   fred_restore_called = true;
+}
+
+/* Sections: RAM as the real one lays it out, teletext with nothing to say
+   (not running), BeebSID whose restore refuses, SCSI two bytes. */
+static uint32_t ram_ptr[2], ram_restored[2];
+static bool ram_restore_called;
+static uint8_t lun_dirs[2], lun_restored[2];
+static unsigned int sid_restores;
+
+size_t ram_emulator_snapshot_save(uint8_t *buf, size_t size)
+{
+   if (size < sizeof ram_ptr) return 0u;
+   memcpy(buf, ram_ptr, sizeof ram_ptr);
+   return sizeof ram_ptr;
+}
+bool ram_emulator_snapshot_restore(const uint8_t *buf, size_t len)
+{
+   if (len != sizeof ram_restored) return false;
+   memcpy(ram_restored, buf, len);
+   ram_restore_called = true;
+   return true;
+}
+size_t teletext_snapshot_save(uint8_t *buf, size_t size) { (void)buf; (void)size; return 0u; }
+bool teletext_snapshot_restore(const uint8_t *buf, size_t len) { (void)buf; (void)len; return false; }
+size_t BeebSID_snapshot_save(uint8_t *buf, size_t size)
+{
+   if (size < 5u) return 0u;
+   memcpy(buf, "SID!!", 5u);
+   return 5u;
+}
+bool BeebSID_snapshot_restore(const uint8_t *buf, size_t len) { (void)buf; (void)len; sid_restores++; return false; }
+size_t harddisc_snapshot_save(uint8_t *buf, size_t size)
+{
+   if (size < 2u) return 0u;
+   memcpy(buf, lun_dirs, 2u);
+   return 2u;
+}
+bool harddisc_snapshot_restore(const uint8_t *buf, size_t len)
+{
+   if (len != 2u) return false;
+   memcpy(lun_restored, buf, 2u);
+   return true;
+}
+
+/* ---- config -------------------------------------------------------------- */
+
+static const char *cfg_resume, *cfg_compress;
+
+const char *config_get(const char *key)
+{
+   if (strcmp(key, "snapshot_resume") == 0) return cfg_resume;
+   if (strcmp(key, "snapshot_compress") == 0) return cfg_compress;
+   return NULL;
+}
+bool config_get_bool(const char *key)
+{
+   const char *v = config_get(key);
+   return v != NULL && (v[0] == '1' || v[0] == 'y');
+}
+
+/* ---- paged JIM RAM -------------------------------------------------------- */
+
+/* Off, as with malloc'd RAM, except in test_paged(): then only the blocks
+   marked here have been written, and a zero-fill releases them. */
+static bool paged;
+static bool page_written[(16u * 1024u * 1024u) >> 12];
+static size_t page_zeroed;
+
+bool jim_pages_backed(size_t offset)
+{
+   return !paged || page_written[offset >> 12];
+}
+bool jim_pages_zero(size_t offset, size_t len)
+{
+   if (!paged)
+      return false;
+   memset(pi.JIM_ram + offset, 0, len);
+   for (size_t i = offset >> 12; i < (offset + len) >> 12; i++)
+      page_written[i] = false;
+   page_zeroed += len;
+   return true;
+}
+
+/* JIM_Init.bin is all in already; a save only has to have asked. */
+static unsigned int init_finished;
+void jim_init_finish(void) { init_finished++; }
+
+/* The overflow tier is not saved: a save is refused while it holds data. */
+static bool tier_held;
+bool jim_tier_holds_data(void) { return tier_held; }
+
+/* ---- in-memory FatFs ----------------------------------------------------- */
+
+#define NFILES 4
+static struct { char name[128]; uint8_t *data; uint32_t size, cap; bool used; } files[NFILES];
+static bool fail_writes;
+
+static int file_find(const char *name)
+{
+   for (int i = 0; i < NFILES; i++)
+      if (files[i].used && strcmp(files[i].name, name) == 0)
+         return i;
+   return -1;
+}
+
+FRESULT f_open(FIL *fp, const char *path, BYTE mode)
+{
+   int i = file_find(path);
+   if (mode & FA_CREATE_ALWAYS) {
+      if (i < 0)
+         for (i = 0; i < NFILES && files[i].used; i++) ;
+      if (i == NFILES) return FR_DENIED;
+      files[i].used = true;
+      snprintf(files[i].name, sizeof files[i].name, "%s", path);
+      files[i].size = 0u;
+   } else if (i < 0) {
+      return FR_NO_FILE;
+   }
+   fp->slot = i; fp->pos = 0u; fp->fsize = files[i].size;
+   return FR_OK;
+}
+FRESULT f_close(FIL *fp) { (void)fp; return FR_OK; }
+FRESULT f_read(FIL *fp, void *buff, UINT btr, UINT *br)
+{
+   uint32_t left = files[fp->slot].size - fp->pos;
+   UINT n = (btr < left) ? btr : (UINT)left;
+   memcpy(buff, files[fp->slot].data + fp->pos, n);
+   fp->pos += n;
+   *br = n;
+   return FR_OK;
+}
+FRESULT f_write(FIL *fp, const void *buff, UINT btw, UINT *bw)
+{
+   typeof(files[0]) *f = &files[fp->slot];
+   if (fail_writes) { *bw = 0u; return FR_DISK_ERR; }
+   if (fp->pos + btw > f->cap) {
+      f->cap = (fp->pos + btw) * 2u;
+      f->data = realloc(f->data, f->cap);
+   }
+   memcpy(f->data + fp->pos, buff, btw);
+   fp->pos += btw;
+   if (fp->pos > f->size) f->size = fp->pos;
+   fp->fsize = f->size;
+   *bw = btw;
+   return FR_OK;
+}
+FRESULT f_lseek(FIL *fp, uint32_t ofs) { fp->pos = ofs; return FR_OK; }
+FRESULT f_rename(const char *a, const char *b)
+{
+   int i = file_find(a);
+   if (i < 0) return FR_NO_FILE;
+   if (file_find(b) >= 0) return FR_EXIST;
+   snprintf(files[i].name, sizeof files[i].name, "%s", b);
+   return FR_OK;
+}
+FRESULT f_unlink(const char *path)
+{
+   int i = file_find(path);
+   if (i < 0) return FR_NO_FILE;
+   files[i].used = false;
+   return FR_OK;
+}
+
+/* ---- tests --------------------------------------------------------------- */
+
+#define SNAP "/Pi1MHz/snapshot.bin"
+#define JIM_BYTES (16u * 1024u * 1024u)
+
+static uint32_t rnd = 12345u;
+static uint8_t rand8(void)
+{
+   rnd = rnd * 1103515245u + 12345u;
+   return (uint8_t)(rnd >> 16);
+}
+
+static void roundtrip(const uint8_t *src, size_t len)
+{
+   uint8_t packed[4096 + 64], out[4096];
+   size_t n = snapshot_pack(src, len, packed, sizeof packed);
+
+   CHECK(n != 0u);
+   CHECK(snapshot_unpack(packed, n, out, len));
+   CHECK(memcmp(out, src, len) == 0);
+}
+
+static void test_packbits(void)
+{
+   uint8_t b[4096], packed[4096 + 64], out[4096];
+
+   memset(b, 0x5A, sizeof b);
+   roundtrip(b, sizeof b);
+   CHECK(snapshot_pack(b, sizeof b, packed, sizeof packed) == 2u * 32u);
+
+   for (size_t i = 0; i < sizeof b; i++)
+      b[i] = rand8();
+   roundtrip(b, sizeof b);
+   // incompressible: no room in a block's worth less one
+   CHECK(snapshot_pack(b, sizeof b, packed, sizeof b - 1u) == 0u);
+
+   // runs of one, two, three and 129 between literals, and at the ends
+   size_t at = 0;
+   for (unsigned int r = 1; at + 300u < sizeof b; r = (r % 5u) + 1u) {
+      uint8_t v = rand8();
+      size_t len = (r == 5u) ? 129u : r;
+      memset(b + at, v, len);
+      at += len;
+      b[at++] = (uint8_t)(v + 1u);
+   }
+   roundtrip(b, sizeof b);
+   for (size_t len = 1; len < 300u; len += 7u)
+      roundtrip(b + 11, len);
+
+   // damaged input is refused, not overrun
+   size_t n = snapshot_pack(b, 1000u, packed, sizeof packed);
+   CHECK(!snapshot_unpack(packed, n - 1u, out, 1000u));
+   CHECK(!snapshot_unpack(packed, n, out, 999u));
+   CHECK(!snapshot_unpack(packed, n, out, 1001u));
+   uint8_t lit_short[] = { 10u, 1u, 2u };
+   CHECK(!snapshot_unpack(lit_short, sizeof lit_short, out, 11u));
+   uint8_t run_cut[] = { 200u };
+   CHECK(!snapshot_unpack(run_cut, sizeof run_cut, out, 57u));
+}
+
+static void fill_jim(void)
+{
+   memset(pi.JIM_ram, 0, JIM_BYTES);
+   for (size_t i = 0; i < 4096u; i++)                       // block 0: noise
+      pi.JIM_ram[i] = rand8();
+   memset(pi.JIM_ram + 0x3000, 0x80, 0x2000);               // M5000/M3000 wave RAM
+   pi.JIM_ram[0x12345] = 1u;                                // one byte in a block
+   memset(pi.JIM_ram + JIM_BYTES - 4096u, 0xE5, 4096u);     // the last block
+   pi.JIM_ram[JIM_BYTES - 1u] = 0u;
+}
+
+static void test_save_resume(void)
+{
+   uint8_t *copy = malloc(JIM_BYTES);
+
+   fill_jim();
+   memcpy(copy, pi.JIM_ram, JIM_BYTES);
+   for (unsigned int i = 0; i < 256u; i++) {
+      fx_register[i] = (uint8_t)(i ^ 0x5Au);
+      pi.Memory[i] = (uint8_t)(255u - i);
+   }
+   ram_ptr[0] = 0x12300u; ram_ptr[1] = 0x45678u;
+   lun_dirs[0] = 3u; lun_dirs[1] = 7u;
+
+   snapshot_init(17u, 0u);
+   CHECK(poll_fn != NULL);
+   CHECK(fx_register[17] == 0u);
+
+   releases = 0u;
+   fx_register[17] = SNAPSHOT_FX_SAVE;
+   poll_fn();
+   CHECK(fx_register[17] == 0u);
+   CHECK(releases == 1u);
+   CHECK(init_finished == 1u);
+   int f = file_find(SNAP);
+   CHECK(f >= 0);
+   CHECK(file_find(SNAP ".tmp") < 0);
+   if (f < 0) { free(copy); return; }
+   // 7 blocks stored, the noise raw and the rest packed
+   CHECK(files[f].size < 5u * 4096u);
+   CHECK(memcmp(files[f].data, SNAPSHOT_MAGIC, 4) == 0);
+   CHECK(files[f].data[8] == 1u && files[f].data[10] == SNAPSHOT_FLAG_PACKED);
+   CHECK(kicks > 0u);
+
+   // a BBC left running meanwhile scribbles on everything
+   memset(pi.JIM_ram, 0xAA, JIM_BYTES);
+   memset(fx_register, 0, sizeof fx_register);
+   boot_kicks = 0u;
+
+   CHECK(snapshot_resume_jim());
+   CHECK(memcmp(pi.JIM_ram, copy, JIM_BYTES) == 0);
+   CHECK(boot_kicks > 0u);
+
+   ram_restore_called = fred_restore_called = false;
+   sid_restores = 0u;
+   snapshot_init(17u, 0u);
+   CHECK(ram_restore_called && ram_restored[0] == 0x12300u && ram_restored[1] == 0x45678u);
+   CHECK(lun_restored[0] == 3u && lun_restored[1] == 7u);
+   CHECK(sid_restores == 1u);                  // tried, refused, skipped
+   CHECK(fred_restore_called && fred_restored[0] == 255u && fred_restored[255] == 0u);
+   CHECK(fx_register[1] == (1u ^ 0x5Au) && fx_register[17] == 0u);
+
+   // restored once: a BBC RST does not do it again
+   ram_restore_called = false;
+   snapshot_init(17u, 0u);
+   CHECK(!ram_restore_called);
+
+   char status[512];
+   snapshot_status_text(status, sizeof status);
+   CHECK(strstr(status, "resumed: 5 blocks") != NULL);
+   CHECK(strstr(status, "3 sections restored, 1 skipped") != NULL);
+   free(copy);
+}
+
+static void test_refusals(void)
+{
+   int f = file_find(SNAP);
+   uint32_t size;
+
+   if (f < 0) { CHECK(f >= 0); return; }
+   size = files[f].size;
+
+   memset(pi.JIM_ram, 0xAA, 4096u);
+   pi.JIM_ram_size = 2u;                       // another Pi
+   CHECK(!snapshot_resume_jim());
+   pi.JIM_ram_size = 1u;
+   CHECK(pi.JIM_ram[0] == 0xAAu);
+
+   cfg_resume = "0";
+   CHECK(!snapshot_resume_jim());
+   cfg_resume = NULL;
+
+   files[f].size = size - 12u;                 // cut short
+   CHECK(!snapshot_resume_jim());
+   files[f].size = size;
+   files[f].data[size - 1u] ^= 1u;             // end count wrong
+   CHECK(!snapshot_resume_jim());
+   files[f].data[size - 1u] ^= 1u;
+   files[f].data[4] = 9u;                      // unknown version
+   CHECK(!snapshot_resume_jim());
+   files[f].data[4] = (uint8_t)SNAPSHOT_VERSION;
+   CHECK(snapshot_resume_jim());
+   snapshot_init(17u, 0u);                     // take the stash
+
+   // a save that fails leaves the old snapshot alone
+   uint8_t *old = malloc(size);
+   memcpy(old, files[f].data, size);
+   fail_writes = true;
+   fx_register[17] = SNAPSHOT_FX_SAVE;
+   poll_fn();
+   fail_writes = false;
+   CHECK(fx_register[17] == SNAPSHOT_FX_FAILED);
+   f = file_find(SNAP);
+   CHECK(f >= 0 && files[f].size == size && memcmp(files[f].data, old, size) == 0);
+   CHECK(file_find(SNAP ".tmp") < 0);
+
+   // and so does one refused with the overflow tier written to
+   tier_held = true;
+   fx_register[17] = SNAPSHOT_FX_SAVE;
+   poll_fn();
+   tier_held = false;
+   CHECK(fx_register[17] == SNAPSHOT_FX_FAILED);
+   f = file_find(SNAP);
+   CHECK(f >= 0 && files[f].size == size && memcmp(files[f].data, old, size) == 0);
+   CHECK(file_find(SNAP ".tmp") < 0);
+   free(old);
+
+   // anything else the Beeb writes is refused; FAILED stays put
+   fx_register[17] = 77u;
+   poll_fn();
+   CHECK(fx_register[17] == SNAPSHOT_FX_FAILED);
+   poll_fn();
+   CHECK(fx_register[17] == SNAPSHOT_FX_FAILED);
+}
+
+/* Paged JIM RAM: a page never written is left out without being looked
+   at, and a resume releases the pages in between rather than writing
+   zeros over them. */
+static void test_paged(void)
+{
+   fill_jim();
+   paged = true;
+   page_written[0] = true;                                  // the noise
+   page_written[(JIM_BYTES >> 12) - 1u] = true;             // the last block
+   fx_register[17] = SNAPSHOT_FX_SAVE;
+   poll_fn();
+   CHECK(fx_register[17] == 0u);
+
+   memset(pi.JIM_ram, 0xAA, JIM_BYTES);
+   page_zeroed = 0u;
+   CHECK(snapshot_resume_jim());
+   snapshot_init(17u, 0u);
+   CHECK(page_zeroed == JIM_BYTES - 2u * 4096u);
+   CHECK(pi.JIM_ram[0x3000] == 0u && pi.JIM_ram[0x12345] == 0u);
+   CHECK(pi.JIM_ram[JIM_BYTES - 2u] == 0xE5u);
+
+   char status[512];
+   snapshot_status_text(status, sizeof status);
+   CHECK(strstr(status, "resumed: 2 blocks") != NULL);
+   paged = false;
+}
+
+static void test_uncompressed_and_discard(void)
+{
+   uint8_t *copy = malloc(JIM_BYTES);
+
+   fill_jim();
+   memcpy(copy, pi.JIM_ram, JIM_BYTES);
+   cfg_compress = "0";
+   snapshot_request(SNAPSHOT_FX_SAVE);
+   fx_register[17] = 0u;
+   poll_fn();
+   cfg_compress = NULL;
+   int f = file_find(SNAP);
+   CHECK(f >= 0);
+   if (f >= 0) {
+      CHECK(files[f].data[10] == 0u);
+      CHECK(files[f].size > 5u * 4096u && files[f].size < 6u * 4096u);
+   }
+   memset(pi.JIM_ram, 0x11, JIM_BYTES);
+   CHECK(snapshot_resume_jim());
+   CHECK(memcmp(pi.JIM_ram, copy, JIM_BYTES) == 0);
+   snapshot_init(17u, 0u);
+
+   fx_register[17] = SNAPSHOT_FX_DISCARD;
+   poll_fn();
+   CHECK(fx_register[17] == 0u);
+   CHECK(file_find(SNAP) < 0);
+   CHECK(!snapshot_resume_jim());
+   fx_register[17] = SNAPSHOT_FX_DISCARD;      // nothing there is fine too
+   poll_fn();
+   CHECK(fx_register[17] == 0u);
+   free(copy);
+}
+
+int main(void)
+{
+   pi.JIM_ram_size = 1u;
+   pi.JIM_ram = malloc(JIM_BYTES);
+
+   test_packbits();
+   test_save_resume();
+   test_refusals();
+   test_paged();
+   test_uncompressed_and_discard();
+
+   for (int i = 0; i < NFILES; i++)
+      free(files[i].data);
+   free(pi.JIM_ram);
+   printf("%d checks, %d failures\n", checks, failures);
+   return failures != 0;
+}
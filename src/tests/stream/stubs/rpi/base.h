@@ -0,0 +1,4 @@
+#pragma once
+/* The test builds -no-pie, so the control block's address fits the 32-bit
+   VC address as it is; JIM RAM is reached by offset from the block's base. */
+#define GPU_BASE 0u
@@ -0,0 +1,4 @@
+#pragma once
+/* Counted by the test: which windows were cleaned and invalidated. */
+void _clean_cache_area(const void *start, unsigned int length);
+void _invalidate_cache_area(const void *start, unsigned int length);
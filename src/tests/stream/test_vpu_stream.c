@@ -0,0 +1,454 @@
+/* Host test of the VPU-streamed data registers (vpu_stream.c), through the
+ * real services port (services_emulator.c).
+ *
+ * The VPU is modelled in C, access for access as Pi1MHzvc.s does it: the
+ * half-word markers, the control block, streamnext and the doorbell.  A FIQ
+ * is the model ringing the doorbell and calling the registered callback
+ * there and then.  The scenarios check the FIQ count - one per 256-byte
+ * window - and what the Beeb sees around the edges: limits, parking, a
+ * command, the VPU path switched off.  The random mix then runs the same
+ * accesses with streaming allowed and off, as a bus capture leaves it, and
+ * the Beeb must not be able to tell the difference: same bytes read, same
+ * RAM, same address read-back.
+ */
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Pi1MHz.h"
+#include "rpi/cache.h"
+#include "services.h"
+#include "vpu_stream.h"
+#include "jim_pages.h"
+
+#define SVC_BASE   0xA6u
+#define SVC_DATA   (SVC_BASE + 3u)
+#define BYTE_DATA  0x03u          /* a step-0 register, as the byte-RAM port */
+
+#define RAM_SIZE   (32u * 1024u * 1024u)
+
+/* ---- Pi1MHz stubs: the VPU window and its shadow ---- */
+static Pi1MHz_t pi;
+Pi1MHz_t *const Pi1MHz = &pi;
+
+#define VPU_HALF        0xAF00u
+#define VPU_HALF_STREAM 0xBF00u
+#define STREAMBIT       0x1000u
+
+static uint32_t vpu[256];
+static callback_func_ptr write_cb[256];
+static callback_func_ptr read_cb[256];
+
+void Pi1MHz_Register_Memory(unsigned int access, unsigned int addr, callback_func_ptr fn)
+{
+   if (access == WRITE_FRED) write_cb[addr & 0xffu] = fn;
+   else                      read_cb[addr & 0xffu] = fn;
+}
+
+void Pi1MHz_MemoryWrite(uint32_t addr, uint8_t data)
+{
+   uint32_t other = pi.Memory[addr ^ 1u] | VPU_HALF;
+   uint32_t mine  = VPU_HALF | data;
+
+   vpu[(addr >> 1) & 0xffu] = (addr & 1u) ? ((mine << 16) | other) : (mine | (other << 16));
+   pi.Memory[addr & 0x1ffu] = data;
+}
+
+void Pi1MHz_MemoryWrite16(uint32_t addr, uint32_t data)
+{
+   pi.Memory[addr] = (uint8_t)data;
+   pi.Memory[addr + 1u] = (uint8_t)(data >> 8);
+   vpu[addr >> 1] = (VPU_HALF << 16 | VPU_HALF) | (data & 0xffu) | ((data & 0xff00u) << 8);
+}
+
+/* As Pi1MHz.c */
+void Pi1MHz_MemoryStream(uint32_t addr, bool on)
+{
+   uint32_t w = addr >> 1;
+   uint32_t word = vpu[w];
+
+   pi.Memory[2u * w] = (uint8_t)word;
+   pi.Memory[2u * w + 1u] = (uint8_t)(word >> 16);
+   uint32_t mine  = (on ? VPU_HALF_STREAM : VPU_HALF) | pi.Memory[addr];
+   uint32_t other = VPU_HALF | pi.Memory[addr ^ 1u];
+   vpu[w] = (addr & 1u) ? ((mine << 16) | other) : (mine | (other << 16));
+}
+
+void Pi1MHz_nIRQ_ASSERT(uint8_t src) { (void)src; }
+void Pi1MHz_nIRQ_CLEAR(uint8_t src) { (void)src; }
+
+void fat_service_init(void) { }
+
+/* JIM RAM is malloc'd here, not paged. */
+bool jim_pages_active(void) { return false; }
+bool jim_pages_back(size_t offset) { (void)offset; return true; }
+uint32_t jim_pages_phys(size_t offset) { (void)offset; return 0u; }
+
+/* ---- cache maintenance: what was cleaned and invalidated ---- */
+static unsigned int cleans, invalidates, window_invalidates;
+
+void _clean_cache_area(const void *start, unsigned int length)
+{
+   (void)start; (void)length;
+   cleans++;
+}
+
+void _invalidate_cache_area(const void *start, unsigned int length)
+{
+   const uint8_t *p = start;
+   invalidates++;
+   if (p >= pi.JIM_ram && p < pi.JIM_ram + RAM_SIZE) {
+      assert(length == 256u && ((size_t)(p - pi.JIM_ram) & 255u) == 0u);
+      window_invalidates++;
+   }
+}
+
+/* ---- the VPU ---- */
+typedef struct {               /* STREAM_COUNT ... in Pi1MHzvc.s */
+   uint32_t count;
+   uint32_t ptr;
+   uint32_t step;
+   uint32_t base;
+   int32_t  addr_word;
+   uint32_t written;
+} block_t;
+
+static unsigned int fiqs;
+
+static block_t *block(void)
+{
+   return (block_t *)(uintptr_t)vpu_stream_bus();
+}
+
+static uint8_t *block_byte(const block_t *b)
+{
+   uint32_t off = b->ptr - b->base;
+   assert(off < RAM_SIZE);
+   return &pi.JIM_ram[off];
+}
+
+/* streamnext then storelocal */
+static void vpu_stream_next(uint8_t addr)
+{
+   block_t *b = block();
+
+   b->count--;
+   b->ptr += b->step;
+   if (b->addr_word >= 0) {
+      uint32_t off = b->ptr - b->base;
+      vpu[b->addr_word] = 0xAF00AF00u | (off & 0xffu) | ((off >> 8 & 0xffu) << 16);
+   }
+   /* the data byte alone: byte 2a of the window, as stb stores it */
+   ((uint8_t *)vpu)[2u * addr] = *block_byte(b);
+}
+
+static uint8_t vpu_half(uint8_t addr)
+{
+   return (uint8_t)(vpu[addr >> 1] >> ((addr & 1u) * 16u));
+}
+
+static bool vpu_streaming(uint8_t addr)
+{
+   return ((vpu[addr >> 1] >> ((addr & 1u) * 16u)) & STREAMBIT) != 0u;
+}
+
+static uint8_t beeb_read(uint8_t addr)
+{
+   uint8_t v = vpu_half(addr);
+
+   if (vpu_streaming(addr) && block()->count != 0u) {
+      vpu_stream_next(addr);
+   } else if (read_cb[addr]) {
+      fiqs++;
+      read_cb[addr](TEST_GPIO(addr, v));
+   }
+   return v;
+}
+
+static void beeb_write(uint8_t addr, uint8_t data)
+{
+   if (vpu_streaming(addr) && block()->count != 0u) {
+      *block_byte(block()) = data;
+      block()->written = block()->count;
+      vpu_stream_next(addr);
+   } else if (write_cb[addr]) {
+      fiqs++;
+      write_cb[addr](TEST_GPIO(addr, data));
+   }
+}
+
+/* ---- a step-0 register, wired as ram_emulator.c wires &FC03 ---- */
+static size_t byte_addr;
+
+static void byte_arm(void)
+{
+   (void)vpu_stream_arm(BYTE_DATA, byte_addr, RAM_SIZE, 0u, -1);
+}
+
+static void byte_addr_write(unsigned int gpio)
+{
+   (void)vpu_stream_take(BYTE_DATA);
+   byte_addr = (byte_addr & ~(size_t)0xffu) | GET_DATA(gpio);
+   Pi1MHz_MemoryWrite(BYTE_DATA, pi.JIM_ram[byte_addr]);
+   Pi1MHz_MemoryWrite(GET_ADDR(gpio), (uint8_t)GET_DATA(gpio));
+   byte_arm();
+}
+
+static void byte_data_write(unsigned int gpio)
+{
+   (void)vpu_stream_take(BYTE_DATA);
+   pi.JIM_ram[byte_addr] = (uint8_t)GET_DATA(gpio);
+   Pi1MHz_MemoryWrite(GET_ADDR(gpio), (uint8_t)GET_DATA(gpio));
+   byte_arm();
+}
+
+/* ---- helpers ---- */
+static int checks, fails;
+static void ok(int cond, const char *what)
+{
+   checks++;
+   if (!cond) { fails++; printf("  FAIL: %s\n", what); }
+   else         printf("  ok: %s\n", what);
+}
+
+static void reset(bool streaming)
+{
+   memset(vpu, 0, sizeof vpu);
+   memset(pi.Memory, 0, sizeof pi.Memory);
+   vpu_stream_reset();
+   services_emulator_init(0, SVC_BASE);
+   byte_addr = RAM_SIZE - 0x1000u;
+   Pi1MHz_Register_Memory(WRITE_FRED, BYTE_DATA - 1u, byte_addr_write);
+   Pi1MHz_Register_Memory(WRITE_FRED, BYTE_DATA, byte_data_write);
+   vpu_stream_enable(streaming);
+   fiqs = 0u;
+   window_invalidates = 0u;
+}
+
+static void svc_seek(uint32_t a)
+{
+   beeb_write(SVC_BASE + 0u, (uint8_t)a);
+   beeb_write(SVC_BASE + 1u, (uint8_t)(a >> 8));
+   beeb_write(SVC_BASE + 2u, (uint8_t)(a >> 16));
+}
+
+/* What the Beeb reads back from +0/+1/+2. */
+static uint32_t svc_tell(void)
+{
+   return (uint32_t)vpu_half(SVC_BASE) | (uint32_t)vpu_half(SVC_BASE + 1u) << 8
+          | (uint32_t)vpu_half(SVC_BASE + 2u) << 16;
+}
+
+static uint8_t pattern(uint32_t a) { return (uint8_t)(a * 7u + (a >> 8) * 13u + 1u); }
+
+static void fill(uint8_t *ram, uint32_t from, uint32_t n)
+{
+   for (uint32_t i = 0; i < n; i++)
+      ram[from + i] = pattern(from + i);
+}
+
+/* ---- scenarios ---- */
+static void test_read_stream(void)
+{
+   puts("== streaming reads ==");
+   reset(true);
+   fill(pi.JIM_ram, 0x1200u, 0x600u);
+   svc_seek(0x1234u);
+   fiqs = 0u;
+
+   bool same = true;
+   for (uint32_t i = 0; i < 1000u; i++)
+      same &= beeb_read(SVC_DATA) == pattern(0x1234u + i);
+   ok(same, "1000 reads return the buffer in order");
+   /* 0x1234 leaves 203 bytes of its window for the VPU, then one FIQ a window */
+   ok(fiqs == 4u, "one FIQ per 256-byte window");
+   ok(svc_tell() == 0x1234u + 1000u, "address read-back kept up by the VPU");
+   ok(vpu_half(SVC_DATA) == pattern(0x1234u + 1000u), "data register shows the next byte");
+   ok(window_invalidates == 0u, "a read-only stream never invalidates JIM RAM");
+}
+
+static void test_write_stream(void)
+{
+   puts("== streaming writes ==");
+   reset(true);
+   svc_seek(0x20010u);
+   fiqs = 0u;
+   for (uint32_t i = 0; i < 700u; i++)
+      beeb_write(SVC_DATA, (uint8_t)(i ^ 0x5au));
+   ok(fiqs == 2u, "700 writes from 0x20010: two FIQs");
+   ok(window_invalidates >= 2u, "windows the VPU wrote are invalidated when taken");
+
+   svc_seek(0x20010u);
+   bool same = true;
+   for (uint32_t i = 0; i < 700u; i++)
+      same &= beeb_read(SVC_DATA) == (uint8_t)(i ^ 0x5au);
+   ok(same, "written bytes read back through the port");
+   ok(svc_tell() == 0x20010u + 700u, "address after the read-back");
+}
+
+static void test_limits(void)
+{
+   puts("== window limits ==");
+   reset(true);
+   fill(pi.JIM_ram, 0xfff0u, 0x20u);
+   svc_seek(0xfff0u);
+   bool same = true;
+   for (uint32_t i = 0; i < 0x20u; i++)
+      same &= beeb_read(SVC_DATA) == pattern(0xfff0u + i);
+   ok(same, "reads run across a 64K boundary");
+   ok(svc_tell() == 0x10010u, "high address byte follows at the window boundary");
+
+   /* a window stops short at the limit: the wrap is the emulator's */
+   fill(pi.JIM_ram, RAM_SIZE - 16u, 16u);
+   Pi1MHz_MemoryWrite(BYTE_DATA, pi.JIM_ram[RAM_SIZE - 10u]);
+   ok(vpu_stream_arm(BYTE_DATA, RAM_SIZE - 10u, RAM_SIZE, 1u, -1), "armed 10 bytes short of the limit");
+   same = true;
+   for (uint32_t i = 0; i < 10u; i++)
+      same &= beeb_read(BYTE_DATA) == pattern(RAM_SIZE - 10u + i);
+   ok(same && block()->count == 0u, "nine served, the last byte left for the emulator");
+   ok(vpu_half(BYTE_DATA) == pattern(RAM_SIZE - 1u), "register shows the last byte");
+   ok(vpu_stream_take(BYTE_DATA) == 9u, "take counts the nine");
+   ok(!vpu_stream_arm(BYTE_DATA, RAM_SIZE, RAM_SIZE, 1u, -1), "nothing to arm at the limit");
+}
+
+static void test_interleave(void)
+{
+   puts("== two streaming registers ==");
+   reset(true);
+   fill(pi.JIM_ram, 0x3000u, 0x400u);
+   svc_seek(0x3000u);
+   for (uint32_t i = 0; i < 100u; i++)
+      (void)beeb_read(SVC_DATA);
+
+   /* the step-0 register takes the VPU; the services port is parked */
+   beeb_write(BYTE_DATA - 1u, 0x40u);
+   fiqs = 0u;
+   for (uint32_t i = 0; i < 10u; i++)
+      beeb_write(BYTE_DATA, (uint8_t)(0xc0u + i));
+   ok(fiqs == 0u, "step-0 register: armed by its address write, no write is a FIQ");
+   ok(pi.JIM_ram[byte_addr] == 0xc9u, "step-0 register stores in place");
+   ok(vpu_half(BYTE_DATA) == 0xc9u, "and reads back what was written");
+
+   bool same = true;
+   for (uint32_t i = 100u; i < 400u; i++)
+      same &= beeb_read(SVC_DATA) == pattern(0x3000u + i);
+   ok(same, "services port carries on where it was parked");
+   ok(svc_tell() == 0x3000u + 400u, "services address intact");
+}
+
+static void test_command_takes(void)
+{
+   puts("== a command takes the port ==");
+   reset(true);
+   fill(pi.JIM_ram, 0x5000u, 0x200u);
+   svc_seek(0x5000u);
+   for (uint32_t i = 0; i < 50u; i++)
+      (void)beeb_read(SVC_DATA);
+   beeb_write(SVC_BASE + 4u, 0xf0u);
+   ok(!vpu_streaming(SVC_DATA), "data register disarmed by the command register");
+
+   /* a handler would have written the buffer now */
+   pi.JIM_ram[0x5000u + 50u] = 0xeeu;
+   pi.JIM_ram[0x5000u + 51u] = 0xefu;
+   ok(vpu_half(SVC_DATA) == pattern(0x5000u + 50u), "register still shows what it did");
+   (void)beeb_read(SVC_DATA);
+   ok(beeb_read(SVC_DATA) == 0xefu, "next window sees the handler's bytes");
+}
+
+static void test_disable(void)
+{
+   puts("== VPU path off mid-stream ==");
+   reset(true);
+   fill(pi.JIM_ram, 0x7000u, 0x300u);
+   svc_seek(0x7000u);
+   for (uint32_t i = 0; i < 30u; i++)
+      (void)beeb_read(SVC_DATA);
+   vpu_stream_enable(false);
+   ok(!vpu_streaming(SVC_DATA), "bus capture start disarms the register");
+   fiqs = 0u;
+   bool same = true;
+   for (uint32_t i = 30u; i < 60u; i++)
+      same &= beeb_read(SVC_DATA) == pattern(0x7000u + i);
+   ok(same && fiqs == 30u, "every byte is a FIQ again, carrying on in order");
+   vpu_stream_enable(true);
+   fiqs = 0u;
+   for (uint32_t i = 60u; i < 300u; i++)
+      same &= beeb_read(SVC_DATA) == pattern(0x7000u + i);
+   ok(same && fiqs < 4u, "and streams again once it is back");
+   ok(svc_tell() == 0x7000u + 300u, "address intact across both switches");
+}
+
+/* Random mixes of seeks, reads, writes and commands: with and without the
+   VPU the Beeb must see exactly the same. */
+static void run_mix(uint8_t *ram, bool streaming, uint32_t seed, uint8_t *reads,
+                    uint32_t *tells, unsigned int *fiq_out)
+{
+   pi.JIM_ram = ram;
+   reset(streaming);
+   for (unsigned int op = 0; op < 4000u; op++) {
+      seed = seed * 1103515245u + 12345u;
+      unsigned int r = (seed >> 16) % 100u;
+      if (r < 2u) {
+         svc_seek(((seed >> 3) & 0x3ffffu) | (r ? DISC_RAM_SIZE - 0x40000u : 0u));
+      } else if (r < 3u) {
+         beeb_write(SVC_BASE + 4u, 0xf1u);
+      } else if (r < 60u) {
+         reads[op] = beeb_read(SVC_DATA);
+      } else {
+         beeb_write(SVC_DATA, (uint8_t)(seed >> 24));
+      }
+      tells[op] = svc_tell();
+   }
+   *fiq_out = fiqs;
+}
+
+static void test_mix(void)
+{
+   puts("== random mix, VPU against per-byte FIQ ==");
+   static uint8_t reads_on[4000], reads_off[4000];
+   static uint32_t tells_on[4000], tells_off[4000];
+   uint8_t *ram_on = pi.JIM_ram;
+   uint8_t *ram_off = calloc(1, RAM_SIZE);
+   unsigned int fiq_on, fiq_off;
+   bool same = true;
+
+   assert(ram_off != NULL);
+   for (uint32_t seed = 1; seed <= 8u; seed++) {
+      memset(ram_on, 0, RAM_SIZE);
+      fill(ram_on, 0, 0x40000u);
+      fill(ram_on, DISC_RAM_SIZE - 0x40000u, 0x40000u);
+      memcpy(ram_off, ram_on, RAM_SIZE);
+      memset(reads_on, 0, sizeof reads_on);
+      memset(reads_off, 0, sizeof reads_off);
+
+      run_mix(ram_off, false, seed, reads_off, tells_off, &fiq_off);
+      run_mix(ram_on, true, seed, reads_on, tells_on, &fiq_on);
+      same &= memcmp(reads_on, reads_off, sizeof reads_on) == 0;
+      same &= memcmp(tells_on, tells_off, sizeof tells_on) == 0;
+      same &= memcmp(ram_on, ram_off, RAM_SIZE) == 0;
+      same &= fiq_on < fiq_off / 4u;
+   }
+   pi.JIM_ram = ram_on;
+   free(ram_off);
+   ok(same, "8 seeds x 4000 accesses: same bytes, addresses and RAM, far fewer FIQs");
+}
+
+int main(void)
+{
+   pi.JIM_ram = calloc(1, RAM_SIZE);
+   pi.JIM_ram_size = 2;             /* DISC_RAM_BASE == 0 */
+   assert(pi.JIM_ram != NULL);
+
+   test_read_stream();
+   test_write_stream();
+   test_limits();
+   test_interleave();
+   test_command_takes();
+   test_disable();
+   test_mix();
+
+   free(pi.JIM_ram);
+   printf("\n%d checks, %d failures\n", checks, fails);
+   return fails ? 1 : 0;
+}
@@ -924,6 +924,8 @@ static int32_t fs_rename_entry_to(const fs_entry_t* entry, uint32_t parent_handl
 
   /* Renaming either end out from under a started LUN has the same effect as
    * deleting it - see the FA_CREATE_ALWAYS note in fs_send_object_info(). */
+  filesystemReleasePreparedLun(entry->path);
+  filesystemReleasePreparedLun(dst_path);
   if (filesystemHostPathBusy(entry->path) || filesystemHostPathBusy(dst_path)
       || fat_service_file_in_use(entry->path) || fat_service_file_in_use(dst_path)) {
     return MTP_RESP_DEVICE_BUSY;
@@ -1263,6 +1265,7 @@ int32_t tud_mtp_data_complete_cb(tud_mtp_cb_data_t* cb_data) {
           && g_write_state.tmp_active
           && (!g_write_state.size_known
               || g_write_state.transferred == g_write_state.size)) {
+        filesystemReleasePreparedLun(g_write_state.path);
         if (filesystemHostPathBusy(g_write_state.path)
             || fat_service_file_in_use(g_write_state.path)) {
           g_write_state.failed_resp = MTP_RESP_DEVICE_BUSY;
@@ -1799,6 +1802,7 @@ static int32_t fs_send_object_info(tud_mtp_cb_data_t* cb_data) {
      * reference-count, and FA_CREATE_ALWAYS frees the cluster chain that
      * BeebSCSI's cluster link map still points at, so its next write would
      * land in whatever now owns those clusters. *BYE stops the LUN. */
+    filesystemReleasePreparedLun(g_write_state.path);
     if (filesystemHostPathBusy(g_write_state.path)
         || fat_service_file_in_use(g_write_state.path)) {
       fs_release_write_state();
@@ -2161,6 +2165,7 @@ static int32_t fs_delete_object(tud_mtp_cb_data_t* cb_data) {
   /* Covers the recursive case too: filesystemHostPathBusy() reports a
    * directory that holds a started LUN's image as busy, so fs_delete_tree()
    * cannot walk into one. */
+  filesystemReleasePreparedLun(entry.path);
   if (filesystemHostPathBusy(entry.path) || fat_service_file_in_use(entry.path)) {
     return MTP_RESP_DEVICE_BUSY;
   }
@@ -0,0 +1,204 @@
+/* VPU-served data registers - see vpu_stream.h.
+ *
+ * The VPU finds the register by a bit in its half of the VPU window word
+ * (Pi1MHz_MemoryStream) and everything else in the control block below,
+ * which lives in ARM RAM and which it reaches through the GPU_BASE alias,
+ * the same way the framebuffer and VCHIQ buffers are handed over.  The
+ * window itself is JIM RAM, used in place: nothing is copied.
+ *
+ * So both sides go through memory the ARM caches, and the rules are:
+ *
+ *    arming     clean the window and then the block, so the VPU reads what
+ *               the ARM last wrote;
+ *    taking     invalidate the block before reading it back, and the
+ *               window too if the VPU wrote to it - only then, so that a
+ *               read-only stream can never throw away an ARM write.
+ *
+ * While a window is armed nothing on the ARM side may write into it.  The
+ * emulators do all their JIM writes for the port from the port's own
+ * callbacks, which take first; a service handler writes the buffer from a
+ * command, and the command register's callback takes too, so the next data
+ * access finds the window disarmed and arms a fresh one.  The page-RAM
+ * window at &FD00 can write anywhere in JIM RAM, so its callback releases
+ * whatever is armed.
+ *
+ * Taking is not synchronised with the VPU beyond that: it relies on the
+ * Beeb not accessing the data register while the FIQ for one of its other
+ * registers is still pending - the assumption the per-byte FIQ already
+ * made, since the byte the register shows is only right once that FIQ has
+ * run.
+ */
+
+#include <string.h>
+
+#include "Pi1MHz.h"
+#include "rpi/base.h"
+#include "rpi/cache.h"
+#include "vpu_stream.h"
+#include "jim_pages.h"
+
+#define STREAM_WINDOW 256u
+
+/* Laid out as Pi1MHzvc.s expects it (STREAM_COUNT ...), one cache line. */
+typedef struct {
+   uint32_t count;      // accesses the VPU may still serve; 0 = ring the ARM
+   uint32_t ptr;        // VC address of the byte the register shows
+   uint32_t step;       // added to ptr after each access
+   uint32_t base;       // VC address of JIM_ram[0], for the read-back
+   int32_t  addr_word;  // VPU word of the address read-back pair, -1 for none
+   uint32_t written;    // non-zero once the VPU has stored a byte
+   uint32_t spare[2];
+} vpu_stream_block_t;
+
+_Static_assert(sizeof(vpu_stream_block_t) == 32, "Pi1MHzvc.s knows the layout");
+
+static vpu_stream_block_t stream_block __attribute__((aligned(32)));
+
+static int      stream_port = -1;    // armed register, -1 for none
+static int      stream_addr_reg;
+static uint32_t stream_given;        // count when it was armed
+static size_t   stream_window;       // offset of the armed window
+
+/* A slot per streaming emulator: a register is only parked when it was
+   armed, and an emulator takes what it has parked before it arms again. */
+#define STREAM_PARKED 2u
+
+static struct {
+   int      port;                    // -1 for a free slot
+   uint32_t done;
+} parked[STREAM_PARKED] = { { -1, 0u }, { -1, 0u } };
+
+static bool     stream_enabled = true;
+
+static uint32_t vpu_stream_vc(const void *p)
+{
+   return (uint32_t)(GPU_BASE | (uintptr_t)p);
+}
+
+/* VC address of JIM_ram[addr].  Paged JIM RAM (jim_pages.h) is only
+   contiguous in the ARM's virtual window, so the VPU is given the page's
+   physical address; a window never crosses a page. */
+static uint32_t vpu_stream_jim(size_t addr)
+{
+   if (jim_pages_active())
+      return (uint32_t)(GPU_BASE | jim_pages_phys(addr));
+   return vpu_stream_vc(Pi1MHz->JIM_ram + addr);
+}
+
+/* How many accesses the VPU may serve from addr: to the end of the window
+   or limit, whichever is first.  Without a step it never leaves the byte,
+   but the block still gets looked at once a window's worth. */
+static uint32_t vpu_stream_window(size_t addr, size_t limit, unsigned int step)
+{
+   size_t n = (STREAM_WINDOW - 1u) - (addr & (STREAM_WINDOW - 1u));
+
+   if (addr >= limit)
+      return 0u;
+   if (step == 0u)
+      return STREAM_WINDOW - 1u;
+   if (limit - 1u - addr < n)
+      n = limit - 1u - addr;
+   return (uint32_t)n;
+}
+
+static uint32_t vpu_stream_stop(void)
+{
+   uint32_t done;
+
+   Pi1MHz_MemoryStream((uint32_t)stream_port, false);
+   _invalidate_cache_area(&stream_block, sizeof stream_block);
+   done = stream_given - stream_block.count;
+   if (stream_block.written != 0u)
+      _invalidate_cache_area(Pi1MHz->JIM_ram + stream_window, STREAM_WINDOW);
+   if (stream_addr_reg >= 0)
+      Pi1MHz_MemoryStream((uint32_t)stream_addr_reg, false);
+   stream_port = -1;
+   return done;
+}
+
+static void vpu_stream_park(void)
+{
+   unsigned int i = 0u;
+
+   while (i + 1u < STREAM_PARKED && parked[i].port >= 0)
+      i++;
+   parked[i].port = stream_port;
+   parked[i].done = vpu_stream_stop();
+}
+
+bool vpu_stream_arm(uint8_t port, size_t addr, size_t limit, unsigned int step,
+                    int addr_reg)
+{
+   uint32_t n;
+
+   vpu_stream_release();
+   if (!stream_enabled)
+      return false;
+   n = vpu_stream_window(addr, limit, step);
+   if (n == 0u)
+      return false;
+
+   // the VPU writes memory directly, so the page has to be one of its own
+   // and not the shared zero page; without one the bytes go by FIQ
+   if (!jim_pages_back(addr))
+      return false;
+
+   // limit is a multiple of the window, so the window is all JIM RAM
+   stream_window = addr & ~(size_t)(STREAM_WINDOW - 1u);
+   _clean_cache_area(Pi1MHz->JIM_ram + stream_window, STREAM_WINDOW);
+
+   stream_block.count = n;
+   stream_block.ptr = vpu_stream_jim(addr);
+   stream_block.step = step;
+   stream_block.base = stream_block.ptr - (uint32_t)addr;   // wraps for paged RAM; only differences are used
+   stream_block.addr_word = (addr_reg < 0) ? -1 : (int32_t)((unsigned int)addr_reg >> 1);
+   stream_block.written = 0u;
+   _clean_cache_area(&stream_block, sizeof stream_block);
+
+   stream_port = port;
+   stream_addr_reg = addr_reg;
+   stream_given = n;
+   Pi1MHz_MemoryStream(port, true);   // last: the VPU may start now
+   return true;
+}
+
+uint32_t vpu_stream_take(uint8_t port)
+{
+   if (stream_port == (int)port)
+      return vpu_stream_stop();
+   for (unsigned int i = 0u; i < STREAM_PARKED; i++) {
+      if (parked[i].port == (int)port) {
+         parked[i].port = -1;
+         return parked[i].done;
+      }
+   }
+   return 0u;
+}
+
+void vpu_stream_release(void)
+{
+   if (stream_port >= 0)
+      vpu_stream_park();
+}
+
+void vpu_stream_enable(bool enable)
+{
+   stream_enabled = enable;
+   if (!enable)
+      vpu_stream_release();
+}
+
+void vpu_stream_reset(void)
+{
+   stream_port = -1;
+   for (unsigned int i = 0u; i < STREAM_PARKED; i++)
+      parked[i].port = -1;
+   stream_enabled = true;
+   memset(&stream_block, 0, sizeof stream_block);
+   _clean_cache_area(&stream_block, sizeof stream_block);
+}
+
+uint32_t vpu_stream_bus(void)
+{
+   return vpu_stream_vc(&stream_block);
+}
@@ -0,0 +1,60 @@
+#ifndef VPU_STREAM_H
+#define VPU_STREAM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Auto-incrementing data registers served by the VPU.
+ *
+ * The services port at &FCA9 and the byte-RAM port at &FC03 cost a FIQ for
+ * every byte the Beeb moves through them.  Armed here, the VPU serves the
+ * register itself from JIM RAM - storing a written byte, stepping the
+ * pointer, putting the next byte up for a read and keeping the address
+ * read-back registers in step - for the rest of a 256-byte window.  The
+ * first access after that rings the doorbell as it always did, and the
+ * emulator's own callback does that byte, moves on and arms the next
+ * window: one FIQ per 256 bytes rather than one per byte.
+ *
+ * The emulator keeps owning its address.  Every callback for the port -
+ * data, address or command register - starts with vpu_stream_take(), which
+ * says how many accesses the VPU served since the window was armed, and
+ * ends, if it wants the VPU back, with vpu_stream_arm().  In between it
+ * updates FRED exactly as it did without the VPU; arming has to come after
+ * any Pi1MHz_MemoryWrite() to the data register's pair.
+ *
+ * Only one register is armed at a time.  Arming another, releasing it, or
+ * switching the VPU path off for a bus capture (Pi1MHz_MemoryLocal), parks
+ * the count of the one that loses out until its emulator takes it.  With
+ * the VPU path off, vpu_stream_arm() returns false and every byte is a FIQ
+ * again. */
+
+/* Let the VPU serve the FRED data register at port from JIM_ram[addr],
+   stepping by step (1 to post-increment, 0 to stay put), to the end of
+   addr's 256-byte window or limit, whichever comes first.  The register
+   must already read as JIM_ram[addr].  addr_reg is the even FRED address of
+   the low/middle address read-back bytes for the VPU to keep up to date,
+   or -1.  False, with nothing armed, if the VPU may not stream. */
+bool vpu_stream_arm(uint8_t port, size_t addr, size_t limit, unsigned int step,
+                    int addr_reg);
+
+/* Take port back: the number of accesses the VPU served for it since it
+   was armed, 0 if it was not. */
+uint32_t vpu_stream_take(uint8_t port);
+
+/* Disarm whatever is armed, parking its count for its emulator: for ARM
+   code about to write JIM RAM that might be in the window.  One compare
+   when nothing is. */
+void vpu_stream_release(void);
+
+/* From Pi1MHz_MemoryLocal(): false takes the VPU off streaming. */
+void vpu_stream_enable(bool enable);
+
+/* From init_emulator(): the VPU window has been cleared, so forget what
+   was armed.  Streaming is allowed again. */
+void vpu_stream_reset(void);
+
+/* The control block's VC address, for the VPU's r5. */
+uint32_t vpu_stream_bus(void);
+
+#endif
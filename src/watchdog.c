@@ -124,6 +124,31 @@ static void watchdog_poll(void)
    *PM_RSTC = PM_PASSWORD | ((*PM_RSTC & PM_RSTC_WRCFG_CLR) | PM_RSTC_WRCFG_FULL_RESET);
 }
 
+/* For the rare poller that has to hold the loop for longer than the
+   timeout - a snapshot save - and so cannot wait for watchdog_poll().  Does
+   nothing when no watchdog was configured, rather than arming one. */
+void watchdog_kick(void)
+{
+   if (watchdog_ticks == 0u)
+      return;
+   watchdog_last_kick_us = RPI_GetSystemTime();
+   *PM_WDOG = PM_PASSWORD | watchdog_ticks;
+   *PM_RSTC = PM_PASSWORD | ((*PM_RSTC & PM_RSTC_WRCFG_CLR) | PM_RSTC_WRCFG_FULL_RESET);
+}
+
+/* A deferred init (USB, the video player's index) may block as long as it
+   did when it ran between watchdog_boot_kick() calls, which can be well
+   past a one-second configured timeout.  The kick clock is left alone, so
+   the next due watchdog_poll() - at most a quarter of a second after the
+   init returns - puts the configured timeout back. */
+void watchdog_init_kick(void)
+{
+   if (watchdog_ticks == 0u)
+      return;
+   *PM_WDOG = PM_PASSWORD | (WATCHDOG_BOOT_SECONDS * PM_WDOG_TICKS_PER_SEC);
+   *PM_RSTC = PM_PASSWORD | ((*PM_RSTC & PM_RSTC_WRCFG_CLR) | PM_RSTC_WRCFG_FULL_RESET);
+}
+
 // cppcheck-suppress unusedFunction
 void watchdog_init(uint8_t instance, uint8_t address)
 {
@@ -161,5 +186,9 @@ void watchdog_init(uint8_t instance, uint8_t address)
    /* Take over from the boot watchdog seamlessly: stamp the kick clock as
       already due so the first poll re-arms with the configured timeout. */
    watchdog_last_kick_us = RPI_GetSystemTime() - WATCHDOG_KICK_INTERVAL_US;
-   Pi1MHz_Register_Poll(watchdog_poll);
+   /* Last in the pass, and only called when a kick could be due.  The check
+      in watchdog_poll() stays: the scheduler's period is in its own ticks,
+      the kick clock is Pi1MHz_now_us. */
+   Pi1MHz_Register_Poll_Sched(watchdog_poll, POLL_BACKGROUND,
+                              WATCHDOG_KICK_INTERVAL_US, 0u);
 }
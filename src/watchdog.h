@@ -15,4 +15,13 @@ void watchdog_stop(void);
 void watchdog_boot_kick(void);
 void watchdog_init(uint8_t instance, uint8_t address);
 
+/* Re-arm the configured watchdog now, from a poller that blocks the loop
+   for longer than its timeout.  A no-op if there is no watchdog. */
+void watchdog_kick(void);
+
+/* Give an emulator init deferred to the poll loop the same allowance it had
+   at boot; watchdog_poll() brings the configured timeout back on its next
+   kick.  A no-op if there is no watchdog. */
+void watchdog_init_kick(void);
+
 #endif
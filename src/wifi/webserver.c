@@ -29,6 +29,9 @@
 #include "../rpi/systimer.h"
 #include "../Pi1MHz.h"
 #include "../AUN/aun_emulator.h"
+#include "../bus_trace.h"
+#include "../profiler.h"
+#include "../snapshot.h"
 
 #include "lwip/err.h"
 #include "lwip/tcp.h"
@@ -170,6 +173,7 @@ typedef struct {
    uint32_t dl_remaining;
    bool     dl_eof;
    bool     dl_bench;      /* /bench.bin: body from RAM, no SD involved */
+   bool     dl_trace;      /* /bustrace.bin: body from the bus recorder */
    uint8_t  dl_buf[WS_FILE_CHUNK];
    size_t   dl_buf_len;
    size_t   dl_buf_sent;
@@ -444,6 +448,19 @@ static bool ws_propfind_cache_lookup(const char *path, FILINFO *out)
    leave a dangling reference. */
 static ws_conn_t      *g_ws_active_copy;
 
+/* The /bustrace.bin download in flight, if any.  Its body arrives as the
+   Beeb makes accesses, not when TCP asks for more, so webserver_poll pumps
+   it every tick; conn_close and the keep-alive reset end the capture. */
+static ws_conn_t      *g_ws_trace_conn;
+
+static void ws_trace_release(const ws_conn_t *c)
+{
+   if (g_ws_trace_conn != c)
+      return;
+   g_ws_trace_conn = NULL;
+   bus_trace_stop();
+}
+
 /* When the last byte moved on any connection.  Used to keep the free-space
    FAT walk out of the way of active transfers - see webserver_refresh_sd_free. */
 static uint32_t        g_ws_last_io_us;
@@ -1175,7 +1192,9 @@ static void ws_parent_path(const char *sdpath, char *out, size_t osz)
 /* A path is busy while the Beeb holds it open either as a started SCSI
    LUN image or through the FAT service (MMFS disc images, BEEB.MMB) -
    or when it is a directory containing such a file.  The advice differs
-   per filing system, so the shared message names both. */
+   per filing system, so the shared message names both.  Only looks: each
+   write path first lets go of a LUN image BeebSCSI opened ahead of the
+   Beeb, with filesystemReleasePreparedLun(). */
 #define WS_BUSY_MSG "That file is in use by the Beeb - release it first " \
                     "(*BYE in ADFS; close it or CTRL-BREAK in MMFS)."
 static bool ws_beeb_path_busy(const char *path)
@@ -1755,6 +1774,7 @@ static bool conn_close(ws_conn_t *c, bool abort_conn)
       timeout / client-disconnect mid-COPY must release the slot so
       the next COPY request isn't rejected with 503 forever. */
    ws_copy_slot_release(c);
+   ws_trace_release(c);
 
    if (c->pcb != NULL) {
       struct tcp_pcb *pcb = c->pcb;
@@ -1902,6 +1922,13 @@ static bool conn_pump(ws_conn_t *c)
                   is to measure the network path with the SD card out of the
                   loop entirely - the file path below pays an f_read here. */
                br = req;
+            } else if (c->dl_trace) {
+               /* Whatever the recorder has so far.  Nothing yet is not the
+                  end - the Beeb may simply be quiet - so wait for
+                  webserver_poll to pump again rather than set dl_eof. */
+               br = (UINT)bus_trace_read(c->dl_buf, req);
+               if (br == 0u)
+                  break;
             } else if (f_read(&c->dl_file, c->dl_buf, req, &br) != FR_OK
                 || br == 0u) {
                /* Short of the Content-Length already promised (file truncated
@@ -2136,6 +2163,8 @@ static void conn_reset_for_next_request(ws_conn_t *c, size_t pipelined_keep)
    c->dl_remaining = 0u;
    c->dl_eof = false;
    c->dl_bench = false;
+   ws_trace_release(c);
+   c->dl_trace = false;
    c->dl_buf_len = 0u;
    c->dl_buf_sent = 0u;
    c->up_state = UP_PART_HEADER;
@@ -2335,6 +2364,9 @@ static bool route_home(ws_conn_t *c)
       "<p><a href=\"/framebuffer\">View the framebuffer &rarr;</a></p>"
       "<p><a href=\"/status\">Network status &rarr;</a></p>"
       "<p><a href=\"/aun\">AUN status &rarr;</a></p>"
+      "<p><a href=\"/bustrace.bin\">Capture the next 64K bus accesses &rarr;</a></p>"
+      "<p><a href=\"/profile\">Poll and FIQ profiler &rarr;</a></p>"
+      "<p><a href=\"/snapshot\">Save or discard the resume snapshot &rarr;</a></p>"
       "<p><a href=\"/reboot\">Reboot the Pi &rarr;</a></p>"
       "</div>");
    page_close(&b);
@@ -2358,6 +2390,80 @@ static bool route_aun(ws_conn_t *c)
    return ws_finish_html(c, 200, "OK", &b);
 }
 
+/* GET /profile[?on=1|off=1|reset=1] - the profiler's last complete
+   one-second window (profiler.h), and the switch for it.  The Beeb can
+   switch it too, through the Profiler's fx register; either sees the
+   other's setting. */
+static bool route_profile(ws_conn_t *c, const char *query)
+{
+   static char prof[8192];
+   char v[4];
+   ws_strbuf_t b;
+
+   /* HEAD must not switch anything. */
+   if (!c->is_head) {
+      if (ws_query_param(query, "on", v, sizeof v))
+         profiler_set(true);
+      if (ws_query_param(query, "off", v, sizeof v))
+         profiler_set(false);
+      if (ws_query_param(query, "reset", v, sizeof v))
+         profiler_reset();
+   }
+
+   profiler_status_text(prof, sizeof prof);
+   sb_init(&b);
+   page_open(&b, "Profiler");
+   sb_puts(&b, "<h1>Profiler</h1><div class=\"card\"><pre>");
+   sb_html(&b, prof);
+   sb_puts(&b, "</pre>"
+               "<p><a href=\"/profile?on=1\">On</a> &middot; "
+               "<a href=\"/profile?off=1\">Off</a> &middot; "
+               "<a href=\"/profile?reset=1\">Restart the window</a> &middot; "
+               "<a href=\"/profile\">Refresh</a></p></div>");
+   page_close(&b);
+   return ws_finish_html(c, 200, "OK", &b);
+}
+
+/* GET /snapshot[?save=1|discard=1] - the resume snapshot (snapshot.h).
+   Saving walks the whole of JIM RAM, so it is only queued here and done by
+   the snapshot poller once this page has gone; refresh to see how it went. */
+static bool route_snapshot(ws_conn_t *c, const char *query)
+{
+   static char snap[512];
+   char v[4];
+   ws_strbuf_t b;
+   const char *queued = NULL;
+
+   /* HEAD must not do anything. */
+   if (!c->is_head) {
+      if (ws_query_param(query, "save", v, sizeof v)) {
+         snapshot_request(SNAPSHOT_FX_SAVE);
+         queued = "Saving - the Pi pauses while it writes.";
+      } else if (ws_query_param(query, "discard", v, sizeof v)) {
+         snapshot_request(SNAPSHOT_FX_DISCARD);
+         queued = "Discarding - the next power-on starts cold.";
+      }
+   }
+
+   snapshot_status_text(snap, sizeof snap);
+   sb_init(&b);
+   page_open(&b, "Snapshot");
+   sb_puts(&b, "<h1>Snapshot</h1><div class=\"card\">");
+   if (queued != NULL) {
+      sb_puts(&b, "<p>");
+      sb_html(&b, queued);
+      sb_puts(&b, "</p>");
+   }
+   sb_puts(&b, "<pre>");
+   sb_html(&b, snap);
+   sb_puts(&b, "</pre>"
+               "<p><a href=\"/snapshot?save=1\">Save now</a> &middot; "
+               "<a href=\"/snapshot?discard=1\">Discard</a> &middot; "
+               "<a href=\"/snapshot\">Refresh</a></p></div>");
+   page_close(&b);
+   return ws_finish_html(c, 200, "OK", &b);
+}
+
 static bool route_status(ws_conn_t *c)
 {
    wifi_status_t                st  = wifi_get_status();
@@ -3066,6 +3172,69 @@ static bool route_bench(ws_conn_t *c)
    return true;
 }
 
+/* GET /bustrace.bin?n=<accesses> - capture the next n FRED/JIM accesses
+   (default 64K, at most 16M) and stream them as they happen, in the format
+   bus_trace.h describes.  The length is known up front, so this is an
+   ordinary Content-Length download that simply arrives at the Beeb's pace;
+   closing the connection ends the capture. */
+#define WS_TRACE_DEFAULT_RECORDS (64u * 1024u)
+#define WS_TRACE_MAX_RECORDS     (16u * 1024u * 1024u)
+
+static bool route_bustrace(ws_conn_t *c, const char *query)
+{
+   ws_strbuf_t h;
+   char n_str[12];
+   uint32_t records = WS_TRACE_DEFAULT_RECORDS;
+
+   if (ws_query_param(query, "n", n_str, sizeof n_str)) {
+      unsigned long n = strtoul(n_str, NULL, 10);
+      if (n == 0u)
+         return ws_error(c, 400, "Bad Request", "n must be a positive count.");
+      records = (n > WS_TRACE_MAX_RECORDS) ? WS_TRACE_MAX_RECORDS : (uint32_t)n;
+   }
+   /* HEAD must not start a capture nobody will read. */
+   if (!c->is_head) {
+      if (!bus_trace_start(records))
+         return ws_error(c, 503, "Service Unavailable",
+                         "A bus trace is already running.");
+      g_ws_trace_conn = c;
+   }
+
+   sb_init(&h);
+   sb_printf(&h,
+             "HTTP/1.1 200 OK\r\n"
+             "Content-Type: application/octet-stream\r\n"
+             "Content-Length: %lu\r\n"
+             "Content-Disposition: attachment; filename=\"bustrace.bin\"\r\n"
+             "Cache-Control: no-store\r\n"
+             "%s"
+             "\r\n",
+             (unsigned long)(BUS_TRACE_HEADER + records * BUS_TRACE_RECORD),
+             ws_connection_hdr(c));
+   if (h.failed) {
+      sb_free(&h);
+      ws_trace_release(c);
+      return ws_oom(c);
+   }
+
+   c->dl_open = false;
+   c->dl_trace = true;
+   c->dl_remaining = BUS_TRACE_HEADER + records * BUS_TRACE_RECORD;
+   c->dl_eof = false;
+   c->dl_buf_len = 0u;
+   c->dl_buf_sent = 0u;
+
+   free(c->out);
+   c->out = h.data;
+   c->out_len = h.len;
+   c->out_sent = 0u;
+   c->bytes_queued = 0u;
+   c->bytes_acked = 0u;
+   c->state = CONN_SEND_FILE;
+   conn_pump(c);
+   return true;
+}
+
 static bool route_files_get(ws_conn_t *c, const char *rawpath)
 {
    char    decoded[WS_PATH_MAX];
@@ -3245,6 +3414,7 @@ static bool upload_finish(ws_conn_t *c)
       char tmp[WS_UP_TMP_MAX];
 
       upload_build_paths(c, full, sizeof full, tmp, sizeof tmp);
+      filesystemReleasePreparedLun(full);
       if (ws_beeb_path_busy(full))
          return upload_fail(c, WS_BUSY_MSG);
       (void)f_unlink(full);                 /* f_rename needs a free target */
@@ -3315,6 +3485,7 @@ static bool upload_begin_part(ws_conn_t *c)
          re-check - so a disconnect, or the Beeb opening the file mid-upload,
          cannot destroy a pre-existing file.  Still refuse up front if the
          Beeb already holds it open. */
+      filesystemReleasePreparedLun(full);
       if (ws_beeb_path_busy(full))
          return upload_fail(c, WS_BUSY_MSG);
 
@@ -4111,12 +4282,15 @@ static bool dav_put_flush(ws_conn_t *c)
       Bytes already flushed have patched the file (there is no temp
       to roll back), but stopping bounds the damage and the client's
       write ordering keeps the catalogue consistent. */
-   if (c->dav_put_in_place && ws_beeb_path_busy(c->dav_put_target)) {
-      f_close(&c->write_file.dav);
-      c->dav_put_open = false;
-      c->dav_put_buf_len = 0u;
-      (void)ws_error(c, 423, "Locked", WS_BUSY_MSG);
-      return false;
+   if (c->dav_put_in_place) {
+      filesystemReleasePreparedLun(c->dav_put_target);
+      if (ws_beeb_path_busy(c->dav_put_target)) {
+         f_close(&c->write_file.dav);
+         c->dav_put_open = false;
+         c->dav_put_buf_len = 0u;
+         (void)ws_error(c, 423, "Locked", WS_BUSY_MSG);
+         return false;
+      }
    }
    if (f_write(&c->write_file.dav, c->dl_buf, (UINT)c->dav_put_buf_len, &bw)
           != FR_OK || bw != c->dav_put_buf_len) {
@@ -4225,6 +4399,7 @@ static bool dav_put_finish(ws_conn_t *c)
          can start the LUN in that window - so re-check here rather than
          trusting the check at PUT entry. Drop the temp and fail: better a
          failed upload than an image replaced under a running BeebSCSI. */
+      filesystemReleasePreparedLun(c->dav_put_target);
       if (ws_beeb_path_busy(c->dav_put_target)) {
          (void)f_unlink(c->dav_put_tmppath);
          return ws_error(c, 423, "Locked", WS_BUSY_MSG);
@@ -4453,6 +4628,7 @@ static bool route_dav_put(ws_conn_t *c, const char *rawpath, int body_at,
       whatever later owns those clusters. *BYE on the Beeb stops the LUN.
       Re-checked at the rename in dav_put_finish(), since the LUN can start
       while a long upload is still streaming into the .part file. */
+   filesystemReleasePreparedLun(sdpath);
    if (ws_beeb_path_busy(sdpath))
       return ws_error(c, 423, "Locked", WS_BUSY_MSG);
 
@@ -4786,6 +4962,7 @@ static bool route_dav_delete(ws_conn_t *c, const char *rawpath)
       return ws_error(c, 403, "Forbidden", "Refusing to delete the root.");
    /* Also covers a collection holding a started LUN's image, so the
       depth-infinity walk below cannot descend into one. */
+   filesystemReleasePreparedLun(sdpath);
    if (ws_beeb_path_busy(sdpath))
       return ws_error(c, 423, "Locked", WS_BUSY_MSG);
    if (f_stat(sdpath, &fno) != FR_OK)
@@ -5049,6 +5226,8 @@ static bool route_dav_move_or_copy(ws_conn_t *c, const char *rawpath, bool is_mo
       return ws_error(c, 403, "Forbidden", "Refusing to touch the root.");
    /* Either end: moving the image away from a started LUN is as bad as
       overwriting the one it is running from. */
+   filesystemReleasePreparedLun(src);
+   filesystemReleasePreparedLun(dst);
    if (ws_beeb_path_busy(src) || ws_beeb_path_busy(dst))
       return ws_error(c, 423, "Locked", WS_BUSY_MSG);
    if (f_stat(src, &fno_src) != FR_OK)
@@ -5799,8 +5978,14 @@ static bool process_request(ws_conn_t *c, int body_at)
          return route_status(c);
       if (strcmp(rawpath, "/bench.bin") == 0)
          return route_bench(c);
+      if (strcmp(rawpath, "/bustrace.bin") == 0)
+         return route_bustrace(c, (query != NULL) ? query + 1 : NULL);
       if (strcmp(rawpath, "/aun") == 0)
          return route_aun(c);
+      if (strcmp(rawpath, "/profile") == 0)
+         return route_profile(c, (query != NULL) ? query + 1 : NULL);
+      if (strcmp(rawpath, "/snapshot") == 0)
+         return route_snapshot(c, (query != NULL) ? query + 1 : NULL);
       if (strcmp(rawpath, "/framebuffer") == 0)
          return route_framebuffer(c);
       if (strcmp(rawpath, "/framebuffer.bmp") == 0)
@@ -6183,6 +6368,10 @@ void webserver_poll(void)
       ws_copy_step(g_ws_active_copy);
    }
 
+   /* The bus trace body is produced by the FIQ, not by an ACK. */
+   if (g_ws_trace_conn != NULL)
+      (void)conn_pump(g_ws_trace_conn);
+
    if (g_ws_ready)
       webserver_refresh_sd_free();
 
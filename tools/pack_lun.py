@@ -0,0 +1,303 @@
+#!/usr/bin/env python3
+"""
+pack_lun.py - pack, unpack and check BeebSCSI packed (compressed) LUN images
+
+A packed scsiN.dat (see src/BeebSCSI/packedlun.h) is a 512 byte header, an
+index of the disc's chunks, and the chunks, each compressed on its own as
+an LZ4 block and starting on a 512 byte boundary. The Pi reads it as the
+disc, but never writes it, so it is for VFS volumes and other discs that
+are only read: a Domesday volume takes less of the SD card, and less time
+to read off it.
+
+  ./pack_lun.py scsi0.dat scsi0-packed.dat           # flat -> packed
+  ./pack_lun.py --flat scsi0-packed.dat scsi0.dat    # packed -> flat
+  ./pack_lun.py --verify scsi0-packed.dat            # every chunk unpacks
+  ./pack_lun.py --verify scsi0-packed.dat scsi0.dat  # ... to this image
+
+Chunks are 64K unless --chunk says otherwise (4, 8, 16 or 32, in K). 64K
+packs best and reads a volume through fastest, but the Pi has to read a
+whole chunk for a single sector, so a disc that ADFS reads a sector here
+and there is quicker in chunks of 16K.
+
+A flat image shorter than its disc can be given the disc's size with
+--sectors; the rest reads as zeros, as it would from the flat image.
+
+Requires: python3. The lz4 module (pip install lz4) is used if it is there,
+which packs a disc many times faster and a little smaller; without it the
+blocks are made here, at about a megabyte a second.
+"""
+
+import argparse
+import struct
+import sys
+
+try:
+    import lz4.block as lz4block
+except ImportError:
+    lz4block = None
+
+MAGIC = b"BSCSILZ4"
+VERSION = 1
+HEADER_SIZE = 512
+CHUNK_SIZES = (4, 8, 16, 32, 64)     # K
+MAX_SECTORS = 1 << 21
+
+MIN_MATCH = 4
+LAST_LITERALS = 5      # the block format's end rules, which the Pi's
+MF_LIMIT = 12          # decoder and every other one hold blocks to
+
+
+def align(n):
+    return (n + 511) // 512 * 512
+
+
+def data_start(chunks):
+    return align(HEADER_SIZE + chunks * 8)
+
+
+def put_length(out, n):
+    while n >= 255:
+        out.append(255)
+        n -= 255
+    out.append(n)
+
+
+def match_length(src, ref, pos, limit):
+    """How far src[pos:] runs on as src[ref:] does, stopping at limit."""
+    n, step = 0, 16
+    while step:
+        k = min(step, limit - pos - n)
+        if k <= 0:
+            break
+        if src[ref + n:ref + n + k] == src[pos + n:pos + n + k]:
+            n += k
+            step *= 2
+        else:
+            step = k // 2
+    return n
+
+
+def compress(src):
+    """An LZ4 block of src, greedy, as src/lz4_block.c makes them."""
+    if lz4block is not None:
+        return lz4block.compress(src, mode="high_compression",
+                                 compression=12, store_size=False)
+    n = len(src)
+    out = bytearray()
+    table = {}
+    anchor = pos = 0
+    misses = 0
+    while pos < n - MF_LIMIT:
+        key = src[pos:pos + MIN_MATCH]
+        ref = table.get(key)
+        table[key] = pos
+        if ref is None:
+            # the longer it goes without a match, the further it skips
+            misses += 1
+            pos += 1 + (misses >> 6)
+            continue
+        misses = 0
+        length = MIN_MATCH + match_length(src, ref + MIN_MATCH,
+                                          pos + MIN_MATCH, n - LAST_LITERALS)
+        lit = pos - anchor
+        ml = length - MIN_MATCH
+        out.append((min(lit, 15) << 4) | min(ml, 15))
+        if lit >= 15:
+            put_length(out, lit - 15)
+        out += src[anchor:pos]
+        out += struct.pack("<H", pos - ref)
+        if ml >= 15:
+            put_length(out, ml - 15)
+        pos += length
+        anchor = pos
+        if pos - 2 < n - MF_LIMIT:
+            table[src[pos - 2:pos + 2]] = pos - 2
+    lit = n - anchor
+    out.append(min(lit, 15) << 4)
+    if lit >= 15:
+        put_length(out, lit - 15)
+    out += src[anchor:]
+    return bytes(out)
+
+
+def decompress(src, size):
+    """The size bytes an LZ4 block unpacks to; ValueError if it does not."""
+    if lz4block is not None:
+        try:
+            out = lz4block.decompress(src, uncompressed_size=size)
+        except Exception as e:
+            raise ValueError(str(e)) from None
+        if len(out) != size:
+            raise ValueError("wrong size")
+        return out
+    out = bytearray()
+    i = 0
+    try:
+        while True:
+            token = src[i]
+            i += 1
+            lit = token >> 4
+            if lit == 15:
+                while True:
+                    b = src[i]
+                    i += 1
+                    lit += b
+                    if b != 255:
+                        break
+            if i + lit > len(src):
+                raise ValueError("literals past the end")
+            out += src[i:i + lit]
+            i += lit
+            if i == len(src):
+                break
+            offset = src[i] | src[i + 1] << 8
+            i += 2
+            if offset == 0 or offset > len(out):
+                raise ValueError("bad match offset")
+            ml = token & 15
+            if ml == 15:
+                while True:
+                    b = src[i]
+                    i += 1
+                    ml += b
+                    if b != 255:
+                        break
+            ml += MIN_MATCH
+            start = len(out) - offset
+            if offset >= ml:
+                out += out[start:start + ml]
+            else:
+                run = out[start:]
+                out += (run * (ml // offset + 1))[:ml]
+            if len(out) > size:
+                raise ValueError("longer than its chunk")
+    except IndexError:
+        raise ValueError("truncated") from None
+    if len(out) != size:
+        raise ValueError("shorter than its chunk")
+    return bytes(out)
+
+
+def pack(args):
+    with open(args.input, "rb") as f:
+        flat = f.read()
+    sectors = args.sectors or (len(flat) + 255) // 256
+    if sectors == 0:
+        sys.exit("error: the disc has no sectors")
+    if sectors > MAX_SECTORS:
+        sys.exit(f"error: {sectors} sectors is more than ADFS can address")
+    if sectors * 256 < len(flat):
+        sys.exit(f"error: {args.input} is longer than {sectors} sectors")
+    if flat[:8] == MAGIC:
+        sys.exit(f"error: {args.input} is already packed")
+    disc = flat + bytes(sectors * 256 - len(flat))
+
+    chunk_size = args.chunk * 1024
+    chunks = (sectors * 256 + chunk_size - 1) // chunk_size
+    offset = data_start(chunks)
+    index, blobs = [], []
+    for c in range(chunks):
+        chunk = disc[c * chunk_size:(c + 1) * chunk_size]
+        blob = compress(chunk)
+        # a chunk that does not get smaller is held as it is
+        if len(blob) >= len(chunk):
+            blob = chunk
+        index.append((offset, len(blob)))
+        blobs.append(blob)
+        offset += align(len(blob))
+
+    header = struct.pack("<8sIII", MAGIC, VERSION, chunk_size // 256, sectors)
+    head = header.ljust(HEADER_SIZE, b"\0")
+    head += b"".join(struct.pack("<II", o, n) for o, n in index)
+    with open(args.output, "wb") as out:
+        out.write(head.ljust(data_start(chunks), b"\0"))
+        for blob in blobs:
+            out.write(blob.ljust(align(len(blob)), b"\0"))
+    print(f"wrote {args.output}: {sectors} sectors in {chunks} "
+          f"{args.chunk}K chunks, "
+          f"{offset} bytes ({100 * offset / (sectors * 256):.0f}% of flat)")
+
+
+def unpack(name):
+    """The disc a packed image holds, checked as the Pi checks it."""
+    with open(name, "rb") as f:
+        image = f.read()
+    if len(image) < HEADER_SIZE or image[:8] != MAGIC:
+        sys.exit(f"error: {name} is not a packed LUN image")
+    version, chunk_sectors, sectors = struct.unpack_from("<III", image, 8)
+    if version != VERSION or chunk_sectors not in [k * 4 for k in CHUNK_SIZES]:
+        sys.exit(f"error: {name}: unknown version {version} "
+                 f"or chunk size {chunk_sectors}")
+    if not 0 < sectors <= MAX_SECTORS:
+        sys.exit(f"error: {name}: {sectors} sectors")
+    chunks = (sectors + chunk_sectors - 1) // chunk_sectors
+    start = data_start(chunks)
+    if len(image) < start:
+        sys.exit(f"error: {name} is damaged (its index is cut short)")
+
+    disc = []
+    for c in range(chunks):
+        offset, length = struct.unpack_from("<II", image, HEADER_SIZE + c * 8)
+        size = min(sectors - c * chunk_sectors, chunk_sectors) * 256
+        if offset < start or length == 0 or length > size \
+                or offset + length > len(image):
+            sys.exit(f"error: {name} is damaged (chunk {c} is not "
+                     "within the image)")
+        blob = image[offset:offset + length]
+        if length == size:
+            disc.append(blob)
+            continue
+        try:
+            disc.append(decompress(blob, size))
+        except ValueError as e:
+            sys.exit(f"error: {name} is damaged (chunk {c}: {e})")
+    return b"".join(disc), sectors
+
+
+def to_flat(args):
+    disc, sectors = unpack(args.input)
+    with open(args.output, "wb") as out:
+        out.write(disc)
+    print(f"wrote {args.output}: {sectors} sectors")
+
+
+def verify(args):
+    disc, sectors = unpack(args.input)
+    if args.output:
+        with open(args.output, "rb") as f:
+            flat = f.read()
+        flat += bytes(max(0, sectors * 256 - len(flat)))
+        if flat != disc:
+            sys.exit(f"error: {args.input} does not hold {args.output}")
+    print(f"{args.input}: {sectors} sectors, all chunks unpack"
+          + (f" to {args.output}" if args.output else ""))
+
+
+def main():
+    p = argparse.ArgumentParser(
+        description="Pack, unpack and check BeebSCSI packed LUN images")
+    p.add_argument("input")
+    p.add_argument("output", nargs="?")
+    mode = p.add_mutually_exclusive_group()
+    mode.add_argument("--flat", action="store_true",
+                      help="make a flat image from a packed one")
+    mode.add_argument("--verify", action="store_true",
+                      help="check a packed image, against a flat one if "
+                      "given")
+    p.add_argument("--chunk", type=int, choices=CHUNK_SIZES, default=64,
+                   help="K of the disc to a chunk (default 64)")
+    p.add_argument("--sectors", type=int, default=0,
+                   help="sectors on the disc (default: the flat image's size)")
+    args = p.parse_args()
+    if args.verify:
+        verify(args)
+    elif args.output is None:
+        p.error("an output file is needed")
+    elif args.flat:
+        to_flat(args)
+    else:
+        pack(args)
+
+
+if __name__ == "__main__":
+    main()
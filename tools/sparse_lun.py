@@ -0,0 +1,143 @@
+#!/usr/bin/env python3
+"""
+sparse_lun.py - convert BeebSCSI LUN images between flat and sparse
+
+A flat scsiN.dat is the disc byte for byte. A sparse one (see
+src/BeebSCSI/sparselun.h) is a 512 byte header, a map with a 32 bit entry
+per 16K block of the disc, and only the blocks that hold something other
+than the data pattern, so an empty or nearly empty disc takes next to no
+room on the SD card.
+
+  ./sparse_lun.py scsi0.dat scsi0-sparse.dat        # flat -> sparse
+  ./sparse_lun.py --flat scsi0-sparse.dat scsi0.dat # sparse -> flat
+
+An overlay (scsiN.cow, the Beeb's writes to an unchanged scsiN.dat) is the
+same format; --flat with --base gives the disc as the Beeb sees it:
+
+  ./sparse_lun.py --flat --base scsi0.dat scsi0.cow scsi0-now.dat
+
+A flat image shorter than its disc (one that was never formatted in full)
+can be given the disc's size with --sectors; the rest reads as the
+pattern. --pattern sets what a block never written reads as (default 0,
+what FORMAT fills with).
+
+Requires: python3.
+"""
+
+import argparse
+import struct
+import sys
+
+MAGIC = b"BSCSISPR"
+VERSION = 1
+HEADER_SIZE = 512
+OVERLAY = 0x01
+BLOCK_SECTORS = 64
+BLOCK_SIZE = BLOCK_SECTORS * 256
+
+
+def data_start(blocks):
+    end = HEADER_SIZE + blocks * 4
+    return (end + BLOCK_SIZE - 1) // BLOCK_SIZE * BLOCK_SIZE
+
+
+def to_sparse(args):
+    with open(args.input, "rb") as f:
+        flat = f.read()
+    sectors = args.sectors or (len(flat) + 255) // 256
+    if sectors == 0:
+        sys.exit("error: the disc has no sectors")
+    if sectors * 256 < len(flat):
+        sys.exit(f"error: {args.input} is longer than {sectors} sectors")
+    if flat[:8] == MAGIC:
+        sys.exit(f"error: {args.input} is already sparse")
+
+    blocks = (sectors + BLOCK_SECTORS - 1) // BLOCK_SECTORS
+    pattern = bytes([args.pattern])
+    disc = flat + pattern * (blocks * BLOCK_SIZE - len(flat))
+    empty = pattern * BLOCK_SIZE
+    entries, data = [], []
+    for b in range(blocks):
+        block = disc[b * BLOCK_SIZE:(b + 1) * BLOCK_SIZE]
+        if block == empty:
+            entries.append(0)
+        else:
+            data.append(block)
+            entries.append(len(data))
+
+    header = struct.pack("<8sIIIB", MAGIC, VERSION, BLOCK_SECTORS, sectors,
+                         args.pattern)
+    head = header.ljust(HEADER_SIZE, b"\0") + struct.pack(f"<{blocks}I", *entries)
+    with open(args.output, "wb") as out:
+        out.write(head.ljust(data_start(blocks), b"\0"))
+        for block in data:
+            out.write(block)
+    print(f"wrote {args.output}: {sectors} sectors, "
+          f"{len(data)} of {blocks} blocks held")
+
+
+def to_flat(args):
+    with open(args.input, "rb") as f:
+        image = f.read()
+    if len(image) < HEADER_SIZE or image[:8] != MAGIC:
+        sys.exit(f"error: {args.input} is not a sparse LUN image")
+    version, block_sectors, sectors = struct.unpack_from("<III", image, 8)
+    pattern, flags = image[20], image[21]
+    if version != VERSION or block_sectors != BLOCK_SECTORS:
+        sys.exit(f"error: {args.input}: unknown version {version} "
+                 f"or block size {block_sectors}")
+    base = None
+    if flags & OVERLAY:
+        if not args.base:
+            sys.exit(f"error: {args.input} is an overlay - give its "
+                     "image with --base")
+        with open(args.base, "rb") as f:
+            base = f.read()
+        base += bytes(sectors * 256 - min(len(base), sectors * 256))
+
+    blocks = (sectors + BLOCK_SECTORS - 1) // BLOCK_SECTORS
+    entries = struct.unpack_from(f"<{blocks}I", image, HEADER_SIZE)
+    start = data_start(blocks)
+    empty = bytes([pattern]) * BLOCK_SIZE
+    with open(args.output, "wb") as out:
+        for b, entry in enumerate(entries):
+            if entry == 0 and base is not None:
+                block = base[b * BLOCK_SIZE:(b + 1) * BLOCK_SIZE]
+            elif entry == 0:
+                block = empty
+            else:
+                offset = start + (entry - 1) * BLOCK_SIZE
+                block = image[offset:offset + BLOCK_SIZE]
+                if len(block) != BLOCK_SIZE:
+                    sys.exit(f"error: {args.input} is damaged "
+                             f"(block {b} is past its end)")
+            if (b + 1) * BLOCK_SECTORS > sectors:
+                block = block[:(sectors - b * BLOCK_SECTORS) * 256]
+            out.write(block)
+    print(f"wrote {args.output}: {sectors} sectors")
+
+
+def main():
+    p = argparse.ArgumentParser(
+        description="Convert BeebSCSI LUN images between flat and sparse")
+    p.add_argument("input")
+    p.add_argument("output")
+    p.add_argument("--flat", action="store_true",
+                   help="make a flat image from a sparse one")
+    p.add_argument("--base",
+                   help="with --flat, the image an overlay is over")
+    p.add_argument("--sectors", type=int, default=0,
+                   help="sectors on the disc (default: the flat image's size)")
+    p.add_argument("--pattern", type=lambda v: int(v, 0), default=0,
+                   help="byte a block never written reads as (default 0)")
+    args = p.parse_args()
+    if not 0 <= args.pattern <= 255:
+        sys.exit("error: --pattern must be a byte")
+    if args.flat:
+        to_flat(args)
+    else:
+        to_sparse(args)
+
+
+if __name__ == "__main__":
+    main()
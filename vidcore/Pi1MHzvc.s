@@ -8,11 +8,18 @@
 # gpfsel_data_idle setup
 
 #  r0 - pointer to shared memory ( VC address) of 1MHz registers
+#       one word per address pair, low half even address:
+#         bits 0-7   the byte a read returns
+#         bit  13    nOE: drive the external buffer on a read
+#         bit  14    store locally: a write is kept here, not sent to the ARM
+#         bit  12    streaming data register: see streamnext
 #  r1 - pointer to data to xfer to ARM
 #  r2 - nOE pin
 #  r3 - data outputs
 #  r4 - debug output control
-#  r5 - debug pin mask (0 = no debug  xx= debug pin e.g 1<<21)
+#  r5 - pointer to the stream control block (VC address, vpu_stream.c).
+#       This used to be the debug pin mask, which was always passed as 0;
+#       the debug pin stores are commented out in both loops now.
 
 # Internal register allocation
 #  r0 - pointer to shared memory ( VC address) of tube registers
@@ -20,17 +27,19 @@
 #  r2 - External nOE pin
 #  r3 - Databus and test pin output select
 #  r4 - debug output control
-#  r5 - debug pin mask (0 = no debug  xx= debug pin e.g 1<<21)
+#  r5 - pointer to the stream control block
 #  r6 - GPFSEL0 constant
 #  r7 -
 #  r8 - temp
-#  r9 -
-# r10 -
-# r11 -
+#  r9 - GPCLR0 offset (nOE loop)
+# r10 - word for the address pair (write cycle), the access (streaming)
+# r11 - temp (store locally, streaming)
 # r12 - GPIO pins value
 # r13 - pointer to doorbell register
-# r14 -
-# r15 -
+# r14 - temp (store locally, streaming)
+# r15 - temp (streaming)
+# r16 - temp (streaming)
+# lr  - streamnext return
 
 # GPIO registers
 .equ GPFSEL0,       0x7e200000
@@ -50,6 +59,18 @@
 .equ DATASHIFT,    2
 .equ ADDRBUS_SHIFT, (16)
 .equ OUTPUTBIT,   (15)
+.equ LOCALBIT,    (14)           # of the low half; the ARM sets both or neither
+.equ STREAMBIT,   (12)           # of either half, just that one
+
+# The stream control block (vpu_stream_block_t in vpu_stream.c)
+.equ STREAM_COUNT,   0           # accesses the VPU may still serve; 0 = ring the ARM
+.equ STREAM_PTR,     4           # VC address of the byte the register shows
+.equ STREAM_STEP,    8           # added to STREAM_PTR after each access
+.equ STREAM_BASE,    12          # VC address of offset 0, for the read-back
+.equ STREAM_AWORD,   16          # word of the address read-back pair, -1 for none
+.equ STREAM_WRITTEN, 20          # set once the VPU has stored a byte
+
+.equ VPU_HALFPAIR, 0xAF00AF00    # VPU_HALF in both halves (Pi1MHz.c)
 
 .equ ADDRESSBUS_WIDTH, (8 + 1)
 .equ DATABUS_WIDTH, 8
@@ -127,10 +148,12 @@ waitforclkhighloop:
    lsleq  r8, DATASHIFT          # low 16 bits with databus shift
 
   # btst   r8, OUTPUTBIT
+   btst   r8, STREAMBIT + DATASHIFT          # flags last until the bne below
    extu   r8, DATABUS_WIDTH + DATASHIFT      # bmask isolate the databus NB lower bit are already zero form above
 
    st     r8, GPSET0_offset(r6)  # set up databus
    st     r3, GPFSEL0_offset(r6) # set databus to output
+   bne    streamread
    st     r12, (r1)              # post data
    st     r12, (r13)             # ring doorbell
 
@@ -146,16 +169,116 @@ waitforclklow2loop:
 
 .balignw 16,1 # Align with nops
 writecycle:
+   mov    r10, r8          # keep the pair's word: r8 takes the data below
 waitforclkloww2:
    mov    r8,r12
    ld     r12, GPLEV0_offset(r6)
    btst   r12, CLK
    bne    waitforclkloww2
 
+   btst   r8, ADDRBUS_SHIFT      # the half being written
+   lsrne  r10, 16
+   btst   r10, LOCALBIT
+   bne    storelocal
+   btst   r10, STREAMBIT
+   bne    streamwrite
    st     r8, (r1)         # post data
    st     r8, (r13)        # ring doorbell
    b      Poll_loop
 
+# A plain echo register: put the byte where a read will find it and leave
+# the ARM alone.  Just the data byte, which for address a is byte 2a of the
+# window: the ARM may be writing the other half of the pair, and a read,
+# change and write back of the word here would undo it.  The flags byte is
+# the ARM's.
+storelocal:
+   lsr    r14, r8, ADDRBUS_SHIFT
+   lsr    r11, r8, DATASHIFT
+   extu   r14, ADDRESSBUS_WIDTH  # the address, A0 included
+   extu   r11, DATABUS_WIDTH
+   lsl    r14, 1
+   add    r14, r0
+   stb    r11, (r14)
+   b      Poll_loop
+
+# A streaming data register.  The Beeb has had its byte; let go of the bus
+# before going anywhere near SDRAM, then either move the register on
+# ourselves or, with the window used up, hand this access to the ARM as
+# usual - it moves the window on.
+streamread:
+   mov    r10, r12               # the access
+streamread_wait:
+   ld     r12, GPLEV0_offset(r6)
+   btst   r12, CLK
+   bne    streamread_wait
+
+   st     r4, GPFSEL0_offset(r6) # data bus to inputs except debug
+   st     r8, GPCLR0_offset(r6)  # clear databus low
+
+   ld     r11, STREAM_COUNT(r5)
+   cmp    r11, 0
+   beq    streamread_arm
+   bl     streamnext
+   b      storelocal
+streamread_arm:
+   st     r10, (r1)              # post data
+   st     r10, (r13)             # ring doorbell
+   b      Poll_loop
+
+streamwrite:
+   ld     r11, STREAM_COUNT(r5)
+   cmp    r11, 0
+   beq    streamwrite_arm
+   ld     r14, STREAM_PTR(r5)
+   lsr    r15, r8, DATASHIFT
+   stb    r15, (r14)             # the Beeb's byte, straight into JIM RAM
+   st     r11, STREAM_WRITTEN(r5)
+   mov    r10, r8
+   bl     streamnext
+   b      storelocal
+streamwrite_arm:
+   st     r8, (r1)               # post data
+   st     r8, (r13)              # ring doorbell
+   b      Poll_loop
+
+# One access of a streaming window done: the ARM armed the block for the
+# data register whose half has STREAMBIT set, and will not look at it again
+# until the count runs out or the Beeb touches another of its registers.
+# Count the access, step the pointer, keep the address read-back registers
+# in step, and return r8 = the access (r10) carrying the byte the register
+# shows next, for storelocal to put in place.  r11 = the count, non-zero.
+# Shared by both loops: nothing here touches the bus.
+streamnext:
+   sub    r11, 1
+   st     r11, STREAM_COUNT(r5)
+   ld     r14, STREAM_PTR(r5)
+   ld     r15, STREAM_STEP(r5)
+   add    r14, r15
+   st     r14, STREAM_PTR(r5)
+
+   ld     r15, STREAM_AWORD(r5)
+   cmp    r15, 0
+   blt    streamnext_byte
+   ld     r11, STREAM_BASE(r5)
+   sub    r11, r14, r11          # the offset: low and middle bytes
+   lsr    r16, r11, 8
+   extu   r11, 8
+   extu   r16, 8
+   lsl    r16, 16
+   or     r11, r16
+   mov    r16, VPU_HALFPAIR
+   or     r11, r16
+   st     r11, (r0,r15)
+
+streamnext_byte:
+   ldb    r11, (r14)
+   mov    r15, 0xFF << DATASHIFT
+   mov    r8, r10
+   bic    r8, r15
+   lsl    r11, DATASHIFT
+   or     r8, r11
+   rts
+
 
 #
 # Same as above but with nOE pin ( only for system without the screen enabled
@@ -165,7 +288,7 @@ use_nOE:
 .balignw 16,1 # Align with nops
 
 nOE_Poll_loop:
-   st     r5, GPCLR0_offset(r6)  # Turn off debug signal
+   # st     r5, GPCLR0_offset(r6)  # Turn off debug signal
 
 nOE_Poll_access_low:
    ld     r12, GPLEV0_offset(r6)  # loop until we see FRED or JIM low
@@ -174,7 +297,7 @@ nOE_Poll_access_low:
    btstne r12, nPCFD
    bne    nOE_Poll_access_low
 
-   st     r5, GPSET0_offset(r6)  # Debug pin
+   # st     r5, GPSET0_offset(r6)  # Debug pin
 
    btst   r12, CLK
    beq    nOE_waitforclkhigh
@@ -217,7 +340,7 @@ nOE_waitforclkhighloop:
    lsrne  r8, 16 - DATASHIFT     # High 16 bits to low 16 bits with databus shift
    lsleq  r8, DATASHIFT          # low 16 bits with databus shift
 
-
+   mov    r10, r8                # for the stream check
    btst   r8, OUTPUTBIT
    extu   r8, DATABUS_WIDTH + DATASHIFT      # bmask isolate the databus NB lower bit are already zero form above
 
@@ -226,6 +349,8 @@ nOE_waitforclkhighloop:
    beq   bytenotwrittento
    st    r2,(r6,r9)             # set external output enable low ( only if it has been written to)
 bytenotwrittento:
+   btst  r10, STREAMBIT + DATASHIFT
+   bne   nOE_streamread
    st    r12, (r1)              # post data
    st    r12, (r13)             # ring doorbell
 
@@ -243,13 +368,69 @@ nOE_waitforclklow2loop:
 
 nOE_writecycle:
    st     r2, GPCLR0_offset(r6)  # set external output enable low
+   mov    r10, r8
 nOE_waitforclkloww2:
    mov    r8,r12
    ld     r12, GPLEV0_offset(r6)
    btst   r12, CLK
    bne    nOE_waitforclkloww2
 
+   btst   r8, ADDRBUS_SHIFT      # the half being written
+   lsrne  r10, 16
+   btst   r10, LOCALBIT
+   bne    nOE_storelocal
+   btst   r10, STREAMBIT
+   bne    nOE_streamwrite
    st     r8, (r1)         # post data
    st     r8, (r13)        # ring doorbell
    st     r2, GPSET0_offset(r6)  # set external output enable high
-   b      nOE_Poll_loop
\ No newline at end of file
+   b      nOE_Poll_loop
+
+nOE_storelocal:
+   st     r2, GPSET0_offset(r6)  # set external output enable high
+   lsr    r14, r8, ADDRBUS_SHIFT
+   lsr    r11, r8, DATASHIFT
+   extu   r14, ADDRESSBUS_WIDTH
+   extu   r11, DATABUS_WIDTH
+   lsl    r14, 1
+   add    r14, r0
+   stb    r11, (r14)
+   b      nOE_Poll_loop
+
+nOE_streamread:
+   mov    r10, r12               # the access
+nOE_streamread_wait:
+   ld     r12, GPLEV0_offset(r6)
+   btst   r12, CLK
+   bne    nOE_streamread_wait
+
+   st     r2, GPSET0_offset(r6)  # set external output enable high
+   st     r4, GPFSEL0_offset(r6) # data bus to inputs except debug
+   st     r8, GPCLR0_offset(r6)  # clear databus low
+
+   ld     r11, STREAM_COUNT(r5)
+   cmp    r11, 0
+   beq    nOE_streamread_arm
+   bl     streamnext
+   b      nOE_storelocal
+nOE_streamread_arm:
+   st     r10, (r1)              # post data
+   st     r10, (r13)             # ring doorbell
+   b      nOE_Poll_loop
+
+nOE_streamwrite:
+   st     r2, GPSET0_offset(r6)  # set external output enable high
+   ld     r11, STREAM_COUNT(r5)
+   cmp    r11, 0
+   beq    nOE_streamwrite_arm
+   ld     r14, STREAM_PTR(r5)
+   lsr    r15, r8, DATASHIFT
+   stb    r15, (r14)
+   st     r11, STREAM_WRITTEN(r5)
+   mov    r10, r8
+   bl     streamnext
+   b      nOE_storelocal
+nOE_streamwrite_arm:
+   st     r8, (r1)               # post data
+   st     r8, (r13)              # ring doorbell
+   b      nOE_Poll_loop